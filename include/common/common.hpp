@@ -1,6 +1,7 @@
 #pragma once
 
 #include <concepts>
+#include <cstddef>
 #include <cstdint>
 
 namespace pvm {
@@ -33,4 +34,26 @@ constexpr T getBits(T word) {
   return static_cast<T>(getBitsNoShift<kHigh, kLow>(word) >> kLow);
 }
 
+// Replicates bit `bits - 1` of `word` into the bits above it
+template <std::size_t bits, std::unsigned_integral T>
+constexpr T signExtend(T word) {
+  static_assert(bits > 0 && bits <= sizeofBits<T>(), "Incorrect field width");
+  if constexpr (bits == sizeofBits<T>()) {
+    return word;
+  } else {
+    constexpr auto kSign = T(1) << (bits - 1);
+    word &= static_cast<T>((T(1) << bits) - 1);
+    return static_cast<T>((word ^ kSign) - kSign);
+  }
+}
+
+// Inverse of getBits: `value` placed at [from, to], the rest zero
+template <std::size_t from, std::size_t to, std::unsigned_integral T>
+constexpr T setBits(T value) {
+  constexpr auto kSize = sizeof(T) * 8;
+  constexpr auto kHigh = kSize - from - 1;
+  constexpr auto kLow = kSize - to - 1;
+  return getBitsNoShift<kHigh, kLow>(static_cast<T>(value << kLow));
+}
+
 } // namespace pvm
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+
+namespace pvm {
+
+class Value;
+
+// Hash map from Int, Float or String keys, with reference semantics like
+// Object. Open addressing in the SwissTable layout: slots come in groups of
+// kGroup, each slot with a control byte that is free or holds 7 bits of the
+// hash of its key, and a probe matches the control bytes of a whole group at
+// once, with SSE2 unless built with PVM_NO_SIMD. Float keys compare by their
+// bits, with -0.0 taken as 0.0.
+class Dict {
+public:
+  static constexpr std::size_t kGroup = 16;
+
+  // room for `capacity` entries before the first rehash
+  explicit Dict(std::size_t capacity = 0,
+                std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+  [[nodiscard]] static bool isKey(const Value &key) noexcept;
+
+  [[nodiscard]] std::size_t size() const noexcept;
+  // nullptr when absent, valid until the next set()
+  [[nodiscard]] const Value *find(const Value &key) const;
+  // `key` has to pass isKey()
+  void set(const Value &key, Value val) const;
+  bool remove(const Value &key) const;
+  void reserve(std::size_t capacity) const;
+
+  // Entries in slot order: key() is nullptr for slots in [0, slots()) that
+  // hold none
+  [[nodiscard]] std::size_t slots() const noexcept;
+  [[nodiscard]] const Value *key(std::size_t slot) const noexcept;
+  [[nodiscard]] const Value &value(std::size_t slot) const noexcept;
+
+  [[nodiscard]] const void *identity() const noexcept;
+
+private:
+  struct Entry;
+  struct Data;
+  std::shared_ptr<Data> m_data;
+};
+
+} // namespace pvm
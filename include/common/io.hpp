@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+
+namespace pvm {
+
+// Writes all `size` bytes to `fd`, retrying short and interrupted writes;
+// false on any other failure, errno tells which
+bool writeAll(int fd, const void *data, std::size_t size);
+
+} // namespace pvm
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace pvm {
+
+// Separates the producer and consumer sides so they do not false-share
+inline constexpr std::size_t kCacheLine = 64;
+
+// Bounded lock-free ring for one producer and one consumer thread. Each side
+// caches the other side's index and only rereads it when the ring looks
+// full or empty. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscQueue final {
+public:
+  explicit SpscQueue(std::size_t capacity)
+      : m_slots(std::bit_ceil(checked(capacity))), m_mask(m_slots.size() - 1) {
+  }
+
+  // Moves from `val` only when there was room
+  [[nodiscard]] bool tryPush(T &val) {
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_cachedHead == m_slots.size()) {
+      m_cachedHead = m_head.load(std::memory_order_acquire);
+      if (tail - m_cachedHead == m_slots.size()) {
+        return false;
+      }
+    }
+
+    m_slots[tail & m_mask] = std::move(val);
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  [[nodiscard]] bool tryPop(T &out) {
+    auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_cachedTail) {
+      m_cachedTail = m_tail.load(std::memory_order_acquire);
+      if (head == m_cachedTail) {
+        return false;
+      }
+    }
+
+    auto &slot = m_slots[head & m_mask];
+    out = std::move(slot);
+    slot = T{};
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Snapshots, only exact when the other side is idle
+  [[nodiscard]] bool empty() const noexcept {
+    return m_head.load(std::memory_order_acquire) ==
+           m_tail.load(std::memory_order_acquire);
+  }
+  [[nodiscard]] bool full() const noexcept {
+    return m_tail.load(std::memory_order_acquire) -
+               m_head.load(std::memory_order_acquire) ==
+           m_slots.size();
+  }
+  [[nodiscard]] std::size_t capacity() const noexcept {
+    return m_slots.size();
+  }
+
+private:
+  static std::size_t checked(std::size_t capacity) {
+    if (capacity == 0) {
+      throw std::invalid_argument{"queue capacity must be positive"};
+    }
+    return capacity;
+  }
+
+  std::vector<T> m_slots;
+  std::size_t m_mask;
+
+  alignas(kCacheLine) std::atomic<std::size_t> m_head{0};
+  std::size_t m_cachedTail{0};
+  alignas(kCacheLine) std::atomic<std::size_t> m_tail{0};
+  std::size_t m_cachedHead{0};
+};
+
+// Bounded lock-free queue for many producers and one consumer. Every cell
+// carries a sequence number telling whose turn it is, producers claim cells
+// with a CAS on the enqueue index.
+template <typename T>
+class MpscQueue final {
+public:
+  explicit MpscQueue(std::size_t capacity)
+      : m_capacity(std::bit_ceil(checked(capacity))), m_mask(m_capacity - 1),
+        m_cells(std::make_unique<Cell[]>(m_capacity)) {
+    for (std::size_t i = 0; i < m_capacity; ++i) {
+      m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Moves from `val` only when there was room
+  [[nodiscard]] bool tryPush(T &val) {
+    auto pos = m_enqueue.load(std::memory_order_relaxed);
+    Cell *cell = nullptr;
+    for (;;) {
+      cell = &m_cells[pos & m_mask];
+      auto seq = cell->seq.load(std::memory_order_acquire);
+      auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = m_enqueue.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->data = std::move(val);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  [[nodiscard]] bool tryPop(T &out) {
+    auto pos = m_dequeue.load(std::memory_order_relaxed);
+    auto &cell = m_cells[pos & m_mask];
+    if (cell.seq.load(std::memory_order_acquire) != pos + 1) {
+      return false;
+    }
+
+    out = std::move(cell.data);
+    cell.data = T{};
+    cell.seq.store(pos + m_capacity, std::memory_order_release);
+    m_dequeue.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Snapshots, only exact when the other side is idle
+  [[nodiscard]] bool empty() const noexcept {
+    auto pos = m_dequeue.load(std::memory_order_relaxed);
+    return m_cells[pos & m_mask].seq.load(std::memory_order_acquire) != pos + 1;
+  }
+  [[nodiscard]] bool full() const noexcept {
+    for (;;) {
+      auto pos = m_enqueue.load(std::memory_order_acquire);
+      auto seq = m_cells[pos & m_mask].seq.load(std::memory_order_acquire);
+      if (seq == pos || static_cast<std::intptr_t>(seq - pos) < 0) {
+        return seq != pos;
+      }
+      // another producer moved on since we read the index
+    }
+  }
+  [[nodiscard]] std::size_t capacity() const noexcept {
+    return m_capacity;
+  }
+
+private:
+  struct Cell final {
+    std::atomic<std::size_t> seq{0};
+    T data{};
+  };
+
+  static std::size_t checked(std::size_t capacity) {
+    if (capacity == 0) {
+      throw std::invalid_argument{"queue capacity must be positive"};
+    }
+    return capacity;
+  }
+
+  std::size_t m_capacity;
+  std::size_t m_mask;
+  std::unique_ptr<Cell[]> m_cells;
+
+  alignas(kCacheLine) std::atomic<std::size_t> m_enqueue{0};
+  alignas(kCacheLine) std::atomic<std::size_t> m_dequeue{0};
+};
+
+} // namespace pvm
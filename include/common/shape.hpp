@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace pvm {
+
+using FieldId = std::uint32_t;
+
+// Hidden class of an Object: which fields it has and in which slot each one
+// lives. Objects that got the same fields in the same order share a shape,
+// so a shape check is enough to reuse a previously looked up slot.
+class Shape final {
+public:
+  static constexpr std::uint32_t kNoSlot = UINT32_MAX;
+
+  [[nodiscard]] std::uint32_t find(FieldId field) const;
+  // fields in slot order
+  [[nodiscard]] const std::vector<FieldId> &fields() const noexcept;
+  [[nodiscard]] std::uint32_t size() const noexcept;
+
+private:
+  friend class ShapeTree;
+
+  std::vector<FieldId> m_fields{};
+  std::unordered_map<FieldId, std::uint32_t> m_slots{};
+  std::unordered_map<FieldId, Shape *> m_transitions{};
+};
+
+// Owns the shapes of one interpreter: the empty root and every shape reached
+// from it by adding fields one at a time
+class ShapeTree final {
+public:
+  ShapeTree();
+  ShapeTree(const ShapeTree &) = delete;
+  ShapeTree &operator=(const ShapeTree &) = delete;
+
+  [[nodiscard]] const Shape *root() const noexcept;
+
+  // `shape` plus `field` in a new last slot, created on first use
+  const Shape *transition(const Shape *shape, FieldId field);
+
+  [[nodiscard]] std::size_t size() const noexcept;
+
+  // Drops every shape but a fresh root, objects using them must be gone
+  void clear();
+
+private:
+  std::deque<Shape> m_shapes{};
+};
+
+} // namespace pvm
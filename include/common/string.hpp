@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <ostream>
+#include <string_view>
+#include <unordered_map>
+
+#include "common/config.hpp"
+
+namespace pvm {
+
+// Immutable byte string. Up to kInline bytes live in the value itself,
+// longer ones in a node shared by copies. Concatenation makes a rope node
+// that is flattened on the first access to its bytes; ropes deeper than
+// kMaxDepth are flattened right away, so the number of nested nodes stays
+// bounded. Like Object, a string is not to be shared between threads.
+class String final {
+public:
+  // The node pointer, 7 bytes and the size fill 24 bytes, which with the
+  // variant index keeps a Value at 32
+  static constexpr std::size_t kInline = 7;
+  static constexpr std::uint32_t kMaxDepth = 32;
+
+  String() noexcept = default;
+  explicit String(std::string_view text,
+                  std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+  [[nodiscard]] static String concat(const String &lhs, const String &rhs,
+                                     std::pmr::memory_resource *resource =
+                                         std::pmr::get_default_resource());
+
+  [[nodiscard]] Int size() const noexcept;
+  // Flattens a rope, later calls are O(1)
+  [[nodiscard]] std::string_view view() const;
+  // bytes [from, to), the caller checks 0 <= from <= to <= size()
+  [[nodiscard]] String
+  slice(Int from, Int to,
+        std::pmr::memory_resource *resource = std::pmr::get_default_resource()) const;
+
+  // FNV-1a of the bytes, cached for strings outside of the value
+  [[nodiscard]] std::uint32_t hash() const;
+  // <0, 0 or >0 in byte order
+  [[nodiscard]] int compare(const String &other) const;
+  // O(1) when both are interned in the same table or share a node
+  [[nodiscard]] bool operator==(const String &other) const;
+
+  [[nodiscard]] bool interned() const noexcept;
+  [[nodiscard]] bool isRope() const noexcept;
+
+  friend std::ostream &operator<<(std::ostream &ost, const String &str);
+
+private:
+  friend class StringTable;
+  struct Node;
+
+  [[nodiscard]] std::uint32_t depth() const noexcept;
+
+  std::shared_ptr<Node> m_node{};
+  std::array<char, kInline> m_inline{};
+  std::uint8_t m_size{};
+};
+
+static_assert(sizeof(String) == 24);
+
+// Interning table of an interpreter, for identifiers and keys: it hands out
+// one node per distinct content, so interned strings compare by identity.
+// Strings short enough to live in the value compare in O(1) anyway and are
+// returned as they are.
+class StringTable final {
+public:
+  StringTable();
+
+  [[nodiscard]] String intern(const String &str);
+  [[nodiscard]] std::size_t size() const noexcept;
+  // Strings interned so far stay valid but no longer count as interned
+  void clear();
+
+private:
+  std::uint64_t m_id;
+  // keys view the bytes of the node they map to
+  std::unordered_map<std::string_view, String> m_strings{};
+};
+
+} // namespace pvm
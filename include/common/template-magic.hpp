@@ -33,7 +33,7 @@ struct NthImpl {
 
 template <size_t N, typename Head, typename... Tail>
 struct NthImpl<N, Head, Tail...> {
-  using T = NthImpl<N - 1, Tail...>;
+  using T = typename NthImpl<N - 1, Tail...>::T;
 };
 template <typename Head, typename... Tail>
 struct NthImpl<0, Head, Tail...> {
@@ -43,6 +43,22 @@ struct NthImpl<0, Head, Tail...> {
 template <size_t N, typename... Types>
 using Nth = typename NthImpl<N, Types...>::T;
 
+template <typename F>
+struct FunctionTraits;
+
+template <typename R, typename... Args>
+struct FunctionTraits<R (*)(Args...)> {
+  using Return = R;
+
+  template <size_t N>
+  using Arg = std::remove_cvref_t<Nth<N, Args...>>;
+
+  static constexpr size_t kArity = sizeof...(Args);
+};
+
+template <typename R, typename... Args>
+struct FunctionTraits<R (*)(Args...) noexcept> : FunctionTraits<R (*)(Args...)> {};
+
 template <typename FirstType, typename... Types>
 std::type_info const &NthTypeInfoImpl(std::size_t n) {
   if constexpr (sizeof...(Types) == 0) {
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
 #include <stdexcept>
 #include <type_traits>
 #include <typeinfo>
@@ -7,7 +11,10 @@
 #include <vector>
 
 #include "common/config.hpp"
+#include "common/dict.hpp"
+#include "common/string.hpp"
 #include "common/template-magic.hpp"
+#include "common/vec4.hpp"
 
 namespace pvm {
 
@@ -16,17 +23,21 @@ class Value;
 class Array;
 class Function;
 class Object;
+class Shape;
 
 class Null {};
 
 class Array {
 public:
   Array() = default;
-  ~Array() = default;
+  ~Array();
 
-  explicit Array(Int size);
+  // Copies share the resource of their source, so arrays created by an
+  // interpreter stay in its arena however often they are copied around
+  explicit Array(Int size,
+                 std::pmr::memory_resource *resource = std::pmr::get_default_resource());
 
-  Array(Array const &other) = default;
+  Array(Array const &other);
   Array(Array &&other) noexcept;
 
   Array &operator=(Array const &other);
@@ -37,15 +48,69 @@ public:
   [[nodiscard]] Value const &at(Int pos) const &;
   [[nodiscard]] Value &at(Int pos) &;
 
+  // Default-constructed and moved-from arrays have no resource to grow into
   void resize(Int newSize);
   void clear();
 
+  [[nodiscard]] std::pmr::memory_resource *resource() const noexcept;
+
+private:
+  // The elements and their allocator sit in a header allocated from the
+  // resource itself, so an Array is a single pointer, nullptr until it is
+  // given a resource
+  struct Rep;
+
+  static Rep *allocate(std::pmr::vector<Value> data);
+  static void release(Rep *rep) noexcept;
+
+  Rep *m_rep{nullptr};
+};
+
+// Record with reference semantics: copies are handles to the same fields.
+// The shape tells which field lives in which slot.
+class Object {
+public:
+  explicit Object(const Shape *shape,
+                  std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+  [[nodiscard]] const Shape *shape() const noexcept;
+
+  // unchecked, `pos` must be below the slot count of shape()
+  [[nodiscard]] Value &slot(std::uint32_t pos) const noexcept;
+
+  // Moves to `next`, which is shape() plus one field, and stores its value
+  void append(const Shape *next, Value val) const;
+
+  [[nodiscard]] const void *identity() const noexcept;
+
+private:
+  struct Data;
+  std::shared_ptr<Data> m_data;
+};
+
+// Code address plus the values it captured, copies share the captures
+class Function {
+public:
+  explicit Function(Addr entry,
+                    std::pmr::memory_resource *resource = std::pmr::get_default_resource());
+
+  [[nodiscard]] Addr entry() const noexcept;
+
+  [[nodiscard]] std::uint32_t captured() const noexcept;
+  [[nodiscard]] Value const &env(std::uint32_t pos) const;
+  void capture(Value val) const;
+
+  [[nodiscard]] const void *identity() const noexcept;
+
 private:
-  std::vector<Value> m_data;
+  struct Data;
+  std::shared_ptr<Data> m_data;
 };
 
 template <typename Type>
-concept ValueType = pvm::variadic::Contains<Type, Null, Bool, Float, Int, Array>;
+concept ValueType =
+    pvm::variadic::Contains<Type, Null, Bool, Float, Int, Array, Object, Function, Vec4i,
+                           Vec4f, String, Dict>;
 
 class ValueMismatchError : public std::runtime_error {
 public:
@@ -62,7 +127,9 @@ private:
 
 class Value {
 public:
-  using Variant = std::variant<Null, Bool, Float, Int, Array>;
+  using Variant =
+      std::variant<Null, Bool, Float, Int, Array, Object, Function, Vec4i, Vec4f, String,
+                   Dict>;
 
   Value() noexcept;
   ~Value() = default;
@@ -82,6 +149,18 @@ public:
   template <ValueType Type>
   [[nodiscard]] Type get() const;
 
+  // get() without the copy, valid while the value holds Type
+  template <ValueType Type>
+  [[nodiscard]] Type const &view() const;
+
+  // view() that returns nullptr instead of throwing
+  template <ValueType Type>
+  [[nodiscard]] Type const *tryView() const noexcept;
+
+  // get() that moves out of the value instead of copying
+  template <ValueType Type>
+  [[nodiscard]] Type take() &&;
+
   template <ValueType Type>
   void set(Type value);
 
@@ -95,6 +174,32 @@ private:
   Variant m_data;
 };
 
+// Registers and the frames pushed on calls are made of these; String, the
+// largest alternative, keeps its inline buffer small enough for it
+static_assert(sizeof(Value) == 32);
+
+struct Object::Data {
+  const Shape *shape;
+  std::pmr::vector<Value> slots;
+};
+
+struct Function::Data {
+  Addr entry;
+  std::pmr::vector<Value> env;
+};
+
+inline Addr Function::entry() const noexcept {
+  return m_data->entry;
+}
+
+inline const Shape *Object::shape() const noexcept {
+  return m_data->shape;
+}
+
+inline Value &Object::slot(std::uint32_t pos) const noexcept {
+  return m_data->slots[pos];
+}
+
 template <ValueType Type>
 Value::Value(Type const &value) noexcept(std::is_nothrow_copy_constructible_v<Type>)
     : m_data(value) {
@@ -115,6 +220,31 @@ template <ValueType Type>
   return *pvalue;
 }
 
+template <ValueType Type>
+[[nodiscard]] Type const &Value::view() const {
+  std::add_pointer_t<std::add_const_t<Type>> pvalue = std::get_if<Type>(&m_data);
+  if (pvalue == nullptr) {
+    throw ValueMismatchError(typeid(Type), typeid(Type));
+  }
+
+  return *pvalue;
+}
+
+template <ValueType Type>
+[[nodiscard]] Type const *Value::tryView() const noexcept {
+  return std::get_if<Type>(&m_data);
+}
+
+template <ValueType Type>
+[[nodiscard]] Type Value::take() && {
+  std::add_pointer_t<Type> pvalue = std::get_if<Type>(&m_data);
+  if (pvalue == nullptr) {
+    throw ValueMismatchError(typeid(Type), typeid(Type));
+  }
+
+  return std::move(*pvalue);
+}
+
 template <ValueType Type>
 void Value::set(Type value) {
   if (!this->holds<Type>()) {
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+
+#if defined(__SSE2__) && !defined(PVM_NO_SIMD)
+#define PVM_VEC4_SSE 1
+#include <immintrin.h>
+#else
+#define PVM_VEC4_SSE 0
+#endif
+
+#include "common/config.hpp"
+
+namespace pvm {
+
+// Four Int or Float lanes. They are stored with the alignment of a lane so
+// that Value keeps its size and alignment; every operation moves them
+// through one SSE register with unaligned loads and stores.
+template <typename T>
+struct Vec4 final {
+  static_assert(std::is_same_v<T, Int> || std::is_same_v<T, Float>);
+  using Lane = T;
+
+  std::array<T, 4> lanes{};
+
+  [[nodiscard]] bool operator==(const Vec4 &) const = default;
+};
+
+using Vec4i = Vec4<Int>;
+using Vec4f = Vec4<Float>;
+
+// Lane-wise arithmetic. Int lanes wrap around on overflow, comparisons give
+// Int lanes of all ones or zero. Building with PVM_NO_SIMD, or for a target
+// without SSE2, gives the scalar loops instead, with the same results:
+// min/max pick the second operand when one is NaN, like minps/maxps, and
+// hsum adds (l0 + l2) + (l1 + l3).
+namespace vec4 {
+
+namespace detail {
+
+inline Int wrap(std::int64_t val) {
+  return static_cast<Int>(static_cast<std::uint32_t>(val));
+}
+
+template <typename T, typename Op>
+Vec4<T> lanewise(const Vec4<T> &lhs, const Vec4<T> &rhs, Op op) {
+  Vec4<T> res{};
+  for (std::size_t i = 0; i < 4; ++i) {
+    res.lanes[i] = op(lhs.lanes[i], rhs.lanes[i]);
+  }
+  return res;
+}
+
+template <typename T, typename Pred>
+Vec4i mask(const Vec4<T> &lhs, const Vec4<T> &rhs, Pred pred) {
+  Vec4i res{};
+  for (std::size_t i = 0; i < 4; ++i) {
+    res.lanes[i] = pred(lhs.lanes[i], rhs.lanes[i]) ? -1 : 0;
+  }
+  return res;
+}
+
+#if PVM_VEC4_SSE
+inline __m128 load(const Vec4f &vec) {
+  return _mm_loadu_ps(vec.lanes.data());
+}
+
+inline __m128i load(const Vec4i &vec) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(vec.lanes.data()));
+}
+
+inline Vec4f store(__m128 reg) {
+  Vec4f vec;
+  _mm_storeu_ps(vec.lanes.data(), reg);
+  return vec;
+}
+
+inline Vec4i store(__m128i reg) {
+  Vec4i vec;
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(vec.lanes.data()), reg);
+  return vec;
+}
+#endif
+
+} // namespace detail
+
+template <typename T>
+Vec4<T> splat(T val) {
+  return Vec4<T>{{val, val, val, val}};
+}
+
+template <typename T>
+Vec4<T> add(const Vec4<T> &lhs, const Vec4<T> &rhs) {
+#if PVM_VEC4_SSE
+  using detail::load;
+  if constexpr (std::is_same_v<T, Float>) {
+    return detail::store(_mm_add_ps(load(lhs), load(rhs)));
+  } else {
+    return detail::store(_mm_add_epi32(load(lhs), load(rhs)));
+  }
+#else
+  return detail::lanewise(lhs, rhs, [](T a, T b) {
+    if constexpr (std::is_same_v<T, Float>) {
+      return a + b;
+    } else {
+      return detail::wrap(std::int64_t{a} + b);
+    }
+  });
+#endif
+}
+
+template <typename T>
+Vec4<T> sub(const Vec4<T> &lhs, const Vec4<T> &rhs) {
+#if PVM_VEC4_SSE
+  using detail::load;
+  if constexpr (std::is_same_v<T, Float>) {
+    return detail::store(_mm_sub_ps(load(lhs), load(rhs)));
+  } else {
+    return detail::store(_mm_sub_epi32(load(lhs), load(rhs)));
+  }
+#else
+  return detail::lanewise(lhs, rhs, [](T a, T b) {
+    if constexpr (std::is_same_v<T, Float>) {
+      return a - b;
+    } else {
+      return detail::wrap(std::int64_t{a} - b);
+    }
+  });
+#endif
+}
+
+template <typename T>
+Vec4<T> mul(const Vec4<T> &lhs, const Vec4<T> &rhs) {
+#if PVM_VEC4_SSE
+  using detail::load;
+  if constexpr (std::is_same_v<T, Float>) {
+    return detail::store(_mm_mul_ps(load(lhs), load(rhs)));
+  }
+#if defined(__SSE4_1__)
+  if constexpr (std::is_same_v<T, Int>) {
+    return detail::store(_mm_mullo_epi32(load(lhs), load(rhs)));
+  }
+#endif
+#endif
+  return detail::lanewise(lhs, rhs, [](T a, T b) {
+    if constexpr (std::is_same_v<T, Float>) {
+      return a * b;
+    } else {
+      return detail::wrap(std::int64_t{a} * b);
+    }
+  });
+}
+
+// Float lanes only, there is no integer division in SSE
+inline Vec4f div(const Vec4f &lhs, const Vec4f &rhs) {
+#if PVM_VEC4_SSE
+  return detail::store(_mm_div_ps(detail::load(lhs), detail::load(rhs)));
+#else
+  return detail::lanewise(lhs, rhs, [](Float a, Float b) { return a / b; });
+#endif
+}
+
+// lhs * rhs + acc, rounded once for Float lanes
+template <typename T>
+Vec4<T> fma(const Vec4<T> &lhs, const Vec4<T> &rhs, const Vec4<T> &acc) {
+  if constexpr (std::is_same_v<T, Int>) {
+    return add(mul(lhs, rhs), acc);
+  } else {
+#if PVM_VEC4_SSE && defined(__FMA__)
+    using detail::load;
+    return detail::store(_mm_fmadd_ps(load(lhs), load(rhs), load(acc)));
+#else
+    Vec4f res{};
+    for (std::size_t i = 0; i < 4; ++i) {
+      res.lanes[i] = std::fma(lhs.lanes[i], rhs.lanes[i], acc.lanes[i]);
+    }
+    return res;
+#endif
+  }
+}
+
+template <typename T>
+T hsum(const Vec4<T> &vec) {
+#if PVM_VEC4_SSE
+  using detail::load;
+  if constexpr (std::is_same_v<T, Float>) {
+    auto reg = load(vec);
+    auto pairs = _mm_add_ps(reg, _mm_movehl_ps(reg, reg));
+    return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, 1)));
+  } else {
+    auto reg = load(vec);
+    auto pairs = _mm_add_epi32(reg, _mm_shuffle_epi32(reg, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtsi128_si32(
+        _mm_add_epi32(pairs, _mm_shuffle_epi32(pairs, _MM_SHUFFLE(2, 3, 0, 1))));
+  }
+#else
+  const auto &l = vec.lanes;
+  if constexpr (std::is_same_v<T, Float>) {
+    return (l[0] + l[2]) + (l[1] + l[3]);
+  } else {
+    return detail::wrap(std::int64_t{l[0]} + l[2] + l[1] + l[3]);
+  }
+#endif
+}
+
+template <typename T>
+Vec4<T> min(const Vec4<T> &lhs, const Vec4<T> &rhs) {
+#if PVM_VEC4_SSE
+  using detail::load;
+  if constexpr (std::is_same_v<T, Float>) {
+    return detail::store(_mm_min_ps(load(lhs), load(rhs)));
+  } else {
+#if defined(__SSE4_1__)
+    return detail::store(_mm_min_epi32(load(lhs), load(rhs)));
+#else
+    auto a = load(lhs);
+    auto b = load(rhs);
+    auto lt = _mm_cmplt_epi32(a, b);
+    return detail::store(_mm_or_si128(_mm_and_si128(lt, a), _mm_andnot_si128(lt, b)));
+#endif
+  }
+#else
+  return detail::lanewise(lhs, rhs, [](T a, T b) { return a < b ? a : b; });
+#endif
+}
+
+template <typename T>
+Vec4<T> max(const Vec4<T> &lhs, const Vec4<T> &rhs) {
+#if PVM_VEC4_SSE
+  using detail::load;
+  if constexpr (std::is_same_v<T, Float>) {
+    return detail::store(_mm_max_ps(load(lhs), load(rhs)));
+  } else {
+#if defined(__SSE4_1__)
+    return detail::store(_mm_max_epi32(load(lhs), load(rhs)));
+#else
+    auto a = load(lhs);
+    auto b = load(rhs);
+    auto gt = _mm_cmpgt_epi32(a, b);
+    return detail::store(_mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b)));
+#endif
+  }
+#else
+  return detail::lanewise(lhs, rhs, [](T a, T b) { return a > b ? a : b; });
+#endif
+}
+
+template <typename T>
+Vec4i less(const Vec4<T> &lhs, const Vec4<T> &rhs) {
+#if PVM_VEC4_SSE
+  using detail::load;
+  if constexpr (std::is_same_v<T, Float>) {
+    return detail::store(_mm_castps_si128(_mm_cmplt_ps(load(lhs), load(rhs))));
+  } else {
+    return detail::store(_mm_cmplt_epi32(load(lhs), load(rhs)));
+  }
+#else
+  return detail::mask(lhs, rhs, [](T a, T b) { return a < b; });
+#endif
+}
+
+template <typename T>
+Vec4i equal(const Vec4<T> &lhs, const Vec4<T> &rhs) {
+#if PVM_VEC4_SSE
+  using detail::load;
+  if constexpr (std::is_same_v<T, Float>) {
+    return detail::store(_mm_castps_si128(_mm_cmpeq_ps(load(lhs), load(rhs))));
+  } else {
+    return detail::store(_mm_cmpeq_epi32(load(lhs), load(rhs)));
+  }
+#else
+  return detail::mask(lhs, rhs, std::equal_to<T>{});
+#endif
+}
+
+} // namespace vec4
+
+} // namespace pvm
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "common/instruction.hpp"
+
+namespace pvm {
+
+struct AotOptions final {
+  // a shared object for `pvm run` instead of a standalone executable
+  bool shared{false};
+};
+
+// C++ translation unit running `instrs` through the interpreter handlers,
+// one function per region reachable from pc 0, a call or a func.new target
+[[nodiscard]] std::string emitAot(const std::vector<Instr> &instrs,
+                                  const AotOptions &options);
+
+// Compiles `source` with the compiler and libraries pvm itself was built with
+void buildAot(const std::string &source, const std::string &output,
+              const AotOptions &options);
+
+// `exec_<type>_<instr>(state, Instr<TYPE>{...});`
+[[nodiscard]] std::string emitHandlerCall(const Instr &instr);
+
+// Whether the handler can never stop the run, so the emitted code need not
+// check the status after it
+[[nodiscard]] bool isInfallible(const Instr &instr);
+
+} // namespace pvm
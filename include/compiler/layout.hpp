@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "common/config.hpp"
+#include "common/instruction.hpp"
+
+namespace pvm {
+
+// Execution counts of one run, indexed by pc
+struct Profile final {
+  std::vector<std::uint64_t> execs{};
+  // times control went from pc anywhere but pc + 1
+  std::vector<std::uint64_t> taken{};
+};
+
+// Profile file: this header followed by execs, then taken, one word per pc
+struct ProfileHeader final {
+  static constexpr std::uint32_t kMagic = 0x504d5650; // "PVMP"
+  static constexpr std::uint32_t kVersion = 1;
+
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t count;
+};
+
+// Runs `instrs` to halt under a tracer, reading `input`
+[[nodiscard]] Profile profileRun(const std::vector<Instr> &instrs, std::istream &input);
+
+void saveProfile(const std::string &path, const Profile &profile);
+[[nodiscard]] Profile loadProfile(const std::string &path);
+
+// Locality of the executed instructions as the interpreter fetches them, one
+// decoded Instr per pc; transfers through ret and icall are not known
+// statically and are left out
+struct LayoutMetrics final {
+  static constexpr std::size_t kLineSize = 64;
+  static constexpr std::size_t kPageSize = 4096;
+
+  // cache lines and pages holding at least one executed instruction
+  std::size_t hotLines{};
+  std::size_t hotPages{};
+  // dynamic count of dispatches moving to another cache line
+  std::uint64_t lineSwitches{};
+  // mean distance in instructions of taken branches and calls
+  double jumpDistance{};
+};
+
+[[nodiscard]] LayoutMetrics measureLayout(const std::vector<Instr> &instrs,
+                                          const Profile &profile);
+
+struct Layout final {
+  std::vector<Instr> instrs{};
+  // the input profile in the new order
+  Profile profile{};
+};
+
+// Moves code around in chains, runs of blocks that fall through into each
+// other and end in halt or ret. Branches are conditional jumps only, so
+// falling through is fixed by the code and chains never split; what moves
+// is where they go: the entry chain first, then the executed chains, each
+// next to the one it exchanges most transfers with, then the cold ones. A
+// chain running off the end of the code stays last. Branch, call and
+// func.new offsets are patched, the result behaves like the input.
+[[nodiscard]] Layout layoutHotCold(const std::vector<Instr> &instrs,
+                                   const Profile &profile);
+
+} // namespace pvm
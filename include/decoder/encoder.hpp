@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+#include "common/instruction.hpp"
+
+namespace pvm {
+
+// Inverse of Decoder, throws std::out_of_range for a field that does not fit
+// its bits
+class Encoder final {
+public:
+  std::uint32_t encode(const Instr &instr);
+};
+
+} // namespace pvm
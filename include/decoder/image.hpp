@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common/instruction.hpp"
+
+namespace pvm {
+
+// Bytecode image: this header followed by one encoded word per instruction,
+// in host byte order
+struct ImageHeader final {
+  static constexpr std::uint32_t kMagic = 0x424d5650; // "PVMB"
+  static constexpr std::uint32_t kVersion = 1;
+
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint64_t count;
+};
+
+[[nodiscard]] std::vector<std::uint32_t> encodeProgram(const std::vector<Instr> &instrs);
+[[nodiscard]] std::vector<Instr> decodeProgram(const std::vector<std::uint32_t> &words);
+
+void saveImage(const std::string &path, const std::vector<Instr> &instrs);
+[[nodiscard]] std::vector<Instr> loadImage(const std::string &path);
+// The encoded words of an image, undecoded
+[[nodiscard]] std::vector<std::uint32_t> loadImageWords(const std::string &path);
+
+} // namespace pvm
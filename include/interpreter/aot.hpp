@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "interpreter/interpreter.hpp"
+#include "memory/memory.hpp"
+
+namespace pvm {
+
+// bumped whenever Interpreter::State or a handler signature changes
+inline constexpr std::uint32_t kAotAbi = 1;
+inline constexpr const char *kAotSymbol = "pvm_aot_program";
+
+// What pvm-aot emits: the encoded program and the code compiled from it
+struct AotProgram final {
+  std::uint32_t abi;
+  const std::uint32_t *words;
+  std::size_t size;
+  void (*entry)(Interpreter::State &);
+};
+
+// The code `program` was compiled from, to construct its Interpreter with
+[[nodiscard]] CodePtr aotCode(const AotProgram &program);
+
+// Shared object built by `pvm-aot build --shared`. It resolves the handlers
+// against the loading executable, which has to export them.
+class AotLibrary final {
+public:
+  explicit AotLibrary(const std::string &path);
+  AotLibrary(const AotLibrary &) = delete;
+  AotLibrary &operator=(const AotLibrary &) = delete;
+  ~AotLibrary();
+
+  [[nodiscard]] const AotProgram &program() const noexcept;
+
+private:
+  void *m_handle{};
+  const AotProgram *m_program{};
+};
+
+} // namespace pvm
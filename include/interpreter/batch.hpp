@@ -0,0 +1,84 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "common/config.hpp"
+#include "interpreter/interpreter.hpp"
+#include "memory/memory.hpp"
+
+namespace pvm {
+
+struct BatchStats final {
+  std::uint64_t groups;
+  // instructions issued, each for every active lane at once
+  std::uint64_t steps;
+  // sum of active lanes over the issued instructions, laneSteps / (steps *
+  // kLanes) is the share of the vector doing useful work
+  std::uint64_t laneSteps;
+};
+
+// What run() throws when an active lane does what traps in the scalar
+// interpreter, with the same Interpreter::describe() message
+class BatchTrapError : public std::runtime_error {
+public:
+  explicit BatchTrapError(const Interpreter::Trap &raised);
+
+  Interpreter::Trap trap;
+};
+
+// Runs one straight-line-and-branches program over many inputs in lock step.
+// Registers are kept as structure of arrays with one lane per input, every
+// instruction is executed for all lanes of a group by a kernel the compiler
+// can vectorize and branch.branch divergence is handled with an active mask:
+// the lanes at the lowest pc run first and rejoin the others once their pcs
+// meet again. Calls, arrays, memory, objects, closures and natives are
+// rejected up front.
+class BatchInterpreter final {
+public:
+  static constexpr std::size_t kLanes = 64;
+  using Mask = std::uint64_t;
+
+  explicit BatchInterpreter(CodePtr code);
+
+  // `inputs[i]` is what unary.read sees in run i, its unary.write output is
+  // returned at the same index
+  [[nodiscard]] std::vector<std::string> run(const std::vector<std::string> &inputs);
+
+  [[nodiscard]] const BatchStats &stats() const noexcept;
+
+private:
+  struct Op final {
+    Opcode type;
+    OpId id;
+    std::uint32_t ttypeid;
+    RegId reg1;
+    RegId reg2;
+    // immediate bits or branch offset
+    std::uint32_t imm;
+  };
+
+  struct Lanes final {
+    alignas(64) std::array<std::uint32_t, kLanes> bits;
+    std::array<std::uint8_t, kLanes> tags;
+  };
+
+  void runGroup(const std::string *inputs, std::string *outputs, std::size_t count);
+  void execute(const Op &op, Addr pc, Mask active);
+  Mask branchTaken(const Op &op, Mask active) const;
+
+  CodePtr m_code;
+  std::vector<Op> m_ops{};
+  std::vector<Lanes> m_regs;
+  std::array<Addr, kLanes> m_lanePc{};
+  std::array<std::istringstream, kLanes> m_in{};
+  std::array<std::ostringstream, kLanes> m_out{};
+  BatchStats m_stats{};
+};
+
+} // namespace pvm
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "common/queue.hpp"
+#include "common/value.hpp"
+
+namespace pvm {
+
+using ChannelId = std::uint16_t;
+
+// Bounded queue of values between interpreters, possibly running on
+// different threads. Scalars and strings are copied, arrays are moved: their
+// storage lives in arrays(), a pool shared by all channels, and changes hands
+// without copying elements. Objects, functions and dicts share state and
+// cannot be sent. Interpreters allocate from the pool through an account of
+// their arena (Arena::account()) and move what they receive into their own.
+class Channel final {
+public:
+  enum Kind : std::uint8_t {
+    // one sending and one receiving interpreter
+    eSPSC,
+    // any number of senders, one receiver
+    eMPSC,
+  };
+
+  enum Op : std::uint8_t {
+    eSEND,
+    eRECV,
+  };
+
+  using Wake = std::function<void()>;
+
+  Channel(Kind kind, std::size_t capacity);
+  Channel(const Channel &) = delete;
+  Channel &operator=(const Channel &) = delete;
+
+  // Moves from `val` on success, false when the channel is full
+  [[nodiscard]] bool trySend(Value &val);
+  // false when the channel is empty
+  [[nodiscard]] bool tryRecv(Value &out);
+
+  // Registers `wake` to be called once after the next receive (for eSEND)
+  // or send (for eRECV). Returns false without registering if `op` could
+  // already go ahead. Wakes may be spurious, the waiter retries.
+  bool parkUntil(Op op, const void *owner, Wake wake);
+  // Drops every wake registered by `owner`
+  void cancel(const void *owner);
+
+  [[nodiscard]] Kind kind() const noexcept;
+  [[nodiscard]] std::size_t capacity() const noexcept;
+
+  // Thread-safe resource that sendable arrays are allocated from
+  static std::pmr::memory_resource *arrays();
+
+  // Deep copy of `val` with every array moved to `resource` and every string
+  // given a fresh node there, throws for objects, functions and dicts at any
+  // depth. Arrays already in `resource` keep their storage.
+  static Value transferable(Value &&val, std::pmr::memory_resource *resource = arrays());
+  // Whether transferable() accepts `val`
+  [[nodiscard]] static bool canTransfer(const Value &val) noexcept;
+
+private:
+  [[nodiscard]] bool ready(Op op) const;
+  void wake(Op op);
+
+  std::variant<SpscQueue<Value>, MpscQueue<Value>> m_queue;
+  Kind m_kind;
+
+  std::mutex m_waitMutex{};
+  std::array<std::atomic<bool>, 2> m_waiting{};
+  std::array<std::vector<std::pair<const void *, Wake>>, 2> m_waiters{};
+};
+
+using ChannelPtr = std::shared_ptr<Channel>;
+
+} // namespace pvm
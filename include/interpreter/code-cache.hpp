@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "memory/memory.hpp"
+
+namespace pvm {
+
+// Cache entry: this header, the encoded words it was built from, then the
+// decoded instructions, aligned for Instr, which are mapped as they are
+struct CodeCacheHeader final {
+  static constexpr std::uint32_t kMagic = 0x434d5650; // "PVMC"
+  static constexpr std::uint32_t kVersion = 3;
+
+  std::uint32_t magic;
+  std::uint32_t version;
+  // hash of the decoder and verifier that wrote the entry
+  std::uint64_t buildId;
+  std::uint64_t count;
+  std::uint32_t instrSize;
+  std::uint32_t flags;
+  // FNV-1a of this header, with the checksum zero, and the decoded
+  // instructions
+  std::uint64_t checksum;
+};
+
+enum CodeCacheFlag : std::uint32_t {
+  eCACHED_VERIFIED = 1U << 0U,
+};
+
+struct CodeCacheStats final {
+  std::uint64_t hits{};
+  std::uint64_t misses{};
+  std::uint64_t evictions{};
+};
+
+// Content-addressed directory of decoded code, keyed by a hash of the
+// bytecode and the VM build. A hit maps the entry instead of decoding and
+// verifying again. Entries are published by rename, so processes can share
+// the directory; the least recently used ones are removed once the entries
+// add up to more than `capacity` bytes.
+class CodeCache final {
+public:
+  static constexpr std::uint64_t kDefaultCapacity = std::uint64_t{256} << 20U;
+
+  explicit CodeCache(std::filesystem::path dir,
+                     std::uint64_t capacity = kDefaultCapacity);
+
+  [[nodiscard]] CodePtr load(const std::string &imagePath);
+  [[nodiscard]] CodePtr load(const std::vector<std::uint32_t> &words);
+
+  [[nodiscard]] const std::filesystem::path &dir() const noexcept;
+  [[nodiscard]] const CodeCacheStats &stats() const noexcept;
+
+  // Evicts least recently used entries until the directory fits capacity
+  void trim();
+
+private:
+  [[nodiscard]] std::filesystem::path
+  entryPath(const std::vector<std::uint32_t> &words) const;
+  [[nodiscard]] CodePtr map(const std::filesystem::path &path,
+                            const std::vector<std::uint32_t> &words) const;
+  void store(const std::filesystem::path &path, const std::vector<std::uint32_t> &words,
+             const Code &code);
+
+  std::filesystem::path m_dir;
+  std::uint64_t m_capacity;
+  CodeCacheStats m_stats{};
+};
+
+} // namespace pvm
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "common/config.hpp"
+#include "generated/bytecode.hpp"
+#include "generated/handlers.hpp"
+#include "interpreter/aot.hpp"
+
+namespace pvm {
+
+// Programs baked into the binary as a constexpr array of encoded words:
+//
+//   constexpr auto kProgram = encodeWords(std::array{...});
+//   Interpreter interp{aotCode(kEmbedded<kProgram>)};
+//   interp.run(kEmbedded<kProgram>);
+//
+// Every word is decoded at compile time and gets its own step: a direct call
+// of its handler with the fields as constants, followed by a direct jump to
+// the statically known successor. Only ret, icall and resumption go through
+// a table indexed by pc. The jumps are sibling calls, so the including
+// translation unit has to be built with -O2 or -foptimize-sibling-calls,
+// like the interpreter itself.
+
+template <const auto &Words>
+void embeddedDispatch(Interpreter::State &state);
+
+template <const auto &Words, Addr Pc>
+void embeddedStep(Interpreter::State &state) {
+  if constexpr (Pc >= std::size(Words)) {
+    throw std::out_of_range{"embedded program ran past its end"};
+  } else {
+    constexpr auto kInstr = decodeWord(Words[Pc]);
+    using Entry = Handlers<kInstr.opType>;
+    constexpr auto kTyped = std::get<typename Entry::Type>(kInstr.instrVar);
+    constexpr auto kHandler = Entry::kTable[kInstr.opID];
+
+    kHandler(state, kTyped);
+
+    if constexpr (kInstr.opType == eHALT) {
+      return;
+    } else if constexpr (kInstr.opType == eBRANCH) {
+      if (state.status != Interpreter::eRUNNING) {
+        return;
+      }
+      if constexpr (kInstr.opID == eBRANCH_BRANCH || kInstr.opID == eBRANCH_CALL) {
+        constexpr Addr kTarget = Pc + std::bit_cast<Addr>(kTyped.offset);
+        if (state.rf.readPC() == kTarget) {
+          return embeddedStep<Words, kTarget>(state);
+        }
+        // a branch not taken, a memoized call or a false call condition
+        return embeddedStep<Words, Pc + 1>(state);
+      } else {
+        return embeddedDispatch<Words>(state);
+      }
+    } else {
+      if constexpr (!Entry::kInfallible) {
+        if (state.status != Interpreter::eRUNNING) [[unlikely]] {
+          return;
+        }
+      }
+      state.rf.incrementPC();
+      return embeddedStep<Words, Pc + 1>(state);
+    }
+  }
+}
+
+template <const auto &Words, std::size_t... Pcs>
+constexpr auto makeEmbeddedSteps(std::index_sequence<Pcs...> /*unused*/) {
+  return std::array<void (*)(Interpreter::State &), sizeof...(Pcs)>{
+      &embeddedStep<Words, Pcs>...};
+}
+
+template <const auto &Words>
+inline constexpr auto kEmbeddedSteps =
+    makeEmbeddedSteps<Words>(std::make_index_sequence<std::size(Words)>{});
+
+template <const auto &Words>
+void embeddedDispatch(Interpreter::State &state) {
+  auto pc = state.rf.readPC();
+  if (pc >= kEmbeddedSteps<Words>.size()) [[unlikely]] {
+    throw std::out_of_range{"embedded program has no instruction at pc " +
+                            std::to_string(pc)};
+  }
+  return kEmbeddedSteps<Words>[pc](state);
+}
+
+// Runs with Interpreter::run(const AotProgram &), same as a program compiled
+// by pvm-aot
+template <const auto &Words>
+inline constexpr AotProgram kEmbedded{
+    kAotAbi, std::data(Words), std::size(Words), &embeddedDispatch<Words>};
+
+} // namespace pvm
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "common/config.hpp"
+
+namespace pvm {
+
+enum HwCounter : std::uint8_t {
+  eHW_CYCLES,
+  eHW_INSTRUCTIONS,
+  eHW_BRANCH_MISSES,
+  eHW_L1D_MISSES,
+  eHW_ITLB_MISSES,
+  // nanoseconds, only opened when there is no cycle counter, as in most VMs
+  eHW_TASK_CLOCK,
+  eHW_COUNTER_NUM
+};
+
+struct HwCounts final {
+  std::uint64_t execs{};
+  std::array<std::uint64_t, eHW_COUNTER_NUM> values{};
+};
+
+// perf_event_open counters of the calling thread, user space only, charged
+// to the instruction that was dispatched when they advanced: its handler
+// and the dispatch to the next one. Counters the host does not have are
+// left out. Attached with Interpreter::setHwProfiler(), which switches runs
+// to the instrumented dispatch chain; the counts include its overhead.
+class HwProfiler final {
+public:
+  static constexpr Addr kDefaultRange = 16;
+  // opIDs are 5 bits wide
+  static constexpr std::size_t kOpsPerType = 32;
+
+  // Throws std::system_error when not even the clock can be opened
+  explicit HwProfiler(Addr rangeSize = kDefaultRange);
+  HwProfiler(const HwProfiler &) = delete;
+  HwProfiler &operator=(const HwProfiler &) = delete;
+  ~HwProfiler();
+
+  // whether perf_event_open is permitted at all here
+  [[nodiscard]] static bool available() noexcept;
+  [[nodiscard]] static const char *name(HwCounter counter) noexcept;
+
+  // Makes room for the pc ranges of code with `codeSize` instructions, so
+  // that step() does not allocate; called by Interpreter::setHwProfiler()
+  void reserve(std::size_t codeSize);
+  // Called by the instrumented dispatch before every instruction
+  void step(Addr pc, std::uint8_t opType, std::uint8_t opID) noexcept;
+  // Charges the last instruction, at the end of a run
+  void flush() noexcept;
+
+  [[nodiscard]] bool has(HwCounter counter) const noexcept;
+  [[nodiscard]] Addr rangeSize() const noexcept;
+  [[nodiscard]] const HwCounts &byOp(std::uint8_t opType, std::uint8_t opID) const;
+  // indexed by pc / rangeSize()
+  [[nodiscard]] const std::vector<HwCounts> &byRange() const noexcept;
+
+  // IPC and per-execution counts by opcode, then by pc range
+  void report(std::ostream &ost) const;
+
+private:
+  struct Counter final {
+    HwCounter kind;
+    int fd;
+    void *page;
+  };
+
+  void read(std::array<std::uint64_t, eHW_COUNTER_NUM> &out) noexcept;
+  void charge(const std::array<std::uint64_t, eHW_COUNTER_NUM> &now) noexcept;
+
+  std::vector<Counter> m_counters{};
+  int m_leader{-1};
+  Addr m_rangeSize;
+
+  std::vector<HwCounts> m_byOp;
+  std::vector<HwCounts> m_byRange{};
+
+  // what the counters read when the current instruction was dispatched
+  std::array<std::uint64_t, eHW_COUNTER_NUM> m_last{};
+  bool m_pending{};
+  Addr m_pc{};
+  std::size_t m_op{};
+};
+
+} // namespace pvm
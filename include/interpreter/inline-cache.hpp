@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "common/shape.hpp"
+
+namespace pvm {
+
+// Per-instruction cache of field lookups, keyed by the shape of the object
+// the instruction saw. For object.set `next` is the shape after the store,
+// it differs from `shape` when the store adds the field.
+struct InlineCache final {
+  static constexpr std::size_t kWays = 4;
+
+  struct Entry final {
+    const Shape *shape;
+    const Shape *next;
+    std::uint32_t slot;
+  };
+
+  std::array<Entry, kWays> entries{};
+  // entries in use, once all are taken new shapes replace them round-robin
+  std::uint8_t used{};
+  std::uint8_t victim{};
+
+  [[nodiscard]] const Entry *find(const Shape *shape) const noexcept {
+    for (std::size_t i = 0; i < used; ++i) {
+      if (entries[i].shape == shape) {
+        return &entries[i];
+      }
+    }
+    return nullptr;
+  }
+
+  void insert(const Entry &entry) noexcept {
+    if (used < kWays) {
+      entries[used++] = entry;
+      return;
+    }
+    entries[victim] = entry;
+    victim = static_cast<std::uint8_t>((victim + 1) % kWays);
+  }
+};
+
+} // namespace pvm
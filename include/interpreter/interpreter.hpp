@@ -1,28 +1,142 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <istream>
 #include <limits>
+#include <memory_resource>
+#include <ostream>
+#include <string>
+#include <vector>
 
+#include "common/shape.hpp"
+#include "common/string.hpp"
 #include "decoder/decoder.hpp"
+#include "interpreter/channel.hpp"
+#include "interpreter/inline-cache.hpp"
+#include "interpreter/memo.hpp"
+#include "interpreter/native.hpp"
+#include "memory/arena.hpp"
 #include "memory/memory.hpp"
 #include "memory/regfile.hpp"
 
 namespace pvm {
 
+struct AotProgram;
+class HwProfiler;
+class Tracer;
+
 class Interpreter final {
 public:
+  enum Status : std::uint8_t {
+    eRUNNING,
+    eHALTED,
+    eOUT_OF_FUEL,
+    eINTERRUPTED,
+    eWAITING_INPUT,
+    // chan.send on a full or chan.recv on an empty channel
+    eBLOCKED,
+    // a runtime error, State::trap tells which; run() keeps returning it until
+    // reset() or restore()
+    eTRAPPED,
+  };
+
+  enum TrapKind : std::uint8_t {
+    eTRAP_NONE,
+    // the register does not hold the type the instruction works on
+    eTRAP_TYPE_MISMATCH,
+    eTRAP_INVALID_TYPE_ID,
+    eTRAP_INDEX_OUT_OF_RANGE,
+    eTRAP_MISSING_FIELD,
+    eTRAP_BAD_CALL_TARGET,
+    eTRAP_EMPTY_CALL_STACK,
+    eTRAP_MEMORY_FAULT,
+    eTRAP_UNREGISTERED_NATIVE,
+    // native.call argument of the wrong type
+    eTRAP_NATIVE_ARGUMENT,
+    eTRAP_UNATTACHED_CHANNEL,
+    // objects, functions and dicts cannot be sent
+    eTRAP_NOT_TRANSFERABLE,
+    eTRAP_MISSING_KEY,
+    // an allocation would have passed the memory limit
+    eTRAP_OUT_OF_MEMORY,
+    // Int division by zero, or of the lowest Int by -1
+    eTRAP_DIVISION,
+  };
+
+  // The instruction at `pc` did not complete
+  struct Trap final {
+    TrapKind kind{eTRAP_NONE};
+    Addr pc{};
+    // the offending register; the field, native or channel id; the call target
+    std::uint32_t operand{};
+  };
+
+  static constexpr std::uint64_t kUnlimitedFuel = std::numeric_limits<std::int64_t>::max();
+
   struct State final {
     Decoder dec;
     RegFile rf;
     Memory mem;
-    Code code;
-    std::ostream &ost;
-    std::istream &ist;
+    CodePtr code;
+    std::reference_wrapper<std::ostream> ost;
+    std::reference_wrapper<std::istream> ist;
+    // arrays and call frames are allocated here
+    std::pmr::memory_resource *arena{std::pmr::get_default_resource()};
+    // arrays and strings, the account of the arena in Channel::arrays() once a
+    // channel is attached
+    std::pmr::memory_resource *arrays{arena};
+    // the arena again, where linear memory is accounted for; null for a State
+    // made outside of an Interpreter
+    Arena *budget{nullptr};
+
+    std::pmr::vector<RegFile> stack{arena};
+    Tracer *tracer{nullptr};
+    HwProfiler *hwprof{nullptr};
+    // outcome of the last branch.branch, a taken offset of 1 lands on the
+    // same pc as a fall-through
+    bool branchTaken{false};
+
+    Status status{eRUNNING};
+    // Fuel is charged per straight-line segment at taken backward branches,
+    // calls and returns; `segment` is the first pc not yet paid for
+    std::int64_t fuel{};
+    Addr segment{};
+    std::atomic<bool> interrupt{false};
+    // unary.read suspends with eWAITING_INPUT instead of blocking on `ist`
+    bool nonBlockingInput{false};
+
+    ShapeTree shapes{};
+    // what str.intern returns
+    StringTable strings{};
+    // indexed by pc, sized to the code on the first access through them
+    std::vector<InlineCache> inlineCaches{};
+
+    // indexed by NativeId, unregistered ids are null
+    std::vector<NativeThunk> natives{};
+
+    Memo memo{};
+
+    // indexed by ChannelId, unattached ids are null
+    std::vector<ChannelPtr> channels{};
+    // what the run that returned eBLOCKED is waiting for
+    Channel *blockedOn{nullptr};
+    Channel::Op blockedOp{};
+    // what stopped the run that returned eTRAPPED
+    Trap trap{};
 
-    std::vector<RegFile> stack;
+    // set when verify() accepted the code and the run started from pc 0 with
+    // fresh registers, run() then dispatches to the unchecked handlers
+    bool verified{false};
   };
 
 private:
+  // declared first so that it outlives everything State allocated from it
+  Arena m_arena;
   State m_state;
+  // compiled program last found to match the code, see run(const AotProgram &)
+  const AotProgram *m_aotMatch{};
 
 public:
   explicit Interpreter(const Code &code);
@@ -30,11 +144,91 @@ public:
   Interpreter(const Code &code, std::istream &ist);
   Interpreter(const Code &code, std::ostream &ost, std::istream &ist);
 
-  void run();
+  explicit Interpreter(CodePtr code);
+  Interpreter(CodePtr code, std::ostream &ost, std::istream &ist);
+  Interpreter(const Interpreter &) = delete;
+  Interpreter &operator=(const Interpreter &) = delete;
+
+  // Runs until halt, until the budget is spent or until interrupt() is
+  // observed. The budget may be overshot by at most one straight-line
+  // segment. Suspended runs resume from the same instruction.
+  Status run(std::uint64_t budget = kUnlimitedFuel);
+  // Same, but executes `program`, compiled by pvm-aot from this code; the
+  // tracer is not called
+  Status run(const AotProgram &program, std::uint64_t budget = kUnlimitedFuel);
   [[nodiscard]] const State &getState() const;
 
+  // "type mismatch in r3 at pc 12" and the like
+  [[nodiscard]] static std::string describe(const Trap &trap);
+
+  // Safe to call from any thread, the run stops at the next checkpoint
+  void interrupt();
+
+  // Makes unary.read suspend the run while `ist` has nothing buffered, the
+  // read is retried by the next run()
+  void setNonBlockingInput(bool enable);
+
+  // Bytes in use and their peak count the arena, linear memory and the
+  // arrays and strings charged to this interpreter in Channel::arrays()
+  [[nodiscard]] ArenaStats allocationStats() const;
+
+  struct OpAllocations final {
+    std::uint8_t opType;
+    std::uint8_t opID;
+    std::size_t allocations;
+    std::size_t bytes;
+  };
+  // allocationStats() split by the opcode that allocated, most bytes first;
+  // allocations made between runs go to the instruction at the pc
+  [[nodiscard]] std::vector<OpAllocations> allocationsByOp() const;
+
+  // Caps the bytes of allocationStats(): an allocation past it traps with
+  // eTRAP_OUT_OF_MEMORY and mem.grow gives -1. Kept by reset().
+  void setMemoryLimit(std::size_t bytes);
+
+  // Makes `Fn`, a pointer to a function such as Float (*)(Int, Float), callable
+  // by native.call `id`. Its arguments are read unboxed from consecutive
+  // registers and its result, which cannot be a Function, goes to the
+  // accumulator.
+  template <auto Fn>
+  void registerNative(NativeId id) {
+    setNative(id, &nativeThunk<Fn>);
+  }
+
+  // Makes chan.send / chan.recv `id` use `channel`. From then on arrays are
+  // allocated from Channel::arrays(), so sending them does not copy; they
+  // are charged to the sender until the receiver takes them.
+  void attachChannel(ChannelId id, ChannelPtr channel);
+
+  // Caches results of branch.call to functions found pure, keeping at most
+  // `capacity` of them; 0 turns memoization off
+  void enableMemoization(std::size_t capacity);
+  // Overrides the purity analysis for the function at `entry`
+  void markPure(Addr entry);
+  [[nodiscard]] const MemoStats &memoStats() const;
+
+  // nullptr switches back to the untraced dispatch
+  void setTracer(Tracer *tracer);
+  // Samples hardware counters around every instruction; nullptr detaches
+  void setHwProfiler(HwProfiler *hwprof);
+
+  // Brings the instance back to its freshly constructed state; only
+  // registers and memory pages that were written are cleared and the arena
+  // is released in one go, so this is much cheaper than constructing a new
+  // Interpreter
+  void reset();
+  void reset(CodePtr code);
+  void reset(CodePtr code, std::ostream &ost, std::istream &ist);
+
+  // Binary image of the program and everything it has computed so far,
+  // restore() replaces the program and state but keeps streams and tracer
+  void snapshot(const std::string &path) const;
+  void restore(const std::string &path);
+
 private:
   Instr getInstr();
+  Status outOfMemory();
+  void setNative(NativeId id, NativeThunk thunk);
 };
 
 } // namespace pvm
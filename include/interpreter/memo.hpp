@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "common/config.hpp"
+#include "common/value.hpp"
+#include "memory/memory.hpp"
+#include "memory/regfile.hpp"
+
+namespace pvm {
+
+struct MemoStats final {
+  std::uint64_t hits;
+  std::uint64_t misses;
+  std::uint64_t evictions;
+  // calls not eligible for caching: impure callee or a non-scalar argument
+  std::uint64_t skipped;
+  std::size_t entries;
+};
+
+// What a call to `entry` can depend on. A function is pure when nothing it
+// can reach does I/O, touches memory, objects or captures, halts or calls
+// indirectly; its result then only depends on the registers it reads before
+// writing them.
+struct PurityInfo final {
+  bool pure;
+  std::vector<RegId> liveIns;
+};
+
+[[nodiscard]] PurityInfo analyzePurity(const Code &code, Addr entry,
+                                     bool trusted = false);
+
+// Results of branch.call to pure functions keyed by the entry pc and the
+// values of the callee's live-in registers, evicted least recently used
+// first. Off until enable(), calls with non-scalar live-ins are not cached.
+class Memo final {
+public:
+  void enable(std::size_t capacity);
+  [[nodiscard]] bool enabled() const noexcept {
+    return m_capacity != 0;
+  }
+  [[nodiscard]] std::size_t capacity() const noexcept;
+
+  // Trusts `entry` to be pure even if the analysis says otherwise, its
+  // live-ins are still found by the analysis
+  void markPure(Addr entry);
+
+  // Cached result of calling `entry` with `rf`, or nullptr. On a miss for a
+  // pure callee the call is remembered, its ret at frame `depth` (stack
+  // size once the frame is pushed) stores the result.
+  const Value *lookup(const Code &code, Addr entry, const RegFile &rf, std::size_t depth);
+  void onReturn(std::size_t depth, const Value &result);
+
+  [[nodiscard]] const MemoStats &stats() const noexcept;
+
+  // Drops results and analyses, e.g. when the code changes
+  void clear();
+  // clear() and back to disabled
+  void reset();
+
+private:
+  using Key = std::vector<std::uint64_t>;
+
+  struct KeyHash final {
+    std::size_t operator()(const Key &key) const noexcept;
+  };
+
+  struct Entry final {
+    Key key;
+    Value result;
+  };
+
+  struct Pending final {
+    std::size_t depth;
+    Key key;
+  };
+
+  const PurityInfo &purity(const Code &code, Addr entry);
+  void insert(Key &&key, const Value &result);
+
+  std::size_t m_capacity{};
+  std::list<Entry> m_lru{};
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_index{};
+  std::unordered_map<Addr, PurityInfo> m_purity{};
+  std::unordered_set<Addr> m_trusted{};
+  std::vector<Pending> m_pending{};
+  MemoStats m_stats{};
+};
+
+} // namespace pvm
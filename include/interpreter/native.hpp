@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "common/config.hpp"
+#include "common/template-magic.hpp"
+#include "common/value.hpp"
+#include "memory/regfile.hpp"
+
+namespace pvm {
+
+using NativeId = std::uint16_t;
+
+// Reads the arguments of a native call from consecutive registers starting
+// at `first` and writes the result, if any, to the accumulator. Returns false,
+// without calling, when an argument has the wrong type.
+using NativeThunk = bool (*)(RegFile &rf, RegId first);
+
+template <typename T>
+concept NativeType = ValueType<T> && !std::is_same_v<T, Null>;
+
+// A host-built Function could point anywhere in the code, while verified
+// code only ever calls the entries of func.new
+template <typename T>
+concept NativeResult = NativeType<T> && !std::is_same_v<T, Function>;
+
+// Marshalling for `Fn` generated at compile time: the call to Fn is direct,
+// so native.call pays a single indirect call to reach it
+template <auto Fn>
+bool nativeThunk(RegFile &rf, RegId first) {
+  using Traits = variadic::FunctionTraits<decltype(Fn)>;
+
+  return [&]<std::size_t... I>(std::index_sequence<I...>) {
+    static_assert((NativeType<typename Traits::template Arg<I>> && ...),
+                  "native arguments must be value types");
+
+    std::tuple args{rf.peekReg(static_cast<RegId>(first + I))
+                        .template tryView<typename Traits::template Arg<I>>()...};
+    if (((std::get<I>(args) == nullptr) || ...)) {
+      return false;
+    }
+
+    if constexpr (std::is_void_v<typename Traits::Return>) {
+      Fn(*std::get<I>(args)...);
+    } else {
+      static_assert(NativeResult<typename Traits::Return>,
+                    "native result must be a value type other than Function");
+      rf.writeAcc(Value{Fn(*std::get<I>(args)...)});
+    }
+    return true;
+  }(std::make_index_sequence<Traits::kArity>{});
+}
+
+} // namespace pvm
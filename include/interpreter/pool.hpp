@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "interpreter/interpreter.hpp"
+#include "memory/memory.hpp"
+
+namespace pvm {
+
+// Hands out warm interpreters: a released instance is reset() and reused by
+// the next acquire() instead of being torn down and constructed again.
+// The pool must outlive every handle it gave out.
+class InterpreterPool final {
+public:
+  class Releaser final {
+  public:
+    explicit Releaser(InterpreterPool *pool = nullptr) noexcept : m_pool(pool) {
+    }
+    void operator()(Interpreter *interp) const;
+
+  private:
+    InterpreterPool *m_pool;
+  };
+
+  using Handle = std::unique_ptr<Interpreter, Releaser>;
+
+  explicit InterpreterPool(std::size_t maxIdle, std::size_t prewarm = 0);
+
+  [[nodiscard]] Handle acquire(CodePtr code);
+  [[nodiscard]] Handle acquire(CodePtr code, std::ostream &ost, std::istream &ist);
+
+  [[nodiscard]] std::size_t idle() const;
+
+private:
+  void release(Interpreter *interp);
+
+  std::size_t m_maxIdle;
+  mutable std::mutex m_mutex{};
+  std::vector<std::unique_ptr<Interpreter>> m_idle{};
+};
+
+} // namespace pvm
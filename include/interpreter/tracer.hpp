@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "common/config.hpp"
+#include "common/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+
+namespace pvm {
+
+enum TraceKind : std::uint8_t {
+  eTRACE_EXEC,
+  eTRACE_BRANCH_TAKEN,
+  eTRACE_BRANCH_NOT_TAKEN,
+  eTRACE_CALL,
+  eTRACE_RET,
+  eTRACE_READ,
+  eTRACE_WRITE,
+  eTRACE_KIND_NUM
+};
+
+struct TraceEvent final {
+  Addr pc;
+  std::uint8_t opType;
+  std::uint8_t opID;
+  std::uint8_t kind;
+  std::uint8_t ttypeid;
+  // branch/call/ret: destination pc, read/write: raw value bits, the length
+  // for strings
+  std::uint64_t payload;
+};
+static_assert(sizeof(TraceEvent) == 16);
+
+struct TraceHeader final {
+  static constexpr std::uint64_t kMagic = 0x45434152544d5650; // "PVMTRACE"
+  static constexpr std::uint32_t kVersion = 1;
+
+  std::uint64_t magic;
+  std::uint32_t version;
+  std::uint32_t reserved;
+  std::uint64_t capacity;
+  // total number of recorded events, the ring keeps the last `capacity`
+  std::uint64_t head;
+};
+
+struct TraceStats final {
+  std::uint64_t total{};
+  std::uint64_t kept{};
+  std::uint64_t byKind[eTRACE_KIND_NUM]{};
+  std::vector<std::vector<std::uint64_t>> byOp{};
+};
+
+class Tracer final {
+public:
+  // anonymous ring, inspected in-process
+  explicit Tracer(std::size_t capacity);
+  // file-backed ring, survives the process for post-mortem decoding
+  Tracer(const std::string &path, std::size_t capacity);
+
+  Tracer(const Tracer &) = delete;
+  Tracer &operator=(const Tracer &) = delete;
+  ~Tracer();
+
+  void record(const TraceEvent &event) noexcept {
+    m_events[m_header->head++ & m_mask] = event;
+  }
+
+  [[nodiscard]] std::size_t capacity() const noexcept;
+  [[nodiscard]] std::uint64_t recorded() const noexcept;
+  [[nodiscard]] std::vector<TraceEvent> events() const;
+
+private:
+  void map(int fd, std::size_t capacity);
+
+  void *m_base{};
+  std::size_t m_size{};
+  TraceHeader *m_header{};
+  TraceEvent *m_events{};
+  std::uint64_t m_mask{};
+};
+
+class TraceReader final {
+public:
+  explicit TraceReader(const std::string &path);
+
+  [[nodiscard]] std::uint64_t recorded() const noexcept;
+  [[nodiscard]] bool wrapped() const noexcept;
+  [[nodiscard]] const std::vector<TraceEvent> &events() const noexcept;
+
+private:
+  TraceHeader m_header{};
+  std::vector<TraceEvent> m_events{};
+};
+
+// `instr` by value: taking the address of the dispatch frame's copy would
+// keep the traced chain from compiling to sibling calls
+void traceExec(Tracer &tracer, const Interpreter::State &state, Addr pc,
+               Instr instr);
+
+[[nodiscard]] TraceStats collectTraceStats(const std::vector<TraceEvent> &events,
+                                           std::uint64_t recorded);
+
+// Recorded `unary.read` values in the text form the interpreter consumes,
+// feeding it back as the input stream replays the run deterministically.
+// Throws when the run read strings, their bytes are not recorded.
+[[nodiscard]] std::string traceReplayInput(const std::vector<TraceEvent> &events,
+                                           std::uint64_t recorded);
+
+} // namespace pvm
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+#include "common/config.hpp"
+#include "memory/memory.hpp"
+
+namespace pvm {
+
+struct Verification final {
+  bool ok;
+  // the first instruction found unverifiable and why
+  Addr pc;
+  std::string reason;
+};
+
+// Abstract interpretation of register types over the control flow graph,
+// calls included, for a run starting at pc 0 with fresh registers. Code that
+// passes never fails a type or type id check and never falls off its end or
+// returns without a frame, so it runs on the unchecked handlers. Conditional
+// calls are rejected: a false condition leaves a frame behind and breaks the
+// pairing of calls and returns.
+[[nodiscard]] Verification verify(const Code &code);
+
+} // namespace pvm
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+namespace pvm {
+
+class RegFile;
+
+struct ArenaStats final {
+  std::size_t allocations;
+  std::size_t deallocations;
+  std::size_t bytesInUse;
+  // of bytesInUse plus externalBytes plus sharedBytes
+  std::size_t peakBytes;
+  // chunks the pools took from the global heap
+  std::size_t reservedBytes;
+  // held by the owner outside of the pools, the linear memory of an
+  // interpreter
+  std::size_t externalBytes;
+  // charged by the account of the arena in a shared pool, see
+  // Arena::account()
+  std::size_t sharedBytes;
+  // allocations and external growth turned down by the limit
+  std::size_t refused;
+};
+
+// Allocations made while the pc of the attributed register file pointed at
+// one instruction
+struct AllocationSite final {
+  std::size_t allocations;
+  std::size_t bytes;
+};
+
+// What an allocation past the limit of an Arena throws
+class ArenaLimitError final : public std::bad_alloc {
+public:
+  [[nodiscard]] const char *what() const noexcept override {
+    return "arena memory limit exceeded";
+  }
+};
+
+class Arena;
+
+// Allocates from a thread-safe pool shared between interpreters and charges
+// the bytes to an Arena and its limit. Blocks may be freed from any thread,
+// even once the arena is gone: the account lives until its last block does.
+class PoolAccount final : public std::pmr::memory_resource {
+public:
+  PoolAccount(const PoolAccount &) = delete;
+  PoolAccount &operator=(const PoolAccount &) = delete;
+
+  [[nodiscard]] std::size_t bytesInUse() const noexcept;
+  [[nodiscard]] std::pmr::memory_resource *pool() const noexcept;
+
+private:
+  friend class Arena;
+
+  PoolAccount(Arena &arena, std::pmr::memory_resource *pool) noexcept;
+  ~PoolAccount() override = default;
+
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+  void do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) override;
+  [[nodiscard]] bool do_is_equal(const memory_resource &other) const noexcept override;
+
+  // called by the arena as it goes away
+  void detach() noexcept;
+  void drop(std::size_t refs) noexcept;
+
+  Arena *m_arena;
+  std::pmr::memory_resource *m_pool;
+  // the bytes in use, plus one while the arena is alive
+  std::atomic<std::size_t> m_refs{1};
+};
+
+// Per-interpreter allocator: size-class pools carved out of large chunks, so
+// arrays and call frames do not go through the global malloc. Not
+// thread-safe, an interpreter is only ever run by one thread at a time.
+class Arena final : public std::pmr::memory_resource {
+public:
+  static constexpr std::size_t kNoLimit = std::numeric_limits<std::size_t>::max();
+
+  Arena();
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena() override;
+
+  [[nodiscard]] ArenaStats stats() const noexcept;
+
+  // Returns every chunk at once, anything still allocated from the arena
+  // dangles afterwards. The limit, the attribution and the account are
+  // kept.
+  void release();
+
+  // Allocations that would take bytesInUse plus externalBytes plus
+  // sharedBytes past `bytes` throw ArenaLimitError
+  void setLimit(std::size_t bytes) noexcept;
+  [[nodiscard]] std::size_t limit() const noexcept;
+  // false, and nothing changes, when `bytes` would pass the limit
+  bool setExternalBytes(std::size_t bytes) noexcept;
+
+  // Charges every allocation to the pc of `rf` as well, nullptr stops
+  void attributeTo(const RegFile *rf) noexcept;
+  // indexed by pc, up to the highest pc that allocated
+  [[nodiscard]] const std::vector<AllocationSite> &sites() const noexcept;
+
+  // The account of this arena in `pool`, made on the first call; every
+  // call has to pass the same pool
+  [[nodiscard]] PoolAccount *account(std::pmr::memory_resource *pool);
+
+private:
+  friend class PoolAccount;
+
+  class Upstream final : public std::pmr::memory_resource {
+  public:
+    explicit Upstream(ArenaStats &stats) noexcept : m_stats(stats) {
+    }
+
+  private:
+    void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) override;
+    [[nodiscard]] bool do_is_equal(const memory_resource &other) const noexcept override;
+
+    ArenaStats &m_stats;
+  };
+
+  void *do_allocate(std::size_t bytes, std::size_t alignment) override;
+  void do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) override;
+  [[nodiscard]] bool do_is_equal(const memory_resource &other) const noexcept override;
+
+  // whether `bytes` more in use and `externalBytes` stay within the limit
+  [[nodiscard]] bool fits(std::size_t bytes, std::size_t externalBytes) const noexcept;
+  [[nodiscard]] std::size_t sharedBytes() const noexcept;
+  void updatePeak() noexcept;
+
+  ArenaStats m_stats{};
+  std::size_t m_limit{kNoLimit};
+  const RegFile *m_attributed{nullptr};
+  std::vector<AllocationSite> m_sites{};
+  PoolAccount *m_account{nullptr};
+  Upstream m_upstream;
+  std::pmr::unsynchronized_pool_resource m_pool;
+};
+
+} // namespace pvm
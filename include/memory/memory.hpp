@@ -1,40 +1,133 @@
 #pragma once
 
-#include <algorithm>
-#include <array>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <span>
+#include <type_traits>
 #include <vector>
 
+#include <setjmp.h>
+#include <signal.h>
+
 #include "common/config.hpp"
 #include "common/instruction.hpp"
 #include "common/value.hpp"
 
 namespace pvm {
 
+// Byte-addressable linear memory. The whole 32-bit address space plus a
+// guard area is reserved up front and only the first pages() pages are
+// accessible, so accesses are never bounds-checked: anything past the
+// committed size faults on an inaccessible page, see MemoryFaultScope.
+// Empty memories share one reservation; a private one is mapped by the
+// first grow().
 class Memory final {
 public:
-  explicit Memory() = default;
-  explicit Memory(std::vector<Value> const &data) {
-    std::copy(data.begin(), data.end(), m_data.begin());
+  static constexpr std::size_t kPageSize = 64 * 1024;
+  static constexpr std::size_t kMaxPages = (std::size_t{1} << 32U) / kPageSize;
+  // covers the largest offset plus access width an instruction can encode
+  static constexpr std::size_t kGuardSize = kPageSize;
+  static constexpr std::size_t kReservation = kMaxPages * kPageSize + kGuardSize;
+
+  Memory();
+  Memory(const Memory &) = delete;
+  Memory &operator=(const Memory &) = delete;
+  Memory(Memory &&other) noexcept;
+  Memory &operator=(Memory &&other) noexcept;
+  ~Memory();
+
+  template <typename T>
+  [[nodiscard]] T load(std::uint64_t addr) const noexcept {
+    static_assert(std::is_trivially_copyable_v<T>);
+    T val;
+    std::memcpy(&val, m_base + addr, sizeof(T));
+    return val;
+  }
+
+  template <typename T>
+  void store(std::uint64_t addr, T val) noexcept {
+    static_assert(std::is_trivially_copyable_v<T>);
+    std::memcpy(m_base + addr, &val, sizeof(T));
   }
 
-  [[nodiscard]] std::uint64_t loadWord(Addr addr) const;
-  void storeVal(Addr addr, Value val);
+  // Commits `delta` more zeroed pages, returns the previous page count or
+  // -1 when the memory would outgrow kMaxPages
+  std::int64_t grow(std::size_t delta);
+
+  [[nodiscard]] std::size_t pages() const noexcept;
+  [[nodiscard]] std::size_t size() const noexcept;
+  [[nodiscard]] std::byte *data() noexcept;
+  [[nodiscard]] const std::byte *data() const noexcept;
+
+  // true for every address of the reservation, accessible or not
+  [[nodiscard]] bool contains(const void *addr) const noexcept;
+
+  // Drops every page, the private reservation is kept for the next grow()
+  void reset();
+
+private:
+  void release() noexcept;
+
+  std::byte *m_base;
+  std::size_t m_pages{};
+  bool m_private{};
+};
+
+// While alive, a fault on the reservation of `mem` on this thread jumps back
+// to the sigsetjmp(env(), 0) point of the caller instead of killing the
+// process. Frames skipped by the jump must have trivial destructors.
+class MemoryFaultScope final {
+public:
+  explicit MemoryFaultScope(const Memory &mem) noexcept;
+  MemoryFaultScope(const MemoryFaultScope &) = delete;
+  MemoryFaultScope &operator=(const MemoryFaultScope &) = delete;
+  ~MemoryFaultScope();
+
+  [[nodiscard]] sigjmp_buf &env() noexcept;
 
 private:
-  // TODO: temporary
-  std::array<Value, 1024> m_data{};
+  friend void handleMemoryFault(int sig, siginfo_t *info, void *ctx);
+
+  const Memory &m_mem;
+  MemoryFaultScope *m_outer;
+  sigjmp_buf m_env{};
 };
 
 class Code final {
 public:
   explicit Code(const std::vector<Instr> &data);
   explicit Code(std::vector<Instr> &&data);
+  // Instructions kept alive by `storage`, e.g. a mapped file. `verified` is
+  // the verify() verdict when whoever built the code already knows it.
+  Code(std::shared_ptr<const void> storage, std::span<const Instr> instrs,
+       std::optional<bool> verified = std::nullopt);
+  Code(const Code &other);
+  Code &operator=(const Code &) = delete;
 
   [[nodiscard]] Instr loadInstr(Addr pc) const;
+  [[nodiscard]] std::size_t size() const;
+  [[nodiscard]] std::span<const Instr> data() const;
+  // nullopt until the verdict is known
+  [[nodiscard]] std::optional<bool> verified() const;
+  // Records the verify() verdict for everyone sharing the code, so it is
+  // computed once however many interpreters load it
+  void setVerified(bool ok) const noexcept;
 
 private:
-  std::vector<Instr> m_data{};
+  static constexpr std::uint8_t kUnknown = 0;
+  static constexpr std::uint8_t kRejected = 1;
+  static constexpr std::uint8_t kAccepted = 2;
+
+  std::shared_ptr<const void> m_storage{};
+  std::span<const Instr> m_instrs{};
+  mutable std::atomic<std::uint8_t> m_verified{kUnknown};
 };
 
+// Code is immutable once built, interpreters running the same program share it
+using CodePtr = std::shared_ptr<const Code>;
+
 } // namespace pvm
@@ -14,6 +14,8 @@ private:
 
   std::array<Value, kRegNum> m_data{};
   Addr m_pc{};
+  // registers at and above this index were never written
+  std::uint16_t m_touched{};
 
 public:
   void writeAcc(Value &&val);
@@ -23,10 +25,17 @@ public:
   void writeReg(RegId regId, Value &&val);
   void writeReg(RegId regId, const Value &val);
   [[nodiscard]] Value readReg(RegId regId) const;
+  // readReg() without the copy, valid until the register is written
+  [[nodiscard]] const Value &peekReg(RegId regId) const noexcept;
+  // Moves the value out and leaves null behind
+  [[nodiscard]] Value takeReg(RegId regId);
 
   void incrementPC();
   void writePC(Addr addr);
   [[nodiscard]] Addr readPC() const;
+
+  [[nodiscard]] std::size_t touched() const;
+  void reset();
 };
 
 } // namespace pvm
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "interpreter/interpreter.hpp"
+#include "memory/memory.hpp"
+
+namespace pvm {
+
+// M:N scheduler: interpreters run as green threads in fuel-bounded slices on
+// a fixed pool of OS threads. Every worker owns a deque, runs its tasks
+// round-robin and steals from the others once it runs dry. A task that reads
+// past its buffered input is parked until feed() or closeInput(), one blocked
+// on a channel until the other side of it makes progress.
+class Scheduler final {
+public:
+  using TaskId = std::size_t;
+
+  static constexpr std::uint64_t kDefaultSlice = 10'000;
+
+  explicit Scheduler(std::size_t workers, std::uint64_t slice = kDefaultSlice);
+  Scheduler(const Scheduler &) = delete;
+  Scheduler &operator=(const Scheduler &) = delete;
+  // Stops after the slices in flight, unfinished tasks are dropped. Channels
+  // shared with tasks must not be used by other threads meanwhile.
+  ~Scheduler();
+
+  // `channels[id]` is attached as channel id, null entries are skipped
+  TaskId spawn(CodePtr code, std::string_view input = {}, bool closeInput = true,
+               const std::vector<ChannelPtr> &channels = {});
+
+  // Interpreter::setMemoryLimit() of the tasks spawned afterwards
+  void setMemoryLimit(std::size_t bytes) noexcept;
+
+  void feed(TaskId id, std::string_view input);
+  void closeInput(TaskId id);
+
+  // Block until the task (or every task) has halted or parked on input or
+  // a channel
+  void wait(TaskId id);
+  void wait();
+
+  // eTRAPPED as well for a task whose run threw, error() holds what it threw
+  [[nodiscard]] Interpreter::Status status(TaskId id);
+  [[nodiscard]] std::exception_ptr error(TaskId id);
+  [[nodiscard]] std::string output(TaskId id);
+  [[nodiscard]] ArenaStats memoryUsage(TaskId id);
+  [[nodiscard]] std::size_t workers() const noexcept;
+
+private:
+  struct Task final {
+    Task(CodePtr code, std::string_view input, bool closed);
+
+    std::mutex mutex{};
+    std::stringstream ist{};
+    std::stringstream ost{};
+    Interpreter interp;
+    Interpreter::Status status{Interpreter::eRUNNING};
+    std::exception_ptr error{};
+    bool inputClosed{};
+    bool parked{};
+    // guarded by m_stateMutex, set once the task halts or parks
+    bool settled{};
+  };
+
+  struct Worker final {
+    std::mutex mutex{};
+    std::deque<Task *> tasks{};
+    std::thread thread{};
+  };
+
+  Task &task(TaskId id);
+  void enqueue(Task *task, std::size_t worker);
+  void unpark(Task &task);
+  void block(Task &task, std::size_t worker);
+  Task *pop(std::size_t worker);
+  Task *steal(std::size_t thief);
+  void retire(Task &task);
+  void loop(std::size_t worker);
+
+  std::uint64_t m_slice;
+  std::atomic<std::size_t> m_memoryLimit{Arena::kNoLimit};
+
+  std::mutex m_tasksMutex{};
+  std::deque<std::unique_ptr<Task>> m_tasks{};
+
+  std::vector<std::unique_ptr<Worker>> m_workers{};
+  std::atomic<std::size_t> m_next{0};
+
+  // tasks sitting in deques, workers sleep while there are none
+  std::mutex m_stateMutex{};
+  std::condition_variable m_work{};
+  std::condition_variable m_settled{};
+  std::size_t m_queued{0};
+  // tasks queued or in flight, wait() returns when it drops to zero
+  std::size_t m_active{0};
+  bool m_stop{false};
+};
+
+} // namespace pvm
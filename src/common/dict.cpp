@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <utility>
+
+#if defined(__SSE2__) && !defined(PVM_NO_SIMD)
+#define PVM_DICT_SSE 1
+#include <immintrin.h>
+#else
+#define PVM_DICT_SSE 0
+#endif
+
+#include "common/dict.hpp"
+#include "common/value.hpp"
+
+namespace pvm {
+
+namespace {
+
+// Control bytes: a full slot holds the low 7 bits of its hash, free ones
+// have the sign bit set
+constexpr std::int8_t kEmpty = -128;
+constexpr std::int8_t kDeleted = -2;
+
+// Bit i is set for slot i of the group
+class GroupMask final {
+public:
+  explicit GroupMask(std::uint32_t bits) : m_bits(bits) {
+  }
+
+  explicit operator bool() const noexcept {
+    return m_bits != 0;
+  }
+
+  [[nodiscard]] std::size_t lowest() const noexcept {
+    return static_cast<std::size_t>(std::countr_zero(m_bits));
+  }
+
+  void dropLowest() noexcept {
+    m_bits &= m_bits - 1;
+  }
+
+private:
+  std::uint32_t m_bits;
+};
+
+#if PVM_DICT_SSE
+class Group final {
+public:
+  explicit Group(const std::int8_t *ctrl)
+      : m_ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl))) {
+  }
+
+  [[nodiscard]] GroupMask match(std::int8_t h2) const {
+    return mask(_mm_cmpeq_epi8(_mm_set1_epi8(h2), m_ctrl));
+  }
+
+  [[nodiscard]] GroupMask matchEmpty() const {
+    return match(kEmpty);
+  }
+
+  // empty or deleted, the bytes below -1
+  [[nodiscard]] GroupMask matchFree() const {
+    return mask(_mm_cmpgt_epi8(_mm_set1_epi8(-1), m_ctrl));
+  }
+
+private:
+  static GroupMask mask(__m128i bytes) {
+    return GroupMask{static_cast<std::uint32_t>(_mm_movemask_epi8(bytes))};
+  }
+
+  __m128i m_ctrl;
+};
+#else
+class Group final {
+public:
+  explicit Group(const std::int8_t *ctrl) {
+    std::memcpy(m_ctrl, ctrl, Dict::kGroup);
+  }
+
+  [[nodiscard]] GroupMask match(std::int8_t h2) const {
+    return matchIf([h2](std::int8_t byte) { return byte == h2; });
+  }
+
+  [[nodiscard]] GroupMask matchEmpty() const {
+    return match(kEmpty);
+  }
+
+  [[nodiscard]] GroupMask matchFree() const {
+    return matchIf([](std::int8_t byte) { return byte < -1; });
+  }
+
+private:
+  template <typename Pred>
+  GroupMask matchIf(Pred pred) const {
+    std::uint32_t bits = 0;
+    for (std::size_t i = 0; i < Dict::kGroup; ++i) {
+      bits |= pred(m_ctrl[i]) ? 1U << i : 0U;
+    }
+    return GroupMask{bits};
+  }
+
+  std::int8_t m_ctrl[Dict::kGroup];
+};
+#endif
+
+std::uint64_t mix(std::uint64_t bits) {
+  bits ^= bits >> 30U;
+  bits *= 0xbf58476d1ce4e5b9ULL;
+  bits ^= bits >> 27U;
+  bits *= 0x94d049bb133111ebULL;
+  return bits ^ (bits >> 31U);
+}
+
+// -0.0 and 0.0 are one key
+std::uint32_t floatBits(Float num) {
+  auto bits = std::bit_cast<std::uint32_t>(num);
+  return bits == 0x80000000U ? 0 : bits;
+}
+
+// the type goes above the 32 bits of the key, Int 1 and Float 1 differ
+std::uint64_t hashKey(const Value &key) {
+  if (const auto *num = key.tryView<Int>(); num != nullptr) {
+    return mix(std::bit_cast<std::uint32_t>(*num));
+  }
+  if (const auto *num = key.tryView<Float>(); num != nullptr) {
+    return mix(floatBits(*num) | (std::uint64_t{1} << 32U));
+  }
+  return mix(key.view<String>().hash() | (std::uint64_t{2} << 32U));
+}
+
+bool sameKey(const Value &lhs, const Value &rhs) {
+  if (const auto *num = lhs.tryView<Int>(); num != nullptr) {
+    const auto *other = rhs.tryView<Int>();
+    return other != nullptr && *num == *other;
+  }
+  if (const auto *num = lhs.tryView<Float>(); num != nullptr) {
+    const auto *other = rhs.tryView<Float>();
+    return other != nullptr && floatBits(*num) == floatBits(*other);
+  }
+  const auto *other = rhs.tryView<String>();
+  return other != nullptr && lhs.view<String>() == *other;
+}
+
+std::int8_t h2(std::uint64_t hash) {
+  return static_cast<std::int8_t>(hash & 0x7fU);
+}
+
+// capacity * 7/8 entries fit, so every probe meets an empty slot
+std::size_t maxLoad(std::size_t capacity) {
+  return capacity - capacity / 8;
+}
+
+} // namespace
+
+struct Dict::Entry {
+  Value key{};
+  Value val{};
+};
+
+struct Dict::Data {
+  std::pmr::vector<std::int8_t> ctrl;
+  std::pmr::vector<Entry> entries;
+  std::size_t size{};
+  // empty slots that may still be filled before a rehash
+  std::size_t growthLeft{};
+
+  // Quadratic over groups: the n-th probe is n(n+1)/2 groups after the
+  // first, which visits every group of a power-of-two table
+  template <typename Visit>
+  std::size_t probe(std::uint64_t hash, Visit visit) const {
+    auto groups = ctrl.size() / kGroup;
+    auto group = (hash >> 7U) & (groups - 1);
+    for (std::size_t step = 1;; ++step) {
+      if (auto found = visit(group * kGroup, Group{&ctrl[group * kGroup]});
+          found != kNone) {
+        return found;
+      }
+      group = (group + step) & (groups - 1);
+    }
+  }
+
+  std::size_t find(const Value &key, std::uint64_t hash) const {
+    if (ctrl.empty()) {
+      return kNone;
+    }
+    return probe(hash, [&](std::size_t first, const Group &group) {
+      for (auto match = group.match(h2(hash)); match; match.dropLowest()) {
+        auto slot = first + match.lowest();
+        if (sameKey(entries[slot].key, key)) {
+          return slot;
+        }
+      }
+      // a probe that met an empty slot would have ended here
+      return group.matchEmpty() ? kMissing : kNone;
+    });
+  }
+
+  // the first free slot of the probe sequence, the key is not present
+  void insert(Value key, Value val, std::uint64_t hash) {
+    auto slot = probe(hash, [](std::size_t first, const Group &group) {
+      auto free = group.matchFree();
+      return free ? first + free.lowest() : kNone;
+    });
+    growthLeft -= ctrl[slot] == kEmpty ? 1U : 0U;
+    ctrl[slot] = h2(hash);
+    entries[slot] = Entry{std::move(key), std::move(val)};
+    ++size;
+  }
+
+  void rehash(std::size_t capacity) {
+    auto resource = entries.get_allocator().resource();
+    std::pmr::vector<std::int8_t> oldCtrl(capacity, kEmpty, resource);
+    std::pmr::vector<Entry> oldEntries(capacity, resource);
+    oldCtrl.swap(ctrl);
+    oldEntries.swap(entries);
+    size = 0;
+    growthLeft = maxLoad(capacity);
+    for (std::size_t slot = 0; slot < oldCtrl.size(); ++slot) {
+      if (oldCtrl[slot] >= 0) {
+        auto hash = hashKey(oldEntries[slot].key);
+        insert(std::move(oldEntries[slot].key), std::move(oldEntries[slot].val), hash);
+      }
+    }
+  }
+
+  static constexpr std::size_t kNone = ~std::size_t{0};
+  // kNone ends no probe, kMissing ends a lookup without a match
+  static constexpr std::size_t kMissing = kNone - 1;
+};
+
+namespace {
+
+// the smallest power-of-two number of groups that holds `count` entries
+std::size_t capacityFor(std::size_t count) {
+  auto capacity = Dict::kGroup;
+  while (maxLoad(capacity) < count) {
+    capacity *= 2;
+  }
+  return capacity;
+}
+
+} // namespace
+
+Dict::Dict(std::size_t capacity, std::pmr::memory_resource *resource)
+    : m_data(std::allocate_shared<Data>(
+          std::pmr::polymorphic_allocator<Data>{resource},
+          Data{.ctrl = std::pmr::vector<std::int8_t>{resource},
+               .entries = std::pmr::vector<Entry>{resource}})) {
+  if (capacity != 0) {
+    reserve(capacity);
+  }
+}
+
+bool Dict::isKey(const Value &key) noexcept {
+  return key.holds<Int>() || key.holds<Float>() || key.holds<String>();
+}
+
+std::size_t Dict::size() const noexcept {
+  return m_data->size;
+}
+
+const Value *Dict::find(const Value &key) const {
+  auto slot = m_data->find(key, hashKey(key));
+  return slot < Data::kMissing ? &m_data->entries[slot].val : nullptr;
+}
+
+void Dict::set(const Value &key, Value val) const {
+  auto &data = *m_data;
+  auto hash = hashKey(key);
+  if (auto slot = data.find(key, hash); slot < Data::kMissing) {
+    data.entries[slot].val = std::move(val);
+    return;
+  }
+
+  if (data.growthLeft == 0) {
+    // tombstones alone may have used up the room, then the same
+    // capacity does
+    auto capacity = data.ctrl.size();
+    data.rehash(data.size < maxLoad(capacity) / 2 ? std::max(capacity, kGroup)
+                                                  : capacityFor(data.size + 1));
+  }
+  data.insert(key, std::move(val), hash);
+}
+
+bool Dict::remove(const Value &key) const {
+  auto &data = *m_data;
+  auto slot = data.find(key, hashKey(key));
+  if (slot >= Data::kMissing) {
+    return false;
+  }
+
+  // A lookup only passes a group without empty slots, so in a group that
+  // has one the slot can become empty again rather than a tombstone
+  auto first = slot - slot % kGroup;
+  if (Group{&data.ctrl[first]}.matchEmpty()) {
+    data.ctrl[slot] = kEmpty;
+    ++data.growthLeft;
+  } else {
+    data.ctrl[slot] = kDeleted;
+  }
+  data.entries[slot] = Entry{};
+  --data.size;
+  return true;
+}
+
+void Dict::reserve(std::size_t capacity) const {
+  auto &data = *m_data;
+  if (capacity > data.size + data.growthLeft) {
+    data.rehash(capacityFor(capacity));
+  }
+}
+
+std::size_t Dict::slots() const noexcept {
+  return m_data->ctrl.size();
+}
+
+const Value *Dict::key(std::size_t slot) const noexcept {
+  return m_data->ctrl[slot] >= 0 ? &m_data->entries[slot].key : nullptr;
+}
+
+const Value &Dict::value(std::size_t slot) const noexcept {
+  return m_data->entries[slot].val;
+}
+
+const void *Dict::identity() const noexcept {
+  return m_data.get();
+}
+
+} // namespace pvm
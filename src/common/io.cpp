@@ -0,0 +1,25 @@
+#include <cerrno>
+
+#include <unistd.h>
+
+#include "common/io.hpp"
+
+namespace pvm {
+
+bool writeAll(int fd, const void *data, std::size_t size) {
+  const auto *bytes = static_cast<const char *>(data);
+  while (size != 0) {
+    auto n = ::write(fd, bytes, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    bytes += n;
+    size -= static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+} // namespace pvm
@@ -0,0 +1,52 @@
+#include "common/shape.hpp"
+
+namespace pvm {
+
+std::uint32_t Shape::find(FieldId field) const {
+  auto it = m_slots.find(field);
+  return it == m_slots.end() ? kNoSlot : it->second;
+}
+
+const std::vector<FieldId> &Shape::fields() const noexcept {
+  return m_fields;
+}
+
+std::uint32_t Shape::size() const noexcept {
+  return static_cast<std::uint32_t>(m_fields.size());
+}
+
+ShapeTree::ShapeTree() {
+  m_shapes.emplace_back();
+}
+
+const Shape *ShapeTree::root() const noexcept {
+  return &m_shapes.front();
+}
+
+const Shape *ShapeTree::transition(const Shape *shape, FieldId field) {
+  // every shape handed out lives in m_shapes, which is not const
+  auto &from = const_cast<Shape &>(*shape);
+  if (auto it = from.m_transitions.find(field); it != from.m_transitions.end()) {
+    return it->second;
+  }
+
+  auto &to = m_shapes.emplace_back();
+  to.m_fields = from.m_fields;
+  to.m_fields.push_back(field);
+  to.m_slots = from.m_slots;
+  to.m_slots.emplace(field, from.size());
+
+  from.m_transitions.emplace(field, &to);
+  return &to;
+}
+
+std::size_t ShapeTree::size() const noexcept {
+  return m_shapes.size();
+}
+
+void ShapeTree::clear() {
+  m_shapes.clear();
+  m_shapes.emplace_back();
+}
+
+} // namespace pvm
@@ -0,0 +1,224 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/string.hpp"
+
+namespace pvm {
+
+// Flat nodes own their bytes. Rope nodes own their two halves until the
+// first view(), which writes the bytes into `flat` and drops the halves.
+struct String::Node {
+  std::size_t size;
+  std::uint32_t depth;
+  mutable std::pmr::string flat;
+  mutable String left{};
+  mutable String right{};
+  mutable bool flattened;
+  mutable bool hashed{false};
+  mutable std::uint32_t hash{};
+  // id of the table that interned the node, 0 when none did
+  mutable std::uint64_t internedIn{};
+};
+
+namespace {
+
+std::uint32_t fnv1a(std::string_view bytes) {
+  std::uint32_t hash = 0x811c9dc5U;
+  for (auto byte : bytes) {
+    hash ^= static_cast<unsigned char>(byte);
+    hash *= 0x01000193U;
+  }
+  return hash;
+}
+
+std::uint64_t nextTableId() {
+  static std::atomic<std::uint64_t> next{1};
+  return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+String::String(std::string_view text, std::pmr::memory_resource *resource) {
+  if (text.size() <= kInline) {
+    std::copy(text.begin(), text.end(), m_inline.begin());
+    m_size = static_cast<std::uint8_t>(text.size());
+    return;
+  }
+  m_node = std::allocate_shared<Node>(
+      std::pmr::polymorphic_allocator<Node>{resource},
+      Node{.size = text.size(),
+           .depth = 0,
+           .flat = std::pmr::string{text, resource},
+           .flattened = true});
+}
+
+String String::concat(const String &lhs, const String &rhs,
+                      std::pmr::memory_resource *resource) {
+  if (lhs.size() == 0) {
+    return rhs;
+  }
+  if (rhs.size() == 0) {
+    return lhs;
+  }
+  auto size = static_cast<std::size_t>(lhs.size()) + static_cast<std::size_t>(rhs.size());
+  if (size <= kInline) {
+    String res{};
+    std::memcpy(res.m_inline.data(), lhs.m_inline.data(), lhs.m_size);
+    std::memcpy(res.m_inline.data() + lhs.m_size, rhs.m_inline.data(), rhs.m_size);
+    res.m_size = static_cast<std::uint8_t>(size);
+    return res;
+  }
+
+  String res{};
+  res.m_node = std::allocate_shared<Node>(
+      std::pmr::polymorphic_allocator<Node>{resource},
+      Node{.size = size,
+           .depth = std::max(lhs.depth(), rhs.depth()) + 1,
+           .flat = std::pmr::string{resource},
+           .left = lhs,
+           .right = rhs,
+           .flattened = false});
+  if (res.m_node->depth > kMaxDepth) {
+    (void)res.view();
+  }
+  return res;
+}
+
+Int String::size() const noexcept {
+  return static_cast<Int>(m_node != nullptr ? m_node->size : m_size);
+}
+
+// Walks the rope with an explicit stack, appending the leaves left to right.
+// Halves that are flattened already are copied without descending.
+std::string_view String::view() const {
+  if (m_node == nullptr) {
+    return {m_inline.data(), m_size};
+  }
+  const auto &node = *m_node;
+  if (node.flattened) {
+    return node.flat;
+  }
+
+  node.flat.reserve(node.size);
+  std::vector<const String *> pending{&node.right, &node.left};
+  while (!pending.empty()) {
+    const auto *part = pending.back();
+    pending.pop_back();
+    if (part->m_node == nullptr || part->m_node->flattened) {
+      node.flat.append(part->view());
+    } else {
+      pending.push_back(&part->m_node->right);
+      pending.push_back(&part->m_node->left);
+    }
+  }
+  node.flattened = true;
+  node.left = String{};
+  node.right = String{};
+  return node.flat;
+}
+
+String String::slice(Int from, Int to, std::pmr::memory_resource *resource) const {
+  if (from == 0 && to == size()) {
+    return *this;
+  }
+  return String{view().substr(static_cast<std::size_t>(from),
+                              static_cast<std::size_t>(to - from)),
+                resource};
+}
+
+std::uint32_t String::hash() const {
+  if (m_node == nullptr) {
+    return fnv1a(view());
+  }
+  if (!m_node->hashed) {
+    m_node->hash = fnv1a(view());
+    m_node->hashed = true;
+  }
+  return m_node->hash;
+}
+
+int String::compare(const String &other) const {
+  if (m_node != nullptr && m_node == other.m_node) {
+    return 0;
+  }
+  return view().compare(other.view());
+}
+
+bool String::operator==(const String &other) const {
+  if (m_node == nullptr || other.m_node == nullptr) {
+    return m_node == other.m_node && view() == other.view();
+  }
+  if (m_node == other.m_node) {
+    return true;
+  }
+  if (m_node->internedIn != 0 && m_node->internedIn == other.m_node->internedIn) {
+    return false;
+  }
+  if (m_node->size != other.m_node->size ||
+      (m_node->hashed && other.m_node->hashed && m_node->hash != other.m_node->hash)) {
+    return false;
+  }
+  return view() == other.view();
+}
+
+bool String::interned() const noexcept {
+  return m_node != nullptr && m_node->internedIn != 0;
+}
+
+bool String::isRope() const noexcept {
+  return m_node != nullptr && !m_node->flattened;
+}
+
+std::uint32_t String::depth() const noexcept {
+  return m_node != nullptr && !m_node->flattened ? m_node->depth : 0;
+}
+
+// Writes the leaves of a rope in place rather than flattening it, printing
+// never allocates from the string's resource
+std::ostream &operator<<(std::ostream &ost, const String &str) {
+  if (!str.isRope()) {
+    return ost << str.view();
+  }
+  std::vector<const String *> pending{&str};
+  while (!pending.empty()) {
+    const auto *part = pending.back();
+    pending.pop_back();
+    if (part->isRope()) {
+      pending.push_back(&part->m_node->right);
+      pending.push_back(&part->m_node->left);
+    } else {
+      ost << part->view();
+    }
+  }
+  return ost;
+}
+
+StringTable::StringTable() : m_id{nextTableId()} {
+}
+
+String StringTable::intern(const String &str) {
+  if (str.m_node == nullptr) {
+    return str;
+  }
+  auto bytes = str.view();
+  auto [it, fresh] = m_strings.try_emplace(bytes, str);
+  if (fresh) {
+    str.m_node->internedIn = m_id;
+  }
+  return it->second;
+}
+
+std::size_t StringTable::size() const noexcept {
+  return m_strings.size();
+}
+
+void StringTable::clear() {
+  m_strings.clear();
+  m_id = nextTableId();
+}
+
+} // namespace pvm
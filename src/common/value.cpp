@@ -1,5 +1,7 @@
+#include <memory>
 #include <sstream>
 #include <stdexcept>
+#include <utility>
 #include <variant>
 
 #include "common/value.hpp"
@@ -30,43 +32,142 @@ Value &Value::operator=(Value &&other) noexcept {
   return *this;
 }
 
-Array::Array(Int size) : m_data(size) {
+struct Array::Rep {
+  std::pmr::vector<Value> data;
+};
+
+Array::Rep *Array::allocate(std::pmr::vector<Value> data) {
+  std::pmr::memory_resource *resource = data.get_allocator().resource();
+  void *mem = resource->allocate(sizeof(Rep), alignof(Rep));
+  return std::construct_at(static_cast<Rep *>(mem), Rep{std::move(data)});
+}
+
+void Array::release(Rep *rep) noexcept {
+  if (rep == nullptr) {
+    return;
+  }
+
+  std::pmr::memory_resource *resource = rep->data.get_allocator().resource();
+  std::destroy_at(rep);
+  resource->deallocate(rep, sizeof(Rep), alignof(Rep));
+}
+
+Array::Array(Int size, std::pmr::memory_resource *resource)
+    : m_rep(allocate(std::pmr::vector<Value>(static_cast<std::size_t>(size), resource))) {
+}
+
+Array::~Array() {
+  release(m_rep);
 }
 
-Array::Array(Array &&other) noexcept : m_data(std::move(other.m_data)) {
+Array::Array(Array const &other)
+    : m_rep(other.m_rep == nullptr
+                ? nullptr
+                : allocate(std::pmr::vector<Value>(other.m_rep->data,
+                                                   other.m_rep->data.get_allocator()))) {
 }
 
+Array::Array(Array &&other) noexcept : m_rep(std::exchange(other.m_rep, nullptr)) {
+}
+
+// Keeps our own resource, as assigning one pmr vector to another does
 Array &Array::operator=(Array const &other) {
   if (this == &other) {
     return *this;
   }
 
-  m_data = other.m_data;
+  if (other.m_rep == nullptr) {
+    clear();
+  } else if (m_rep == nullptr) {
+    // no resource of our own yet, so take the one of the source as a copy does
+    m_rep = allocate(std::pmr::vector<Value>(other.m_rep->data,
+                                             other.m_rep->data.get_allocator()));
+  } else {
+    m_rep->data = other.m_rep->data;
+  }
   return *this;
 }
+// Takes over the storage of `other` together with its resource, moving
+// element by element into our own resource would copy them
 Array &Array::operator=(Array &&other) noexcept {
-  m_data = std::move(other.m_data);
+  if (this != &other) {
+    release(std::exchange(m_rep, std::exchange(other.m_rep, nullptr)));
+  }
   return *this;
 }
 
 [[nodiscard]] Int Array::size() const noexcept {
-  return static_cast<Int>(m_data.size());
+  return m_rep == nullptr ? 0 : static_cast<Int>(m_rep->data.size());
 }
 [[nodiscard]] Value Array::at(Int pos) const && {
-  return m_data.at(pos);
+  return std::as_const(*this).at(pos);
 }
 [[nodiscard]] Value const &Array::at(Int pos) const & {
-  return m_data.at(pos);
+  if (m_rep == nullptr) {
+    throw std::out_of_range("Array::at");
+  }
+  return m_rep->data.at(static_cast<std::size_t>(pos));
 }
 [[nodiscard]] Value &Array::at(Int pos) & {
-  return m_data.at(pos);
+  if (m_rep == nullptr) {
+    throw std::out_of_range("Array::at");
+  }
+  return m_rep->data.at(static_cast<std::size_t>(pos));
 }
 
 void Array::resize(Int newSize) {
-  m_data.resize(static_cast<size_t>(newSize), Value(Null()));
+  if (m_rep == nullptr) {
+    if (newSize == 0) {
+      return;
+    }
+    throw std::logic_error("Array::resize without a resource");
+  }
+  m_rep->data.resize(static_cast<size_t>(newSize), Value(Null()));
 }
 void Array::clear() {
-  m_data.clear();
+  if (m_rep != nullptr) {
+    m_rep->data.clear();
+  }
+}
+
+[[nodiscard]] std::pmr::memory_resource *Array::resource() const noexcept {
+  return m_rep == nullptr ? std::pmr::get_default_resource()
+                          : m_rep->data.get_allocator().resource();
+}
+
+Object::Object(const Shape *shape, std::pmr::memory_resource *resource)
+    : m_data(std::allocate_shared<Data>(std::pmr::polymorphic_allocator<Data>{resource},
+                                        Data{shape, std::pmr::vector<Value>{resource}})) {
+}
+
+void Object::append(const Shape *next, Value val) const {
+  m_data->slots.push_back(std::move(val));
+  m_data->shape = next;
+}
+
+const void *Object::identity() const noexcept {
+  return m_data.get();
+}
+
+Function::Function(Addr entry, std::pmr::memory_resource *resource)
+    : m_data(std::allocate_shared<Data>(std::pmr::polymorphic_allocator<Data>{resource},
+                                        Data{entry, std::pmr::vector<Value>{resource}})) {
+}
+
+std::uint32_t Function::captured() const noexcept {
+  return static_cast<std::uint32_t>(m_data->env.size());
+}
+
+Value const &Function::env(std::uint32_t pos) const {
+  return m_data->env.at(pos);
+}
+
+void Function::capture(Value val) const {
+  m_data->env.push_back(std::move(val));
+}
+
+const void *Function::identity() const noexcept {
+  return m_data.get();
 }
 
 } // namespace pvm
@@ -0,0 +1,327 @@
+#include <bit>
+#include <cerrno>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "common/config.hpp"
+#include "compiler/aot.hpp"
+#include "decoder/image.hpp"
+#include "generated/instruction.hpp"
+
+namespace pvm {
+
+namespace {
+
+// Straight-line code reachable from `entry` without entering a call.
+// Regions may overlap, shared blocks are compiled into each of them.
+struct Region final {
+  Addr entry;
+  std::set<Addr> pcs{};
+  // pcs the region dispatch can jump to
+  std::set<Addr> labels{};
+};
+
+bool isBranch(const Instr &instr, BranchOpID op) {
+  return instr.opType == eBRANCH && instr.opID == op;
+}
+
+Addr branchTarget(Addr pc, const Instr &instr) {
+  return pc + std::bit_cast<Addr>(std::get<InstrBRANCH>(instr.instrVar).offset);
+}
+
+std::set<Addr> collectEntries(const std::vector<Instr> &instrs) {
+  std::set<Addr> entries{0};
+  for (Addr pc = 0; pc < instrs.size(); ++pc) {
+    const auto &instr = instrs[pc];
+    auto target = static_cast<Addr>(instrs.size());
+    if (isBranch(instr, eBRANCH_CALL)) {
+      target = branchTarget(pc, instr);
+    } else if (instr.opType == eFUNC && instr.opID == eFUNC_NEW) {
+      target = pc + std::bit_cast<Addr>(std::get<InstrFUNC>(instr.instrVar).offset);
+    }
+    if (target < instrs.size()) {
+      entries.insert(target);
+    }
+  }
+  return entries;
+}
+
+Region collectRegion(const std::vector<Instr> &instrs, Addr entry) {
+  Region region{.entry = entry};
+  region.labels.insert(entry);
+
+  std::vector<Addr> work{entry};
+  auto visit = [&](Addr pc) {
+    if (pc < instrs.size() && region.pcs.insert(pc).second) {
+      work.push_back(pc);
+    }
+  };
+  region.pcs.insert(entry);
+
+  while (!work.empty()) {
+    auto pc = work.back();
+    work.pop_back();
+
+    const auto &instr = instrs[pc];
+    switch (instr.opType) {
+    case eHALT:
+      break;
+    case eBRANCH:
+      // every branch may suspend on fuel, a run resumes right at it
+      region.labels.insert(pc);
+      if (instr.opID == eBRANCH_RET) {
+        break;
+      }
+      if (instr.opID == eBRANCH_BRANCH) {
+        auto target = branchTarget(pc, instr);
+        region.labels.insert(target);
+        visit(target);
+      } else {
+        region.labels.insert(pc + 1);
+      }
+      visit(pc + 1);
+      break;
+    default:
+      // a suspended run resumes right at the instruction
+      if (instr.opType == eUNARY || instr.opType == eCHAN) {
+        region.labels.insert(pc);
+      }
+      visit(pc + 1);
+      break;
+    }
+  }
+
+  // blocks are emitted in pc order, a fallthrough across a gap needs a goto
+  for (auto it = region.pcs.begin(); it != region.pcs.end(); ++it) {
+    auto next = std::next(it);
+    if (next != region.pcs.end() && *next != *it + 1) {
+      region.labels.insert(*it + 1);
+    }
+  }
+  return region;
+}
+
+std::string regionName(Addr entry) {
+  return "region" + std::to_string(entry);
+}
+
+std::string label(Addr pc) {
+  return "L" + std::to_string(pc);
+}
+
+constexpr const char *kStatusCheck =
+    "  if (state.status != Interpreter::eRUNNING) {\n    return;\n  }\n";
+
+// Returns whether control falls through to pc + 1
+bool emitInstr(std::ostream &os, const std::vector<Instr> &instrs,
+               const std::set<Addr> &entries, Addr pc) {
+  const auto &instr = instrs[pc];
+  os << "  " << emitHandlerCall(instr) << '\n';
+
+  switch (instr.opType) {
+  case eHALT:
+    os << "  return;\n";
+    return false;
+  case eBRANCH:
+    os << kStatusCheck;
+    if (instr.opID == eBRANCH_BRANCH) {
+      auto target = branchTarget(pc, instr);
+      if (target < instrs.size()) {
+        os << "  if (state.rf.readPC() == " << target << ") {\n    goto "
+           << label(target) << ";\n  }\n";
+      }
+      break;
+    }
+    if (instr.opID == eBRANCH_CALL) {
+      // a memoized call or a false condition continues at pc + 1
+      auto target = branchTarget(pc, instr);
+      if (entries.contains(target)) {
+        os << "  if (state.rf.readPC() == " << target << ") {\n    "
+           << regionName(target) << "(state);\n  }\n" << kStatusCheck;
+      }
+      os << "  goto dispatch;\n";
+    } else if (instr.opID == eBRANCH_ICALL) {
+      os << "  callRegion(state, state.rf.readPC());\n"
+         << kStatusCheck << "  goto dispatch;\n";
+    } else {
+      os << "  return;\n";
+    }
+    return false;
+  default:
+    os << (isInfallible(instr) ? "" : kStatusCheck) << "  state.rf.incrementPC();\n";
+    break;
+  }
+
+  if (pc + 1 >= instrs.size()) {
+    os << "  goto dispatch;\n";
+    return false;
+  }
+  return true;
+}
+
+void emitRegion(std::ostream &os, const std::vector<Instr> &instrs,
+                const std::set<Addr> &entries, const Region &region) {
+  os << "void " << regionName(region.entry) << "(State &state) {\n"
+     << "dispatch:\n"
+     << "  switch (state.rf.readPC()) {\n";
+  for (auto pc : region.labels) {
+    if (region.pcs.contains(pc)) {
+      os << "  case " << pc << ":\n    goto " << label(pc) << ";\n";
+    }
+  }
+  os << "  default:\n    return;\n  }\n";
+
+  for (auto it = region.pcs.begin(); it != region.pcs.end(); ++it) {
+    auto pc = *it;
+    if (region.labels.contains(pc)) {
+      os << label(pc) << ":\n";
+    }
+    auto fallsThrough = emitInstr(os, instrs, entries, pc);
+
+    auto next = std::next(it);
+    if (fallsThrough && (next == region.pcs.end() || *next != pc + 1)) {
+      os << "  goto " << label(pc + 1) << ";\n";
+    }
+  }
+  os << "}\n\n";
+}
+
+} // namespace
+
+std::string emitAot(const std::vector<Instr> &instrs, const AotOptions &options) {
+  if (instrs.empty()) {
+    throw std::invalid_argument{"nothing to compile"};
+  }
+
+  auto entries = collectEntries(instrs);
+  std::vector<Region> regions{};
+  for (auto entry : entries) {
+    regions.push_back(collectRegion(instrs, entry));
+  }
+
+  std::ostringstream os{};
+  os << "// Generated by pvm-aot, do not edit\n\n"
+     << "#include <cstdint>\n#include <iostream>\n#include <stdexcept>\n"
+     << "#include <string>\n\n"
+     << "#include \"generated/handlers.hpp\"\n"
+     << "#include \"interpreter/aot.hpp\"\n\n"
+     << "namespace {\n\nusing namespace pvm;\nusing State = Interpreter::State;\n\n";
+
+  os << "constexpr std::uint32_t kWords[] = {";
+  auto words = encodeProgram(instrs);
+  for (std::size_t i = 0; i < words.size(); ++i) {
+    os << (i % 8 == 0 ? "\n   " : "") << ' ' << words[i] << "U,";
+  }
+  os << "\n};\n\n";
+
+  for (auto entry : entries) {
+    os << "void " << regionName(entry) << "(State &state);\n";
+  }
+
+  os << "\n[[maybe_unused]] void callRegion(State &state, Addr entry) {\n"
+     << "  switch (entry) {\n";
+  for (auto entry : entries) {
+    os << "  case " << entry << ":\n    " << regionName(entry)
+       << "(state);\n    return;\n";
+  }
+  os << "  default:\n    throw std::out_of_range{\"no compiled function at \" + "
+        "std::to_string(entry)};\n  }\n}\n\n";
+
+  for (const auto &region : regions) {
+    emitRegion(os, instrs, entries, region);
+  }
+
+  // resumes at any block of any region, that is how the runs continue after
+  // a suspension and how control gets back into a caller's region
+  std::map<Addr, Addr> owner{};
+  for (const auto &region : regions) {
+    for (auto pc : region.labels) {
+      if (region.pcs.contains(pc)) {
+        owner.emplace(pc, region.entry);
+      }
+    }
+  }
+  os << "void entry(State &state) {\n"
+     << "  while (state.status == Interpreter::eRUNNING) {\n"
+     << "    switch (state.rf.readPC()) {\n";
+  for (auto [pc, entry] : owner) {
+    os << "    case " << pc << ":\n      " << regionName(entry)
+       << "(state);\n      break;\n";
+  }
+  os << "    default:\n      throw std::out_of_range{\"no compiled code at pc \" + "
+        "std::to_string(state.rf.readPC())};\n    }\n  }\n}\n\n"
+     << "} // namespace\n\n"
+     << "extern \"C\" const pvm::AotProgram pvm_aot_program{\n"
+     << "    pvm::kAotAbi, kWords, sizeof(kWords) / sizeof(kWords[0]), &entry};\n";
+
+  if (!options.shared) {
+    os << "\nint main() {\n"
+       << "  try {\n"
+       << "    pvm::Interpreter interp{pvm::aotCode(pvm_aot_program)};\n"
+       << "    auto status = interp.run(pvm_aot_program);\n"
+       << "    if (status == pvm::Interpreter::eTRAPPED) {\n"
+       << "      std::cerr << pvm::Interpreter::describe(interp.getState().trap)"
+          " << std::endl;\n"
+       << "    }\n"
+       << "    return status == pvm::Interpreter::eHALTED ? 0 : 1;\n"
+       << "  } catch (const std::exception &e) {\n"
+       << "    std::cerr << e.what() << std::endl;\n"
+       << "    return 1;\n"
+       << "  }\n"
+       << "}\n";
+  }
+
+  return os.str();
+}
+
+void buildAot(const std::string &source, const std::string &output,
+              const AotOptions &options) {
+  std::vector<std::string> args{PVM_AOT_CXX, "-std=c++20", "-O2"};
+  std::istringstream includes{PVM_AOT_INCLUDE_DIRS};
+  for (std::string dir{}; std::getline(includes, dir, ':');) {
+    args.push_back("-I" + dir);
+  }
+  if (options.shared) {
+    args.insert(args.end(), {"-fPIC", "-shared"});
+  }
+  args.insert(args.end(), {source, "-o", output});
+  if (!options.shared) {
+    args.emplace_back("-Wl,--start-group");
+    std::istringstream libs{PVM_AOT_LIBS};
+    for (std::string lib{}; std::getline(libs, lib, ':');) {
+      args.push_back(lib);
+    }
+    args.insert(args.end(), {"-Wl,--end-group", "-ldl"});
+  }
+
+  std::vector<char *> argv{};
+  for (auto &arg : args) {
+    argv.push_back(arg.data());
+  }
+  argv.push_back(nullptr);
+
+  auto pid = ::fork();
+  if (pid < 0) {
+    throw std::system_error{errno, std::generic_category(), "cannot fork"};
+  }
+  if (pid == 0) {
+    ::execvp(argv[0], argv.data());
+    ::_exit(127);
+  }
+
+  int status = 0;
+  while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    throw std::runtime_error{"compiling " + source + " failed"};
+  }
+}
+
+} // namespace pvm
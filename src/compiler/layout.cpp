@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "compiler/layout.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/tracer.hpp"
+
+namespace pvm {
+
+namespace {
+
+// events of one slice have to fit in the ring, a slice overshoots its fuel
+// by at most one straight-line segment
+constexpr std::uint64_t kProfileSlice = 1U << 16U;
+
+const std::uint32_t *offsetField(const Instr &instr) {
+  if (instr.opType == eBRANCH &&
+      (instr.opID == eBRANCH_BRANCH || instr.opID == eBRANCH_CALL)) {
+    return &std::get<InstrBRANCH>(instr.instrVar).offset;
+  }
+  if (instr.opType == eFUNC && instr.opID == eFUNC_NEW) {
+    return &std::get<InstrFUNC>(instr.instrVar).offset;
+  }
+  return nullptr;
+}
+
+std::uint32_t *offsetField(Instr &instr) {
+  return const_cast<std::uint32_t *>(offsetField(std::as_const(instr)));
+}
+
+// The pc the instruction names, if any
+std::optional<Addr> staticTarget(Addr pc, const Instr &instr) {
+  const auto *offset = offsetField(instr);
+  if (offset == nullptr) {
+    return std::nullopt;
+  }
+  return pc + std::bit_cast<Addr>(*offset);
+}
+
+bool isTransfer(const Instr &instr) {
+  return instr.opType == eBRANCH;
+}
+
+bool fallsThrough(const Instr &instr) {
+  return instr.opType != eHALT && !(instr.opType == eBRANCH && instr.opID == eBRANCH_RET);
+}
+
+struct Chain final {
+  Addr begin;
+  Addr end;
+  std::uint64_t heat{};
+};
+
+void checkProfile(const std::vector<Instr> &instrs, const Profile &profile) {
+  if (profile.execs.size() != instrs.size() || profile.taken.size() != instrs.size()) {
+    throw std::invalid_argument{"profile was not taken from this code"};
+  }
+}
+
+} // namespace
+
+Profile profileRun(const std::vector<Instr> &instrs, std::istream &input) {
+  Profile profile{.execs = std::vector<std::uint64_t>(instrs.size()),
+                  .taken = std::vector<std::uint64_t>(instrs.size())};
+
+  Tracer tracer{kProfileSlice + 2 * instrs.size()};
+  std::ostringstream output{};
+  Interpreter interp{std::make_shared<const Code>(instrs), output, input};
+  interp.setTracer(&tracer);
+
+  std::uint64_t seen = 0;
+  Interpreter::Status status{};
+  do {
+    status = interp.run(kProfileSlice);
+
+    auto events = tracer.events();
+    auto fresh = tracer.recorded() - seen;
+    if (fresh > events.size()) {
+      throw std::runtime_error{"profiled slice overflowed the trace ring"};
+    }
+    for (auto it = events.end() - static_cast<std::ptrdiff_t>(fresh); it != events.end();
+         ++it) {
+      ++profile.execs[it->pc];
+      auto transfer = it->kind == eTRACE_BRANCH_TAKEN || it->kind == eTRACE_CALL ||
+                      it->kind == eTRACE_RET;
+      if (transfer && it->payload != it->pc + 1) {
+        ++profile.taken[it->pc];
+      }
+    }
+    seen = tracer.recorded();
+  } while (status == Interpreter::eOUT_OF_FUEL);
+
+  if (status == Interpreter::eTRAPPED) {
+    throw std::runtime_error{"profiled run trapped: " +
+                             Interpreter::describe(interp.getState().trap)};
+  }
+  if (status != Interpreter::eHALTED) {
+    throw std::runtime_error{"profiled run did not halt"};
+  }
+  return profile;
+}
+
+void saveProfile(const std::string &path, const Profile &profile) {
+  std::ofstream ofs{path, std::ios::binary | std::ios::trunc};
+  if (!ofs) {
+    throw std::runtime_error{"cannot open " + path};
+  }
+
+  ProfileHeader header{.magic = ProfileHeader::kMagic,
+                       .version = ProfileHeader::kVersion,
+                       .count = profile.execs.size()};
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  for (const auto *counts : {&profile.execs, &profile.taken}) {
+    ofs.write(reinterpret_cast<const char *>(counts->data()),
+              static_cast<std::streamsize>(header.count * sizeof(std::uint64_t)));
+  }
+  if (!ofs) {
+    throw std::runtime_error{"cannot write " + path};
+  }
+}
+
+Profile loadProfile(const std::string &path) {
+  std::ifstream ifs{path, std::ios::binary | std::ios::ate};
+  if (!ifs) {
+    throw std::runtime_error{"cannot open " + path};
+  }
+  auto size = static_cast<std::uint64_t>(ifs.tellg());
+  ifs.seekg(0);
+
+  ProfileHeader header{};
+  ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!ifs || header.magic != ProfileHeader::kMagic ||
+      header.version != ProfileHeader::kVersion) {
+    throw std::runtime_error{"not a pvm profile: " + path};
+  }
+  if (header.count > (size - sizeof(header)) / (2 * sizeof(std::uint64_t))) {
+    throw std::runtime_error{"truncated profile " + path};
+  }
+
+  Profile profile{.execs = std::vector<std::uint64_t>(header.count),
+                  .taken = std::vector<std::uint64_t>(header.count)};
+  for (auto *counts : {&profile.execs, &profile.taken}) {
+    ifs.read(reinterpret_cast<char *>(counts->data()),
+             static_cast<std::streamsize>(header.count * sizeof(std::uint64_t)));
+  }
+  if (!ifs) {
+    throw std::runtime_error{"truncated profile " + path};
+  }
+  return profile;
+}
+
+LayoutMetrics measureLayout(const std::vector<Instr> &instrs, const Profile &profile) {
+  checkProfile(instrs, profile);
+
+  auto line = [](Addr pc) { return pc * sizeof(Instr) / LayoutMetrics::kLineSize; };
+  std::set<std::size_t> lines{};
+  std::set<std::size_t> pages{};
+  LayoutMetrics metrics{};
+  std::uint64_t jumps = 0;
+  double distance = 0;
+
+  for (Addr pc = 0; pc < instrs.size(); ++pc) {
+    auto execs = profile.execs[pc];
+    if (execs == 0) {
+      continue;
+    }
+    lines.insert(line(pc));
+    pages.insert(pc * sizeof(Instr) / LayoutMetrics::kPageSize);
+
+    auto taken = std::min(profile.taken[pc], execs);
+    if (fallsThrough(instrs[pc]) && line(pc + 1) != line(pc)) {
+      metrics.lineSwitches += execs - taken;
+    }
+    auto target = staticTarget(pc, instrs[pc]);
+    if (target && isTransfer(instrs[pc]) && taken != 0) {
+      metrics.lineSwitches += line(*target) != line(pc) ? taken : 0;
+      jumps += taken;
+      auto span = *target > pc ? *target - pc : pc - *target;
+      distance += static_cast<double>(taken) * static_cast<double>(span);
+    }
+  }
+
+  metrics.hotLines = lines.size();
+  metrics.hotPages = pages.size();
+  metrics.jumpDistance = jumps == 0 ? 0 : distance / static_cast<double>(jumps);
+  return metrics;
+}
+
+Layout layoutHotCold(const std::vector<Instr> &instrs, const Profile &profile) {
+  checkProfile(instrs, profile);
+  if (instrs.empty()) {
+    return Layout{};
+  }
+
+  std::vector<Chain> chains{};
+  std::vector<std::size_t> chainOf(instrs.size());
+  for (Addr pc = 0; pc < instrs.size(); ++pc) {
+    if (pc == 0 || !fallsThrough(instrs[pc - 1])) {
+      chains.push_back(Chain{.begin = pc, .end = pc});
+    }
+    auto &chain = chains.back();
+    chain.end = pc + 1;
+    chain.heat += profile.execs[pc];
+    chainOf[pc] = chains.size() - 1;
+
+    auto target = staticTarget(pc, instrs[pc]);
+    if (target && *target >= instrs.size()) {
+      throw std::invalid_argument{"target of pc " + std::to_string(pc) +
+                                  " is outside of the code"};
+    }
+  }
+
+  // transfers between chains, in both directions
+  std::vector<std::map<std::size_t, std::uint64_t>> weight(chains.size());
+  for (Addr pc = 0; pc < instrs.size(); ++pc) {
+    auto target = staticTarget(pc, instrs[pc]);
+    if (target && isTransfer(instrs[pc])) {
+      auto from = chainOf[pc];
+      auto to = chainOf[*target];
+      weight[from][to] += profile.taken[pc];
+      weight[to][from] += profile.taken[pc];
+    }
+  }
+
+  // a chain that runs off the end of the code must stay last, chains.size()
+  // when there is none
+  auto open = fallsThrough(instrs.back()) ? chains.size() - 1 : chains.size();
+
+  std::vector<std::size_t> order{0};
+  std::vector<bool> placed(chains.size());
+  placed[0] = true;
+  std::vector<std::uint64_t> affinity(chains.size());
+  for (auto [c, w] : weight[0]) {
+    affinity[c] += w;
+  }
+  for (;;) {
+    std::optional<std::size_t> best{};
+    for (std::size_t c = 0; c < chains.size(); ++c) {
+      if (placed[c] || c == open || chains[c].heat == 0) {
+        continue;
+      }
+      if (!best || affinity[c] > affinity[*best] ||
+          (affinity[c] == affinity[*best] && chains[c].heat > chains[*best].heat)) {
+        best = c;
+      }
+    }
+    if (!best) {
+      break;
+    }
+    order.push_back(*best);
+    placed[*best] = true;
+    for (auto [c, w] : weight[*best]) {
+      affinity[c] += w;
+    }
+  }
+  for (std::size_t c = 0; c < chains.size(); ++c) {
+    if (!placed[c] && c != open) {
+      order.push_back(c);
+      placed[c] = true;
+    }
+  }
+  if (open < chains.size()) {
+    order.push_back(open);
+  }
+
+  std::vector<Addr> newPc(instrs.size());
+  Addr next = 0;
+  for (auto c : order) {
+    for (auto pc = chains[c].begin; pc < chains[c].end; ++pc) {
+      newPc[pc] = next++;
+    }
+  }
+
+  // every element is overwritten below, copying just sizes the vector
+  Layout layout{.instrs = instrs,
+                .profile = Profile{.execs = std::vector<std::uint64_t>(instrs.size()),
+                                   .taken = std::vector<std::uint64_t>(instrs.size())}};
+  for (Addr pc = 0; pc < instrs.size(); ++pc) {
+    auto instr = instrs[pc];
+    if (auto target = staticTarget(pc, instr)) {
+      *offsetField(instr) = newPc[*target] - newPc[pc];
+    }
+    layout.instrs[newPc[pc]] = instr;
+    layout.profile.execs[newPc[pc]] = profile.execs[pc];
+    layout.profile.taken[newPc[pc]] = profile.taken[pc];
+  }
+  return layout;
+}
+
+} // namespace pvm
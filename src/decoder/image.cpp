@@ -0,0 +1,85 @@
+#include <fstream>
+#include <stdexcept>
+
+#include "decoder/decoder.hpp"
+#include "decoder/encoder.hpp"
+#include "decoder/image.hpp"
+#include "generated/bytecode.hpp"
+
+namespace pvm {
+
+std::uint32_t Encoder::encode(const Instr &instr) {
+  return encodeWord(instr);
+}
+
+std::vector<std::uint32_t> encodeProgram(const std::vector<Instr> &instrs) {
+  Encoder enc{};
+  std::vector<std::uint32_t> words{};
+  words.reserve(instrs.size());
+  for (const auto &instr : instrs) {
+    words.push_back(enc.encode(instr));
+  }
+  return words;
+}
+
+std::vector<Instr> decodeProgram(const std::vector<std::uint32_t> &words) {
+  Decoder dec{};
+  std::vector<Instr> instrs{};
+  instrs.reserve(words.size());
+  for (auto word : words) {
+    instrs.push_back(dec.decode(word));
+  }
+  return instrs;
+}
+
+void saveImage(const std::string &path, const std::vector<Instr> &instrs) {
+  auto words = encodeProgram(instrs);
+
+  std::ofstream ofs{path, std::ios::binary | std::ios::trunc};
+  if (!ofs) {
+    throw std::runtime_error{"cannot open " + path};
+  }
+
+  ImageHeader header{.magic = ImageHeader::kMagic,
+                     .version = ImageHeader::kVersion,
+                     .count = words.size()};
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  ofs.write(reinterpret_cast<const char *>(words.data()),
+            static_cast<std::streamsize>(words.size() * sizeof(std::uint32_t)));
+  if (!ofs) {
+    throw std::runtime_error{"cannot write " + path};
+  }
+}
+
+std::vector<Instr> loadImage(const std::string &path) {
+  return decodeProgram(loadImageWords(path));
+}
+
+std::vector<std::uint32_t> loadImageWords(const std::string &path) {
+  std::ifstream ifs{path, std::ios::binary | std::ios::ate};
+  if (!ifs) {
+    throw std::runtime_error{"cannot open " + path};
+  }
+  auto size = static_cast<std::uint64_t>(ifs.tellg());
+  ifs.seekg(0);
+
+  ImageHeader header{};
+  ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+  if (!ifs || header.magic != ImageHeader::kMagic ||
+      header.version != ImageHeader::kVersion) {
+    throw std::runtime_error{"not a pvm image: " + path};
+  }
+  if (header.count > (size - sizeof(header)) / sizeof(std::uint32_t)) {
+    throw std::runtime_error{"truncated image " + path};
+  }
+
+  std::vector<std::uint32_t> words(header.count);
+  ifs.read(reinterpret_cast<char *>(words.data()),
+           static_cast<std::streamsize>(words.size() * sizeof(std::uint32_t)));
+  if (!ifs) {
+    throw std::runtime_error{"truncated image " + path};
+  }
+  return words;
+}
+
+} // namespace pvm
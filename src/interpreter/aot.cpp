@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+
+#include "decoder/encoder.hpp"
+#include "decoder/image.hpp"
+#include "interpreter/aot.hpp"
+
+namespace pvm {
+
+namespace {
+
+bool sameCode(const AotProgram &program, const Code &code) {
+  if (program.size != code.size()) {
+    return false;
+  }
+  Encoder enc{};
+  auto instrs = code.data();
+  for (std::size_t pc = 0; pc < instrs.size(); ++pc) {
+    if (enc.encode(instrs[pc]) != program.words[pc]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+CodePtr aotCode(const AotProgram &program) {
+  std::vector<std::uint32_t> words(program.words, program.words + program.size);
+  return std::make_shared<const Code>(decodeProgram(words));
+}
+
+AotLibrary::AotLibrary(const std::string &path)
+    : m_handle{::dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL)} {
+  if (m_handle == nullptr) {
+    throw std::runtime_error{"cannot load " + path + ": " + ::dlerror()};
+  }
+
+  m_program = static_cast<const AotProgram *>(::dlsym(m_handle, kAotSymbol));
+  if (m_program == nullptr || m_program->abi != kAotAbi) {
+    ::dlclose(m_handle);
+    throw std::runtime_error{"not a compiled pvm program: " + path};
+  }
+}
+
+AotLibrary::~AotLibrary() {
+  ::dlclose(m_handle);
+}
+
+const AotProgram &AotLibrary::program() const noexcept {
+  return *m_program;
+}
+
+// Compares the words `program` was compiled from with the code re-encoded,
+// the same length alone lets another program run against this state
+Interpreter::Status Interpreter::run(const AotProgram &program, std::uint64_t budget) {
+  if (&program != m_aotMatch) {
+    if (program.abi != kAotAbi || !sameCode(program, *m_state.code)) {
+      throw std::runtime_error{"compiled program does not match the code"};
+    }
+    m_aotMatch = &program;
+  }
+  if (m_state.status == eHALTED || m_state.status == eTRAPPED) {
+    return m_state.status;
+  }
+
+  m_state.status = eRUNNING;
+  m_state.fuel = static_cast<std::int64_t>(std::min(budget, kUnlimitedFuel));
+  m_state.segment = m_state.rf.readPC();
+
+  MemoryFaultScope faults{m_state.mem};
+  if (sigsetjmp(faults.env(), 0) != 0) {
+    m_state.status = eTRAPPED;
+    m_state.trap = {.kind = eTRAP_MEMORY_FAULT, .pc = m_state.rf.readPC()};
+    return eTRAPPED;
+  }
+
+  try {
+    program.entry(m_state);
+  } catch (const ArenaLimitError &) {
+    return outOfMemory();
+  }
+  return m_state.status;
+}
+
+} // namespace pvm
@@ -0,0 +1,432 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <typeinfo>
+
+#include <float16_t/float16_t.hpp>
+
+#include "common/value.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/batch.hpp"
+
+namespace pvm {
+
+namespace {
+
+using Mask = BatchInterpreter::Mask;
+constexpr std::size_t kLanes = BatchInterpreter::kLanes;
+using LaneBits = std::array<std::uint32_t, kLanes>;
+
+enum LaneTag : std::uint8_t {
+  eLANE_NULL,
+  eLANE_BOOL,
+  eLANE_INT,
+  eLANE_FLOAT,
+};
+
+constexpr std::uint32_t kInt = 1;
+constexpr std::uint32_t kFloat = 2;
+
+bool supported(const Instr &instr) {
+  switch (instr.opType) {
+  case eHALT:
+  case eUNARY:
+  case eBINARY:
+  case eREG:
+    return true;
+  case eIMM:
+    return instr.opID != eIMM_ARRAY;
+  case eBRANCH:
+    return instr.opID == eBRANCH_BRANCH;
+  default:
+    return false;
+  }
+}
+
+std::uint32_t floatImmBits(std::uint32_t data) {
+  std::uint16_t raw = 0;
+  std::memcpy(&raw, &data, sizeof(raw));
+  return std::bit_cast<std::uint32_t>(static_cast<Float>(numeric::float16_t{raw}));
+}
+
+template <typename Lanes>
+void check(const Lanes &reg, Mask active, LaneTag tag, const std::type_info &type) {
+  Mask bad = 0;
+  for (std::size_t lane = 0; lane < kLanes; ++lane) {
+    bad |= static_cast<Mask>(reg.tags[lane] != tag) << lane;
+  }
+  if ((bad & active) != 0) {
+    throw ValueMismatchError(type, type);
+  }
+}
+
+template <typename Lanes>
+void blend(Lanes &dst, const LaneBits &res, LaneTag tag, Mask active) {
+  for (std::size_t lane = 0; lane < kLanes; ++lane) {
+    bool on = ((active >> lane) & 1U) != 0;
+    dst.bits[lane] = on ? res[lane] : dst.bits[lane];
+    dst.tags[lane] = on ? static_cast<std::uint8_t>(tag) : dst.tags[lane];
+  }
+}
+
+template <typename T>
+LaneTag tagOf() {
+  if constexpr (std::is_same_v<T, Int>) {
+    return eLANE_INT;
+  } else if constexpr (std::is_same_v<T, Float>) {
+    return eLANE_FLOAT;
+  } else {
+    return eLANE_BOOL;
+  }
+}
+
+template <typename T>
+std::uint32_t toBits(T val) {
+  if constexpr (std::is_same_v<T, bool>) {
+    return val ? 1U : 0U;
+  } else {
+    return std::bit_cast<std::uint32_t>(val);
+  }
+}
+
+// Every lane is computed and the inactive ones are masked out when blending,
+// so F must not trap on whatever the inactive lanes hold
+template <typename In, typename Lanes, typename F>
+void binaryKernel(Lanes &dst, const Lanes &lhs, const Lanes &rhs, Mask active, F f) {
+  check(lhs, active, tagOf<In>(), typeid(In));
+  check(rhs, active, tagOf<In>(), typeid(In));
+
+  using Out = decltype(f(In{}, In{}));
+  LaneBits res{};
+  for (std::size_t lane = 0; lane < kLanes; ++lane) {
+    res[lane] =
+        toBits(f(std::bit_cast<In>(lhs.bits[lane]), std::bit_cast<In>(rhs.bits[lane])));
+  }
+  blend(dst, res, tagOf<Out>(), active);
+}
+
+template <typename In, typename Lanes, typename F>
+void unaryKernel(Lanes &dst, const Lanes &src, Mask active, F f) {
+  check(src, active, tagOf<In>(), typeid(In));
+
+  LaneBits res{};
+  for (std::size_t lane = 0; lane < kLanes; ++lane) {
+    res[lane] = toBits(f(std::bit_cast<In>(src.bits[lane])));
+  }
+  blend(dst, res, tagOf<In>(), active);
+}
+
+// A zero divisor or INT_MIN / -1 in an active lane traps, as it does in the
+// scalar interpreter
+template <typename Lanes>
+bool divisorsFault(const Lanes &lhs, const Lanes &rhs, Mask active) {
+  Mask bad = 0;
+  for (std::size_t lane = 0; lane < kLanes; ++lane) {
+    auto num = std::bit_cast<Int>(lhs.bits[lane]);
+    auto den = std::bit_cast<Int>(rhs.bits[lane]);
+    bool fault = den == 0 || (den == -1 && num == std::numeric_limits<Int>::min());
+    bad |= static_cast<Mask>(fault) << lane;
+  }
+  return (bad & active) != 0;
+}
+
+// signed overflow wraps as it does on the hardware instead of being UB
+template <typename Op>
+struct Wrapping final {
+  Int operator()(Int lhs, Int rhs) const {
+    return std::bit_cast<Int>(
+        Op{}(std::bit_cast<std::uint32_t>(lhs), std::bit_cast<std::uint32_t>(rhs)));
+  }
+};
+
+template <typename Lanes, typename IntOp, typename FloatOp>
+void arithmetic(Lanes &dst, const Lanes &lhs, const Lanes &rhs, Mask active,
+                std::uint32_t ttypeid, IntOp intOp, FloatOp floatOp) {
+  switch (ttypeid) {
+  case kInt:
+    binaryKernel<Int>(dst, lhs, rhs, active, intOp);
+    break;
+  case kFloat:
+    binaryKernel<Float>(dst, lhs, rhs, active, floatOp);
+    break;
+  default:
+    throw std::runtime_error{"unknown ttypeid for bin instr"};
+  }
+}
+
+template <typename F>
+void forEachLane(Mask mask, F f) {
+  while (mask != 0) {
+    f(static_cast<std::size_t>(std::countr_zero(mask)));
+    mask &= mask - 1;
+  }
+}
+
+} // namespace
+
+BatchTrapError::BatchTrapError(const Interpreter::Trap &raised)
+    : std::runtime_error(Interpreter::describe(raised)), trap(raised) {
+}
+
+BatchInterpreter::BatchInterpreter(CodePtr code)
+    : m_code(std::move(code)), m_regs(kRegistersCount) {
+  m_ops.reserve(m_code->size());
+  for (Addr pc = 0; pc < m_code->size(); ++pc) {
+    auto instr = m_code->loadInstr(pc);
+    if (!supported(instr)) {
+      throw std::runtime_error{std::string{opName(instr.opType, instr.opID)} + " at pc " +
+                               std::to_string(pc) + " is not supported in batch mode"};
+    }
+
+    Op op{.type = instr.opType,
+          .id = instr.opID,
+          .ttypeid = 0,
+          .reg1 = 0,
+          .reg2 = 0,
+          .imm = 0};
+    std::visit(
+        [&](const auto &var) {
+          using T = std::decay_t<decltype(var)>;
+          if constexpr (std::is_same_v<T, InstrUNARY>) {
+            op.ttypeid = var.ttypeid;
+            op.reg1 = static_cast<RegId>(var.regid);
+          } else if constexpr (std::is_same_v<T, InstrBINARY>) {
+            op.ttypeid = var.ttypeid;
+            op.reg1 = static_cast<RegId>(var.regid1);
+            op.reg2 = static_cast<RegId>(var.regid2);
+          } else if constexpr (std::is_same_v<T, InstrREG>) {
+            op.reg1 = static_cast<RegId>(var.regid);
+          } else if constexpr (std::is_same_v<T, InstrIMM>) {
+            op.imm = instr.opID == eIMM_FLOATING ? floatImmBits(var.data)
+                                                 : static_cast<std::uint32_t>(var.data);
+          } else if constexpr (std::is_same_v<T, InstrBRANCH>) {
+            op.reg1 = static_cast<RegId>(var.regid);
+            op.imm = std::bit_cast<std::uint32_t>(var.offset);
+          }
+        },
+        instr.instrVar);
+    m_ops.push_back(op);
+  }
+}
+
+std::vector<std::string> BatchInterpreter::run(const std::vector<std::string> &inputs) {
+  std::vector<std::string> outputs(inputs.size());
+  for (std::size_t first = 0; first < inputs.size(); first += kLanes) {
+    auto count = std::min(kLanes, inputs.size() - first);
+    runGroup(inputs.data() + first, outputs.data() + first, count);
+  }
+  return outputs;
+}
+
+const BatchStats &BatchInterpreter::stats() const noexcept {
+  return m_stats;
+}
+
+void BatchInterpreter::runGroup(const std::string *inputs, std::string *outputs,
+                                std::size_t count) {
+  for (auto &reg : m_regs) {
+    reg.tags.fill(eLANE_NULL);
+  }
+  for (std::size_t lane = 0; lane < count; ++lane) {
+    m_in[lane].clear();
+    m_in[lane].str(inputs[lane]);
+    m_out[lane].str({});
+  }
+  ++m_stats.groups;
+
+  Mask live = count == kLanes ? ~Mask{0} : (Mask{1} << count) - 1;
+  Mask active = live;
+  Addr pc = 0;
+
+  while (live != 0) {
+    if (pc >= m_ops.size()) {
+      throw std::out_of_range{"pc " + std::to_string(pc) + " is outside of the code"};
+    }
+    const auto &op = m_ops[pc];
+    ++m_stats.steps;
+    m_stats.laneSteps += static_cast<std::uint64_t>(std::popcount(active));
+
+    Addr next = pc + 1;
+    if (op.type == eHALT) {
+      live &= ~active;
+      active = 0;
+    } else if (op.type == eBRANCH) {
+      auto target = pc + op.imm;
+      auto taken = branchTaken(op, active);
+      if (taken == active) {
+        next = target;
+      } else if (taken != 0) {
+        forEachLane(taken, [&](std::size_t lane) { m_lanePc[lane] = target; });
+        forEachLane(active & ~taken, [&](std::size_t lane) { m_lanePc[lane] = next; });
+        active = 0;
+      }
+    } else {
+      execute(op, pc, active);
+    }
+
+    if (active == live) [[likely]] {
+      pc = next;
+      continue;
+    }
+
+    // diverged: park the group and resume the lanes with the lowest pc,
+    // lanes waiting there join them
+    forEachLane(active, [&](std::size_t lane) { m_lanePc[lane] = next; });
+    pc = std::numeric_limits<Addr>::max();
+    forEachLane(live, [&](std::size_t lane) { pc = std::min(pc, m_lanePc[lane]); });
+    active = 0;
+    forEachLane(live, [&](std::size_t lane) {
+      active |= static_cast<Mask>(m_lanePc[lane] == pc) << lane;
+    });
+  }
+
+  for (std::size_t lane = 0; lane < count; ++lane) {
+    outputs[lane] = m_out[lane].str();
+  }
+}
+
+BatchInterpreter::Mask BatchInterpreter::branchTaken(const Op &op, Mask active) const {
+  const auto &cond = m_regs[op.reg1];
+  check(cond, active, eLANE_BOOL, typeid(Bool));
+
+  Mask taken = 0;
+  for (std::size_t lane = 0; lane < kLanes; ++lane) {
+    taken |= static_cast<Mask>(cond.bits[lane] != 0) << lane;
+  }
+  return taken & active;
+}
+
+void BatchInterpreter::execute(const Op &op, Addr pc, Mask active) {
+  auto &acc = m_regs[0];
+
+  switch (op.type) {
+  case eIMM: {
+    LaneBits res{};
+    res.fill(op.imm);
+    blend(acc, res, op.id == eIMM_FLOATING ? eLANE_FLOAT : eLANE_INT, active);
+    break;
+  }
+  case eREG: {
+    auto &dst = m_regs[op.reg1];
+    for (std::size_t lane = 0; lane < kLanes; ++lane) {
+      bool on = ((active >> lane) & 1U) != 0;
+      dst.bits[lane] = on ? acc.bits[lane] : dst.bits[lane];
+      dst.tags[lane] = on ? acc.tags[lane] : dst.tags[lane];
+    }
+    break;
+  }
+  case eBINARY: {
+    const auto &lhs = m_regs[op.reg1];
+    const auto &rhs = m_regs[op.reg2];
+    switch (op.id) {
+    case eBINARY_ADD:
+      arithmetic(acc, lhs, rhs, active, op.ttypeid, Wrapping<std::plus<>>{},
+                 std::plus<Float>{});
+      break;
+    case eBINARY_SUB:
+      arithmetic(acc, lhs, rhs, active, op.ttypeid, Wrapping<std::minus<>>{},
+                 std::minus<Float>{});
+      break;
+    case eBINARY_MUL:
+      arithmetic(acc, lhs, rhs, active, op.ttypeid, Wrapping<std::multiplies<>>{},
+                 std::multiplies<Float>{});
+      break;
+    case eBINARY_DIV: {
+      if (op.ttypeid == kInt) {
+        check(lhs, active, eLANE_INT, typeid(Int));
+        check(rhs, active, eLANE_INT, typeid(Int));
+        if (divisorsFault(lhs, rhs, active)) {
+          throw BatchTrapError{
+              {.kind = Interpreter::eTRAP_DIVISION, .pc = pc, .operand = op.reg2}};
+        }
+      }
+      // only inactive lanes get here with a zero or INT_MIN / -1
+      auto safeDiv = [](Int num, Int den) {
+        return den == 0 || (den == -1 && num == std::numeric_limits<Int>::min())
+                   ? num
+                   : num / den;
+      };
+      arithmetic(acc, lhs, rhs, active, op.ttypeid, safeDiv, std::divides<Float>{});
+      break;
+    }
+    case eBINARY_LESS:
+      arithmetic(acc, lhs, rhs, active, op.ttypeid, std::less<Int>{}, std::less<Float>{});
+      break;
+    case eBINARY_EQUAL:
+      arithmetic(acc, lhs, rhs, active, op.ttypeid, std::equal_to<Int>{},
+                 std::equal_to<Float>{});
+      break;
+    default:
+      throw std::runtime_error{"unknown binary instruction"};
+    }
+    break;
+  }
+  case eUNARY: {
+    const auto &src = m_regs[op.reg1];
+    switch (op.id) {
+    case eUNARY_ABS:
+      if (op.ttypeid == kInt) {
+        unaryKernel<Int>(acc, src, active, [](Int val) {
+          auto bits = std::bit_cast<std::uint32_t>(val);
+          return std::bit_cast<Int>(val < 0 ? 0U - bits : bits);
+        });
+      } else if (op.ttypeid == kFloat) {
+        unaryKernel<Float>(acc, src, active, [](Float val) { return std::fabs(val); });
+      } else {
+        throw std::runtime_error{"unknown type id in abs instruction"};
+      }
+      break;
+    case eUNARY_SQRT:
+      if (op.ttypeid != kFloat) {
+        throw std::runtime_error{"unknown type id in sqrt instruction"};
+      }
+      unaryKernel<Float>(acc, src, active, [](Float val) { return std::sqrt(val); });
+      break;
+    case eUNARY_READ:
+      if (op.ttypeid != kInt && op.ttypeid != kFloat) {
+        throw std::runtime_error{"unknown type id in read instruction"};
+      }
+      forEachLane(active, [&](std::size_t lane) {
+        if (op.ttypeid == kInt) {
+          Int tmp{};
+          m_in[lane] >> tmp;
+          acc.bits[lane] = std::bit_cast<std::uint32_t>(tmp);
+          acc.tags[lane] = eLANE_INT;
+        } else {
+          Float tmp{};
+          m_in[lane] >> tmp;
+          acc.bits[lane] = std::bit_cast<std::uint32_t>(tmp);
+          acc.tags[lane] = eLANE_FLOAT;
+        }
+      });
+      break;
+    case eUNARY_WRITE:
+      if (op.ttypeid == kInt) {
+        check(src, active, eLANE_INT, typeid(Int));
+        forEachLane(active, [&](std::size_t lane) {
+          m_out[lane] << std::bit_cast<Int>(src.bits[lane]) << '\n';
+        });
+      } else if (op.ttypeid == kFloat) {
+        check(src, active, eLANE_FLOAT, typeid(Float));
+        forEachLane(active, [&](std::size_t lane) {
+          m_out[lane] << std::bit_cast<Float>(src.bits[lane]) << '\n';
+        });
+      } else {
+        throw std::runtime_error{"unknown type id in write instruction"};
+      }
+      break;
+    default:
+      throw std::runtime_error{"unknown unary instruction"};
+    }
+    break;
+  }
+  default:
+    throw std::runtime_error{"unknown instruction in batch mode"};
+  }
+}
+
+} // namespace pvm
@@ -0,0 +1,149 @@
+#include <atomic>
+#include <stdexcept>
+
+#include "interpreter/channel.hpp"
+
+namespace pvm {
+
+namespace {
+
+std::variant<SpscQueue<Value>, MpscQueue<Value>> makeQueue(Channel::Kind kind,
+                                                           std::size_t capacity) {
+  if (kind == Channel::eSPSC) {
+    return std::variant<SpscQueue<Value>, MpscQueue<Value>>{
+        std::in_place_type<SpscQueue<Value>>, capacity};
+  }
+  return std::variant<SpscQueue<Value>, MpscQueue<Value>>{
+      std::in_place_type<MpscQueue<Value>>, capacity};
+}
+
+} // namespace
+
+Channel::Channel(Kind kind, std::size_t capacity)
+    : m_queue(makeQueue(kind, capacity)), m_kind(kind) {
+}
+
+// The fences pair with the one in parkUntil(): either the waiter sees the
+// new state of the queue or we see its flag
+bool Channel::trySend(Value &val) {
+  auto sent = std::visit([&val](auto &queue) { return queue.tryPush(val); }, m_queue);
+  if (sent) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiting[eRECV].load(std::memory_order_relaxed)) {
+      wake(eRECV);
+    }
+  }
+  return sent;
+}
+
+bool Channel::tryRecv(Value &out) {
+  auto received = std::visit([&out](auto &queue) { return queue.tryPop(out); }, m_queue);
+  if (received) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_waiting[eSEND].load(std::memory_order_relaxed)) {
+      wake(eSEND);
+    }
+  }
+  return received;
+}
+
+bool Channel::parkUntil(Op op, const void *owner, Wake wake) {
+  std::lock_guard lock{m_waitMutex};
+  m_waiting[op].store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (ready(op)) {
+    m_waiting[op].store(!m_waiters[op].empty(), std::memory_order_relaxed);
+    return false;
+  }
+
+  m_waiters[op].emplace_back(owner, std::move(wake));
+  return true;
+}
+
+void Channel::cancel(const void *owner) {
+  std::lock_guard lock{m_waitMutex};
+  for (std::size_t op = 0; op < m_waiters.size(); ++op) {
+    std::erase_if(m_waiters[op],
+                  [owner](const auto &waiter) { return waiter.first == owner; });
+    m_waiting[op].store(!m_waiters[op].empty(), std::memory_order_relaxed);
+  }
+}
+
+void Channel::wake(Op op) {
+  std::vector<std::pair<const void *, Wake>> waiters{};
+  {
+    std::lock_guard lock{m_waitMutex};
+    waiters.swap(m_waiters[op]);
+    m_waiting[op].store(false, std::memory_order_relaxed);
+  }
+  // outside of the lock, a wake may well send or receive on this channel
+  for (auto &waiter : waiters) {
+    waiter.second();
+  }
+}
+
+bool Channel::ready(Op op) const {
+  return std::visit(
+      [op](const auto &queue) { return op == eSEND ? !queue.full() : !queue.empty(); },
+      m_queue);
+}
+
+Channel::Kind Channel::kind() const noexcept {
+  return m_kind;
+}
+
+std::size_t Channel::capacity() const noexcept {
+  return std::visit([](const auto &queue) { return queue.capacity(); }, m_queue);
+}
+
+std::pmr::memory_resource *Channel::arrays() {
+  // never destroyed, arrays may still be alive during static destruction
+  static auto *pool = new std::pmr::synchronized_pool_resource{};
+  return pool;
+}
+
+Value Channel::transferable(Value &&val, std::pmr::memory_resource *resource) {
+  if (val.holds<Object>() || val.holds<Function>() || val.holds<Dict>()) {
+    throw std::runtime_error{
+        "objects, functions and dicts cannot be sent over a channel"};
+  }
+  // a fresh node, string nodes are not synchronized
+  if (const auto *str = val.tryView<String>(); str != nullptr) {
+    return Value{String{str->view(), resource}};
+  }
+  if (!val.holds<Array>()) {
+    return std::move(val);
+  }
+
+  // an array from `resource` keeps its storage, its elements are still walked
+  auto arr = std::move(val).take<Array>();
+  if (arr.resource() != resource) {
+    Array moved{arr.size(), resource};
+    for (Int i = 0; i < arr.size(); ++i) {
+      moved.at(i) = std::move(arr.at(i));
+    }
+    arr = std::move(moved);
+  }
+  for (Int i = 0; i < arr.size(); ++i) {
+    arr.at(i) = transferable(std::move(arr.at(i)), resource);
+  }
+  return Value{std::move(arr)};
+}
+
+bool Channel::canTransfer(const Value &val) noexcept {
+  if (val.holds<Object>() || val.holds<Function>() || val.holds<Dict>()) {
+    return false;
+  }
+  const auto *arr = val.tryView<Array>();
+  if (arr == nullptr) {
+    return true;
+  }
+  for (Int i = 0; i < arr->size(); ++i) {
+    if (!canTransfer(arr->at(i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace pvm
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <memory>
+#include <span>
+#include <sstream>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/io.hpp"
+#include "decoder/image.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/code-cache.hpp"
+#include "interpreter/verifier.hpp"
+
+namespace pvm {
+
+namespace {
+
+constexpr std::string_view kEntryExtension = ".pvmc";
+
+std::uint64_t hashBytes(std::uint64_t hash, const void *data, std::size_t size) {
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  for (std::size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+constexpr std::uint64_t kFnvOffset = 0xcbf29ce484222325ULL;
+
+const std::uint64_t kBuildId = [] {
+  std::string_view id{PVM_BUILD_ID};
+  return hashBytes(kFnvOffset, id.data(), id.size());
+}();
+
+std::size_t instrsOffset(std::uint64_t count) {
+  auto offset = sizeof(CodeCacheHeader) + count * sizeof(std::uint32_t);
+  return (offset + alignof(Instr) - 1) / alignof(Instr) * alignof(Instr);
+}
+
+std::size_t entrySize(std::uint64_t count) {
+  return instrsOffset(count) + count * sizeof(Instr);
+}
+
+// Flags decide whether the code runs unchecked, so they are covered as
+// well as the instructions
+std::uint64_t checksum(CodeCacheHeader header, std::span<const Instr> instrs) {
+  header.checksum = 0;
+  auto hash = hashBytes(kFnvOffset, &header, sizeof(header));
+  return hashBytes(hash, instrs.data(), instrs.size_bytes());
+}
+
+
+} // namespace
+
+CodeCache::CodeCache(std::filesystem::path dir, std::uint64_t capacity)
+    : m_dir{std::move(dir)}, m_capacity{capacity} {
+  std::filesystem::create_directories(m_dir);
+}
+
+CodePtr CodeCache::load(const std::string &imagePath) {
+  return load(loadImageWords(imagePath));
+}
+
+CodePtr CodeCache::load(const std::vector<std::uint32_t> &words) {
+  auto path = entryPath(words);
+  if (auto code = map(path, words)) {
+    ++m_stats.hits;
+    std::error_code ec{};
+    std::filesystem::last_write_time(
+        path, std::filesystem::file_time_type::clock::now(), ec);
+    return code;
+  }
+  ++m_stats.misses;
+
+  auto decoded = std::make_shared<const std::vector<Instr>>(decodeProgram(words));
+  auto verified = verify(Code{decoded, *decoded}).ok;
+  auto code = std::make_shared<const Code>(decoded, *decoded, verified);
+  store(path, words, *code);
+  trim();
+  return code;
+}
+
+const std::filesystem::path &CodeCache::dir() const noexcept {
+  return m_dir;
+}
+
+const CodeCacheStats &CodeCache::stats() const noexcept {
+  return m_stats;
+}
+
+void CodeCache::trim() {
+  struct Entry final {
+    std::filesystem::path path;
+    std::uintmax_t size;
+    std::filesystem::file_time_type used;
+  };
+
+  std::vector<Entry> entries{};
+  std::uintmax_t total = 0;
+  std::error_code ec{};
+  for (const auto &file : std::filesystem::directory_iterator{m_dir, ec}) {
+    if (file.path().extension() != kEntryExtension) {
+      continue;
+    }
+    std::error_code sizeError{};
+    auto size = file.file_size(sizeError);
+    auto used = file.last_write_time(ec);
+    if (!sizeError && !ec) {
+      entries.push_back(Entry{.path = file.path(), .size = size, .used = used});
+      total += size;
+    }
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &lhs, const Entry &rhs) { return lhs.used < rhs.used; });
+  for (const auto &entry : entries) {
+    if (total <= m_capacity) {
+      break;
+    }
+    // another process may have evicted it first
+    if (std::filesystem::remove(entry.path, ec)) {
+      ++m_stats.evictions;
+    }
+    total -= entry.size;
+  }
+}
+
+std::filesystem::path
+CodeCache::entryPath(const std::vector<std::uint32_t> &words) const {
+  auto key = hashBytes(kBuildId, words.data(), words.size() * sizeof(std::uint32_t));
+  std::ostringstream name{};
+  name << std::hex << std::setw(16) << std::setfill('0') << key << kEntryExtension;
+  return m_dir / name.str();
+}
+
+// A missing, foreign or damaged entry is a miss, the store after it replaces
+// the entry
+CodePtr CodeCache::map(const std::filesystem::path &path,
+                       const std::vector<std::uint32_t> &words) const {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st {};
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<std::size_t>(st.st_size) != entrySize(words.size())) {
+    ::close(fd);
+    return nullptr;
+  }
+
+  auto size = static_cast<std::size_t>(st.st_size);
+  auto *base = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (base == MAP_FAILED) {
+    return nullptr;
+  }
+  std::shared_ptr<const void> storage{
+      base, [size](const void *addr) { ::munmap(const_cast<void *>(addr), size); }};
+
+  CodeCacheHeader header{};
+  std::memcpy(&header, base, sizeof(header));
+  const auto *bytes = static_cast<const std::byte *>(base);
+  if (header.magic != CodeCacheHeader::kMagic ||
+      header.version != CodeCacheHeader::kVersion || header.buildId != kBuildId ||
+      header.instrSize != sizeof(Instr) || header.count != words.size() ||
+      std::memcmp(bytes + sizeof(header), words.data(),
+                  words.size() * sizeof(std::uint32_t)) != 0) {
+    return nullptr;
+  }
+
+  std::span instrs{reinterpret_cast<const Instr *>(bytes + instrsOffset(header.count)),
+                   header.count};
+  if (checksum(header, instrs) != header.checksum ||
+      !std::all_of(instrs.begin(), instrs.end(), wellFormed)) {
+    return nullptr;
+  }
+  return std::make_shared<const Code>(std::move(storage), instrs,
+                                      (header.flags & eCACHED_VERIFIED) != 0);
+}
+
+// Best effort: an entry that cannot be written costs the next start a decode
+void CodeCache::store(const std::filesystem::path &path,
+                      const std::vector<std::uint32_t> &words, const Code &code) {
+  auto tmp = path.string() + ".tmp-XXXXXX";
+  int fd = ::mkstemp(tmp.data());
+  if (fd < 0) {
+    return;
+  }
+
+  std::uint32_t flags = code.verified().value_or(false) ? eCACHED_VERIFIED : 0U;
+  auto instrs = code.data();
+  CodeCacheHeader header{
+      .magic = CodeCacheHeader::kMagic,
+      .version = CodeCacheHeader::kVersion,
+      .buildId = kBuildId,
+      .count = words.size(),
+      .instrSize = sizeof(Instr),
+      .flags = flags,
+      .checksum = 0};
+  header.checksum = checksum(header, instrs);
+  std::vector<char> padding(instrsOffset(words.size()) - sizeof(header) -
+                            words.size() * sizeof(std::uint32_t));
+  auto ok = writeAll(fd, &header, sizeof(header)) &&
+            writeAll(fd, words.data(), words.size() * sizeof(std::uint32_t)) &&
+            writeAll(fd, padding.data(), padding.size()) &&
+            writeAll(fd, instrs.data(), instrs.size_bytes());
+  ok = ::close(fd) == 0 && ok;
+  if (!ok || ::rename(tmp.c_str(), path.c_str()) != 0) {
+    ::unlink(tmp.c_str());
+  }
+}
+
+} // namespace pvm
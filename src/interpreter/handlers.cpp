@@ -1,23 +1,170 @@
 #include <algorithm>
+#include <atomic>
 #include <bit>
+#include <cctype>
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <istream>
+#include <limits>
+#include <optional>
 #include <ostream>
-#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include <float16_t/float16_t.hpp>
 
 #include "common/config.hpp"
+#include "common/dict.hpp"
+#include "common/shape.hpp"
+#include "common/string.hpp"
 #include "common/value.hpp"
+#include "common/vec4.hpp"
 #include "generated/handlers.hpp"
 #include "generated/instruction.hpp"
 
 namespace pvm {
 
+namespace {
+
+// Pays for the segment ending at the current instruction. On exhaustion or
+// interrupt the instruction is left unexecuted, so the next run() resumes it
+bool checkpoint(Interpreter::State &state) {
+  auto pc = state.rf.readPC();
+  state.fuel -= static_cast<std::int64_t>(pc - state.segment) + 1;
+  state.segment = pc;
+
+  if (state.interrupt.load(std::memory_order_relaxed)) [[unlikely]] {
+    state.interrupt.store(false, std::memory_order_relaxed);
+    state.status = Interpreter::eINTERRUPTED;
+    return false;
+  }
+  if (state.fuel < 0) [[unlikely]] {
+    state.status = Interpreter::eOUT_OF_FUEL;
+    return false;
+  }
+  return true;
+}
+
+// Skips buffered whitespace and tells whether a token is available without
+// blocking on the underlying device
+bool inputReady(std::istream &ist) {
+  auto *buf = ist.rdbuf();
+  while (buf->in_avail() > 0) {
+    if (std::isspace(buf->sgetc()) == 0) {
+      return true;
+    }
+    buf->sbumpc();
+  }
+  return false;
+}
+
+// Stops the run at the current instruction. Kept out of line so that the
+// handlers only pay for a call on their cold path.
+[[gnu::cold, gnu::noinline]] void trap(Interpreter::State &state,
+                                       Interpreter::TrapKind kind,
+                                       std::uint32_t operand) noexcept {
+  state.status = Interpreter::eTRAPPED;
+  state.trap = {.kind = kind, .pc = state.rf.readPC(), .operand = operand};
+}
+
+// Checked handlers validate operand types and type ids at run time and trap,
+// returning nullptr. The unchecked variants only run verified code, see
+// verifier.hpp, which guarantees both, so the null checks fold away.
+template <bool kChecked, ValueType T>
+T const *operand(Interpreter::State &state, std::uint32_t regid) noexcept {
+  const auto *val = state.rf.peekReg(static_cast<RegId>(regid)).tryView<T>();
+  if constexpr (kChecked) {
+    if (val == nullptr) [[unlikely]] {
+      trap(state, Interpreter::eTRAP_TYPE_MISMATCH, regid);
+    }
+  } else if (val == nullptr) {
+    __builtin_unreachable();
+  }
+  return val;
+}
+
+template <bool kChecked>
+void invalidTypeId(Interpreter::State &state, std::uint32_t ttypeid) noexcept {
+  if constexpr (kChecked) {
+    trap(state, Interpreter::eTRAP_INVALID_TYPE_ID, ttypeid);
+  } else {
+    __builtin_unreachable();
+  }
+}
+
+// base + offset always lands inside the reservation, so there is no bounds
+// check: past the committed pages the access faults and run() traps
+template <bool kChecked>
+std::optional<std::uint64_t> effectiveAddr(Interpreter::State &state,
+                                           InstrMEM instr) noexcept {
+  const auto *base = operand<kChecked, Int>(state, instr.regid);
+  if (base == nullptr) {
+    return std::nullopt;
+  }
+  return std::uint64_t{std::bit_cast<Addr>(*base)} + instr.offset;
+}
+
+Channel *channel(Interpreter::State &state, std::uint32_t id) noexcept {
+  if (id >= state.channels.size() || state.channels[id] == nullptr) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_UNATTACHED_CHANNEL, id);
+    return nullptr;
+  }
+  return state.channels[id].get();
+}
+
+// The array in `aregid` and the index in `regid`, validated
+const Array *element(Interpreter::State &state, InstrARRAY instr, Int &index) noexcept {
+  const auto *array = operand<true, Array>(state, instr.aregid);
+  const auto *pos = operand<true, Int>(state, instr.regid);
+  if (array == nullptr || pos == nullptr) {
+    return nullptr;
+  }
+  if (*pos < 0 || *pos >= array->size()) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_INDEX_OUT_OF_RANGE, instr.regid);
+    return nullptr;
+  }
+  index = *pos;
+  return array;
+}
+
+// The dict in `regid1` and the key in `regid2`, validated
+const Dict *dictKey(Interpreter::State &state, InstrDICT instr,
+                    const Value *&key) noexcept {
+  const auto *dict = operand<true, Dict>(state, instr.regid1);
+  if (dict == nullptr) {
+    return nullptr;
+  }
+  const auto &val = state.rf.peekReg(static_cast<RegId>(instr.regid2));
+  if (!Dict::isKey(val)) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_TYPE_MISMATCH, instr.regid2);
+    return nullptr;
+  }
+  key = &val;
+  return dict;
+}
+
+void block(Interpreter::State &state, Channel &chan, Channel::Op op) {
+  state.status = Interpreter::eBLOCKED;
+  state.blockedOn = &chan;
+  state.blockedOp = op;
+}
+
+template <typename Cache>
+Cache &siteCache(Interpreter::State &state, std::vector<Cache> &caches) {
+  auto pc = state.rf.readPC();
+  if (pc >= caches.size()) [[unlikely]] {
+    caches.resize(state.code->size());
+  }
+  return caches[pc];
+}
+
+} // namespace
+
 void exec_halt_halt(Interpreter::State &state, InstrHALT instr) {
+  state.status = Interpreter::eHALTED;
 }
 
 void exec_imm_integer(Interpreter::State &state, InstrIMM instr) {
@@ -37,190 +184,939 @@ void exec_imm_floating(Interpreter::State &state, InstrIMM instr) {
 }
 
 void exec_imm_array(Interpreter::State &state, InstrIMM instr) {
-  auto a = Array(std::bit_cast<Int>(instr.data));
+  auto a = Array(std::bit_cast<Int>(instr.data), state.arrays);
   state.rf.writeAcc(Value{a});
 }
 
 void exec_array_set(Interpreter::State &state, InstrARRAY instr) {
-  state.rf.readReg(instr.aregid)
-      .get<Array>()
-      .at(state.rf.readReg(instr.regid).get<Int>()) = state.rf.readAcc();
+  Int index{};
+  const auto *array = element(state, instr, index);
+  if (array == nullptr) {
+    return;
+  }
+  // arrays are values, so this writes into a copy
+  Array{*array}.at(index) = state.rf.readAcc();
 }
 
 void exec_array_get(Interpreter::State &state, InstrARRAY instr) {
-  auto value = state.rf.readReg(instr.aregid)
-                   .get<Array>()
-                   .at(state.rf.readReg(instr.regid).get<Int>());
+  Int index{};
+  const auto *array = element(state, instr, index);
+  if (array == nullptr) {
+    return;
+  }
+  auto value = array->at(index);
   state.rf.writeAcc(value);
 }
 
 void exec_reg_mov(Interpreter::State &state, InstrREG instr) {
-  state.rf.writeReg(instr.regid, state.rf.readAcc());
+  state.rf.writeReg(instr.regid, state.rf.peekReg(0));
 }
 
-void exec_branch_branch(Interpreter::State &state, InstrBRANCH instr) {
+template <bool kChecked>
+void memLoad(Interpreter::State &state, InstrMEM instr) noexcept {
+  auto addr = effectiveAddr<kChecked>(state, instr);
+  if (!addr) {
+    return;
+  }
+  if (instr.ttypeid == 1) {
+    state.rf.writeAcc(Value{state.mem.load<Int>(*addr)});
+  } else if (instr.ttypeid == 2) {
+    state.rf.writeAcc(Value{state.mem.load<Float>(*addr)});
+  } else {
+    invalidTypeId<kChecked>(state, instr.ttypeid);
+  }
+}
+
+template <bool kChecked>
+void memStore(Interpreter::State &state, InstrMEM instr) noexcept {
+  auto addr = effectiveAddr<kChecked>(state, instr);
+  if (!addr) {
+    return;
+  }
+  auto store = [&]<typename T>() {
+    if (const auto *val = operand<kChecked, T>(state, 0); val != nullptr) {
+      state.mem.store(*addr, *val);
+    }
+  };
+  if (instr.ttypeid == 1) {
+    store.template operator()<Int>();
+  } else if (instr.ttypeid == 2) {
+    store.template operator()<Float>();
+  } else {
+    invalidTypeId<kChecked>(state, instr.ttypeid);
+  }
+}
+
+void exec_mem_load(Interpreter::State &state, InstrMEM instr) noexcept {
+  memLoad<true>(state, instr);
+}
+
+void exec_unchecked_mem_load(Interpreter::State &state, InstrMEM instr) noexcept {
+  memLoad<false>(state, instr);
+}
+
+void exec_mem_store(Interpreter::State &state, InstrMEM instr) noexcept {
+  memStore<true>(state, instr);
+}
+
+void exec_unchecked_mem_store(Interpreter::State &state, InstrMEM instr) noexcept {
+  memStore<false>(state, instr);
+}
+
+void exec_mem_grow(Interpreter::State &state, InstrMEM instr) {
+  const auto *delta = operand<true, Int>(state, instr.regid);
+  if (delta == nullptr) {
+    return;
+  }
+  std::int64_t previous = -1;
+  // the memory limit refuses pages like kMaxPages does
+  if (*delta >= 0) {
+    auto pages = state.mem.pages() + static_cast<std::size_t>(*delta);
+    if (pages <= Memory::kMaxPages &&
+        (state.budget == nullptr ||
+         state.budget->setExternalBytes(pages * Memory::kPageSize))) {
+      previous = state.mem.grow(static_cast<std::size_t>(*delta));
+    }
+  }
+  state.rf.writeAcc(Value{static_cast<Int>(previous)});
+}
+
+void exec_mem_size(Interpreter::State &state, InstrMEM /*instr*/) {
+  state.rf.writeAcc(Value{static_cast<Int>(state.mem.pages())});
+}
+
+void exec_object_new(Interpreter::State &state, InstrOBJECT /*instr*/) {
+  state.rf.writeAcc(Value{Object{state.shapes.root(), state.arena}});
+}
+
+void exec_object_get(Interpreter::State &state, InstrOBJECT instr) {
+  const auto *handle = operand<true, Object>(state, instr.oregid);
+  if (handle == nullptr) {
+    return;
+  }
+  auto obj = *handle;
+  auto &cache = siteCache(state, state.inlineCaches);
+  const auto *shape = obj.shape();
+  if (const auto *hit = cache.find(shape); hit != nullptr) [[likely]] {
+    state.rf.writeAcc(obj.slot(hit->slot));
+    return;
+  }
+
+  auto slot = shape->find(instr.field);
+  if (slot == Shape::kNoSlot) {
+    trap(state, Interpreter::eTRAP_MISSING_FIELD, instr.field);
+    return;
+  }
+  cache.insert({.shape = shape, .next = shape, .slot = slot});
+  state.rf.writeAcc(obj.slot(slot));
+}
+
+void exec_object_set(Interpreter::State &state, InstrOBJECT instr) {
+  const auto *handle = operand<true, Object>(state, instr.oregid);
+  if (handle == nullptr) {
+    return;
+  }
+  auto obj = *handle;
+  auto &cache = siteCache(state, state.inlineCaches);
+  const auto *shape = obj.shape();
+  const auto *hit = cache.find(shape);
+  if (hit == nullptr) [[unlikely]] {
+    InlineCache::Entry entry{.shape = shape, .next = shape, .slot = shape->find(instr.field)};
+    if (entry.slot == Shape::kNoSlot) {
+      entry.next = state.shapes.transition(shape, instr.field);
+      entry.slot = shape->size();
+    }
+    cache.insert(entry);
+    hit = cache.find(shape);
+  }
+
+  if (hit->next != shape) {
+    obj.append(hit->next, state.rf.readAcc());
+  } else {
+    obj.slot(hit->slot) = state.rf.readAcc();
+  }
+}
+
+void exec_func_new(Interpreter::State &state, InstrFUNC instr) {
+  auto entry = state.rf.readPC() + std::bit_cast<Addr>(instr.offset);
+  state.rf.writeAcc(Value{Function{entry, state.arena}});
+}
+
+void exec_func_bind(Interpreter::State &state, InstrFUNC instr) {
+  if (const auto *fn = operand<true, Function>(state, 0); fn != nullptr) {
+    fn->capture(state.rf.readReg(instr.regid));
+  }
+}
+
+void exec_func_env(Interpreter::State &state, InstrFUNC instr) {
+  const auto *fn = operand<true, Function>(state, instr.regid);
+  if (fn == nullptr) {
+    return;
+  }
+  if (instr.offset >= fn->captured()) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_INDEX_OUT_OF_RANGE, instr.regid);
+    return;
+  }
+  auto captured = fn->env(instr.offset);
+  state.rf.writeAcc(captured);
+}
+
+void exec_native_call(Interpreter::State &state, InstrNATIVE instr) {
+  if (instr.id >= state.natives.size() || state.natives[instr.id] == nullptr)
+      [[unlikely]] {
+    trap(state, Interpreter::eTRAP_UNREGISTERED_NATIVE, instr.id);
+    return;
+  }
+  if (!state.natives[instr.id](state.rf, static_cast<RegId>(instr.regid))) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_NATIVE_ARGUMENT, instr.id);
+  }
+}
+
+// Scalars are copied; an array is moved out of the register, leaving null
+// behind, so its storage goes to the receiver as is
+void exec_chan_send(Interpreter::State &state, InstrCHAN instr) {
+  auto *chan = channel(state, instr.id);
+  if (chan == nullptr) {
+    return;
+  }
+  auto regid = static_cast<RegId>(instr.regid);
+  if (!Channel::canTransfer(state.rf.peekReg(regid))) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_NOT_TRANSFERABLE, regid);
+    return;
+  }
+  auto msg = state.rf.takeReg(regid);
+  if (!msg.holds<Array>()) {
+    state.rf.writeReg(regid, msg);
+  }
+
+  msg = Channel::transferable(std::move(msg), state.arrays);
+  if (!chan->trySend(msg)) {
+    if (msg.holds<Array>()) {
+      state.rf.writeReg(regid, std::move(msg));
+    }
+    block(state, *chan, Channel::eSEND);
+  }
+}
+
+void exec_chan_recv(Interpreter::State &state, InstrCHAN instr) {
+  auto *chan = channel(state, instr.id);
+  if (chan == nullptr) {
+    return;
+  }
+  Value msg{};
+  if (!chan->tryRecv(msg)) {
+    block(state, *chan, Channel::eRECV);
+    return;
+  }
+  // into our own account, the sender stops paying for it; past the memory
+  // limit the message is dropped along with the trap
+  state.rf.writeAcc(Channel::transferable(std::move(msg), state.arrays));
+}
+
+template <bool kChecked>
+void branch(Interpreter::State &state, InstrBRANCH instr) noexcept {
   auto &rf = state.rf;
 
-  if (auto cond = rf.readReg(instr.regid).get<Bool>(); !cond) {
+  const auto *cond = operand<kChecked, Bool>(state, instr.regid);
+  if (cond == nullptr) {
+    return;
+  }
+  state.branchTaken = *cond;
+  if (!*cond) {
     state.rf.incrementPC();
     return;
   }
 
+  // forward jumps keep the segment open, it is charged up to the next checkpoint
+  if (std::bit_cast<std::int32_t>(instr.offset) > 0) {
+    rf.writePC(rf.readPC() + std::bit_cast<Addr>(instr.offset));
+    return;
+  }
+
+  if (!checkpoint(state)) {
+    return;
+  }
   rf.writePC(rf.readPC() + std::bit_cast<Addr>(instr.offset));
+  state.segment = rf.readPC();
+}
+
+void exec_branch_branch(Interpreter::State &state, InstrBRANCH instr) noexcept {
+  branch<true>(state, instr);
+}
+
+void exec_unchecked_branch_branch(Interpreter::State &state, InstrBRANCH instr) noexcept {
+  branch<false>(state, instr);
 }
 
 void exec_branch_call(Interpreter::State &state, InstrBRANCH instr) {
-  state.stack.push_back(state.rf);
+  const auto *condition = operand<true, Bool>(state, instr.regid);
+  if (condition == nullptr || !checkpoint(state)) {
+    return;
+  }
 
   auto &rf = state.rf;
-  if (auto cond = rf.readReg(instr.regid).get<Bool>(); !cond) {
+  auto cond = *condition;
+  if (cond && state.memo.enabled()) {
+    auto entry = rf.readPC() + std::bit_cast<Addr>(instr.offset);
+    const auto *hit = state.memo.lookup(*state.code, entry, rf, state.stack.size() + 1);
+    if (hit != nullptr) {
+      rf.writeAcc(*hit);
+      rf.incrementPC();
+      state.segment = rf.readPC();
+      return;
+    }
+  }
+
+  state.stack.push_back(state.rf);
+
+  if (!cond) {
     state.rf.incrementPC();
+    state.segment = rf.readPC();
     return;
   }
 
   rf.writePC(rf.readPC() + std::bit_cast<Addr>(instr.offset));
+  state.segment = rf.readPC();
+}
+
+// The callee starts with the caller's registers and itself in the
+// accumulator, that is how it reaches what it captured
+void exec_branch_icall(Interpreter::State &state, InstrBRANCH instr) {
+  if (!checkpoint(state)) {
+    return;
+  }
+
+  const auto *callee = operand<true, Function>(state, instr.regid);
+  if (callee == nullptr) {
+    return;
+  }
+  auto fn = *callee;
+  if (fn.entry() >= state.code->size()) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_BAD_CALL_TARGET, fn.entry());
+    return;
+  }
+
+  state.stack.push_back(state.rf);
+  state.rf.writePC(fn.entry());
+  state.rf.writeAcc(Value{std::move(fn)});
+  state.segment = state.rf.readPC();
 }
 
 void exec_branch_ret(Interpreter::State &state, InstrBRANCH instr) {
+  if (state.stack.empty()) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_EMPTY_CALL_STACK, instr.regid);
+    return;
+  }
+  if (!checkpoint(state)) {
+    return;
+  }
+
   auto returnValue = state.rf.readReg(instr.regid);
+  if (state.memo.enabled()) {
+    state.memo.onReturn(state.stack.size(), returnValue);
+  }
 
   state.rf = state.stack.back();
   state.rf.writeAcc(returnValue);
   state.stack.pop_back();
 
   state.rf.incrementPC();
+  state.segment = state.rf.readPC();
 }
 
-void exec_unary_write(Interpreter::State &state, InstrUNARY instr) {
-  auto val = state.rf.readReg(instr.regid);
+template <bool kChecked>
+void unaryWrite(Interpreter::State &state, InstrUNARY instr) noexcept {
+  auto write = [&]<typename T>() {
+    if (const auto *val = operand<kChecked, T>(state, instr.regid); val != nullptr) {
+      state.ost.get() << *val << std::endl;
+    }
+  };
   if (instr.ttypeid == 1) {
-    state.ost << val.get<Int>() << std::endl;
+    write.template operator()<Int>();
   } else if (instr.ttypeid == 2) {
-    state.ost << val.get<Float>() << std::endl;
+    write.template operator()<Float>();
+  } else if (instr.ttypeid == 3) {
+    write.template operator()<String>();
   } else {
-    throw std::runtime_error{"unknown type id in write instruction"};
+    invalidTypeId<kChecked>(state, instr.ttypeid);
   }
 }
 
+void exec_unary_write(Interpreter::State &state, InstrUNARY instr) noexcept {
+  unaryWrite<true>(state, instr);
+}
+
+void exec_unchecked_unary_write(Interpreter::State &state, InstrUNARY instr) noexcept {
+  unaryWrite<false>(state, instr);
+}
+
 void exec_unary_read(Interpreter::State &state, InstrUNARY instr) {
+  if (state.nonBlockingInput && !inputReady(state.ist.get())) {
+    state.status = Interpreter::eWAITING_INPUT;
+    return;
+  }
+
   if (instr.ttypeid == 1) {
     Int tmp{};
-    state.ist >> tmp;
+    state.ist.get() >> tmp;
     state.rf.writeAcc(Value{tmp});
   } else if (instr.ttypeid == 2) {
     Float tmp{};
-    state.ist >> tmp;
+    state.ist.get() >> tmp;
     state.rf.writeAcc(Value{tmp});
+  } else if (instr.ttypeid == 3) {
+    // one whitespace-delimited word, like the numbers
+    std::string tmp{};
+    state.ist.get() >> tmp;
+    state.rf.writeAcc(Value{String{tmp, state.arrays}});
   } else {
-    throw std::runtime_error{"unknown type id in write instruction"};
+    invalidTypeId<true>(state, instr.ttypeid);
   }
 }
 
-void exec_unary_abs(Interpreter::State &state, InstrUNARY instr) {
+template <bool kChecked>
+void unaryAbs(Interpreter::State &state, InstrUNARY instr) noexcept {
   if (instr.ttypeid == 1) {
-    auto tmp = state.rf.readReg(instr.regid).get<Int>();
-    state.rf.writeAcc(Value{std::abs(tmp)});
+    if (const auto *tmp = operand<kChecked, Int>(state, instr.regid); tmp != nullptr) {
+      state.rf.writeAcc(Value{std::abs(*tmp)});
+    }
   } else if (instr.ttypeid == 2) {
-    auto tmp = state.rf.readReg(instr.regid).get<Float>();
-    state.rf.writeAcc(Value{std::fabs(tmp)});
+    if (const auto *tmp = operand<kChecked, Float>(state, instr.regid); tmp != nullptr) {
+      state.rf.writeAcc(Value{std::fabs(*tmp)});
+    }
   } else {
-    throw std::runtime_error{"unknown type id in write instruction"};
+    invalidTypeId<kChecked>(state, instr.ttypeid);
   }
 }
 
-void exec_unary_sqrt(Interpreter::State &state, InstrUNARY instr) {
+void exec_unary_abs(Interpreter::State &state, InstrUNARY instr) noexcept {
+  unaryAbs<true>(state, instr);
+}
+
+void exec_unchecked_unary_abs(Interpreter::State &state, InstrUNARY instr) noexcept {
+  unaryAbs<false>(state, instr);
+}
+
+template <bool kChecked>
+void unarySqrt(Interpreter::State &state, InstrUNARY instr) noexcept {
   if (instr.ttypeid == 2) {
-    auto tmp = state.rf.readReg(instr.regid).get<Float>();
-    state.rf.writeAcc(Value{std::sqrt(tmp)});
+    if (const auto *tmp = operand<kChecked, Float>(state, instr.regid); tmp != nullptr) {
+      state.rf.writeAcc(Value{std::sqrt(*tmp)});
+    }
   } else {
-    throw std::runtime_error{"unknown type id in write instruction"};
+    invalidTypeId<kChecked>(state, instr.ttypeid);
   }
 }
 
-template <typename In, typename F>
-void exec_binary_template(Interpreter::State &state, InstrBINARY instr, F f) {
-  auto lhs = state.rf.readReg(instr.regid1).get<In>();
-  auto rhs = state.rf.readReg(instr.regid2).get<In>();
-  auto res = f(lhs, rhs);
-  state.rf.writeAcc(Value{res});
+void exec_unary_sqrt(Interpreter::State &state, InstrUNARY instr) noexcept {
+  unarySqrt<true>(state, instr);
+}
+
+void exec_unchecked_unary_sqrt(Interpreter::State &state, InstrUNARY instr) noexcept {
+  unarySqrt<false>(state, instr);
 }
 
-void exec_binary_less(Interpreter::State &state, InstrBINARY instr) {
+template <bool kChecked, template <typename> typename Op>
+void binary(Interpreter::State &state, InstrBINARY instr) noexcept {
+  auto apply = [&]<typename In>() {
+    const auto *lhs = operand<kChecked, In>(state, instr.regid1);
+    if (lhs == nullptr) {
+      return;
+    }
+    const auto *rhs = operand<kChecked, In>(state, instr.regid2);
+    if (rhs == nullptr) {
+      return;
+    }
+    auto res = Op<In>{}(*lhs, *rhs);
+    state.rf.writeAcc(Value{res});
+  };
+
   switch (instr.ttypeid) {
   case 1:
-    exec_binary_template<Int>(state, instr, std::less<Int>{});
+    apply.template operator()<Int>();
     break;
   case 2:
-    exec_binary_template<Float>(state, instr, std::less<Float>{});
+    apply.template operator()<Float>();
     break;
   default:
-    throw std::runtime_error{"unknown ttypeid for bin instr"};
+    invalidTypeId<kChecked>(state, instr.ttypeid);
   }
 }
 
-void exec_binary_equal(Interpreter::State &state, InstrBINARY instr) {
-  switch (instr.ttypeid) {
-  case 1:
-    exec_binary_template<Int>(state, instr, std::equal_to<Int>{});
-    break;
-  case 2:
-    exec_binary_template<Float>(state, instr, std::equal_to<Float>{});
-    break;
-  default:
-    throw std::runtime_error{"unknown ttypeid for bin instr"};
+void exec_binary_less(Interpreter::State &state, InstrBINARY instr) noexcept {
+  binary<true, std::less>(state, instr);
+}
+
+void exec_unchecked_binary_less(Interpreter::State &state, InstrBINARY instr) noexcept {
+  binary<false, std::less>(state, instr);
+}
+
+void exec_binary_equal(Interpreter::State &state, InstrBINARY instr) noexcept {
+  binary<true, std::equal_to>(state, instr);
+}
+
+void exec_unchecked_binary_equal(Interpreter::State &state, InstrBINARY instr) noexcept {
+  binary<false, std::equal_to>(state, instr);
+}
+
+void exec_binary_add(Interpreter::State &state, InstrBINARY instr) noexcept {
+  binary<true, std::plus>(state, instr);
+}
+
+void exec_unchecked_binary_add(Interpreter::State &state, InstrBINARY instr) noexcept {
+  binary<false, std::plus>(state, instr);
+}
+
+void exec_binary_sub(Interpreter::State &state, InstrBINARY instr) noexcept {
+  binary<true, std::minus>(state, instr);
+}
+
+void exec_unchecked_binary_sub(Interpreter::State &state, InstrBINARY instr) noexcept {
+  binary<false, std::minus>(state, instr);
+}
+
+void exec_binary_mul(Interpreter::State &state, InstrBINARY instr) noexcept {
+  binary<true, std::multiplies>(state, instr);
+}
+
+void exec_unchecked_binary_mul(Interpreter::State &state, InstrBINARY instr) noexcept {
+  binary<false, std::multiplies>(state, instr);
+}
+
+// A zero divisor or the lowest Int over -1 would fault on the hardware and
+// take the host down. The verifier cannot rule them out, so div has no
+// unchecked variant.
+void exec_binary_div(Interpreter::State &state, InstrBINARY instr) {
+  if (instr.ttypeid != 1) {
+    binary<true, std::divides>(state, instr);
+    return;
+  }
+  const auto *lhs = operand<true, Int>(state, instr.regid1);
+  if (lhs == nullptr) {
+    return;
+  }
+  const auto *rhs = operand<true, Int>(state, instr.regid2);
+  if (rhs == nullptr) {
+    return;
   }
+  if (*rhs == 0 || (*rhs == -1 && *lhs == std::numeric_limits<Int>::min()))
+      [[unlikely]] {
+    trap(state, Interpreter::eTRAP_DIVISION, instr.regid2);
+    return;
+  }
+  state.rf.writeAcc(Value{*lhs / *rhs});
 }
 
-void exec_binary_add(Interpreter::State &state, InstrBINARY instr) {
+// vec.* lanes are Int or Float by ttypeid, r1 and r2 hold vectors of them
+// but for the scalar of splat and the lane value of set
+template <bool kChecked, typename Body>
+void vecLanes(Interpreter::State &state, InstrVEC instr, Body body) noexcept {
   switch (instr.ttypeid) {
   case 1:
-    exec_binary_template<Int>(state, instr, std::plus<Int>{});
+    body.template operator()<Int>();
     break;
   case 2:
-    exec_binary_template<Float>(state, instr, std::plus<Float>{});
+    body.template operator()<Float>();
     break;
   default:
-    throw std::runtime_error{"unknown ttypeid for bin instr"};
+    invalidTypeId<kChecked>(state, instr.ttypeid);
   }
 }
 
-void exec_binary_sub(Interpreter::State &state, InstrBINARY instr) {
-  switch (instr.ttypeid) {
-  case 1:
-    exec_binary_template<Int>(state, instr, std::minus<Int>{});
-    break;
-  case 2:
-    exec_binary_template<Float>(state, instr, std::minus<Float>{});
-    break;
-  default:
-    throw std::runtime_error{"unknown ttypeid for bin instr"};
+template <bool kChecked, typename Op>
+void vecBinary(Interpreter::State &state, InstrVEC instr, Op op) noexcept {
+  vecLanes<kChecked>(state, instr, [&]<typename T>() {
+    const auto *lhs = operand<kChecked, Vec4<T>>(state, instr.regid1);
+    if (lhs == nullptr) {
+      return;
+    }
+    const auto *rhs = operand<kChecked, Vec4<T>>(state, instr.regid2);
+    if (rhs == nullptr) {
+      return;
+    }
+    state.rf.writeAcc(Value{op(*lhs, *rhs)});
+  });
+}
+
+constexpr auto kVecAdd = [](const auto &lhs, const auto &rhs) {
+  return vec4::add(lhs, rhs);
+};
+constexpr auto kVecSub = [](const auto &lhs, const auto &rhs) {
+  return vec4::sub(lhs, rhs);
+};
+constexpr auto kVecMul = [](const auto &lhs, const auto &rhs) {
+  return vec4::mul(lhs, rhs);
+};
+constexpr auto kVecMin = [](const auto &lhs, const auto &rhs) {
+  return vec4::min(lhs, rhs);
+};
+constexpr auto kVecMax = [](const auto &lhs, const auto &rhs) {
+  return vec4::max(lhs, rhs);
+};
+constexpr auto kVecLess = [](const auto &lhs, const auto &rhs) {
+  return vec4::less(lhs, rhs);
+};
+constexpr auto kVecEqual = [](const auto &lhs, const auto &rhs) {
+  return vec4::equal(lhs, rhs);
+};
+
+template <bool kChecked>
+void vecDiv(Interpreter::State &state, InstrVEC instr) noexcept {
+  if (instr.ttypeid != 2) {
+    invalidTypeId<kChecked>(state, instr.ttypeid);
+    return;
   }
+  const auto *lhs = operand<kChecked, Vec4f>(state, instr.regid1);
+  if (lhs == nullptr) {
+    return;
+  }
+  const auto *rhs = operand<kChecked, Vec4f>(state, instr.regid2);
+  if (rhs == nullptr) {
+    return;
+  }
+  state.rf.writeAcc(Value{vec4::div(*lhs, *rhs)});
 }
 
-void exec_binary_mul(Interpreter::State &state, InstrBINARY instr) {
-  switch (instr.ttypeid) {
-  case 1:
-    exec_binary_template<Int>(state, instr, std::multiplies<Int>{});
-    break;
-  case 2:
-    exec_binary_template<Float>(state, instr, std::multiplies<Float>{});
-    break;
-  default:
-    throw std::runtime_error{"unknown ttypeid for bin instr"};
+// acc <- r1 * r2 + acc
+template <bool kChecked>
+void vecFma(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecLanes<kChecked>(state, instr, [&]<typename T>() {
+    const auto *lhs = operand<kChecked, Vec4<T>>(state, instr.regid1);
+    if (lhs == nullptr) {
+      return;
+    }
+    const auto *rhs = operand<kChecked, Vec4<T>>(state, instr.regid2);
+    if (rhs == nullptr) {
+      return;
+    }
+    const auto *acc = operand<kChecked, Vec4<T>>(state, 0);
+    if (acc == nullptr) {
+      return;
+    }
+    state.rf.writeAcc(Value{vec4::fma(*lhs, *rhs, *acc)});
+  });
+}
+
+template <bool kChecked>
+void vecSplat(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecLanes<kChecked>(state, instr, [&]<typename T>() {
+    if (const auto *val = operand<kChecked, T>(state, instr.regid1); val != nullptr) {
+      state.rf.writeAcc(Value{vec4::splat(*val)});
+    }
+  });
+}
+
+template <bool kChecked>
+void vecGet(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecLanes<kChecked>(state, instr, [&]<typename T>() {
+    const auto *vec = operand<kChecked, Vec4<T>>(state, instr.regid1);
+    if (vec != nullptr) {
+      state.rf.writeAcc(Value{vec->lanes[instr.lane]});
+    }
+  });
+}
+
+// acc <- r1 with lane `lane` replaced by r2
+template <bool kChecked>
+void vecSet(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecLanes<kChecked>(state, instr, [&]<typename T>() {
+    const auto *vec = operand<kChecked, Vec4<T>>(state, instr.regid1);
+    if (vec == nullptr) {
+      return;
+    }
+    const auto *val = operand<kChecked, T>(state, instr.regid2);
+    if (val == nullptr) {
+      return;
+    }
+    auto res = *vec;
+    res.lanes[instr.lane] = *val;
+    state.rf.writeAcc(Value{res});
+  });
+}
+
+template <bool kChecked>
+void vecHsum(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecLanes<kChecked>(state, instr, [&]<typename T>() {
+    const auto *vec = operand<kChecked, Vec4<T>>(state, instr.regid1);
+    if (vec != nullptr) {
+      state.rf.writeAcc(Value{vec4::hsum(*vec)});
+    }
+  });
+}
+
+void exec_vec_splat(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecSplat<true>(state, instr);
+}
+
+void exec_unchecked_vec_splat(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecSplat<false>(state, instr);
+}
+
+void exec_vec_get(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecGet<true>(state, instr);
+}
+
+void exec_unchecked_vec_get(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecGet<false>(state, instr);
+}
+
+void exec_vec_set(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecSet<true>(state, instr);
+}
+
+void exec_unchecked_vec_set(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecSet<false>(state, instr);
+}
+
+void exec_vec_add(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<true>(state, instr, kVecAdd);
+}
+
+void exec_unchecked_vec_add(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<false>(state, instr, kVecAdd);
+}
+
+void exec_vec_sub(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<true>(state, instr, kVecSub);
+}
+
+void exec_unchecked_vec_sub(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<false>(state, instr, kVecSub);
+}
+
+void exec_vec_mul(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<true>(state, instr, kVecMul);
+}
+
+void exec_unchecked_vec_mul(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<false>(state, instr, kVecMul);
+}
+
+void exec_vec_div(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecDiv<true>(state, instr);
+}
+
+void exec_unchecked_vec_div(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecDiv<false>(state, instr);
+}
+
+void exec_vec_fma(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecFma<true>(state, instr);
+}
+
+void exec_unchecked_vec_fma(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecFma<false>(state, instr);
+}
+
+void exec_vec_hsum(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecHsum<true>(state, instr);
+}
+
+void exec_unchecked_vec_hsum(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecHsum<false>(state, instr);
+}
+
+void exec_vec_min(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<true>(state, instr, kVecMin);
+}
+
+void exec_unchecked_vec_min(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<false>(state, instr, kVecMin);
+}
+
+void exec_vec_max(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<true>(state, instr, kVecMax);
+}
+
+void exec_unchecked_vec_max(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<false>(state, instr, kVecMax);
+}
+
+void exec_vec_less(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<true>(state, instr, kVecLess);
+}
+
+void exec_unchecked_vec_less(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<false>(state, instr, kVecLess);
+}
+
+void exec_vec_equal(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<true>(state, instr, kVecEqual);
+}
+
+void exec_unchecked_vec_equal(Interpreter::State &state, InstrVEC instr) noexcept {
+  vecBinary<false>(state, instr, kVecEqual);
+}
+
+// str.* take their string from r1; concat, compare and equal a second one
+// from r2. slice takes the bounds [r2, r3) and at the index r2, in bytes.
+void exec_str_len(Interpreter::State &state, InstrSTR instr) {
+  if (const auto *str = operand<true, String>(state, instr.regid1); str != nullptr) {
+    state.rf.writeAcc(Value{str->size()});
   }
 }
 
-void exec_binary_div(Interpreter::State &state, InstrBINARY instr) {
-  switch (instr.ttypeid) {
-  case 1:
-    exec_binary_template<Int>(state, instr, std::divides<Int>{});
-    break;
-  case 2:
-    exec_binary_template<Float>(state, instr, std::divides<Float>{});
-    break;
-  default:
-    throw std::runtime_error{"unknown ttypeid for bin instr"};
+void exec_str_concat(Interpreter::State &state, InstrSTR instr) {
+  const auto *lhs = operand<true, String>(state, instr.regid1);
+  if (lhs == nullptr) {
+    return;
+  }
+  const auto *rhs = operand<true, String>(state, instr.regid2);
+  if (rhs == nullptr) {
+    return;
+  }
+  state.rf.writeAcc(Value{String::concat(*lhs, *rhs, state.arrays)});
+}
+
+void exec_str_slice(Interpreter::State &state, InstrSTR instr) {
+  const auto *str = operand<true, String>(state, instr.regid1);
+  const auto *from = str != nullptr ? operand<true, Int>(state, instr.regid2) : nullptr;
+  const auto *to = from != nullptr ? operand<true, Int>(state, instr.regid3) : nullptr;
+  if (to == nullptr) {
+    return;
+  }
+  if (*from < 0 || *from > *to || *to > str->size()) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_INDEX_OUT_OF_RANGE, instr.regid2);
+    return;
+  }
+  state.rf.writeAcc(Value{str->slice(*from, *to, state.arrays)});
+}
+
+void exec_str_compare(Interpreter::State &state, InstrSTR instr) {
+  const auto *lhs = operand<true, String>(state, instr.regid1);
+  if (lhs == nullptr) {
+    return;
+  }
+  const auto *rhs = operand<true, String>(state, instr.regid2);
+  if (rhs == nullptr) {
+    return;
+  }
+  auto order = lhs->compare(*rhs);
+  state.rf.writeAcc(Value{(order > 0) - (order < 0)});
+}
+
+void exec_str_equal(Interpreter::State &state, InstrSTR instr) {
+  const auto *lhs = operand<true, String>(state, instr.regid1);
+  if (lhs == nullptr) {
+    return;
+  }
+  const auto *rhs = operand<true, String>(state, instr.regid2);
+  if (rhs == nullptr) {
+    return;
+  }
+  state.rf.writeAcc(Value{*lhs == *rhs});
+}
+
+void exec_str_hash(Interpreter::State &state, InstrSTR instr) {
+  if (const auto *str = operand<true, String>(state, instr.regid1); str != nullptr) {
+    state.rf.writeAcc(Value{std::bit_cast<Int>(str->hash())});
+  }
+}
+
+void exec_str_intern(Interpreter::State &state, InstrSTR instr) {
+  if (const auto *str = operand<true, String>(state, instr.regid1); str != nullptr) {
+    state.rf.writeAcc(Value{state.strings.intern(*str)});
+  }
+}
+
+// the byte as an Int in [0, 255]
+void exec_str_at(Interpreter::State &state, InstrSTR instr) {
+  const auto *str = operand<true, String>(state, instr.regid1);
+  const auto *pos = str != nullptr ? operand<true, Int>(state, instr.regid2) : nullptr;
+  if (pos == nullptr) {
+    return;
+  }
+  if (*pos < 0 || *pos >= str->size()) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_INDEX_OUT_OF_RANGE, instr.regid2);
+    return;
+  }
+  auto byte = static_cast<unsigned char>(str->view()[static_cast<std::size_t>(*pos)]);
+  state.rf.writeAcc(Value{static_cast<Int>(byte)});
+}
+
+// the one-byte string of the Int in r1
+void exec_str_chr(Interpreter::State &state, InstrSTR instr) {
+  const auto *code = operand<true, Int>(state, instr.regid1);
+  if (code == nullptr) {
+    return;
+  }
+  if (*code < 0 || *code > 255) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_INDEX_OUT_OF_RANGE, instr.regid1);
+    return;
+  }
+  auto byte = static_cast<char>(*code);
+  state.rf.writeAcc(Value{String{std::string_view{&byte, 1}, state.arrays}});
+}
+
+// A hint only, larger ones grow the table as it fills
+constexpr Int kMaxDictHint = 1 << 20;
+
+void exec_dict_new(Interpreter::State &state, InstrDICT instr) {
+  const auto *hint = operand<true, Int>(state, instr.regid1);
+  if (hint == nullptr) {
+    return;
+  }
+  auto capacity = static_cast<std::size_t>(std::clamp(*hint, Int{0}, kMaxDictHint));
+  state.rf.writeAcc(Value{Dict{capacity, state.arena}});
+}
+
+void exec_dict_get(Interpreter::State &state, InstrDICT instr) {
+  const Value *key = nullptr;
+  const auto *dict = dictKey(state, instr, key);
+  if (dict == nullptr) {
+    return;
+  }
+  const auto *val = dict->find(*key);
+  if (val == nullptr) [[unlikely]] {
+    trap(state, Interpreter::eTRAP_MISSING_KEY, instr.regid2);
+    return;
+  }
+  state.rf.writeAcc(*val);
+}
+
+void exec_dict_set(Interpreter::State &state, InstrDICT instr) {
+  const Value *key = nullptr;
+  if (const auto *dict = dictKey(state, instr, key); dict != nullptr) {
+    dict->set(*key, state.rf.readAcc());
+  }
+}
+
+void exec_dict_has(Interpreter::State &state, InstrDICT instr) {
+  const Value *key = nullptr;
+  if (const auto *dict = dictKey(state, instr, key); dict != nullptr) {
+    state.rf.writeAcc(Value{dict->find(*key) != nullptr});
+  }
+}
+
+// whether the key was there
+void exec_dict_remove(Interpreter::State &state, InstrDICT instr) {
+  const Value *key = nullptr;
+  if (const auto *dict = dictKey(state, instr, key); dict != nullptr) {
+    state.rf.writeAcc(Value{dict->remove(*key)});
+  }
+}
+
+void exec_dict_size(Interpreter::State &state, InstrDICT instr) {
+  if (const auto *dict = operand<true, Dict>(state, instr.regid1); dict != nullptr) {
+    state.rf.writeAcc(Value{static_cast<Int>(dict->size())});
+  }
+}
+
+// a fresh array of the keys, in no particular order, to iterate over with
+// array.get and dict.get
+void exec_dict_keys(Interpreter::State &state, InstrDICT instr) {
+  const auto *dict = operand<true, Dict>(state, instr.regid1);
+  if (dict == nullptr) {
+    return;
+  }
+  Array keys{static_cast<Int>(dict->size()), state.arrays};
+  Int pos = 0;
+  for (std::size_t slot = 0; slot < dict->slots(); ++slot) {
+    if (const auto *key = dict->key(slot); key != nullptr) {
+      keys.at(pos++) = *key;
+    }
   }
+  state.rf.writeAcc(Value{std::move(keys)});
 }
 
 } // namespace pvm
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "generated/instruction.hpp"
+#include "interpreter/hwprof.hpp"
+
+namespace pvm {
+
+namespace {
+
+constexpr std::uint64_t cacheMiss(std::uint64_t cache) {
+  return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8U) |
+         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16U);
+}
+
+struct EventSpec final {
+  std::uint32_t type;
+  std::uint64_t config;
+};
+
+constexpr EventSpec kEvents[eHW_COUNTER_NUM] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, cacheMiss(PERF_COUNT_HW_CACHE_ITLB)},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+};
+
+constexpr const char *kNames[eHW_COUNTER_NUM] = {
+    "cycles", "instructions", "branch-misses", "L1-dcache-misses", "iTLB-misses",
+    "task-clock-ns",
+};
+
+// The calling thread in user space, on any cpu
+int openCounter(HwCounter counter, int groupFd) {
+  perf_event_attr attr{};
+  attr.size = sizeof(attr);
+  attr.type = kEvents[counter].type;
+  attr.config = kEvents[counter].config;
+  // the leader starts disabled and enables the whole group
+  if (groupFd < 0) {
+    attr.disabled = 1;
+  }
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return static_cast<int>(
+      ::syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, PERF_FLAG_FD_CLOEXEC));
+}
+
+std::size_t pageSize() {
+  return static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+// The counter straight from its PMU register, following the seqlock of the
+// mmap'd page; fails while the counter is not on a register, or when the
+// kernel does not let user space read it
+bool readMapped(const void *mapped, std::uint64_t &out) {
+#if defined(__x86_64__) || defined(__i386__)
+  if (mapped == nullptr) {
+    return false;
+  }
+  const volatile auto *page = static_cast<const volatile perf_event_mmap_page *>(mapped);
+  std::uint32_t seq = 0;
+  std::uint64_t count = 0;
+  do {
+    seq = page->lock;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    auto index = page->index;
+    if (page->cap_user_rdpmc == 0 || index == 0) {
+      return false;
+    }
+    std::uint32_t lo = 0;
+    std::uint32_t hi = 0;
+    asm volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(index - 1));
+    auto width = page->pmc_width;
+    auto shift = 64U - width;
+    auto pmc = static_cast<std::int64_t>((std::uint64_t{hi} << 32U | lo) << shift);
+    count = static_cast<std::uint64_t>(page->offset + (pmc >> shift));
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+  } while (page->lock != seq);
+  out = count;
+  return true;
+#else
+  (void)mapped;
+  (void)out;
+  return false;
+#endif
+}
+
+double perExec(std::uint64_t value, std::uint64_t execs) {
+  return static_cast<double>(value) / static_cast<double>(execs);
+}
+
+} // namespace
+
+HwProfiler::HwProfiler(Addr rangeSize)
+    : m_rangeSize{rangeSize}, m_byOp(eOPCODE_NUM * kOpsPerType) {
+  if (rangeSize == 0) {
+    throw std::invalid_argument{"pc range size must be positive"};
+  }
+
+  auto add = [this](HwCounter kind) {
+    int fd = openCounter(kind, m_leader);
+    if (fd < 0) {
+      return errno;
+    }
+    if (m_leader < 0) {
+      m_leader = fd;
+    }
+    auto *page = ::mmap(nullptr, pageSize(), PROT_READ, MAP_SHARED, fd, 0);
+    m_counters.push_back(
+        Counter{.kind = kind, .fd = fd, .page = page == MAP_FAILED ? nullptr : page});
+    return 0;
+  };
+
+  // hosts without a PMU still have the clock
+  for (auto kind : {eHW_CYCLES, eHW_INSTRUCTIONS, eHW_BRANCH_MISSES, eHW_L1D_MISSES,
+                    eHW_ITLB_MISSES}) {
+    add(kind);
+  }
+  if (!has(eHW_CYCLES)) {
+    if (auto err = add(eHW_TASK_CLOCK); err != 0 && m_counters.empty()) {
+      throw std::system_error{err, std::generic_category(), "perf_event_open"};
+    }
+  }
+
+  ::ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ::ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+HwProfiler::~HwProfiler() {
+  ::ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  for (const auto &counter : m_counters) {
+    if (counter.page != nullptr) {
+      ::munmap(counter.page, pageSize());
+    }
+    ::close(counter.fd);
+  }
+}
+
+bool HwProfiler::available() noexcept {
+  int fd = openCounter(eHW_TASK_CLOCK, -1);
+  if (fd < 0) {
+    return false;
+  }
+  ::close(fd);
+  return true;
+}
+
+const char *HwProfiler::name(HwCounter counter) noexcept {
+  return counter < eHW_COUNTER_NUM ? kNames[counter] : "unknown";
+}
+
+void HwProfiler::reserve(std::size_t codeSize) {
+  auto ranges = (codeSize + m_rangeSize - 1) / m_rangeSize;
+  if (ranges > m_byRange.size()) {
+    m_byRange.resize(ranges);
+  }
+}
+
+void HwProfiler::step(Addr pc, std::uint8_t opType, std::uint8_t opID) noexcept {
+  if (m_pending) {
+    std::array<std::uint64_t, eHW_COUNTER_NUM> now{};
+    read(now);
+    charge(now);
+  }
+  m_pending = true;
+  m_pc = pc;
+  m_op = opType * kOpsPerType + opID;
+  // the bookkeeping above is not part of the next instruction
+  read(m_last);
+}
+
+void HwProfiler::flush() noexcept {
+  if (!m_pending) {
+    return;
+  }
+  std::array<std::uint64_t, eHW_COUNTER_NUM> now{};
+  read(now);
+  charge(now);
+  m_pending = false;
+}
+
+bool HwProfiler::has(HwCounter counter) const noexcept {
+  return std::any_of(m_counters.begin(), m_counters.end(),
+                     [counter](const Counter &c) { return c.kind == counter; });
+}
+
+Addr HwProfiler::rangeSize() const noexcept {
+  return m_rangeSize;
+}
+
+const HwCounts &HwProfiler::byOp(std::uint8_t opType, std::uint8_t opID) const {
+  return m_byOp.at(opType * kOpsPerType + opID);
+}
+
+const std::vector<HwCounts> &HwProfiler::byRange() const noexcept {
+  return m_byRange;
+}
+
+// rdpmc only when every counter of the group is on a register, so that all
+// of them are read the same way; one read() of the group otherwise
+void HwProfiler::read(std::array<std::uint64_t, eHW_COUNTER_NUM> &out) noexcept {
+  auto mapped = std::all_of(m_counters.begin(), m_counters.end(), [&](const Counter &c) {
+    return readMapped(c.page, out[c.kind]);
+  });
+  if (mapped) {
+    return;
+  }
+
+  // nr, then the values in the order the counters joined the group
+  std::array<std::uint64_t, 1 + eHW_COUNTER_NUM> group{};
+  if (::read(m_leader, group.data(), sizeof(group)) < 0) {
+    out = m_last;
+    return;
+  }
+  for (std::size_t i = 0; i < m_counters.size(); ++i) {
+    out[m_counters[i].kind] = group[1 + i];
+  }
+}
+
+void HwProfiler::charge(const std::array<std::uint64_t, eHW_COUNTER_NUM> &now) noexcept {
+  auto range = m_pc / m_rangeSize;
+  // reserve() covered the code, a pc past it is not charged to a range
+  auto *pcs = range < m_byRange.size() ? &m_byRange[range] : nullptr;
+  auto &op = m_byOp[m_op];
+  ++op.execs;
+  if (pcs != nullptr) {
+    ++pcs->execs;
+  }
+  for (const auto &counter : m_counters) {
+    auto delta = now[counter.kind] - m_last[counter.kind];
+    op.values[counter.kind] += delta;
+    if (pcs != nullptr) {
+      pcs->values[counter.kind] += delta;
+    }
+  }
+}
+
+void HwProfiler::report(std::ostream &ost) const {
+  auto ipc = has(eHW_CYCLES) && has(eHW_INSTRUCTIONS);
+  auto clock = has(eHW_CYCLES) ? eHW_CYCLES : eHW_TASK_CLOCK;
+
+  auto header = [&](const char *what) {
+    ost << std::left << std::setw(20) << what << std::right << std::setw(12) << "execs";
+    for (const auto &counter : m_counters) {
+      ost << std::setw(20) << std::string{kNames[counter.kind]} + "/exec";
+    }
+    if (ipc) {
+      ost << std::setw(8) << "IPC";
+    }
+    ost << '\n';
+  };
+  auto row = [&](const std::string &what, const HwCounts &counts) {
+    ost << std::left << std::setw(20) << what << std::right << std::setw(12)
+        << counts.execs << std::fixed << std::setprecision(2);
+    for (const auto &counter : m_counters) {
+      ost << std::setw(20) << perExec(counts.values[counter.kind], counts.execs);
+    }
+    if (ipc) {
+      auto cycles = counts.values[eHW_CYCLES];
+      auto instrs = counts.values[eHW_INSTRUCTIONS];
+      ost << std::setw(8) << (cycles == 0 ? 0.0 : perExec(instrs, cycles));
+    }
+    ost << '\n';
+  };
+
+  std::vector<std::size_t> ops{};
+  for (std::size_t i = 0; i < m_byOp.size(); ++i) {
+    if (m_byOp[i].execs != 0) {
+      ops.push_back(i);
+    }
+  }
+  std::stable_sort(ops.begin(), ops.end(), [&](std::size_t lhs, std::size_t rhs) {
+    return m_byOp[lhs].values[clock] > m_byOp[rhs].values[clock];
+  });
+
+  header("opcode");
+  for (auto i : ops) {
+    row(opName(static_cast<std::uint8_t>(i / kOpsPerType),
+               static_cast<std::uint8_t>(i % kOpsPerType)),
+        m_byOp[i]);
+  }
+  ost << '\n';
+  header("pc range");
+  for (std::size_t i = 0; i < m_byRange.size(); ++i) {
+    if (m_byRange[i].execs != 0) {
+      auto first = i * m_rangeSize;
+      row(std::to_string(first) + "-" + std::to_string(first + m_rangeSize - 1),
+          m_byRange[i]);
+    }
+  }
+}
+
+} // namespace pvm
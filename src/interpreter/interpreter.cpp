@@ -1,9 +1,29 @@
+#include <algorithm>
 #include <iostream>
+#include <map>
+#include <string>
+#include <utility>
 
+#include "interpreter/hwprof.hpp"
 #include "interpreter/interpreter.hpp"
+#include "interpreter/verifier.hpp"
 
 namespace pvm {
 
+namespace {
+
+// verified once per Code, not per interpreter or reset() onto it
+bool isVerified(const Code &code) {
+  if (auto known = code.verified()) {
+    return *known;
+  }
+  auto ok = verify(code).ok;
+  code.setVerified(ok);
+  return ok;
+}
+
+} // namespace
+
 Interpreter::Interpreter(const Code &code) : Interpreter(code, std::cout, std::cin) {
 }
 
@@ -16,12 +36,24 @@ Interpreter::Interpreter(const Code &code, std::istream &ist)
 }
 
 Interpreter::Interpreter(const Code &code, std::ostream &ost, std::istream &ist)
-    : m_state{Decoder{}, RegFile{}, Memory{}, Code{code}, ost, ist} {
+    : Interpreter(std::make_shared<const Code>(code), ost, ist) {
+}
+
+Interpreter::Interpreter(CodePtr code)
+    : Interpreter(std::move(code), std::cout, std::cin) {
+}
+
+Interpreter::Interpreter(CodePtr code, std::ostream &ost, std::istream &ist)
+    : m_arena{},
+      m_state{Decoder{}, RegFile{}, Memory{}, std::move(code), ost, ist, &m_arena} {
+  m_state.verified = isVerified(*m_state.code);
+  m_state.budget = &m_arena;
+  m_arena.attributeTo(&m_state.rf);
 }
 
 Instr Interpreter::getInstr() {
   auto pc = m_state.rf.readPC();
-  auto instr = m_state.code.loadInstr(pc);
+  auto instr = m_state.code->loadInstr(pc);
   return instr;
 }
 
@@ -29,4 +61,190 @@ const Interpreter::State &Interpreter::getState() const {
   return m_state;
 }
 
+std::string Interpreter::describe(const Trap &trap) {
+  auto operand = std::to_string(trap.operand);
+  std::string what{};
+  switch (trap.kind) {
+  case eTRAP_NONE:
+    return "no trap";
+  case eTRAP_TYPE_MISMATCH:
+    what = "type mismatch in r" + operand;
+    break;
+  case eTRAP_INVALID_TYPE_ID:
+    what = "unknown type id " + operand;
+    break;
+  case eTRAP_INDEX_OUT_OF_RANGE:
+    what = "index in r" + operand + " out of range";
+    break;
+  case eTRAP_MISSING_FIELD:
+    what = "object has no field " + operand;
+    break;
+  case eTRAP_BAD_CALL_TARGET:
+    what = "call target " + operand + " is outside of the code";
+    break;
+  case eTRAP_EMPTY_CALL_STACK:
+    what = "return with an empty call stack";
+    break;
+  case eTRAP_MEMORY_FAULT:
+    what = "memory access out of bounds";
+    break;
+  case eTRAP_UNREGISTERED_NATIVE:
+    what = "native function " + operand + " is not registered";
+    break;
+  case eTRAP_NATIVE_ARGUMENT:
+    what = "argument type mismatch calling native function " + operand;
+    break;
+  case eTRAP_UNATTACHED_CHANNEL:
+    what = "channel " + operand + " is not attached";
+    break;
+  case eTRAP_NOT_TRANSFERABLE:
+    what = "r" + operand + " holds an object, function or dict, it cannot be sent";
+    break;
+  case eTRAP_MISSING_KEY:
+    what = "key in r" + operand + " is not in the dict";
+    break;
+  case eTRAP_OUT_OF_MEMORY:
+    what = "memory limit exceeded";
+    break;
+  case eTRAP_DIVISION:
+    what = "integer division by zero or overflow, divisor in r" + operand;
+    break;
+  default:
+    what = "trap " + std::to_string(static_cast<int>(trap.kind));
+    break;
+  }
+  return what + " at pc " + std::to_string(trap.pc);
+}
+
+void Interpreter::setTracer(Tracer *tracer) {
+  m_state.tracer = tracer;
+}
+
+void Interpreter::setHwProfiler(HwProfiler *hwprof) {
+  if (hwprof != nullptr) {
+    hwprof->reserve(m_state.code->size());
+  }
+  m_state.hwprof = hwprof;
+}
+
+void Interpreter::interrupt() {
+  m_state.interrupt.store(true, std::memory_order_relaxed);
+}
+
+void Interpreter::setNonBlockingInput(bool enable) {
+  m_state.nonBlockingInput = enable;
+}
+
+void Interpreter::setNative(NativeId id, NativeThunk thunk) {
+  if (id >= m_state.natives.size()) {
+    m_state.natives.resize(id + 1U);
+  }
+  m_state.natives[id] = thunk;
+}
+
+ArenaStats Interpreter::allocationStats() const {
+  return m_arena.stats();
+}
+
+std::vector<Interpreter::OpAllocations> Interpreter::allocationsByOp() const {
+  std::map<std::pair<std::uint8_t, std::uint8_t>, OpAllocations> byOp{};
+  const auto &sites = m_arena.sites();
+  for (Addr pc = 0; pc < sites.size() && pc < m_state.code->size(); ++pc) {
+    if (sites[pc].allocations == 0) {
+      continue;
+    }
+    auto instr = m_state.code->loadInstr(pc);
+    auto &op = byOp[{instr.opType, instr.opID}];
+    op.opType = instr.opType;
+    op.opID = instr.opID;
+    op.allocations += sites[pc].allocations;
+    op.bytes += sites[pc].bytes;
+  }
+
+  std::vector<OpAllocations> ops{};
+  for (const auto &[key, op] : byOp) {
+    ops.push_back(op);
+  }
+  std::stable_sort(ops.begin(), ops.end(), [](const auto &lhs, const auto &rhs) {
+    return lhs.bytes > rhs.bytes;
+  });
+  return ops;
+}
+
+void Interpreter::setMemoryLimit(std::size_t bytes) {
+  m_arena.setLimit(bytes);
+}
+
+// The allocation unwound the instruction that made it, which is left
+// unexecuted like after any other trap
+Interpreter::Status Interpreter::outOfMemory() {
+  if (m_state.hwprof != nullptr) {
+    m_state.hwprof->flush();
+  }
+  m_state.status = eTRAPPED;
+  m_state.trap = {.kind = eTRAP_OUT_OF_MEMORY, .pc = m_state.rf.readPC()};
+  return eTRAPPED;
+}
+
+void Interpreter::attachChannel(ChannelId id, ChannelPtr channel) {
+  if (id >= m_state.channels.size()) {
+    m_state.channels.resize(id + 1U);
+  }
+  m_state.channels[id] = std::move(channel);
+  m_state.arrays = m_arena.account(Channel::arrays());
+}
+
+void Interpreter::enableMemoization(std::size_t capacity) {
+  m_state.memo.enable(capacity);
+}
+
+void Interpreter::markPure(Addr entry) {
+  m_state.memo.markPure(entry);
+}
+
+const MemoStats &Interpreter::memoStats() const {
+  return m_state.memo.stats();
+}
+
+void Interpreter::reset() {
+  m_state.rf.reset();
+  m_state.mem.reset();
+  // hand the frame buffer back before the arena goes away under it
+  std::pmr::vector<RegFile>{m_state.arena}.swap(m_state.stack);
+  m_state.strings.clear();
+  // memoized results can hold arena arrays
+  m_state.memo.reset();
+  m_arena.release();
+  m_state.inlineCaches.clear();
+  m_state.natives.clear();
+  m_state.shapes.clear();
+  m_state.channels.clear();
+  m_state.blockedOn = nullptr;
+  m_state.trap = {};
+  m_state.arrays = m_state.arena;
+  m_state.tracer = nullptr;
+  m_state.hwprof = nullptr;
+
+  m_state.status = eRUNNING;
+  m_state.fuel = 0;
+  m_state.segment = 0;
+  m_state.interrupt.store(false, std::memory_order_relaxed);
+  m_state.nonBlockingInput = false;
+  m_state.verified = m_state.code != nullptr && isVerified(*m_state.code);
+}
+
+void Interpreter::reset(CodePtr code) {
+  if (code != m_state.code) {
+    m_aotMatch = nullptr;
+  }
+  m_state.code = std::move(code);
+  reset();
+}
+
+void Interpreter::reset(CodePtr code, std::ostream &ost, std::istream &ist) {
+  reset(std::move(code));
+  m_state.ost = ost;
+  m_state.ist = ist;
+}
+
 } // namespace pvm
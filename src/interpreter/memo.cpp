@@ -0,0 +1,392 @@
+#include <bit>
+#include <bitset>
+#include <deque>
+#include <utility>
+
+#include "generated/instruction.hpp"
+#include "interpreter/memo.hpp"
+
+namespace pvm {
+
+namespace {
+
+using RegSet = std::bitset<kRegistersCount>;
+
+constexpr RegId kAcc = 0;
+
+// Forward pass over everything reachable from the entry, following nested
+// calls into their callees. `written[pc]` is the set of registers written on
+// every path to pc; a read outside of it is a live-in of the function.
+class PurityAnalysis final {
+public:
+  PurityAnalysis(const Code &code, bool trusted)
+      : m_code(code), m_trusted(trusted), m_written(code.size()), m_seen(code.size()) {
+  }
+
+  PurityInfo run(Addr entry) {
+    flow(entry, RegSet{});
+    while (m_pure && !m_work.empty()) {
+      auto pc = m_work.front();
+      m_work.pop_front();
+      step(pc);
+    }
+
+    PurityInfo info{.pure = m_pure, .liveIns = {}};
+    for (std::size_t reg = 0; reg < kRegistersCount; ++reg) {
+      if (m_liveIns.test(reg)) {
+        info.liveIns.push_back(static_cast<RegId>(reg));
+      }
+    }
+    return info;
+  }
+
+private:
+  void flow(Addr pc, const RegSet &written) {
+    if (pc >= m_code.size()) {
+      m_pure = false;
+      return;
+    }
+    if (!m_seen[pc]) {
+      m_seen[pc] = true;
+      m_written[pc] = written;
+      m_work.push_back(pc);
+      return;
+    }
+    auto narrowed = m_written[pc] & written;
+    if (narrowed != m_written[pc]) {
+      m_written[pc] = narrowed;
+      m_work.push_back(pc);
+    }
+  }
+
+  void read(const RegSet &written, std::uint32_t reg) {
+    if (!written.test(reg)) {
+      m_liveIns.set(reg);
+    }
+  }
+
+  // an effect the cache could not replay
+  void effect() {
+    if (!m_trusted) {
+      m_pure = false;
+    }
+  }
+
+  void step(Addr pc) {
+    auto written = m_written[pc];
+    auto instr = m_code.loadInstr(pc);
+
+    switch (instr.opType) {
+    case eHALT:
+      m_pure = false;
+      return;
+    case eUNARY: {
+      auto unary = std::get<InstrUNARY>(instr.instrVar);
+      if (instr.opID == eUNARY_READ) {
+        effect();
+      } else if (instr.opID == eUNARY_WRITE) {
+        effect();
+        read(written, unary.regid);
+        break;
+      } else {
+        read(written, unary.regid);
+      }
+      written.set(kAcc);
+      break;
+    }
+    case eBINARY: {
+      auto binary = std::get<InstrBINARY>(instr.instrVar);
+      read(written, binary.regid1);
+      read(written, binary.regid2);
+      written.set(kAcc);
+      break;
+    }
+    case eARRAY: {
+      auto array = std::get<InstrARRAY>(instr.instrVar);
+      read(written, array.aregid);
+      read(written, array.regid);
+      if (instr.opID == eARRAY_SET) {
+        effect();
+        read(written, kAcc);
+      } else {
+        written.set(kAcc);
+      }
+      break;
+    }
+    case eBRANCH: {
+      auto branch = std::get<InstrBRANCH>(instr.instrVar);
+      read(written, branch.regid);
+      auto target = pc + std::bit_cast<Addr>(branch.offset);
+      switch (instr.opID) {
+      case eBRANCH_BRANCH:
+        flow(target, written);
+        break;
+      case eBRANCH_CALL: {
+        // the callee starts with a copy of this frame, which comes back
+        // unchanged but for the accumulator
+        flow(target, written);
+        auto after = written;
+        after.set(kAcc);
+        flow(pc + 1, after);
+        return;
+      }
+      case eBRANCH_RET:
+        return;
+      default:
+        // indirect target, nothing to follow
+        m_pure = false;
+        return;
+      }
+      break;
+    }
+    case eMEM: {
+      auto mem = std::get<InstrMEM>(instr.instrVar);
+      effect();
+      read(written, mem.regid);
+      if (instr.opID == eMEM_STORE) {
+        read(written, kAcc);
+      } else {
+        written.set(kAcc);
+      }
+      break;
+    }
+    case eIMM:
+      written.set(kAcc);
+      break;
+    case eREG: {
+      auto reg = std::get<InstrREG>(instr.instrVar);
+      read(written, kAcc);
+      written.set(reg.regid);
+      break;
+    }
+    case eOBJECT: {
+      auto object = std::get<InstrOBJECT>(instr.instrVar);
+      effect();
+      if (instr.opID != eOBJECT_NEW) {
+        read(written, object.oregid);
+      }
+      if (instr.opID == eOBJECT_SET) {
+        read(written, kAcc);
+      } else {
+        written.set(kAcc);
+      }
+      break;
+    }
+    case eVEC: {
+      auto vec = std::get<InstrVEC>(instr.instrVar);
+      read(written, vec.regid1);
+      if (instr.opID != eVEC_SPLAT && instr.opID != eVEC_GET && instr.opID != eVEC_HSUM) {
+        read(written, vec.regid2);
+      }
+      if (instr.opID == eVEC_FMA) {
+        read(written, kAcc);
+      }
+      written.set(kAcc);
+      break;
+    }
+    case eSTR: {
+      auto str = std::get<InstrSTR>(instr.instrVar);
+      read(written, str.regid1);
+      if (instr.opID != eSTR_LEN && instr.opID != eSTR_HASH &&
+          instr.opID != eSTR_INTERN && instr.opID != eSTR_CHR) {
+        read(written, str.regid2);
+      }
+      if (instr.opID == eSTR_SLICE) {
+        read(written, str.regid3);
+      }
+      written.set(kAcc);
+      break;
+    }
+    case eDICT: {
+      auto dict = std::get<InstrDICT>(instr.instrVar);
+      effect();
+      read(written, dict.regid1);
+      if (instr.opID != eDICT_NEW && instr.opID != eDICT_SIZE &&
+          instr.opID != eDICT_KEYS) {
+        read(written, dict.regid2);
+      }
+      if (instr.opID == eDICT_SET) {
+        read(written, kAcc);
+      } else {
+        written.set(kAcc);
+      }
+      break;
+    }
+    case eFUNC: {
+      auto func = std::get<InstrFUNC>(instr.instrVar);
+      effect();
+      if (instr.opID != eFUNC_NEW) {
+        read(written, func.regid);
+      }
+      if (instr.opID == eFUNC_BIND) {
+        read(written, kAcc);
+      } else {
+        written.set(kAcc);
+      }
+      break;
+    }
+    case eNATIVE: {
+      // the arity is not encoded, every register from the first argument on
+      // may be read
+      auto native = std::get<InstrNATIVE>(instr.instrVar);
+      effect();
+      for (auto reg = native.regid; reg < kRegistersCount; ++reg) {
+        read(written, reg);
+      }
+      written.set(kAcc);
+      break;
+    }
+    default:
+      m_pure = false;
+      return;
+    }
+
+    flow(pc + 1, written);
+  }
+
+  const Code &m_code;
+  bool m_trusted;
+  bool m_pure{true};
+  std::vector<RegSet> m_written;
+  std::vector<bool> m_seen;
+  std::deque<Addr> m_work{};
+  RegSet m_liveIns{};
+};
+
+// Scalars only: anything else may change behind the key's back or is too
+// costly to compare
+bool encodeScalar(const Value &val, std::uint64_t &out) {
+  if (val.holds<Int>()) {
+    out = (std::uint64_t{1} << 32U) | std::bit_cast<std::uint32_t>(val.get<Int>());
+  } else if (val.holds<Float>()) {
+    out = (std::uint64_t{2} << 32U) | std::bit_cast<std::uint32_t>(val.get<Float>());
+  } else if (val.holds<Bool>()) {
+    out = (std::uint64_t{3} << 32U) | static_cast<std::uint64_t>(val.get<Bool>());
+  } else if (val.holds<Null>()) {
+    out = 0;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+PurityInfo analyzePurity(const Code &code, Addr entry, bool trusted) {
+  return PurityAnalysis{code, trusted}.run(entry);
+}
+
+std::size_t Memo::KeyHash::operator()(const Key &key) const noexcept {
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for (auto word : key) {
+    hash ^= word;
+    hash *= 0x100000001b3ULL;
+    hash ^= hash >> 29U;
+  }
+  return hash;
+}
+
+void Memo::enable(std::size_t capacity) {
+  m_capacity = capacity;
+  while (m_lru.size() > m_capacity) {
+    m_index.erase(m_lru.back().key);
+    m_lru.pop_back();
+    ++m_stats.evictions;
+  }
+  m_stats.entries = m_lru.size();
+}
+
+std::size_t Memo::capacity() const noexcept {
+  return m_capacity;
+}
+
+void Memo::markPure(Addr entry) {
+  m_trusted.insert(entry);
+  m_purity.erase(entry);
+}
+
+const PurityInfo &Memo::purity(const Code &code, Addr entry) {
+  auto it = m_purity.find(entry);
+  if (it == m_purity.end()) {
+    auto info = analyzePurity(code, entry, m_trusted.contains(entry));
+    it = m_purity.emplace(entry, std::move(info)).first;
+  }
+  return it->second;
+}
+
+const Value *Memo::lookup(const Code &code, Addr entry, const RegFile &rf,
+                          std::size_t depth) {
+  const auto &info = purity(code, entry);
+  if (!info.pure) {
+    ++m_stats.skipped;
+    return nullptr;
+  }
+
+  Key key(info.liveIns.size() + 1);
+  key[0] = entry;
+  for (std::size_t i = 0; i < info.liveIns.size(); ++i) {
+    if (!encodeScalar(rf.readReg(info.liveIns[i]), key[i + 1])) {
+      ++m_stats.skipped;
+      return nullptr;
+    }
+  }
+
+  if (auto it = m_index.find(key); it != m_index.end()) {
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    ++m_stats.hits;
+    return &it->second->result;
+  }
+
+  ++m_stats.misses;
+  m_pending.push_back(Pending{.depth = depth, .key = std::move(key)});
+  return nullptr;
+}
+
+void Memo::onReturn(std::size_t depth, const Value &result) {
+  // frames left behind by an exception never return
+  while (!m_pending.empty() && m_pending.back().depth > depth) {
+    m_pending.pop_back();
+  }
+  if (m_pending.empty() || m_pending.back().depth != depth) {
+    return;
+  }
+
+  insert(std::move(m_pending.back().key), result);
+  m_pending.pop_back();
+}
+
+void Memo::insert(Key &&key, const Value &result) {
+  if (m_index.contains(key)) {
+    return;
+  }
+  if (m_lru.size() >= m_capacity) {
+    m_index.erase(m_lru.back().key);
+    m_lru.pop_back();
+    ++m_stats.evictions;
+  }
+
+  m_lru.push_front(Entry{.key = std::move(key), .result = result});
+  m_index.emplace(m_lru.front().key, m_lru.begin());
+  m_stats.entries = m_lru.size();
+}
+
+const MemoStats &Memo::stats() const noexcept {
+  return m_stats;
+}
+
+void Memo::clear() {
+  m_lru.clear();
+  m_index.clear();
+  m_purity.clear();
+  m_pending.clear();
+  m_stats.entries = 0;
+}
+
+void Memo::reset() {
+  clear();
+  m_trusted.clear();
+  m_capacity = 0;
+  m_stats = MemoStats{};
+}
+
+} // namespace pvm
@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <iostream>
+
+#include "interpreter/pool.hpp"
+
+namespace pvm {
+
+void InterpreterPool::Releaser::operator()(Interpreter *interp) const {
+  if (m_pool == nullptr) {
+    delete interp;
+    return;
+  }
+  m_pool->release(interp);
+}
+
+InterpreterPool::InterpreterPool(std::size_t maxIdle, std::size_t prewarm)
+    : m_maxIdle(maxIdle) {
+  auto empty = std::make_shared<const Code>(std::vector<Instr>{});
+  m_idle.reserve(m_maxIdle);
+  for (std::size_t i = 0; i < std::min(prewarm, m_maxIdle); ++i) {
+    m_idle.push_back(std::make_unique<Interpreter>(empty));
+  }
+}
+
+InterpreterPool::Handle InterpreterPool::acquire(CodePtr code) {
+  return acquire(std::move(code), std::cout, std::cin);
+}
+
+InterpreterPool::Handle InterpreterPool::acquire(CodePtr code, std::ostream &ost,
+                                                 std::istream &ist) {
+  std::unique_ptr<Interpreter> interp{};
+  {
+    std::lock_guard lock{m_mutex};
+    if (!m_idle.empty()) {
+      interp = std::move(m_idle.back());
+      m_idle.pop_back();
+    }
+  }
+
+  if (interp == nullptr) {
+    return Handle{new Interpreter{std::move(code), ost, ist}, Releaser{this}};
+  }
+
+  interp->reset(std::move(code), ost, ist);
+  return Handle{interp.release(), Releaser{this}};
+}
+
+std::size_t InterpreterPool::idle() const {
+  std::lock_guard lock{m_mutex};
+  return m_idle.size();
+}
+
+void InterpreterPool::release(Interpreter *interp) {
+  std::unique_ptr<Interpreter> owned{interp};
+  // clear outside the lock and drop the program, acquire() then only rebinds
+  owned->reset(nullptr);
+
+  std::lock_guard lock{m_mutex};
+  if (m_idle.size() < m_maxIdle) {
+    m_idle.push_back(std::move(owned));
+  }
+}
+
+} // namespace pvm
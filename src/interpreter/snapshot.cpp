@@ -0,0 +1,495 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/dict.hpp"
+#include "common/shape.hpp"
+#include "common/string.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+
+namespace pvm {
+
+// Layout (host byte order, readable by the same build only):
+//   header | code | regfile | stack depth, regfiles | memory
+// A regfile is its pc and the registers below its high-water mark, memory
+// is its page count followed by the pages holding anything but zeroes, so
+// restore work is proportional to the state the program built, not to the
+// VM capacity.
+
+namespace {
+
+constexpr std::uint64_t kSnapshotMagic = 0x50414e534d5650; // "PVMSNAP"
+constexpr std::uint32_t kSnapshotVersion = 7;
+
+// Objects, functions and dicts are shared by reference: one is written in full the
+// first time it is met and as its index in meeting order afterwards, which
+// keeps aliasing and cycles intact
+enum ValueTag : std::uint8_t {
+  eTAG_NULL,
+  eTAG_BOOL,
+  eTAG_INT,
+  eTAG_FLOAT,
+  eTAG_ARRAY,
+  eTAG_OBJECT,
+  eTAG_FUNCTION,
+  eTAG_SHARED_REF,
+  eTAG_VEC4I,
+  eTAG_VEC4F,
+  eTAG_STRING,
+  eTAG_DICT,
+};
+
+struct SnapshotHeader final {
+  std::uint64_t magic;
+  std::uint32_t version;
+  std::uint32_t instrSize;
+  std::uint64_t codeSize;
+  std::uint8_t status;
+  std::uint8_t reserved[7];
+};
+
+class Writer final {
+public:
+  template <typename T>
+  void put(const T &val) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    auto offset = m_buf.size();
+    m_buf.resize(offset + sizeof(T));
+    std::memcpy(m_buf.data() + offset, &val, sizeof(T));
+  }
+
+  void putBytes(const void *data, std::size_t size) {
+    auto offset = m_buf.size();
+    m_buf.resize(offset + size);
+    std::memcpy(m_buf.data() + offset, data, size);
+  }
+
+  void putValue(const Value &val) {
+    if (val.holds<Bool>()) {
+      put(eTAG_BOOL);
+      put(static_cast<std::uint8_t>(val.get<Bool>()));
+    } else if (val.holds<Int>()) {
+      put(eTAG_INT);
+      put(val.get<Int>());
+    } else if (val.holds<Float>()) {
+      put(eTAG_FLOAT);
+      put(val.get<Float>());
+    } else if (val.holds<Array>()) {
+      auto arr = val.get<Array>();
+      put(eTAG_ARRAY);
+      put(arr.size());
+      for (Int i = 0; i < arr.size(); ++i) {
+        putValue(arr.at(i));
+      }
+    } else if (val.holds<Object>()) {
+      putObject(val.get<Object>());
+    } else if (val.holds<Function>()) {
+      putFunction(val.get<Function>());
+    } else if (const auto *dict = val.tryView<Dict>(); dict != nullptr) {
+      putDict(*dict);
+    } else if (val.holds<Vec4i>()) {
+      put(eTAG_VEC4I);
+      put(val.get<Vec4i>());
+    } else if (val.holds<Vec4f>()) {
+      put(eTAG_VEC4F);
+      put(val.get<Vec4f>());
+    } else if (const auto *str = val.tryView<String>(); str != nullptr) {
+      // immutable, so copies need not stay shared; interned ones are
+      // interned again on restore
+      auto bytes = str->view();
+      put(eTAG_STRING);
+      put(static_cast<std::uint8_t>(str->interned()));
+      put<std::uint64_t>(bytes.size());
+      putBytes(bytes.data(), bytes.size());
+    } else {
+      put(eTAG_NULL);
+    }
+  }
+
+  // false if already written, a back-reference is put instead
+  bool putShared(const void *identity) {
+    auto [it, fresh] =
+        m_shared.try_emplace(identity, static_cast<std::uint32_t>(m_shared.size()));
+    if (!fresh) {
+      put(eTAG_SHARED_REF);
+      put(it->second);
+    }
+    return fresh;
+  }
+
+  void putObject(const Object &obj) {
+    if (!putShared(obj.identity())) {
+      return;
+    }
+
+    const auto &fields = obj.shape()->fields();
+    put(eTAG_OBJECT);
+    put(static_cast<std::uint32_t>(fields.size()));
+    for (std::uint32_t i = 0; i < fields.size(); ++i) {
+      put(fields[i]);
+      putValue(obj.slot(i));
+    }
+  }
+
+  void putFunction(const Function &fn) {
+    if (!putShared(fn.identity())) {
+      return;
+    }
+
+    put(eTAG_FUNCTION);
+    put(fn.entry());
+    put(fn.captured());
+    for (std::uint32_t i = 0; i < fn.captured(); ++i) {
+      putValue(fn.env(i));
+    }
+  }
+
+  void putDict(const Dict &dict) {
+    if (!putShared(dict.identity())) {
+      return;
+    }
+
+    put(eTAG_DICT);
+    put<std::uint64_t>(dict.size());
+    for (std::size_t slot = 0; slot < dict.slots(); ++slot) {
+      if (const auto *key = dict.key(slot); key != nullptr) {
+        putValue(*key);
+        putValue(dict.value(slot));
+      }
+    }
+  }
+
+  void putRegFile(const RegFile &rf) {
+    put(rf.readPC());
+    put(static_cast<std::uint32_t>(rf.touched()));
+    for (std::size_t i = 0; i < rf.touched(); ++i) {
+      putValue(rf.readReg(static_cast<RegId>(i)));
+    }
+  }
+
+  void save(const std::string &path) const {
+    std::ofstream ofs{path, std::ios::binary | std::ios::trunc};
+    ofs.write(m_buf.data(), static_cast<std::streamsize>(m_buf.size()));
+    if (!ofs) {
+      throw std::runtime_error{"cannot write snapshot " + path};
+    }
+  }
+
+private:
+  std::vector<char> m_buf{};
+  std::unordered_map<const void *, std::uint32_t> m_shared{};
+};
+
+class Reader final {
+public:
+  Reader(const std::string &path, std::pmr::memory_resource *arena, ShapeTree &shapes,
+         StringTable &strings)
+      : m_arena(arena), m_shapes(shapes), m_strings(strings) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::system_error{errno, std::generic_category(), "cannot open " + path};
+    }
+
+    struct stat st {};
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      throw std::runtime_error{"cannot read snapshot " + path};
+    }
+
+    m_size = static_cast<std::size_t>(st.st_size);
+    m_base = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m_base == MAP_FAILED) {
+      throw std::system_error{errno, std::generic_category(), "cannot map " + path};
+    }
+  }
+
+  Reader(const Reader &) = delete;
+  Reader &operator=(const Reader &) = delete;
+  ~Reader() {
+    ::munmap(m_base, m_size);
+  }
+
+  template <typename T>
+  T get() {
+    T val{};
+    std::memcpy(&val, take(sizeof(T)), sizeof(T));
+    return val;
+  }
+
+  const char *take(std::size_t size) {
+    if (m_size - m_pos < size) {
+      throw std::runtime_error{"truncated snapshot"};
+    }
+    const auto *ptr = static_cast<const char *>(m_base) + m_pos;
+    m_pos += size;
+    return ptr;
+  }
+
+  Value getValue() {
+    switch (get<std::uint8_t>()) {
+    case eTAG_NULL:
+      return Value{};
+    case eTAG_BOOL:
+      return Value{get<std::uint8_t>() != 0};
+    case eTAG_INT:
+      return Value{get<Int>()};
+    case eTAG_FLOAT:
+      return Value{get<Float>()};
+    case eTAG_VEC4I:
+      return Value{get<Vec4i>()};
+    case eTAG_VEC4F:
+      return Value{get<Vec4f>()};
+    case eTAG_STRING: {
+      auto interned = get<std::uint8_t>() != 0;
+      auto size = get<std::uint64_t>();
+      if (size > remaining()) {
+        throw std::runtime_error{"corrupt snapshot string"};
+      }
+      String str{std::string_view{take(size), size}, m_arena};
+      return Value{interned ? m_strings.intern(str) : str};
+    }
+    case eTAG_ARRAY: {
+      auto size = get<Int>();
+      // every element takes at least its tag byte
+      if (size < 0 || static_cast<std::size_t>(size) > remaining()) {
+        throw std::runtime_error{"corrupt snapshot array"};
+      }
+      Array arr{size, m_arena};
+      for (Int i = 0; i < size; ++i) {
+        arr.at(i) = getValue();
+      }
+      return Value{std::move(arr)};
+    }
+    case eTAG_OBJECT:
+      return getObject();
+    case eTAG_FUNCTION:
+      return getFunction();
+    case eTAG_DICT:
+      return getDict();
+    case eTAG_SHARED_REF: {
+      auto index = get<std::uint32_t>();
+      if (index >= m_shared.size()) {
+        throw std::runtime_error{"corrupt snapshot reference"};
+      }
+      return m_shared[index];
+    }
+    default:
+      throw std::runtime_error{"corrupt snapshot value tag"};
+    }
+  }
+
+  Value getObject() {
+    Object obj{m_shapes.root(), m_arena};
+    m_shared.emplace_back(obj);
+
+    auto count = get<std::uint32_t>();
+    // every field takes at least its id and a tag byte
+    if (count > remaining() / (sizeof(FieldId) + 1)) {
+      throw std::runtime_error{"corrupt snapshot object"};
+    }
+    for (std::uint32_t i = 0; i < count; ++i) {
+      auto field = get<FieldId>();
+      if (obj.shape()->find(field) != Shape::kNoSlot) {
+        throw std::runtime_error{"corrupt snapshot object"};
+      }
+      auto val = getValue();
+      obj.append(m_shapes.transition(obj.shape(), field), std::move(val));
+    }
+    return Value{std::move(obj)};
+  }
+
+  Value getFunction() {
+    Function fn{get<Addr>(), m_arena};
+    m_shared.emplace_back(fn);
+
+    auto count = get<std::uint32_t>();
+    if (count > remaining()) {
+      throw std::runtime_error{"corrupt snapshot function"};
+    }
+    for (std::uint32_t i = 0; i < count; ++i) {
+      fn.capture(getValue());
+    }
+    return Value{std::move(fn)};
+  }
+
+  Value getDict() {
+    auto count = get<std::uint64_t>();
+    // every entry takes at least two tag bytes
+    if (count > remaining() / 2) {
+      throw std::runtime_error{"corrupt snapshot dict"};
+    }
+    Dict dict{count, m_arena};
+    m_shared.emplace_back(dict);
+
+    for (std::uint64_t i = 0; i < count; ++i) {
+      auto key = getValue();
+      if (!Dict::isKey(key)) {
+        throw std::runtime_error{"corrupt snapshot dict"};
+      }
+      dict.set(key, getValue());
+    }
+    return Value{std::move(dict)};
+  }
+
+  void getRegFile(RegFile &rf) {
+    rf.writePC(get<Addr>());
+    auto touched = get<std::uint32_t>();
+    if (touched > kRegistersCount) {
+      throw std::runtime_error{"corrupt snapshot register file"};
+    }
+    for (std::uint32_t i = 0; i < touched; ++i) {
+      rf.writeReg(static_cast<RegId>(i), getValue());
+    }
+  }
+
+  [[nodiscard]] std::size_t remaining() const {
+    return m_size - m_pos;
+  }
+
+  [[nodiscard]] bool done() const {
+    return m_pos == m_size;
+  }
+
+private:
+  std::pmr::memory_resource *m_arena;
+  ShapeTree &m_shapes;
+  StringTable &m_strings;
+  std::vector<Value> m_shared{};
+  void *m_base{};
+  std::size_t m_size{};
+  std::size_t m_pos{};
+};
+
+} // namespace
+
+void Interpreter::snapshot(const std::string &path) const {
+  auto code = m_state.code->data();
+
+  Writer out{};
+  out.put(SnapshotHeader{.magic = kSnapshotMagic,
+                         .version = kSnapshotVersion,
+                         .instrSize = sizeof(Instr),
+                         .codeSize = code.size(),
+                         .status = m_state.status,
+                         .reserved = {}});
+  out.putBytes(code.data(), code.size() * sizeof(Instr));
+
+  out.putRegFile(m_state.rf);
+  out.put<std::uint64_t>(m_state.stack.size());
+  for (const auto &frame : m_state.stack) {
+    out.putRegFile(frame);
+  }
+
+  const auto &mem = m_state.mem;
+  std::vector<std::uint32_t> used{};
+  for (std::uint32_t page = 0; page < mem.pages(); ++page) {
+    const auto *begin = mem.data() + page * Memory::kPageSize;
+    if (std::any_of(begin, begin + Memory::kPageSize,
+                    [](std::byte b) { return b != std::byte{0}; })) {
+      used.push_back(page);
+    }
+  }
+  out.put(static_cast<std::uint32_t>(mem.pages()));
+  out.put(static_cast<std::uint32_t>(used.size()));
+  for (auto page : used) {
+    out.put(page);
+    out.putBytes(mem.data() + page * Memory::kPageSize, Memory::kPageSize);
+  }
+
+  out.save(path);
+}
+
+void Interpreter::restore(const std::string &path) {
+  Reader in{path, m_state.arena, m_state.shapes, m_state.strings};
+
+  auto header = in.get<SnapshotHeader>();
+  if (header.magic != kSnapshotMagic || header.version != kSnapshotVersion ||
+      header.instrSize != sizeof(Instr)) {
+    throw std::runtime_error{"incompatible snapshot " + path};
+  }
+
+  if (header.codeSize > in.remaining() / sizeof(Instr)) {
+    throw std::runtime_error{"truncated snapshot " + path};
+  }
+  auto halt = Instr{
+      .opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()};
+  std::vector<Instr> instrs(header.codeSize, halt);
+  std::memcpy(instrs.data(), in.take(header.codeSize * sizeof(Instr)),
+              header.codeSize * sizeof(Instr));
+  if (!std::all_of(instrs.begin(), instrs.end(), wellFormed)) {
+    throw std::runtime_error{"corrupt snapshot code " + path};
+  }
+
+  // host bindings are not part of the image
+  auto *tracer = m_state.tracer;
+  auto *hwprof = m_state.hwprof;
+  auto nonBlockingInput = m_state.nonBlockingInput;
+  auto natives = std::move(m_state.natives);
+  auto memoCapacity = m_state.memo.capacity();
+  auto channels = std::move(m_state.channels);
+  auto *arrays = m_state.arrays;
+  reset();
+  // the verifier only vouches for runs from pc 0 with fresh registers, so it
+  // is left to a later reset() onto the code
+  m_state.code = std::make_shared<const Code>(std::move(instrs));
+  m_state.verified = false;
+  m_aotMatch = nullptr;
+  m_state.tracer = tracer;
+  m_state.hwprof = hwprof;
+  m_state.nonBlockingInput = nonBlockingInput;
+  m_state.natives = std::move(natives);
+  m_state.memo.enable(memoCapacity);
+  m_state.channels = std::move(channels);
+  m_state.arrays = arrays;
+
+  in.getRegFile(m_state.rf);
+  auto depth = in.get<std::uint64_t>();
+  if (depth > in.remaining() / (sizeof(Addr) + sizeof(std::uint32_t))) {
+    throw std::runtime_error{"corrupt snapshot call stack"};
+  }
+  m_state.stack.resize(depth);
+  for (auto &frame : m_state.stack) {
+    in.getRegFile(frame);
+  }
+
+  auto pages = in.get<std::uint32_t>();
+  auto used = in.get<std::uint32_t>();
+  if (pages > Memory::kMaxPages || used > pages) {
+    throw std::runtime_error{"corrupt snapshot memory"};
+  }
+  if (!m_arena.setExternalBytes(std::size_t{pages} * Memory::kPageSize)) {
+    throw std::runtime_error{"snapshot exceeds the memory limit"};
+  }
+  m_state.mem.grow(pages);
+  for (std::uint32_t i = 0; i < used; ++i) {
+    auto page = in.get<std::uint32_t>();
+    if (page >= pages) {
+      throw std::runtime_error{"corrupt snapshot memory"};
+    }
+    std::memcpy(m_state.mem.data() + page * Memory::kPageSize, in.take(Memory::kPageSize),
+                Memory::kPageSize);
+  }
+
+  if (!in.done()) {
+    throw std::runtime_error{"trailing data in snapshot " + path};
+  }
+  m_state.status = header.status == eHALTED ? eHALTED : eRUNNING;
+}
+
+} // namespace pvm
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "interpreter/tracer.hpp"
+
+namespace pvm {
+
+namespace {
+
+constexpr std::uint32_t kTraceInt = 1;
+constexpr std::uint32_t kTraceFloat = 2;
+constexpr std::uint32_t kTraceString = 3;
+
+std::size_t mappingSize(std::size_t capacity) {
+  return sizeof(TraceHeader) + capacity * sizeof(TraceEvent);
+}
+
+std::vector<TraceEvent> orderedEvents(const TraceHeader &header, const TraceEvent *ring) {
+  auto kept = std::min<std::uint64_t>(header.head, header.capacity);
+  auto first = header.head - kept;
+
+  std::vector<TraceEvent> events{};
+  events.reserve(kept);
+  for (auto i = first; i != header.head; ++i) {
+    events.push_back(ring[i & (header.capacity - 1)]);
+  }
+  return events;
+}
+
+std::uint64_t valueBits(const Value &val, std::uint32_t ttypeid) {
+  if (ttypeid == kTraceInt && val.holds<Int>()) {
+    return std::bit_cast<std::uint32_t>(val.get<Int>());
+  }
+  if (ttypeid == kTraceFloat && val.holds<Float>()) {
+    return std::bit_cast<std::uint32_t>(val.get<Float>());
+  }
+  // the bytes do not fit, only the length is kept
+  if (ttypeid == kTraceString && val.holds<String>()) {
+    return static_cast<std::uint64_t>(val.get<String>().size());
+  }
+  return 0;
+}
+
+} // namespace
+
+Tracer::Tracer(std::size_t capacity) {
+  map(-1, capacity);
+}
+
+Tracer::Tracer(const std::string &path, std::size_t capacity) {
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw std::system_error{errno, std::generic_category(), "cannot open " + path};
+  }
+
+  auto size = mappingSize(std::bit_ceil(capacity));
+  if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    auto err = errno;
+    ::close(fd);
+    throw std::system_error{err, std::generic_category(), "cannot resize " + path};
+  }
+
+  map(fd, capacity);
+  ::close(fd);
+}
+
+Tracer::~Tracer() {
+  ::munmap(m_base, m_size);
+}
+
+void Tracer::map(int fd, std::size_t capacity) {
+  if (capacity == 0) {
+    throw std::invalid_argument{"trace capacity must be positive"};
+  }
+  capacity = std::bit_ceil(capacity);
+  m_size = mappingSize(capacity);
+
+  auto flags = fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED;
+  m_base = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+  if (m_base == MAP_FAILED) {
+    throw std::system_error{errno, std::generic_category(), "cannot map trace buffer"};
+  }
+
+  m_header = static_cast<TraceHeader *>(m_base);
+  m_events = reinterpret_cast<TraceEvent *>(m_header + 1);
+  m_mask = capacity - 1;
+
+  *m_header = TraceHeader{.magic = TraceHeader::kMagic,
+                          .version = TraceHeader::kVersion,
+                          .reserved = 0,
+                          .capacity = capacity,
+                          .head = 0};
+}
+
+std::size_t Tracer::capacity() const noexcept {
+  return m_header->capacity;
+}
+
+std::uint64_t Tracer::recorded() const noexcept {
+  return m_header->head;
+}
+
+std::vector<TraceEvent> Tracer::events() const {
+  return orderedEvents(*m_header, m_events);
+}
+
+TraceReader::TraceReader(const std::string &path) {
+  std::ifstream ifs{path, std::ios::binary};
+  if (!ifs) {
+    throw std::runtime_error{"cannot open trace " + path};
+  }
+
+  ifs.read(reinterpret_cast<char *>(&m_header), sizeof(m_header));
+  if (!ifs || m_header.magic != TraceHeader::kMagic ||
+      m_header.version != TraceHeader::kVersion || !std::has_single_bit(m_header.capacity)) {
+    throw std::runtime_error{"not a pvm trace: " + path};
+  }
+
+  std::vector<TraceEvent> ring(m_header.capacity);
+  ifs.read(reinterpret_cast<char *>(ring.data()),
+           static_cast<std::streamsize>(ring.size() * sizeof(TraceEvent)));
+  if (!ifs) {
+    throw std::runtime_error{"truncated trace " + path};
+  }
+
+  m_events = orderedEvents(m_header, ring.data());
+}
+
+std::uint64_t TraceReader::recorded() const noexcept {
+  return m_header.head;
+}
+
+bool TraceReader::wrapped() const noexcept {
+  return m_header.head > m_header.capacity;
+}
+
+const std::vector<TraceEvent> &TraceReader::events() const noexcept {
+  return m_events;
+}
+
+void traceExec(Tracer &tracer, const Interpreter::State &state, Addr pc,
+               Instr instr) {
+  TraceEvent event{.pc = pc,
+                   .opType = instr.opType,
+                   .opID = instr.opID,
+                   .kind = eTRACE_EXEC,
+                   .ttypeid = 0,
+                   .payload = 0};
+
+  auto next = state.rf.readPC();
+  if (instr.opType == eBRANCH) {
+    event.payload = next;
+    switch (instr.opID) {
+    case eBRANCH_CALL:
+    case eBRANCH_ICALL:
+      event.kind = eTRACE_CALL;
+      break;
+    case eBRANCH_RET:
+      event.kind = eTRACE_RET;
+      break;
+    default:
+      event.kind = state.branchTaken ? eTRACE_BRANCH_TAKEN : eTRACE_BRANCH_NOT_TAKEN;
+      break;
+    }
+  } else if (instr.opType == eUNARY &&
+             (instr.opID == eUNARY_READ || instr.opID == eUNARY_WRITE)) {
+    auto unary = std::get<InstrUNARY>(instr.instrVar);
+    event.ttypeid = static_cast<std::uint8_t>(unary.ttypeid);
+    if (instr.opID == eUNARY_READ) {
+      event.kind = eTRACE_READ;
+      event.payload = valueBits(state.rf.readAcc(), unary.ttypeid);
+    } else {
+      event.kind = eTRACE_WRITE;
+      event.payload = valueBits(state.rf.readReg(static_cast<RegId>(unary.regid)),
+                                unary.ttypeid);
+    }
+  }
+
+  tracer.record(event);
+}
+
+TraceStats collectTraceStats(const std::vector<TraceEvent> &events,
+                             std::uint64_t recorded) {
+  TraceStats stats{.total = recorded, .kept = events.size()};
+  stats.byOp.resize(eOPCODE_NUM);
+
+  for (const auto &event : events) {
+    if (event.kind < eTRACE_KIND_NUM) {
+      ++stats.byKind[event.kind];
+    }
+    if (event.opType >= eOPCODE_NUM) {
+      continue;
+    }
+
+    auto &ops = stats.byOp[event.opType];
+    if (ops.size() <= event.opID) {
+      ops.resize(event.opID + 1U);
+    }
+    ++ops[event.opID];
+  }
+
+  return stats;
+}
+
+std::string traceReplayInput(const std::vector<TraceEvent> &events,
+                             std::uint64_t recorded) {
+  if (recorded != events.size()) {
+    throw std::runtime_error{"trace ring wrapped, recorded input is incomplete"};
+  }
+
+  std::stringstream ss{};
+  ss << std::setprecision(std::numeric_limits<Float>::max_digits10);
+  for (const auto &event : events) {
+    if (event.kind != eTRACE_READ) {
+      continue;
+    }
+
+    auto bits = static_cast<std::uint32_t>(event.payload);
+    if (event.ttypeid == kTraceInt) {
+      ss << std::bit_cast<Int>(bits) << '\n';
+    } else if (event.ttypeid == kTraceFloat) {
+      ss << std::bit_cast<Float>(bits) << '\n';
+    } else if (event.ttypeid == kTraceString) {
+      throw std::runtime_error{"trace does not record the bytes of strings read"};
+    }
+  }
+
+  return ss.str();
+}
+
+} // namespace pvm
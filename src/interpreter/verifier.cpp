@@ -0,0 +1,490 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "common/config.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/verifier.hpp"
+
+namespace pvm {
+
+namespace {
+
+// eVAL_TRUE is a Bool known to be true, what equal of an Int register with itself
+// gives; anything else that joins differently becomes eVAL_ANY
+enum Kind : std::uint8_t {
+  eVAL_NULL,
+  eVAL_TRUE,
+  eVAL_BOOL,
+  eVAL_INT,
+  eVAL_FLOAT,
+  eVAL_ARRAY,
+  eVAL_OBJECT,
+  eVAL_FUNCTION,
+  eVAL_VEC4I,
+  eVAL_VEC4F,
+  eVAL_STRING,
+  eVAL_DICT,
+  eVAL_ANY,
+};
+
+using Frame = std::array<Kind, kRegistersCount>;
+
+Kind join(Kind lhs, Kind rhs) {
+  if (lhs == rhs) {
+    return lhs;
+  }
+  if ((lhs == eVAL_TRUE || lhs == eVAL_BOOL) && (rhs == eVAL_TRUE || rhs == eVAL_BOOL)) {
+    return eVAL_BOOL;
+  }
+  return eVAL_ANY;
+}
+
+bool isA(Kind kind, Kind required) {
+  return kind == required || (required == eVAL_BOOL && kind == eVAL_TRUE);
+}
+
+struct Unverifiable final {
+  Addr pc;
+  std::string reason;
+};
+
+class Verifier final {
+public:
+  explicit Verifier(const Code &code) : m_instrs{code.data()}, m_in(m_instrs.size()) {
+  }
+
+  void run() {
+    if (m_instrs.empty()) {
+      throw Unverifiable{0, "empty code"};
+    }
+    collectFunctions();
+
+    Frame fresh{};
+    fresh.fill(eVAL_NULL);
+    propagate(0, fresh);
+    while (!m_work.empty()) {
+      auto pc = m_work.back();
+      m_work.pop_back();
+      m_queued.erase(pc);
+      step(pc);
+    }
+  }
+
+private:
+  std::span<const Instr> m_instrs;
+  std::vector<std::optional<Frame>> m_in;
+  std::vector<Addr> m_work{};
+  std::set<Addr> m_queued{};
+
+  // functions are entered by branch.call or, when created by func.new, by
+  // branch.icall; a ret returns from every function whose body holds it
+  std::set<Addr> m_closures{};
+  std::map<Addr, std::set<Addr>> m_owners{};
+  std::map<Addr, std::set<Addr>> m_callers{};
+  std::set<Addr> m_icalls{};
+  std::map<Addr, Kind> m_returns{};
+
+  Addr target(Addr pc, std::uint32_t offset) const {
+    auto dest = pc + std::bit_cast<Addr>(offset);
+    if (dest >= m_instrs.size()) {
+      throw Unverifiable{pc, "target outside of the code"};
+    }
+    return dest;
+  }
+
+  void collectFunctions() {
+    std::set<Addr> entries{0};
+    for (Addr pc = 0; pc < m_instrs.size(); ++pc) {
+      const auto &instr = m_instrs[pc];
+      if (instr.opType == eBRANCH && instr.opID == eBRANCH_CALL) {
+        entries.insert(target(pc, std::get<InstrBRANCH>(instr.instrVar).offset));
+      } else if (instr.opType == eFUNC && instr.opID == eFUNC_NEW) {
+        auto entry = target(pc, std::get<InstrFUNC>(instr.instrVar).offset);
+        entries.insert(entry);
+        m_closures.insert(entry);
+      }
+    }
+
+    for (auto entry : entries) {
+      std::set<Addr> body{entry};
+      std::vector<Addr> work{entry};
+      while (!work.empty()) {
+        auto pc = work.back();
+        work.pop_back();
+
+        const auto &instr = m_instrs[pc];
+        std::vector<Addr> next{};
+        if (instr.opType == eBRANCH && instr.opID == eBRANCH_RET) {
+          if (entry == 0) {
+            throw Unverifiable{pc, "ret can be reached with an empty call stack"};
+          }
+          m_owners[pc].insert(entry);
+        } else if (instr.opType != eHALT) {
+          next.push_back(pc + 1);
+          if (instr.opType == eBRANCH && instr.opID == eBRANCH_BRANCH) {
+            next.push_back(target(pc, std::get<InstrBRANCH>(instr.instrVar).offset));
+          }
+        }
+
+        for (auto succ : next) {
+          if (succ >= m_instrs.size()) {
+            throw Unverifiable{pc, "execution falls off the end of the code"};
+          }
+          if (body.insert(succ).second) {
+            work.push_back(succ);
+          }
+        }
+      }
+    }
+  }
+
+  void propagate(Addr pc, const Frame &frame) {
+    auto &in = m_in[pc];
+    if (in.has_value()) {
+      auto joined = *in;
+      std::transform(joined.begin(), joined.end(), frame.begin(), joined.begin(), join);
+      if (joined == *in) {
+        return;
+      }
+      in = joined;
+    } else {
+      in = frame;
+    }
+    if (m_queued.insert(pc).second) {
+      m_work.push_back(pc);
+    }
+  }
+
+  void requeue(const std::set<Addr> &pcs) {
+    for (auto pc : pcs) {
+      if (m_in[pc].has_value() && m_queued.insert(pc).second) {
+        m_work.push_back(pc);
+      }
+    }
+  }
+
+  static Kind typeId(Addr pc, std::uint32_t ttypeid, bool floatOnly = false) {
+    if (ttypeid == 2) {
+      return eVAL_FLOAT;
+    }
+    if (ttypeid == 1 && !floatOnly) {
+      return eVAL_INT;
+    }
+    throw Unverifiable{pc, "invalid type id"};
+  }
+
+  static RegId reg(Addr pc, std::uint32_t regid) {
+    if (regid >= kRegistersCount) {
+      throw Unverifiable{pc, "register id out of range"};
+    }
+    return static_cast<RegId>(regid);
+  }
+
+  static void expect(Addr pc, const Frame &frame, std::uint32_t regid, Kind kind) {
+    if (!isA(frame[reg(pc, regid)], kind)) {
+      throw Unverifiable{pc, "r" + std::to_string(regid) +
+                                 " may not hold the operand type"};
+    }
+  }
+
+  void step(Addr pc) {
+    auto frame = *m_in[pc];
+    const auto &instr = m_instrs[pc];
+    if (instr.instrVar.index() != instr.opType) {
+      throw Unverifiable{pc, "malformed instruction"};
+    }
+
+    switch (instr.opType) {
+    case eHALT:
+      return;
+    case eUNARY: {
+      auto unary = std::get<InstrUNARY>(instr.instrVar);
+      auto io = instr.opID == eUNARY_READ || instr.opID == eUNARY_WRITE;
+      auto kind = io && unary.ttypeid == 3
+                      ? eVAL_STRING
+                      : typeId(pc, unary.ttypeid, instr.opID == eUNARY_SQRT);
+      if (instr.opID != eUNARY_READ) {
+        expect(pc, frame, unary.regid, kind);
+      }
+      if (instr.opID != eUNARY_WRITE) {
+        frame[0] = kind;
+      }
+      break;
+    }
+    case eBINARY: {
+      auto binary = std::get<InstrBINARY>(instr.instrVar);
+      auto kind = typeId(pc, binary.ttypeid);
+      expect(pc, frame, binary.regid1, kind);
+      expect(pc, frame, binary.regid2, kind);
+      if (instr.opID == eBINARY_EQUAL) {
+        auto same = kind == eVAL_INT && binary.regid1 == binary.regid2;
+        frame[0] = same ? eVAL_TRUE : eVAL_BOOL;
+      } else {
+        frame[0] = instr.opID == eBINARY_LESS ? eVAL_BOOL : kind;
+      }
+      break;
+    }
+    case eARRAY: {
+      auto array = std::get<InstrARRAY>(instr.instrVar);
+      expect(pc, frame, array.aregid, eVAL_ARRAY);
+      expect(pc, frame, array.regid, eVAL_INT);
+      if (instr.opID == eARRAY_GET) {
+        frame[0] = eVAL_ANY;
+      }
+      break;
+    }
+    case eBRANCH:
+      stepBranch(pc, frame, instr);
+      return;
+    case eMEM: {
+      auto mem = std::get<InstrMEM>(instr.instrVar);
+      if (instr.opID == eMEM_SIZE) {
+        frame[0] = eVAL_INT;
+        break;
+      }
+      expect(pc, frame, mem.regid, eVAL_INT);
+      if (instr.opID == eMEM_GROW) {
+        frame[0] = eVAL_INT;
+      } else if (instr.opID == eMEM_LOAD) {
+        frame[0] = typeId(pc, mem.ttypeid);
+      } else {
+        expect(pc, frame, 0, typeId(pc, mem.ttypeid));
+      }
+      break;
+    }
+    case eIMM:
+      frame[0] = instr.opID == eIMM_INTEGER ? eVAL_INT
+                 : instr.opID == eIMM_ARRAY ? eVAL_ARRAY
+                                            : eVAL_FLOAT;
+      break;
+    case eREG:
+      frame[reg(pc, std::get<InstrREG>(instr.instrVar).regid)] = frame[0];
+      break;
+    case eOBJECT: {
+      auto object = std::get<InstrOBJECT>(instr.instrVar);
+      if (instr.opID == eOBJECT_NEW) {
+        frame[0] = eVAL_OBJECT;
+        break;
+      }
+      expect(pc, frame, object.oregid, eVAL_OBJECT);
+      if (instr.opID == eOBJECT_GET) {
+        frame[0] = eVAL_ANY;
+      }
+      break;
+    }
+    case eFUNC: {
+      auto func = std::get<InstrFUNC>(instr.instrVar);
+      if (instr.opID == eFUNC_NEW) {
+        frame[0] = eVAL_FUNCTION;
+      } else if (instr.opID == eFUNC_BIND) {
+        expect(pc, frame, 0, eVAL_FUNCTION);
+        reg(pc, func.regid);
+      } else {
+        expect(pc, frame, func.regid, eVAL_FUNCTION);
+        frame[0] = eVAL_ANY;
+      }
+      break;
+    }
+    case eNATIVE:
+      frame[0] = eVAL_ANY;
+      break;
+    case eVEC:
+      stepVec(pc, frame, instr);
+      break;
+    case eSTR:
+      stepStr(pc, frame, instr);
+      break;
+    case eDICT: {
+      auto dict = std::get<InstrDICT>(instr.instrVar);
+      if (instr.opID == eDICT_NEW) {
+        expect(pc, frame, dict.regid1, eVAL_INT);
+        frame[0] = eVAL_DICT;
+        break;
+      }
+      // keys are checked at run time, any Int, Float or String will do
+      expect(pc, frame, dict.regid1, eVAL_DICT);
+      reg(pc, dict.regid2);
+      switch (instr.opID) {
+      case eDICT_GET:
+        frame[0] = eVAL_ANY;
+        break;
+      case eDICT_HAS:
+      case eDICT_REMOVE:
+        frame[0] = eVAL_BOOL;
+        break;
+      case eDICT_SIZE:
+        frame[0] = eVAL_INT;
+        break;
+      case eDICT_KEYS:
+        frame[0] = eVAL_ARRAY;
+        break;
+      default:
+        break;
+      }
+      break;
+    }
+    case eCHAN: {
+      auto chan = std::get<InstrCHAN>(instr.instrVar);
+      if (instr.opID == eCHAN_SEND) {
+        // a sent array leaves null behind
+        auto &sent = frame[reg(pc, chan.regid)];
+        sent = sent == eVAL_ARRAY ? eVAL_NULL : sent;
+      } else {
+        frame[0] = eVAL_ANY;
+      }
+      break;
+    }
+    default:
+      throw Unverifiable{pc, "malformed instruction"};
+    }
+
+    propagate(pc + 1, frame);
+  }
+
+  static void stepVec(Addr pc, Frame &frame, const Instr &instr) {
+    auto vec = std::get<InstrVEC>(instr.instrVar);
+    auto lane = typeId(pc, vec.ttypeid, instr.opID == eVEC_DIV);
+    auto kind = lane == eVAL_INT ? eVAL_VEC4I : eVAL_VEC4F;
+    switch (instr.opID) {
+    case eVEC_SPLAT:
+      expect(pc, frame, vec.regid1, lane);
+      frame[0] = kind;
+      return;
+    case eVEC_GET:
+    case eVEC_HSUM:
+      expect(pc, frame, vec.regid1, kind);
+      frame[0] = lane;
+      return;
+    case eVEC_SET:
+      expect(pc, frame, vec.regid1, kind);
+      expect(pc, frame, vec.regid2, lane);
+      frame[0] = kind;
+      return;
+    case eVEC_FMA:
+      expect(pc, frame, 0, kind);
+      break;
+    default:
+      break;
+    }
+    expect(pc, frame, vec.regid1, kind);
+    expect(pc, frame, vec.regid2, kind);
+    frame[0] = instr.opID == eVEC_LESS || instr.opID == eVEC_EQUAL ? eVAL_VEC4I : kind;
+  }
+
+  static void stepStr(Addr pc, Frame &frame, const Instr &instr) {
+    auto str = std::get<InstrSTR>(instr.instrVar);
+    switch (instr.opID) {
+    case eSTR_CHR:
+      expect(pc, frame, str.regid1, eVAL_INT);
+      frame[0] = eVAL_STRING;
+      return;
+    case eSTR_CONCAT:
+    case eSTR_COMPARE:
+    case eSTR_EQUAL:
+      expect(pc, frame, str.regid2, eVAL_STRING);
+      break;
+    case eSTR_SLICE:
+      expect(pc, frame, str.regid3, eVAL_INT);
+      [[fallthrough]];
+    case eSTR_AT:
+      expect(pc, frame, str.regid2, eVAL_INT);
+      break;
+    default:
+      break;
+    }
+    expect(pc, frame, str.regid1, eVAL_STRING);
+    switch (instr.opID) {
+    case eSTR_CONCAT:
+    case eSTR_SLICE:
+    case eSTR_INTERN:
+      frame[0] = eVAL_STRING;
+      break;
+    case eSTR_EQUAL:
+      frame[0] = eVAL_BOOL;
+      break;
+    default:
+      frame[0] = eVAL_INT;
+      break;
+    }
+  }
+
+  void stepBranch(Addr pc, Frame frame, const Instr &instr) {
+    auto branch = std::get<InstrBRANCH>(instr.instrVar);
+    switch (instr.opID) {
+    case eBRANCH_BRANCH:
+      expect(pc, frame, branch.regid, eVAL_BOOL);
+      propagate(target(pc, branch.offset), frame);
+      propagate(pc + 1, frame);
+      return;
+    case eBRANCH_CALL: {
+      expect(pc, frame, branch.regid, eVAL_TRUE);
+      auto entry = target(pc, branch.offset);
+      m_callers[entry].insert(pc);
+      propagate(entry, frame);
+      if (auto it = m_returns.find(entry); it != m_returns.end()) {
+        frame[0] = it->second;
+        propagate(pc + 1, frame);
+      }
+      return;
+    }
+    case eBRANCH_ICALL: {
+      expect(pc, frame, branch.regid, eVAL_FUNCTION);
+      m_icalls.insert(pc);
+      auto callee = frame;
+      callee[0] = eVAL_FUNCTION;
+      std::optional<Kind> result{};
+      for (auto entry : m_closures) {
+        propagate(entry, callee);
+        if (auto it = m_returns.find(entry); it != m_returns.end()) {
+          result = result ? join(*result, it->second) : it->second;
+        }
+      }
+      if (result) {
+        frame[0] = *result;
+        propagate(pc + 1, frame);
+      }
+      return;
+    }
+    case eBRANCH_RET: {
+      auto kind = frame[reg(pc, branch.regid)];
+      for (auto entry : m_owners[pc]) {
+        auto [it, fresh] = m_returns.emplace(entry, kind);
+        if (!fresh) {
+          if (join(it->second, kind) == it->second) {
+            continue;
+          }
+          it->second = join(it->second, kind);
+        }
+        requeue(m_callers[entry]);
+        if (m_closures.contains(entry)) {
+          requeue(m_icalls);
+        }
+      }
+      return;
+    }
+    default:
+      throw Unverifiable{pc, "malformed instruction"};
+    }
+  }
+};
+
+} // namespace
+
+Verification verify(const Code &code) {
+  try {
+    Verifier{code}.run();
+  } catch (const Unverifiable &e) {
+    return Verification{.ok = false, .pc = e.pc, .reason = e.reason};
+  }
+  return Verification{.ok = true, .pc = 0, .reason = {}};
+}
+
+} // namespace pvm
@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "memory/arena.hpp"
+#include "memory/regfile.hpp"
+
+namespace pvm {
+
+void *Arena::Upstream::do_allocate(std::size_t bytes, std::size_t alignment) {
+  auto *ptr = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  m_stats.reservedBytes += bytes;
+  return ptr;
+}
+
+void Arena::Upstream::do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) {
+  std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+  m_stats.reservedBytes -= bytes;
+}
+
+bool Arena::Upstream::do_is_equal(const memory_resource &other) const noexcept {
+  return this == &other;
+}
+
+PoolAccount::PoolAccount(Arena &arena, std::pmr::memory_resource *pool) noexcept
+    : m_arena(&arena), m_pool(pool) {
+}
+
+std::size_t PoolAccount::bytesInUse() const noexcept {
+  return m_refs.load(std::memory_order_relaxed) - 1;
+}
+
+std::pmr::memory_resource *PoolAccount::pool() const noexcept {
+  return m_pool;
+}
+
+// Only the interpreter that owns the arena allocates, so its stats are not
+// shared with other threads; deallocations may come from anywhere
+void *PoolAccount::do_allocate(std::size_t bytes, std::size_t alignment) {
+  if (!m_arena->fits(bytes, m_arena->m_stats.externalBytes)) [[unlikely]] {
+    ++m_arena->m_stats.refused;
+    throw ArenaLimitError{};
+  }
+  auto *ptr = m_pool->allocate(bytes, alignment);
+  m_refs.fetch_add(bytes, std::memory_order_relaxed);
+  m_arena->updatePeak();
+  return ptr;
+}
+
+void PoolAccount::do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) {
+  m_pool->deallocate(ptr, bytes, alignment);
+  drop(bytes);
+}
+
+bool PoolAccount::do_is_equal(const memory_resource &other) const noexcept {
+  return this == &other;
+}
+
+void PoolAccount::detach() noexcept {
+  m_arena = nullptr;
+  drop(1);
+}
+
+void PoolAccount::drop(std::size_t refs) noexcept {
+  if (m_refs.fetch_sub(refs, std::memory_order_acq_rel) == refs) {
+    delete this;
+  }
+}
+
+Arena::Arena() : m_upstream{m_stats}, m_pool{&m_upstream} {
+}
+
+Arena::~Arena() {
+  if (m_account != nullptr) {
+    m_account->detach();
+  }
+}
+
+ArenaStats Arena::stats() const noexcept {
+  auto stats = m_stats;
+  stats.sharedBytes = sharedBytes();
+  return stats;
+}
+
+void Arena::release() {
+  m_pool.release();
+  m_stats = ArenaStats{};
+  m_sites.clear();
+}
+
+void Arena::setLimit(std::size_t bytes) noexcept {
+  m_limit = bytes;
+}
+
+std::size_t Arena::limit() const noexcept {
+  return m_limit;
+}
+
+bool Arena::setExternalBytes(std::size_t bytes) noexcept {
+  if (bytes > m_stats.externalBytes && !fits(0, bytes)) {
+    ++m_stats.refused;
+    return false;
+  }
+  m_stats.externalBytes = bytes;
+  updatePeak();
+  return true;
+}
+
+void Arena::attributeTo(const RegFile *rf) noexcept {
+  m_attributed = rf;
+}
+
+const std::vector<AllocationSite> &Arena::sites() const noexcept {
+  return m_sites;
+}
+
+PoolAccount *Arena::account(std::pmr::memory_resource *pool) {
+  if (m_account == nullptr) {
+    m_account = new PoolAccount{*this, pool};
+  } else if (m_account->pool() != pool) {
+    throw std::invalid_argument{"an arena has an account in one pool only"};
+  }
+  return m_account;
+}
+
+bool Arena::fits(std::size_t bytes, std::size_t externalBytes) const noexcept {
+  auto held = m_stats.bytesInUse + sharedBytes();
+  return held <= m_limit && bytes <= m_limit - held &&
+         externalBytes <= m_limit - held - bytes;
+}
+
+std::size_t Arena::sharedBytes() const noexcept {
+  return m_account == nullptr ? 0 : m_account->bytesInUse();
+}
+
+void Arena::updatePeak() noexcept {
+  m_stats.peakBytes = std::max(m_stats.peakBytes, m_stats.bytesInUse +
+                                                      m_stats.externalBytes +
+                                                      sharedBytes());
+}
+
+void *Arena::do_allocate(std::size_t bytes, std::size_t alignment) {
+  if (!fits(bytes, m_stats.externalBytes)) [[unlikely]] {
+    ++m_stats.refused;
+    throw ArenaLimitError{};
+  }
+  auto *ptr = m_pool.allocate(bytes, alignment);
+  ++m_stats.allocations;
+  m_stats.bytesInUse += bytes;
+  updatePeak();
+
+  if (m_attributed != nullptr) {
+    auto pc = static_cast<std::size_t>(m_attributed->readPC());
+    if (pc >= m_sites.size()) {
+      m_sites.resize(pc + 1);
+    }
+    ++m_sites[pc].allocations;
+    m_sites[pc].bytes += bytes;
+  }
+  return ptr;
+}
+
+void Arena::do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) {
+  m_pool.deallocate(ptr, bytes, alignment);
+  ++m_stats.deallocations;
+  m_stats.bytesInUse -= bytes;
+}
+
+bool Arena::do_is_equal(const memory_resource &other) const noexcept {
+  return this == &other;
+}
+
+} // namespace pvm
@@ -1,22 +1,207 @@
+#include <cerrno>
+#include <mutex>
+#include <system_error>
+#include <utility>
+
+#include <sys/mman.h>
+
 #include "memory/memory.hpp"
 
 namespace pvm {
 
-[[nodiscard]] std::uint64_t Memory::loadWord(Addr addr) const {
-  return static_cast<std::uint64_t>(m_data[addr].get<Int>());
+void handleMemoryFault(int sig, siginfo_t *info, void *ctx);
+
+namespace {
+
+thread_local MemoryFaultScope *tlsFaultScope = nullptr;
+struct sigaction previousAction {};
+
+std::byte *reserve() {
+  auto *base = ::mmap(nullptr, Memory::kReservation, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (base == MAP_FAILED) {
+    throw std::system_error{errno, std::generic_category(), "cannot reserve linear memory"};
+  }
+  return static_cast<std::byte *>(base);
+}
+
+// Backs every memory that has not grown yet, nothing in it is ever accessible
+std::byte *sharedEmptyReservation() {
+  static std::once_flag once{};
+  static std::byte *base = nullptr;
+  std::call_once(once, [] {
+    base = reserve();
+
+    // SA_NODEFER: the handler leaves through siglongjmp without restoring
+    // the signal mask, SIGSEGV must stay unblocked for the next fault
+    struct sigaction action {};
+    action.sa_sigaction = &handleMemoryFault;
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    ::sigaction(SIGSEGV, &action, &previousAction);
+  });
+  return base;
+}
+
+} // namespace
+
+// Faults outside of a scope or of its memory are not ours: hand them to the
+// previous handler, or let the default action kill the process
+void handleMemoryFault(int sig, siginfo_t *info, void *ctx) {
+  auto *scope = tlsFaultScope;
+  if (scope != nullptr && scope->m_mem.contains(info->si_addr)) {
+    siglongjmp(scope->m_env, 1);
+  }
+
+  if ((previousAction.sa_flags & SA_SIGINFO) != 0) {
+    previousAction.sa_sigaction(sig, info, ctx);
+    return;
+  }
+  if (previousAction.sa_handler != SIG_DFL && previousAction.sa_handler != SIG_IGN) {
+    previousAction.sa_handler(sig);
+    return;
+  }
+  ::signal(sig, SIG_DFL);
+}
+
+Memory::Memory() : m_base{sharedEmptyReservation()} {
+}
+
+Memory::Memory(Memory &&other) noexcept
+    : m_base{std::exchange(other.m_base, sharedEmptyReservation())},
+      m_pages{std::exchange(other.m_pages, 0)},
+      m_private{std::exchange(other.m_private, false)} {
+}
+
+Memory &Memory::operator=(Memory &&other) noexcept {
+  if (this != &other) {
+    release();
+    m_base = std::exchange(other.m_base, sharedEmptyReservation());
+    m_pages = std::exchange(other.m_pages, 0);
+    m_private = std::exchange(other.m_private, false);
+  }
+  return *this;
+}
+
+Memory::~Memory() {
+  release();
+}
+
+void Memory::release() noexcept {
+  if (m_private) {
+    ::munmap(m_base, kReservation);
+    m_private = false;
+  }
+}
+
+std::int64_t Memory::grow(std::size_t delta) {
+  auto previous = static_cast<std::int64_t>(m_pages);
+  if (delta > kMaxPages - m_pages) {
+    return -1;
+  }
+  if (delta == 0) {
+    return previous;
+  }
+
+  if (!m_private) {
+    m_base = reserve();
+    m_private = true;
+  }
+  if (::mprotect(m_base + size(), delta * kPageSize, PROT_READ | PROT_WRITE) != 0) {
+    throw std::system_error{errno, std::generic_category(), "cannot grow linear memory"};
+  }
+  m_pages += delta;
+  return previous;
+}
+
+std::size_t Memory::pages() const noexcept {
+  return m_pages;
 }
 
-void Memory::storeVal(Addr addr, Value val) {
-  m_data[addr] = val;
+std::size_t Memory::size() const noexcept {
+  return m_pages * kPageSize;
 }
 
-Code::Code(const std::vector<Instr> &data) : m_data(data) {
+std::byte *Memory::data() noexcept {
+  return m_base;
 }
-Code::Code(std::vector<Instr> &&data) : m_data(std::move(data)) {
+
+const std::byte *Memory::data() const noexcept {
+  return m_base;
+}
+
+bool Memory::contains(const void *addr) const noexcept {
+  const auto *ptr = static_cast<const std::byte *>(addr);
+  return ptr >= m_base && ptr < m_base + kReservation;
+}
+
+void Memory::reset() {
+  if (m_pages == 0) {
+    return;
+  }
+  // dropped pages read back as zeroes once committed again
+  ::madvise(m_base, size(), MADV_DONTNEED);
+  ::mprotect(m_base, size(), PROT_NONE);
+  m_pages = 0;
+}
+
+MemoryFaultScope::MemoryFaultScope(const Memory &mem) noexcept
+    : m_mem{mem}, m_outer{tlsFaultScope} {
+  tlsFaultScope = this;
+}
+
+MemoryFaultScope::~MemoryFaultScope() {
+  tlsFaultScope = m_outer;
+}
+
+sigjmp_buf &MemoryFaultScope::env() noexcept {
+  return m_env;
+}
+
+Code::Code(const std::vector<Instr> &data) : Code(std::vector<Instr>{data}) {
+}
+
+Code::Code(std::vector<Instr> &&data) {
+  auto owned = std::make_shared<const std::vector<Instr>>(std::move(data));
+  m_instrs = *owned;
+  m_storage = std::move(owned);
+}
+
+Code::Code(std::shared_ptr<const void> storage, std::span<const Instr> instrs,
+           std::optional<bool> verified)
+    : m_storage{std::move(storage)}, m_instrs{instrs} {
+  if (verified) {
+    setVerified(*verified);
+  }
+}
+
+Code::Code(const Code &other)
+    : m_storage{other.m_storage}, m_instrs{other.m_instrs},
+      m_verified{other.m_verified.load(std::memory_order_relaxed)} {
 }
 
 Instr Code::loadInstr(Addr pc) const {
-  return m_data[pc];
+  return m_instrs[pc];
+}
+
+std::size_t Code::size() const {
+  return m_instrs.size();
+}
+
+std::span<const Instr> Code::data() const {
+  return m_instrs;
+}
+
+std::optional<bool> Code::verified() const {
+  auto verdict = m_verified.load(std::memory_order_relaxed);
+  if (verdict == kUnknown) {
+    return std::nullopt;
+  }
+  return verdict == kAccepted;
+}
+
+void Code::setVerified(bool ok) const noexcept {
+  m_verified.store(ok ? kAccepted : kRejected, std::memory_order_relaxed);
 }
 
 } // namespace pvm
@@ -1,9 +1,12 @@
+#include <algorithm>
+#include <utility>
+
 #include "memory/regfile.hpp"
 
 namespace pvm {
 
 void RegFile::writeAcc(Value &&val) {
-  writeReg(0, val);
+  writeReg(0, std::move(val));
 }
 
 void RegFile::writeAcc(const Value &val) {
@@ -16,16 +19,26 @@ void RegFile::writeAcc(const Value &val) {
 
 void RegFile::writeReg(RegId regId, Value &&val) {
   m_data[regId] = std::move(val);
+  m_touched = std::max(m_touched, static_cast<std::uint16_t>(regId + 1));
 }
 
 void RegFile::writeReg(RegId regId, const Value &val) {
   m_data[regId] = val;
+  m_touched = std::max(m_touched, static_cast<std::uint16_t>(regId + 1));
 }
 
 [[nodiscard]] Value RegFile::readReg(RegId regId) const {
   return m_data[regId];
 }
 
+[[nodiscard]] const Value &RegFile::peekReg(RegId regId) const noexcept {
+  return m_data[regId];
+}
+
+[[nodiscard]] Value RegFile::takeReg(RegId regId) {
+  return std::exchange(m_data[regId], Value{});
+}
+
 void RegFile::writePC(Addr addr) {
   m_pc = addr;
 }
@@ -38,4 +51,14 @@ void RegFile::incrementPC() {
   ++m_pc;
 }
 
+[[nodiscard]] std::size_t RegFile::touched() const {
+  return m_touched;
+}
+
+void RegFile::reset() {
+  std::fill_n(m_data.begin(), m_touched, Value{});
+  m_touched = 0;
+  m_pc = 0;
+}
+
 } // namespace pvm
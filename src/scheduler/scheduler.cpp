@@ -0,0 +1,282 @@
+#include <stdexcept>
+
+#include "scheduler/scheduler.hpp"
+
+namespace pvm {
+
+Scheduler::Task::Task(CodePtr code, std::string_view input, bool closed)
+    : interp(std::move(code), ost, ist), inputClosed(closed) {
+  ist << input;
+  interp.setNonBlockingInput(!closed);
+}
+
+Scheduler::Scheduler(std::size_t workers, std::uint64_t slice) : m_slice(slice) {
+  if (workers == 0) {
+    throw std::invalid_argument{"scheduler needs at least one worker"};
+  }
+
+  m_workers.reserve(workers);
+  for (std::size_t i = 0; i < workers; ++i) {
+    m_workers.push_back(std::make_unique<Worker>());
+  }
+  for (std::size_t i = 0; i < workers; ++i) {
+    m_workers[i]->thread = std::thread{&Scheduler::loop, this, i};
+  }
+}
+
+Scheduler::~Scheduler() {
+  {
+    std::lock_guard lock{m_stateMutex};
+    m_stop = true;
+  }
+  m_work.notify_all();
+
+  for (auto &worker : m_workers) {
+    worker->thread.join();
+  }
+
+  for (auto &task : m_tasks) {
+    for (const auto &channel : task->interp.getState().channels) {
+      if (channel != nullptr) {
+        channel->cancel(this);
+      }
+    }
+  }
+}
+
+Scheduler::TaskId Scheduler::spawn(CodePtr code, std::string_view input, bool closeInput,
+                                   const std::vector<ChannelPtr> &channels) {
+  auto owned = std::make_unique<Task>(std::move(code), input, closeInput);
+  owned->interp.setMemoryLimit(m_memoryLimit.load(std::memory_order_relaxed));
+  for (std::size_t id = 0; id < channels.size(); ++id) {
+    if (channels[id] != nullptr) {
+      owned->interp.attachChannel(static_cast<ChannelId>(id), channels[id]);
+    }
+  }
+  auto *ptr = owned.get();
+
+  TaskId id = 0;
+  {
+    std::lock_guard lock{m_tasksMutex};
+    id = m_tasks.size();
+    m_tasks.push_back(std::move(owned));
+  }
+
+  std::lock_guard lock{ptr->mutex};
+  enqueue(ptr, m_next++ % m_workers.size());
+  return id;
+}
+
+void Scheduler::setMemoryLimit(std::size_t bytes) noexcept {
+  m_memoryLimit.store(bytes, std::memory_order_relaxed);
+}
+
+void Scheduler::feed(TaskId id, std::string_view input) {
+  auto &t = task(id);
+  std::lock_guard lock{t.mutex};
+  t.ist.clear();
+  t.ist << input;
+  if (t.parked) {
+    unpark(t);
+  }
+}
+
+void Scheduler::closeInput(TaskId id) {
+  auto &t = task(id);
+  std::lock_guard lock{t.mutex};
+  t.inputClosed = true;
+  t.interp.setNonBlockingInput(false);
+  if (t.parked) {
+    unpark(t);
+  }
+}
+
+void Scheduler::wait(TaskId id) {
+  auto &t = task(id);
+  std::unique_lock lock{m_stateMutex};
+  m_settled.wait(lock, [&t] { return t.settled; });
+}
+
+void Scheduler::wait() {
+  std::unique_lock lock{m_stateMutex};
+  m_settled.wait(lock, [this] { return m_active == 0; });
+}
+
+Interpreter::Status Scheduler::status(TaskId id) {
+  auto &t = task(id);
+  std::lock_guard lock{t.mutex};
+  return t.status;
+}
+
+std::exception_ptr Scheduler::error(TaskId id) {
+  auto &t = task(id);
+  std::lock_guard lock{t.mutex};
+  return t.error;
+}
+
+std::string Scheduler::output(TaskId id) {
+  auto &t = task(id);
+  std::lock_guard lock{t.mutex};
+  return t.ost.str();
+}
+
+ArenaStats Scheduler::memoryUsage(TaskId id) {
+  auto &t = task(id);
+  std::lock_guard lock{t.mutex};
+  return t.interp.allocationStats();
+}
+
+std::size_t Scheduler::workers() const noexcept {
+  return m_workers.size();
+}
+
+Scheduler::Task &Scheduler::task(TaskId id) {
+  std::lock_guard lock{m_tasksMutex};
+  if (id >= m_tasks.size()) {
+    throw std::out_of_range{"unknown task id"};
+  }
+  return *m_tasks[id];
+}
+
+// Callers hold the task mutex, it orders before m_stateMutex. Channel wakes
+// do not: a task parked on a channel is only reachable through its wake.
+void Scheduler::enqueue(Task *task, std::size_t worker) {
+  {
+    std::lock_guard lock{m_stateMutex};
+    task->settled = false;
+    ++m_active;
+    ++m_queued;
+  }
+  {
+    std::lock_guard lock{m_workers[worker]->mutex};
+    m_workers[worker]->tasks.push_back(task);
+  }
+  m_work.notify_one();
+}
+
+void Scheduler::unpark(Task &task) {
+  task.parked = false;
+  enqueue(&task, m_next++ % m_workers.size());
+}
+
+// Parks the task on the channel it is blocked on. Holding m_stateMutex keeps
+// a wake from another thread from requeueing it before it is retired; if the
+// channel got ready in the meantime it goes straight back to the deque.
+void Scheduler::block(Task &task, std::size_t worker) {
+  const auto &state = task.interp.getState();
+  {
+    std::unique_lock stateLock{m_stateMutex};
+    auto parked = state.blockedOn->parkUntil(state.blockedOp, this, [this, &task] {
+      enqueue(&task, m_next++ % m_workers.size());
+    });
+    if (parked) {
+      task.settled = true;
+      --m_active;
+      stateLock.unlock();
+      m_settled.notify_all();
+      return;
+    }
+    ++m_queued;
+  }
+
+  std::lock_guard dequeLock{m_workers[worker]->mutex};
+  m_workers[worker]->tasks.push_back(&task);
+}
+
+void Scheduler::retire(Task &task) {
+  {
+    std::lock_guard lock{m_stateMutex};
+    task.settled = true;
+    --m_active;
+  }
+  m_settled.notify_all();
+}
+
+Scheduler::Task *Scheduler::pop(std::size_t worker) {
+  auto &self = *m_workers[worker];
+  std::lock_guard lock{self.mutex};
+  if (self.tasks.empty()) {
+    return nullptr;
+  }
+
+  auto *task = self.tasks.front();
+  self.tasks.pop_front();
+  return task;
+}
+
+Scheduler::Task *Scheduler::steal(std::size_t thief) {
+  for (std::size_t i = 1; i < m_workers.size(); ++i) {
+    auto &victim = *m_workers[(thief + i) % m_workers.size()];
+    std::lock_guard lock{victim.mutex};
+    if (!victim.tasks.empty()) {
+      auto *task = victim.tasks.back();
+      victim.tasks.pop_back();
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+void Scheduler::loop(std::size_t worker) {
+  for (;;) {
+    auto *task = pop(worker);
+    if (task == nullptr) {
+      task = steal(worker);
+    }
+
+    if (task == nullptr) {
+      std::unique_lock lock{m_stateMutex};
+      m_work.wait(lock, [this] { return m_stop || m_queued != 0; });
+      if (m_stop) {
+        return;
+      }
+      continue;
+    }
+
+    {
+      std::lock_guard lock{m_stateMutex};
+      --m_queued;
+      if (m_stop) {
+        return;
+      }
+    }
+
+    std::unique_lock lock{task->mutex};
+    // an exception out of a host native or an allocation fails this task
+    // only, not the worker and every other task with it
+    try {
+      task->status = task->interp.run(m_slice);
+    } catch (...) {
+      task->error = std::current_exception();
+      task->status = Interpreter::eTRAPPED;
+    }
+
+    switch (task->status) {
+    case Interpreter::eOUT_OF_FUEL:
+    case Interpreter::eINTERRUPTED: {
+      {
+        std::lock_guard stateLock{m_stateMutex};
+        ++m_queued;
+      }
+      std::lock_guard dequeLock{m_workers[worker]->mutex};
+      m_workers[worker]->tasks.push_back(task);
+      break;
+    }
+    case Interpreter::eWAITING_INPUT:
+      task->parked = true;
+      retire(*task);
+      break;
+    case Interpreter::eBLOCKED:
+      block(*task, worker);
+      break;
+    case Interpreter::eRUNNING:
+    case Interpreter::eHALTED:
+    case Interpreter::eTRAPPED:
+    default:
+      retire(*task);
+      break;
+    }
+  }
+}
+
+} // namespace pvm
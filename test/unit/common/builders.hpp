@@ -0,0 +1,127 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "memory/memory.hpp"
+
+// Instruction factories for the hand-written programs of the unit tests
+namespace pvm::test {
+
+constexpr std::uint32_t kInt = 1;
+constexpr std::uint32_t kFloat = 2;
+constexpr std::uint32_t kString = 3;
+
+// signed fields take their two's complement bits
+inline std::uint32_t bits(std::int32_t val) {
+  return std::bit_cast<std::uint32_t>(val);
+}
+
+inline Instr imm(std::int32_t data) {
+  return Instr{.opType = eIMM,
+               .opID = eIMM_INTEGER,
+               .instrVar = InstrIMM::Builder().data(bits(data)).build()};
+}
+
+inline Instr array(std::int32_t size) {
+  return Instr{.opType = eIMM,
+               .opID = eIMM_ARRAY,
+               .instrVar = InstrIMM::Builder().data(bits(size)).build()};
+}
+
+inline Instr mov(std::uint32_t regid) {
+  return Instr{.opType = eREG,
+               .opID = eREG_MOV,
+               .instrVar = InstrREG::Builder().regid(regid).build()};
+}
+
+inline Instr unary(UnaryOpID opID, std::uint32_t regid = 0,
+                   std::uint32_t ttypeid = kInt) {
+  return Instr{.opType = eUNARY,
+               .opID = opID,
+               .instrVar = InstrUNARY::Builder().ttypeid(ttypeid).regid(regid).build()};
+}
+
+inline Instr write(std::uint32_t regid, std::uint32_t ttypeid = kInt) {
+  return unary(eUNARY_WRITE, regid, ttypeid);
+}
+
+inline Instr binary(BinaryOpID opID, std::uint32_t regid1, std::uint32_t regid2,
+                    std::uint32_t ttypeid = kInt) {
+  return Instr{
+      .opType = eBINARY,
+      .opID = opID,
+      .instrVar =
+          InstrBINARY::Builder().ttypeid(ttypeid).regid1(regid1).regid2(regid2).build()};
+}
+
+inline Instr branch(BranchOpID opID, std::uint32_t regid, std::int32_t offset = 0) {
+  return Instr{
+      .opType = eBRANCH,
+      .opID = opID,
+      .instrVar = InstrBRANCH::Builder().regid(regid).offset(bits(offset)).build()};
+}
+
+inline Instr func(FuncOpID opID, std::uint32_t regid, std::int32_t offset) {
+  return Instr{
+      .opType = eFUNC,
+      .opID = opID,
+      .instrVar = InstrFUNC::Builder().regid(regid).offset(bits(offset)).build()};
+}
+
+inline Instr mem(MemOpID opID, std::uint32_t ttypeid, std::uint32_t regid,
+                 std::uint32_t offset) {
+  return Instr{
+      .opType = eMEM,
+      .opID = opID,
+      .instrVar =
+          InstrMEM::Builder().ttypeid(ttypeid).regid(regid).offset(offset).build()};
+}
+
+inline Instr object(ObjectOpID opID, std::uint32_t oregid = 0,
+                    std::uint32_t field = 0) {
+  return Instr{
+      .opType = eOBJECT,
+      .opID = opID,
+      .instrVar = InstrOBJECT::Builder().oregid(oregid).field(field).build()};
+}
+
+inline Instr native(std::uint32_t regid, std::uint32_t id) {
+  return Instr{.opType = eNATIVE,
+               .opID = eNATIVE_CALL,
+               .instrVar = InstrNATIVE::Builder().regid(regid).id(id).build()};
+}
+
+inline Instr chan(ChanOpID opID, std::uint32_t id, std::uint32_t regid = 0) {
+  return Instr{.opType = eCHAN,
+               .opID = opID,
+               .instrVar = InstrCHAN::Builder().regid(regid).id(id).build()};
+}
+
+inline Instr halt() {
+  return Instr{
+      .opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()};
+}
+
+inline CodePtr makeCode(std::vector<Instr> instrs) {
+  return std::make_shared<const Code>(std::move(instrs));
+}
+
+// a State to call handlers on directly, outside of an Interpreter
+inline Interpreter::State createState() {
+  return Interpreter::State{Decoder{},
+                            RegFile{},
+                            Memory{},
+                            std::make_shared<const Code>(std::vector<Instr>{}),
+                            std::cout,
+                            std::cin};
+}
+
+} // namespace pvm::test
@@ -0,0 +1,123 @@
+#include <limits>
+#include <set>
+
+#include <gtest/gtest.h>
+
+#include "common/dict.hpp"
+#include "common/value.hpp"
+
+using namespace pvm;
+
+TEST(Dict, SetFindRemove) {
+  Dict dict{};
+  EXPECT_EQ(dict.size(), 0);
+  EXPECT_EQ(dict.find(Value{Int{1}}), nullptr);
+
+  dict.set(Value{Int{1}}, Value{Int{10}});
+  dict.set(Value{Int{2}}, Value{Int{20}});
+  dict.set(Value{Int{1}}, Value{Int{11}});
+  EXPECT_EQ(dict.size(), 2);
+  ASSERT_NE(dict.find(Value{Int{1}}), nullptr);
+  EXPECT_EQ(dict.find(Value{Int{1}})->get<Int>(), 11);
+
+  EXPECT_TRUE(dict.remove(Value{Int{1}}));
+  EXPECT_FALSE(dict.remove(Value{Int{1}}));
+  EXPECT_EQ(dict.find(Value{Int{1}}), nullptr);
+  EXPECT_EQ(dict.find(Value{Int{2}})->get<Int>(), 20);
+  EXPECT_EQ(dict.size(), 1);
+}
+
+TEST(Dict, CopiesShareEntries) {
+  Dict dict{};
+  auto alias = dict;
+  alias.set(Value{Int{1}}, Value{Int{10}});
+  EXPECT_EQ(dict.size(), 1);
+  EXPECT_EQ(dict.identity(), alias.identity());
+}
+
+TEST(Dict, Grows) {
+  Dict dict{};
+  for (Int i = 0; i < 10000; ++i) {
+    dict.set(Value{i * 7919}, Value{i});
+  }
+  EXPECT_EQ(dict.size(), 10000);
+  EXPECT_LE(dict.size(), dict.slots() - dict.slots() / 8);
+  for (Int i = 0; i < 10000; ++i) {
+    const auto *val = dict.find(Value{i * 7919});
+    ASSERT_NE(val, nullptr);
+    EXPECT_EQ(val->get<Int>(), i);
+  }
+  EXPECT_EQ(dict.find(Value{Int{1}}), nullptr);
+}
+
+TEST(Dict, ReserveAvoidsRehash) {
+  Dict dict{1000};
+  auto slots = dict.slots();
+  EXPECT_GE(slots, 1000);
+  for (Int i = 0; i < 1000; ++i) {
+    dict.set(Value{i}, Value{});
+  }
+  EXPECT_EQ(dict.slots(), slots);
+}
+
+TEST(Dict, ChurnStaysBounded) {
+  Dict dict{};
+  for (Int i = 0; i < 100000; ++i) {
+    dict.set(Value{i}, Value{i});
+    if (i >= 8) {
+      ASSERT_TRUE(dict.remove(Value{i - 8}));
+    }
+  }
+  EXPECT_EQ(dict.size(), 8);
+  EXPECT_LE(dict.slots(), 64);
+  for (Int i = 100000 - 8; i < 100000; ++i) {
+    EXPECT_TRUE(dict.find(Value{i}) != nullptr);
+  }
+}
+
+TEST(Dict, KeyTypes) {
+  Dict dict{};
+  dict.set(Value{Int{1}}, Value{Int{1}});
+  dict.set(Value{Float{1}}, Value{Int{2}});
+  dict.set(Value{Float{0}}, Value{Int{3}});
+  dict.set(Value{String{"a key longer than the inline buffer"}}, Value{Int{4}});
+  dict.set(Value{String{"short"}}, Value{Int{5}});
+  EXPECT_EQ(dict.size(), 5);
+
+  EXPECT_EQ(dict.find(Value{Int{1}})->get<Int>(), 1);
+  EXPECT_EQ(dict.find(Value{Float{1}})->get<Int>(), 2);
+  EXPECT_EQ(dict.find(Value{Float{-0.0F}})->get<Int>(), 3);
+  auto rope = String::concat(String{"a key longer "}, String{"than the inline buffer"});
+  EXPECT_EQ(dict.find(Value{rope})->get<Int>(), 4);
+  EXPECT_EQ(dict.find(Value{String{"short"}})->get<Int>(), 5);
+  EXPECT_EQ(dict.find(Value{String{"other"}}), nullptr);
+
+  auto nan = std::numeric_limits<Float>::quiet_NaN();
+  dict.set(Value{nan}, Value{Int{6}});
+  EXPECT_EQ(dict.find(Value{nan})->get<Int>(), 6);
+
+  EXPECT_TRUE(Dict::isKey(Value{String{}}));
+  EXPECT_FALSE(Dict::isKey(Value{}));
+  EXPECT_FALSE(Dict::isKey(Value{Array{1}}));
+}
+
+TEST(Dict, IteratesSlots) {
+  Dict dict{};
+  std::set<Int> keys{};
+  for (Int i = 0; i < 100; ++i) {
+    dict.set(Value{i * i}, Value{i});
+    keys.insert(i * i);
+  }
+  dict.remove(Value{Int{4}});
+  keys.erase(4);
+
+  std::set<Int> seen{};
+  for (std::size_t slot = 0; slot < dict.slots(); ++slot) {
+    if (const auto *key = dict.key(slot); key != nullptr) {
+      auto root = dict.value(slot).get<Int>();
+      EXPECT_EQ(root * root, key->get<Int>());
+      seen.insert(key->get<Int>());
+    }
+  }
+  EXPECT_EQ(seen, keys);
+}
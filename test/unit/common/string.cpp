@@ -0,0 +1,118 @@
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "common/string.hpp"
+
+using namespace pvm;
+
+TEST(String, ShortStringsStayInline) {
+  String str{"seven.."};
+  EXPECT_EQ(str.size(), 7);
+  EXPECT_EQ(str.view(), "seven..");
+  EXPECT_FALSE(str.isRope());
+
+  String longer{"fifteen bytes.."};
+  EXPECT_EQ(longer.size(), 15);
+  EXPECT_EQ(longer.view(), "fifteen bytes..");
+  EXPECT_FALSE(longer.isRope());
+
+  auto joined = String::concat(String{"abc"}, String{"def"});
+  EXPECT_EQ(joined.view(), "abcdef");
+  EXPECT_FALSE(joined.isRope());
+  EXPECT_EQ(String{}.size(), 0);
+}
+
+TEST(String, ConcatFlattensOnFirstView) {
+  String lhs{"a string longer than the inline buffer"};
+  String rhs{", and its tail"};
+  auto joined = String::concat(lhs, rhs);
+  EXPECT_TRUE(joined.isRope());
+  EXPECT_EQ(joined.size(), lhs.size() + rhs.size());
+
+  EXPECT_EQ(joined.view(), "a string longer than the inline buffer, and its tail");
+  EXPECT_FALSE(joined.isRope());
+  // the halves are untouched
+  EXPECT_EQ(lhs.view(), "a string longer than the inline buffer");
+}
+
+TEST(String, DeepConcatIsBounded) {
+  String str{};
+  std::string expected{};
+  for (int i = 0; i < 10000; ++i) {
+    auto piece = std::to_string(i % 10);
+    str = String::concat(str, String{piece});
+    expected += piece;
+  }
+  EXPECT_EQ(str.size(), 10000);
+  EXPECT_EQ(str.view(), expected);
+
+  // a long right-leaning chain still flattens without recursion
+  String tail{"0123456789abcdef"};
+  for (int i = 0; i < 1000; ++i) {
+    tail = String::concat(String{"xyz"}, tail);
+  }
+  EXPECT_EQ(tail.view().substr(0, 6), "xyzxyz");
+  EXPECT_EQ(tail.size(), 3 * 1000 + 16);
+}
+
+TEST(String, Slice) {
+  String str{"hello, wide world of strings"};
+  EXPECT_EQ(str.slice(7, 11).view(), "wide");
+  EXPECT_EQ(str.slice(0, str.size()).view(), str.view());
+  EXPECT_EQ(str.slice(3, 3).size(), 0);
+}
+
+TEST(String, HashAndCompare) {
+  String a{"a rather long string, a"};
+  String b{"a rather long string, b"};
+  EXPECT_EQ(String{""}.hash(), 0x811c9dc5U);
+  auto joined = String::concat(String{"a rather long "}, String{"string, a"});
+  EXPECT_EQ(a.hash(), joined.hash());
+  EXPECT_NE(a.hash(), b.hash());
+
+  EXPECT_LT(a.compare(b), 0);
+  EXPECT_GT(b.compare(a), 0);
+  EXPECT_EQ(a.compare(a), 0);
+  EXPECT_LT(String{"ab"}.compare(String{"abc"}), 0);
+
+  EXPECT_EQ(a, joined);
+  EXPECT_FALSE(a == b);
+}
+
+TEST(String, InterningSharesNodes) {
+  StringTable table{};
+  auto first = table.intern(String{"an identifier of some length"});
+  auto second = table.intern(
+      String::concat(String{"an identifier "}, String{"of some length"}));
+  auto other = table.intern(String{"another identifier, of some length"});
+  EXPECT_TRUE(first.interned());
+  EXPECT_EQ(table.size(), 2);
+  EXPECT_EQ(first, second);
+  EXPECT_FALSE(first == other);
+
+  auto shortStr = table.intern(String{"short"});
+  EXPECT_FALSE(shortStr.interned());
+  EXPECT_EQ(shortStr, String{"short"});
+  EXPECT_EQ(table.size(), 2);
+}
+
+TEST(String, ClearedTableForgetsIdentity) {
+  StringTable table{};
+  auto before = table.intern(String{"an identifier of some length"});
+  table.clear();
+  EXPECT_EQ(table.size(), 0);
+
+  auto after = table.intern(String{"an identifier of some length"});
+  EXPECT_EQ(before.view(), "an identifier of some length");
+  // distinct nodes, compared by content
+  EXPECT_EQ(before, after);
+  EXPECT_FALSE(before == table.intern(String{"an identifier of other length"}));
+}
+
+TEST(String, Prints) {
+  std::ostringstream ost{};
+  ost << String::concat(String{"a string longer than "}, String{"the inline one"});
+  EXPECT_EQ(ost.str(), "a string longer than the inline one");
+}
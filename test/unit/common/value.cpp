@@ -1,3 +1,6 @@
+#include <memory_resource>
+#include <stdexcept>
+
 #include <gtest/gtest.h>
 
 #include "common/value.hpp"
@@ -25,3 +28,27 @@ TEST(Value, WriteWrongType) {
 
   EXPECT_THROW(v.set<float>(1), pvm::ValueMismatchError);
 }
+
+TEST(Array, AssignmentIntoAnEmptyArrayKeepsTheSourceResource) {
+  std::pmr::monotonic_buffer_resource arena{};
+  pvm::Array source{3, &arena};
+  pvm::Array target{};
+
+  target = source;
+
+  EXPECT_EQ(target.size(), 3);
+  EXPECT_EQ(target.resource(), &arena);
+}
+
+TEST(Array, ResizeNeedsAResource) {
+  pvm::Array array{};
+
+  array.resize(0);
+  EXPECT_EQ(array.size(), 0);
+  EXPECT_THROW(array.resize(1), std::logic_error);
+
+  pvm::Array sized{0, std::pmr::new_delete_resource()};
+  sized.resize(2);
+  EXPECT_EQ(sized.size(), 2);
+  EXPECT_EQ(sized.resource(), std::pmr::new_delete_resource());
+}
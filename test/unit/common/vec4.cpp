@@ -0,0 +1,76 @@
+#include <cmath>
+#include <limits>
+
+#include <gtest/gtest.h>
+
+#include "common/vec4.hpp"
+
+using namespace pvm;
+
+// built twice, with and without PVM_NO_SIMD, the results have to agree
+
+TEST(Vec4, FloatArithmetic) {
+  Vec4f a{{1.5F, -2.0F, 3.0F, 8.0F}};
+  Vec4f b{{0.5F, 4.0F, -1.0F, 2.0F}};
+
+  EXPECT_EQ(vec4::add(a, b), (Vec4f{{2.0F, 2.0F, 2.0F, 10.0F}}));
+  EXPECT_EQ(vec4::sub(a, b), (Vec4f{{1.0F, -6.0F, 4.0F, 6.0F}}));
+  EXPECT_EQ(vec4::mul(a, b), (Vec4f{{0.75F, -8.0F, -3.0F, 16.0F}}));
+  EXPECT_EQ(vec4::div(a, b), (Vec4f{{3.0F, -0.5F, -3.0F, 4.0F}}));
+  EXPECT_EQ(vec4::fma(a, b, vec4::splat(1.0F)), (Vec4f{{1.75F, -7.0F, -2.0F, 17.0F}}));
+  EXPECT_EQ(vec4::min(a, b), (Vec4f{{0.5F, -2.0F, -1.0F, 2.0F}}));
+  EXPECT_EQ(vec4::max(a, b), (Vec4f{{1.5F, 4.0F, 3.0F, 8.0F}}));
+  EXPECT_EQ(vec4::hsum(a), 10.5F);
+}
+
+TEST(Vec4, FmaRoundsOnce) {
+  // 1 + 2^-12 squared is 1 + 2^-11 + 2^-24, the last term only survives
+  // without the intermediate rounding
+  auto x = vec4::splat(1.0F + std::ldexp(1.0F, -12));
+  auto res = vec4::fma(x, x, vec4::splat(-(1.0F + std::ldexp(1.0F, -11))));
+  EXPECT_EQ(res, vec4::splat(std::ldexp(1.0F, -24)));
+}
+
+TEST(Vec4, HsumOrder) {
+  Vec4f a{{1e8F, 1.0F, -1e8F, 1.0F}};
+  // (1e8 + -1e8) + (1 + 1)
+  EXPECT_EQ(vec4::hsum(a), 2.0F);
+}
+
+TEST(Vec4, IntLanesWrap) {
+  constexpr auto kMax = std::numeric_limits<Int>::max();
+  constexpr auto kMin = std::numeric_limits<Int>::min();
+  Vec4i a{{kMax, kMin, 7, -3}};
+  Vec4i b{{1, -1, -2, 5}};
+
+  EXPECT_EQ(vec4::add(a, b), (Vec4i{{kMin, kMax, 5, 2}}));
+  EXPECT_EQ(vec4::sub(a, b), (Vec4i{{kMax - 1, kMin + 1, 9, -8}}));
+  EXPECT_EQ(vec4::mul(a, b), (Vec4i{{kMax, kMin, -14, -15}}));
+  EXPECT_EQ(vec4::fma(a, b, vec4::splat(1)), (Vec4i{{kMin, kMin + 1, -13, -14}}));
+  EXPECT_EQ(vec4::min(a, b), (Vec4i{{1, kMin, -2, -3}}));
+  EXPECT_EQ(vec4::max(a, b), (Vec4i{{kMax, -1, 7, 5}}));
+  EXPECT_EQ(vec4::hsum(Vec4i{{kMax, 1, 2, 3}}), kMin + 5);
+}
+
+TEST(Vec4, CompareToMask) {
+  Vec4f a{{1.0F, 2.0F, 3.0F, NAN}};
+  Vec4f b{{2.0F, 2.0F, 1.0F, NAN}};
+  EXPECT_EQ(vec4::less(a, b), (Vec4i{{-1, 0, 0, 0}}));
+  EXPECT_EQ(vec4::equal(a, b), (Vec4i{{0, -1, 0, 0}}));
+
+  Vec4i c{{-5, 0, 5, 9}};
+  Vec4i d{{0, 0, 4, 10}};
+  EXPECT_EQ(vec4::less(c, d), (Vec4i{{-1, 0, 0, -1}}));
+  EXPECT_EQ(vec4::equal(c, d), (Vec4i{{0, -1, 0, 0}}));
+}
+
+TEST(Vec4, MinMaxPickSecondOnNan) {
+  Vec4f a{{NAN, 1.0F, NAN, 1.0F}};
+  Vec4f b{{1.0F, NAN, 1.0F, NAN}};
+  auto lo = vec4::min(a, b);
+  auto hi = vec4::max(a, b);
+  EXPECT_EQ(lo.lanes[0], 1.0F);
+  EXPECT_TRUE(std::isnan(lo.lanes[1]));
+  EXPECT_EQ(hi.lanes[2], 1.0F);
+  EXPECT_TRUE(std::isnan(hi.lanes[3]));
+}
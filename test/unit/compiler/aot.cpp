@@ -0,0 +1,180 @@
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "compiler/aot.hpp"
+#include "decoder/image.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/aot.hpp"
+#include "interpreter/interpreter.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+// clang-format off
+// prints 1 + 2 + ... + n for n read from input
+std::vector<Instr> loopSum() {
+  return {
+      /* 0 */ unary(eUNARY_READ), mov(1), imm(0), mov(2), imm(1), mov(3), imm(1), mov(4),
+      /* 8 */ binary(eBINARY_EQUAL, 4, 4), mov(6),
+      /* 10 */ binary(eBINARY_LESS, 1, 3), mov(5), branch(eBRANCH_BRANCH, 5, 6),
+      /* 13 */ binary(eBINARY_ADD, 2, 3), mov(2), binary(eBINARY_ADD, 3, 4), mov(3),
+      /* 17 */ branch(eBRANCH_BRANCH, 6, -7),
+      /* 18 */ unary(eUNARY_WRITE, 2), halt(),
+  };
+}
+
+// the same sum, recursively
+std::vector<Instr> recursiveSum() {
+  return {
+      /* 0 */ unary(eUNARY_READ), mov(1), binary(eBINARY_EQUAL, 1, 1), mov(2),
+      /* 4 */ branch(eBRANCH_CALL, 2, 4), mov(1), unary(eUNARY_WRITE, 1), halt(),
+      // sum(r1)
+      /* 8 */ imm(0), mov(3), binary(eBINARY_EQUAL, 1, 3), mov(4),
+      /* 12 */ branch(eBRANCH_BRANCH, 4, 12),
+      /* 13 */ binary(eBINARY_ADD, 1, 3), mov(7), imm(-1), mov(5),
+      /* 17 */ binary(eBINARY_ADD, 1, 5), mov(1), branch(eBRANCH_CALL, 2, -11),
+      /* 20 */ mov(8), binary(eBINARY_ADD, 7, 8), mov(9), branch(eBRANCH_RET, 9),
+      /* 24 */ imm(0), mov(9), branch(eBRANCH_RET, 9),
+  };
+}
+
+// a closure adding its captured 10 to the input, called twice
+std::vector<Instr> closure() {
+  return {
+      /* 0 */ imm(10), mov(5),
+      /* 2 */ func(eFUNC_NEW, 0, 14), func(eFUNC_BIND, 5, 0), mov(4),
+      /* 5 */ unary(eUNARY_READ), mov(1), branch(eBRANCH_ICALL, 4), mov(6),
+      /* 9 */ mov(1), branch(eBRANCH_ICALL, 4), mov(7),
+      /* 12 */ unary(eUNARY_WRITE, 6), unary(eUNARY_WRITE, 7), halt(),
+      // adder: r1 + env[0]
+      /* 15 */ halt(),
+      /* 16 */ mov(10), func(eFUNC_ENV, 10, 0), mov(11),
+      /* 19 */ binary(eBINARY_ADD, 1, 11), mov(12), branch(eBRANCH_RET, 12),
+  };
+}
+// clang-format on
+
+class Aot : public ::testing::Test {
+protected:
+  void SetUp() override {
+    m_dir = std::filesystem::temp_directory_path() /
+            ("pvm-aot-" + std::to_string(::getpid()) + "-" +
+             ::testing::UnitTest::GetInstance()->current_test_info()->name());
+    std::filesystem::create_directories(m_dir);
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(m_dir);
+  }
+
+  std::string build(const std::vector<Instr> &instrs, const AotOptions &options) {
+    auto source = (m_dir / "program.cpp").string();
+    auto output = (m_dir / (options.shared ? "program.so" : "program")).string();
+    std::ofstream{source} << emitAot(instrs, options);
+    buildAot(source, output, options);
+    return output;
+  }
+
+  static std::string interpret(const std::vector<Instr> &instrs,
+                               const std::string &input) {
+    std::istringstream ist{input};
+    std::ostringstream ost{};
+    Interpreter interp{std::make_shared<const Code>(instrs), ost, ist};
+    EXPECT_EQ(interp.run(), Interpreter::eHALTED);
+    return ost.str();
+  }
+
+  static std::string runCompiled(const AotLibrary &lib, const std::string &input,
+                                 std::uint64_t budget = Interpreter::kUnlimitedFuel) {
+    std::istringstream ist{input};
+    std::ostringstream ost{};
+    Interpreter interp{aotCode(lib.program()), ost, ist};
+    while (interp.run(lib.program(), budget) == Interpreter::eOUT_OF_FUEL) {
+    }
+    EXPECT_EQ(interp.getState().status, Interpreter::eHALTED);
+    return ost.str();
+  }
+
+  std::filesystem::path m_dir{};
+};
+
+} // namespace
+
+TEST(Image, RoundTripKeepsNegativeOffsets) {
+  auto instrs = recursiveSum();
+  auto decoded = decodeProgram(encodeProgram(instrs));
+  ASSERT_EQ(decoded.size(), instrs.size());
+  EXPECT_EQ(encodeProgram(decoded), encodeProgram(instrs));
+
+  auto call = std::get<InstrBRANCH>(decoded[19].instrVar);
+  EXPECT_EQ(static_cast<std::int32_t>(call.offset), -11);
+  auto dec = std::get<InstrIMM>(decoded[15].instrVar);
+  EXPECT_EQ(static_cast<std::int32_t>(dec.data), -1);
+}
+
+TEST(Image, EncoderRejectsFieldOverflow) {
+  std::vector<Instr> instrs{imm(1U << 20U)};
+  EXPECT_THROW((void)encodeProgram(instrs), std::out_of_range);
+  instrs = {mov(64)};
+  EXPECT_THROW((void)encodeProgram(instrs), std::out_of_range);
+}
+
+TEST_F(Aot, ImageSurvivesSaveAndLoad) {
+  auto path = (m_dir / "program.pvmb").string();
+  saveImage(path, closure());
+  EXPECT_EQ(encodeProgram(loadImage(path)), encodeProgram(closure()));
+}
+
+TEST_F(Aot, MatchesInterpreter) {
+  for (const auto &instrs : {loopSum(), recursiveSum(), closure()}) {
+    AotLibrary lib{build(instrs, AotOptions{.shared = true})};
+    for (const auto *input : {"0", "1", "7", "100"}) {
+      EXPECT_EQ(runCompiled(lib, input), interpret(instrs, input));
+    }
+  }
+}
+
+TEST_F(Aot, ResumesAfterRunningOutOfFuel) {
+  for (const auto &instrs : {loopSum(), recursiveSum()}) {
+    AotLibrary lib{build(instrs, AotOptions{.shared = true})};
+    EXPECT_EQ(runCompiled(lib, "50", 3), interpret(instrs, "50"));
+  }
+}
+
+TEST_F(Aot, StandaloneExecutable) {
+  auto exe = build(loopSum(), AotOptions{});
+  auto in = (m_dir / "in").string();
+  auto out = (m_dir / "out").string();
+  std::ofstream{in} << "10\n";
+
+  ASSERT_EQ(std::system((exe + " < " + in + " > " + out).c_str()), 0);
+  std::stringstream output{};
+  output << std::ifstream{out}.rdbuf();
+  EXPECT_EQ(output.str(), interpret(loopSum(), "10"));
+}
+
+TEST_F(Aot, RejectsOtherCode) {
+  AotLibrary lib{build(loopSum(), AotOptions{.shared = true})};
+  Interpreter interp{std::make_shared<const Code>(closure())};
+  EXPECT_THROW(interp.run(lib.program()), std::runtime_error);
+
+  // same length, one immediate differs
+  auto other = loopSum();
+  other[2] = imm(5);
+  interp.reset(std::make_shared<const Code>(other));
+  EXPECT_THROW(interp.run(lib.program()), std::runtime_error);
+}
@@ -0,0 +1,131 @@
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "compiler/layout.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+// clang-format off
+// 1 + 2 + ... + n with a never taken error path and dead code between the
+// loop and its exit
+std::vector<Instr> interleaved() {
+  std::vector<Instr> instrs{
+      /* 0 */ unary(eUNARY_READ), mov(1), imm(0), mov(2), imm(1), mov(3), imm(1), mov(4),
+      /* 8 */ imm(0), mov(7), binary(eBINARY_EQUAL, 4, 4), mov(6),
+      /* 12 */ branch(eBRANCH_BRANCH, 6, 6), halt(),
+      // cold: i < 0
+      /* 14 */ imm(-1), mov(9), unary(eUNARY_WRITE, 9), halt(),
+      // loop
+      /* 18 */ binary(eBINARY_LESS, 1, 3), mov(5), branch(eBRANCH_BRANCH, 5, 51),
+      /* 21 */ binary(eBINARY_LESS, 3, 7), mov(8), branch(eBRANCH_BRANCH, 8, -9),
+      /* 24 */ binary(eBINARY_ADD, 2, 3), mov(2), binary(eBINARY_ADD, 3, 4), mov(3),
+      /* 28 */ branch(eBRANCH_BRANCH, 6, -10), halt(),
+  };
+  // dead
+  instrs.insert(instrs.end(), 40, imm(0));
+  instrs.push_back(halt());
+  /* 71 */ instrs.insert(instrs.end(), {unary(eUNARY_WRITE, 2), halt()});
+  return instrs;
+}
+
+// a closure doubling its argument behind a dead halt
+std::vector<Instr> closure() {
+  return {
+      /* 0 */ func(eFUNC_NEW, 0, 13), mov(4),
+      /* 2 */ unary(eUNARY_READ), mov(1), branch(eBRANCH_ICALL, 4), mov(6),
+      /* 6 */ mov(1), branch(eBRANCH_ICALL, 4), mov(7),
+      /* 9 */ unary(eUNARY_WRITE, 6), unary(eUNARY_WRITE, 7), halt(),
+      /* 12 */ halt(),
+      /* 13 */ binary(eBINARY_ADD, 1, 1), mov(12), branch(eBRANCH_RET, 12),
+  };
+}
+// clang-format on
+
+std::string interpret(const std::vector<Instr> &instrs, const std::string &input) {
+  std::istringstream ist{input};
+  std::ostringstream ost{};
+  Interpreter interp{std::make_shared<const Code>(instrs), ost, ist};
+  EXPECT_EQ(interp.run(), Interpreter::eHALTED);
+  return ost.str();
+}
+
+Profile profile(const std::vector<Instr> &instrs, const std::string &input) {
+  std::istringstream ist{input};
+  return profileRun(instrs, ist);
+}
+
+} // namespace
+
+TEST(Layout, ProfileCountsExecutionsAndTransfers) {
+  auto counts = profile(interleaved(), "100");
+  EXPECT_EQ(counts.execs[0], 1);
+  EXPECT_EQ(counts.execs[18], 101);
+  EXPECT_EQ(counts.taken[28], 100);
+  EXPECT_EQ(counts.execs[21], 100);
+  EXPECT_EQ(counts.taken[23], 0);
+  EXPECT_EQ(counts.execs[14], 0);
+  EXPECT_EQ(counts.taken[20], 1);
+}
+
+TEST(Layout, ProfileSurvivesSaveAndLoad) {
+  auto path = (std::filesystem::temp_directory_path() /
+               ("pvm-layout-" + std::to_string(::getpid()) + ".profile"))
+                  .string();
+  auto counts = profile(interleaved(), "10");
+  saveProfile(path, counts);
+  auto loaded = loadProfile(path);
+  std::filesystem::remove(path);
+  EXPECT_EQ(loaded.execs, counts.execs);
+  EXPECT_EQ(loaded.taken, counts.taken);
+}
+
+TEST(Layout, HotChainsComeFirst) {
+  auto instrs = interleaved();
+  auto layout = layoutHotCold(instrs, profile(instrs, "100"));
+  ASSERT_EQ(layout.instrs.size(), instrs.size());
+
+  // entry, loop, exit, then the error path and the dead code
+  EXPECT_EQ(layout.instrs[14].opType, eBINARY);
+  EXPECT_EQ(layout.instrs[26].opID, eUNARY_WRITE);
+  EXPECT_EQ(std::get<InstrUNARY>(layout.instrs[26].instrVar).regid, 2);
+  EXPECT_EQ(layout.instrs[28].opType, eIMM);
+  EXPECT_EQ(layout.profile.execs[14], 101);
+
+  for (const auto *input : {"0", "1", "7", "100"}) {
+    EXPECT_EQ(interpret(layout.instrs, input), interpret(instrs, input));
+  }
+
+  auto before = measureLayout(instrs, profile(instrs, "100"));
+  auto after = measureLayout(layout.instrs, layout.profile);
+  EXPECT_LE(after.hotLines, before.hotLines);
+  EXPECT_LE(after.lineSwitches, before.lineSwitches);
+  EXPECT_LT(after.jumpDistance, before.jumpDistance);
+}
+
+TEST(Layout, PatchesFunctionEntries) {
+  auto instrs = closure();
+  auto layout = layoutHotCold(instrs, profile(instrs, "5"));
+  EXPECT_EQ(std::get<InstrFUNC>(layout.instrs[0].instrVar).offset, 12);
+  EXPECT_EQ(interpret(layout.instrs, "5"), "10\n20\n");
+  EXPECT_EQ(interpret(layout.instrs, "21"), interpret(instrs, "21"));
+}
+
+TEST(Layout, RejectsForeignProfile) {
+  EXPECT_THROW((void)layoutHotCold(closure(), profile(interleaved(), "1")),
+               std::invalid_argument);
+}
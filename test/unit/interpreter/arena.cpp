@@ -0,0 +1,180 @@
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "memory/arena.hpp"
+
+using namespace pvm;
+
+namespace {
+
+constexpr std::size_t kInt = 1;
+
+// r1 <- array[16], then call a function that returns at once
+CodePtr makeArrayAndCall() {
+  // clang-format off
+  std::vector<Instr> instrs{
+    Instr{.opType = eIMM, .opID = eIMM_ARRAY, .instrVar = InstrIMM::Builder().data(16).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    Instr{.opType = eBINARY, .opID = eBINARY_EQUAL, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(2).regid2(2).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    Instr{.opType = eBRANCH, .opID = eBRANCH_CALL, .instrVar = InstrBRANCH::Builder().regid(3).offset(2).build()},
+    Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+    Instr{.opType = eBRANCH, .opID = eBRANCH_RET, .instrVar = InstrBRANCH::Builder().regid(1).offset(0).build()},
+  };
+  // clang-format on
+  return std::make_shared<const Code>(std::move(instrs));
+}
+
+// grows the memory by a page twice and prints what each grow returned
+CodePtr makeGrowTwice() {
+  // clang-format off
+  std::vector<Instr> instrs{
+    Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(1).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    Instr{.opType = eMEM, .opID = eMEM_GROW, .instrVar = InstrMEM::Builder().regid(1).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    Instr{.opType = eUNARY, .opID = eUNARY_WRITE, .instrVar = InstrUNARY::Builder().ttypeid(kInt).regid(2).build()},
+    Instr{.opType = eMEM, .opID = eMEM_GROW, .instrVar = InstrMEM::Builder().regid(1).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    Instr{.opType = eUNARY, .opID = eUNARY_WRITE, .instrVar = InstrUNARY::Builder().ttypeid(kInt).regid(2).build()},
+    Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  };
+  // clang-format on
+  return std::make_shared<const Code>(std::move(instrs));
+}
+
+} // namespace
+
+TEST(Arena, TracksAllocations) {
+  Arena arena{};
+  auto *small = arena.allocate(24);
+  auto *large = arena.allocate(4096);
+  EXPECT_EQ(arena.stats().allocations, 2);
+  EXPECT_EQ(arena.stats().bytesInUse, 24 + 4096);
+  EXPECT_GE(arena.stats().reservedBytes, arena.stats().bytesInUse);
+
+  arena.deallocate(large, 4096);
+  EXPECT_EQ(arena.stats().deallocations, 1);
+  EXPECT_EQ(arena.stats().bytesInUse, 24);
+  EXPECT_EQ(arena.stats().peakBytes, 24 + 4096);
+
+  arena.deallocate(small, 24);
+  arena.release();
+  EXPECT_EQ(arena.stats().reservedBytes, 0);
+  EXPECT_EQ(arena.stats().allocations, 0);
+}
+
+TEST(Arena, ArraysStayInTheirResource) {
+  Arena arena{};
+  Array arr{8, &arena};
+  Value val{arr};
+  auto copy = val.get<Array>();
+  EXPECT_EQ(copy.resource(), &arena);
+  EXPECT_EQ(copy.size(), 8);
+  EXPECT_EQ(Array{4}.resource(), std::pmr::get_default_resource());
+}
+
+TEST(Arena, InterpreterAllocatesFromItsArena) {
+  Interpreter interp{makeArrayAndCall()};
+  ASSERT_EQ(interp.allocationStats().allocations, 0);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  const auto &state = interp.getState();
+  EXPECT_EQ(state.stack.get_allocator().resource(), state.arena);
+  EXPECT_EQ(state.rf.readReg(1).get<Array>().resource(), state.arena);
+  EXPECT_EQ(state.rf.readAcc().get<Array>().size(), 16);
+
+  auto stats = interp.allocationStats();
+  // the array, its copy in the pushed frame and the frame buffer
+  EXPECT_GE(stats.allocations, 3);
+  EXPECT_GT(stats.peakBytes, 0);
+
+  interp.reset();
+  EXPECT_EQ(interp.allocationStats().bytesInUse, 0);
+  EXPECT_EQ(interp.allocationStats().reservedBytes, 0);
+
+  // the instance keeps working on a fresh arena
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(state.rf.readReg(1).get<Array>().resource(), state.arena);
+  EXPECT_GT(interp.allocationStats().allocations, 0);
+}
+
+TEST(Arena, Limit) {
+  Arena arena{};
+  arena.setLimit(1024);
+  auto *ptr = arena.allocate(512);
+  EXPECT_THROW((void)arena.allocate(1024), ArenaLimitError);
+  EXPECT_EQ(arena.stats().refused, 1);
+  EXPECT_EQ(arena.stats().bytesInUse, 512);
+
+  EXPECT_FALSE(arena.setExternalBytes(768));
+  EXPECT_TRUE(arena.setExternalBytes(512));
+  EXPECT_EQ(arena.stats().peakBytes, 1024);
+  EXPECT_THROW((void)arena.allocate(8), ArenaLimitError);
+  EXPECT_EQ(arena.stats().refused, 3);
+
+  arena.deallocate(ptr, 512);
+  arena.release();
+  EXPECT_EQ(arena.limit(), 1024);
+}
+
+TEST(Arena, InterpreterTrapsPastItsLimit) {
+  Interpreter interp{makeArrayAndCall()};
+  interp.setMemoryLimit(64);
+  ASSERT_EQ(interp.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(interp.getState().trap.kind, Interpreter::eTRAP_OUT_OF_MEMORY);
+  EXPECT_EQ(interp.getState().trap.pc, 0);
+  EXPECT_EQ(interp.allocationStats().refused, 1);
+  EXPECT_EQ(Interpreter::describe(interp.getState().trap),
+            "memory limit exceeded at pc 0");
+
+  // kept by reset, and a higher limit lets the program through
+  interp.reset();
+  ASSERT_EQ(interp.run(), Interpreter::eTRAPPED);
+  interp.reset();
+  interp.setMemoryLimit(64 * 1024);
+  EXPECT_EQ(interp.run(), Interpreter::eHALTED);
+}
+
+TEST(Arena, MemoryGrowCountsTowardsTheLimit) {
+  std::istringstream ist{};
+  std::ostringstream ost{};
+  Interpreter interp{makeGrowTwice(), ost, ist};
+  interp.setMemoryLimit(Memory::kPageSize + Memory::kPageSize / 2);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(ost.str(), "0\n-1\n");
+  EXPECT_EQ(interp.getState().mem.pages(), 1);
+  EXPECT_EQ(interp.allocationStats().externalBytes, Memory::kPageSize);
+  EXPECT_GE(interp.allocationStats().peakBytes, Memory::kPageSize);
+  EXPECT_EQ(interp.allocationStats().refused, 1);
+}
+
+TEST(Arena, AttributesAllocationsToOpcodes) {
+  Interpreter interp{makeArrayAndCall()};
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  auto ops = interp.allocationsByOp();
+  ASSERT_FALSE(ops.empty());
+  std::size_t allocations = 0;
+  bool array = false;
+  for (const auto &op : ops) {
+    allocations += op.allocations;
+    array = array || (op.opType == eIMM && op.opID == eIMM_ARRAY);
+  }
+  EXPECT_TRUE(array);
+  // every allocation of the run, none was made before it
+  EXPECT_EQ(allocations, interp.allocationStats().allocations);
+  EXPECT_GE(ops.front().bytes, ops.back().bytes);
+
+  interp.reset();
+  EXPECT_TRUE(interp.allocationsByOp().empty());
+}
@@ -0,0 +1,143 @@
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/batch.hpp"
+#include "interpreter/interpreter.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+// clang-format off
+// reads n and writes 1 + ... + n, the loop runs a different number of times
+// in every lane
+CodePtr makeTriangle() {
+  return makeCode({
+      /* 0 */ unary(eUNARY_READ), mov(1), imm(0), mov(2), imm(1), mov(3),
+      /* 6 */ imm(0), mov(5), binary(eBINARY_EQUAL, 5, 5), mov(6),
+      /* 10 */ binary(eBINARY_LESS, 5, 1), mov(4), branch(eBRANCH_BRANCH, 4, 2),
+      /* 13 */ branch(eBRANCH_BRANCH, 6, 8),
+      /* 14 */ binary(eBINARY_ADD, 2, 1), mov(2), binary(eBINARY_SUB, 1, 3), mov(1),
+      /* 18 */ branch(eBRANCH_BRANCH, 6, -8), halt(), halt(),
+      /* 21 */ unary(eUNARY_WRITE, 2), halt(),
+  });
+}
+
+// reads a and b, writes |a - b| computed on either side of a branch
+CodePtr makeDistance() {
+  return makeCode({
+      /* 0 */ unary(eUNARY_READ, 0, kFloat), mov(1), unary(eUNARY_READ, 0, kFloat), mov(2),
+      /* 4 */ binary(eBINARY_LESS, 1, 2, kFloat), mov(3), branch(eBRANCH_BRANCH, 3, 5),
+      /* 7 */ binary(eBINARY_SUB, 1, 2, kFloat), mov(4), unary(eUNARY_WRITE, 4, kFloat), halt(),
+      /* 11 */ binary(eBINARY_SUB, 2, 1, kFloat), mov(4), unary(eUNARY_WRITE, 4, kFloat), halt(),
+  });
+}
+
+// reads a and b, writes 100 / b unless a is 0
+CodePtr makeGuardedDiv() {
+  return makeCode({
+      /* 0 */ unary(eUNARY_READ), mov(1), unary(eUNARY_READ), mov(2),
+      /* 4 */ imm(0), mov(3), binary(eBINARY_EQUAL, 1, 3), mov(4),
+      /* 8 */ branch(eBRANCH_BRANCH, 4, 6),
+      /* 9 */ imm(100), mov(5), binary(eBINARY_DIV, 5, 2), mov(6), unary(eUNARY_WRITE, 6),
+      /* 14 */ halt(),
+  });
+}
+// clang-format on
+
+std::string runScalar(const CodePtr &code, const std::string &input) {
+  std::stringstream ist{input};
+  std::stringstream ost{};
+  Interpreter interp{code, ost, ist};
+  EXPECT_EQ(interp.run(), Interpreter::eHALTED);
+  return ost.str();
+}
+
+} // namespace
+
+TEST(Batch, MatchesScalarAcrossDivergentLoops) {
+  auto code = makeTriangle();
+  std::vector<std::string> inputs{};
+  for (int n = 0; n < 150; ++n) {
+    inputs.push_back(std::to_string(n % 37));
+  }
+
+  BatchInterpreter batch{code};
+  auto outputs = batch.run(inputs);
+  ASSERT_EQ(outputs.size(), inputs.size());
+  for (std::size_t i = 0; i < inputs.size(); ++i) {
+    EXPECT_EQ(outputs[i], runScalar(code, inputs[i])) << "input " << inputs[i];
+  }
+
+  const auto &stats = batch.stats();
+  EXPECT_EQ(stats.groups, 3);
+  EXPECT_LT(stats.laneSteps, stats.steps * BatchInterpreter::kLanes);
+}
+
+TEST(Batch, MatchesScalarAcrossBranches) {
+  auto code = makeDistance();
+  std::vector<std::string> inputs{};
+  for (int i = 0; i < 100; ++i) {
+    inputs.push_back(std::to_string(i * 0.5F) + " " + std::to_string(25.0F - i * 0.25F));
+  }
+
+  BatchInterpreter batch{code};
+  auto outputs = batch.run(inputs);
+  for (std::size_t i = 0; i < inputs.size(); ++i) {
+    EXPECT_EQ(outputs[i], runScalar(code, inputs[i])) << "input " << inputs[i];
+  }
+}
+
+TEST(Batch, UniformInputsStayConverged) {
+  BatchInterpreter batch{makeTriangle()};
+  auto outputs = batch.run(std::vector<std::string>(BatchInterpreter::kLanes, "10"));
+  EXPECT_EQ(outputs.front(), "55\n");
+  EXPECT_EQ(batch.stats().laneSteps, batch.stats().steps * BatchInterpreter::kLanes);
+}
+
+TEST(Batch, RejectsCalls) {
+  auto code = makeCode({branch(eBRANCH_CALL, 0, 1), halt()});
+  EXPECT_THROW(BatchInterpreter{code}, std::runtime_error);
+}
+
+TEST(Batch, DivisionByZeroFaultsOnlyInActiveLanes) {
+  BatchInterpreter batch{makeGuardedDiv()};
+  auto outputs = batch.run({"1 4", "0 0", "1 -2"});
+  EXPECT_EQ(outputs, (std::vector<std::string>{"25\n", "", "-50\n"}));
+
+  EXPECT_THROW((void)batch.run({"1 4", "1 0"}), BatchTrapError);
+
+  // the error the scalar interpreter traps with
+  std::stringstream ist{"1 0"};
+  std::stringstream ost{};
+  Interpreter scalar{makeGuardedDiv(), ost, ist};
+  ASSERT_EQ(scalar.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(scalar.getState().trap.kind, Interpreter::eTRAP_DIVISION);
+  EXPECT_THROW(
+      {
+        try {
+          (void)batch.run({"1 0"});
+        } catch (const BatchTrapError &err) {
+          EXPECT_EQ(err.what(), Interpreter::describe(scalar.getState().trap));
+          throw;
+        }
+      },
+      BatchTrapError);
+}
+
+TEST(Batch, TypeMismatchThrows) {
+  auto code = makeCode(
+      {unary(eUNARY_READ, 0, kFloat), mov(1), unary(eUNARY_WRITE, 1), halt()});
+  BatchInterpreter batch{code};
+  EXPECT_THROW((void)batch.run({"1.5"}), ValueMismatchError);
+}
@@ -0,0 +1,247 @@
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "common/queue.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/channel.hpp"
+#include "interpreter/interpreter.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+// clang-format off
+// sends 1, ..., n over channel 0
+CodePtr makeProducer(Int n) {
+  return makeCode({
+      /* 0 */ imm(1), mov(1), imm(1), mov(2), imm(n + 1), mov(3),
+      /* 6 */ chan(eCHAN_SEND, 0, 1), binary(eBINARY_ADD, 1, 2), mov(1),
+      /* 9 */ binary(eBINARY_LESS, 1, 3), mov(4), branch(eBRANCH_BRANCH, 4, -5),
+      /* 12 */ halt(),
+  });
+}
+
+// receives n values from channel 0 and writes their sum
+CodePtr makeConsumer(Int n) {
+  return makeCode({
+      /* 0 */ imm(0), mov(5), imm(0), mov(1), imm(1), mov(2), imm(n), mov(3),
+      /* 8 */ chan(eCHAN_RECV, 0), mov(6), binary(eBINARY_ADD, 5, 6), mov(5),
+      /* 12 */ binary(eBINARY_ADD, 1, 2), mov(1), binary(eBINARY_LESS, 1, 3), mov(4),
+      /* 16 */ branch(eBRANCH_BRANCH, 4, -8), write(5), halt(),
+  });
+}
+// clang-format on
+
+} // namespace
+
+TEST(Channel, SpscQueueIsBoundedFifo) {
+  SpscQueue<int> queue{3};
+  ASSERT_EQ(queue.capacity(), 4);
+
+  for (int i = 0; i < 4; ++i) {
+    auto val = i;
+    EXPECT_TRUE(queue.tryPush(val));
+  }
+  auto extra = 4;
+  EXPECT_FALSE(queue.tryPush(extra));
+  EXPECT_TRUE(queue.full());
+
+  for (int i = 0; i < 4; ++i) {
+    int out = -1;
+    ASSERT_TRUE(queue.tryPop(out));
+    EXPECT_EQ(out, i);
+  }
+  int out = -1;
+  EXPECT_FALSE(queue.tryPop(out));
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(Channel, MpscQueueKeepsEveryProducersOrder) {
+  constexpr int kProducers = 4;
+  constexpr int kPerProducer = 20000;
+  MpscQueue<int> queue{64};
+
+  std::vector<std::thread> producers{};
+  for (int p = 0; p < kProducers; ++p) {
+    producers.emplace_back([&queue, p] {
+      for (int i = 0; i < kPerProducer; ++i) {
+        auto val = p * kPerProducer + i;
+        while (!queue.tryPush(val)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  std::vector<int> next(kProducers, 0);
+  for (int received = 0; received < kProducers * kPerProducer;) {
+    int val = 0;
+    if (!queue.tryPop(val)) {
+      std::this_thread::yield();
+      continue;
+    }
+    auto producer = val / kPerProducer;
+    EXPECT_EQ(val % kPerProducer, next[producer]++);
+    ++received;
+  }
+
+  for (auto &thread : producers) {
+    thread.join();
+  }
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(Channel, ArraysChangeHandsWithoutCopy) {
+  Channel channel{Channel::eSPSC, 2};
+  Value msg{Array{16, Channel::arrays()}};
+  const auto *storage = &msg.view<Array>().at(0);
+
+  ASSERT_TRUE(channel.trySend(msg));
+  Value out{};
+  ASSERT_TRUE(channel.tryRecv(out));
+  EXPECT_EQ(&out.view<Array>().at(0), storage);
+
+  // an array from somewhere else is copied into the shared pool once
+  auto moved = Channel::transferable(Value{Array{4}});
+  EXPECT_EQ(moved.view<Array>().resource(), Channel::arrays());
+  EXPECT_THROW((void)Channel::transferable(Value{Function{0}}), std::runtime_error);
+}
+
+// arrays made after attachChannel() are in the pool already, what they hold
+// is checked and copied all the same
+TEST(Channel, PoolArraysAreStillChecked) {
+  Channel channel{Channel::eSPSC, 2};
+  auto rope = String::concat(String{"a string too long"}, String{"to be stored inline"});
+  ASSERT_TRUE(rope.isRope());
+
+  Array nested{1, Channel::arrays()};
+  nested.at(0) = Value{rope};
+  Array strings{2, Channel::arrays()};
+  strings.at(0) = Value{rope};
+  strings.at(1) = Value{std::move(nested)};
+  Value msg{std::move(strings)};
+  const auto *storage = &msg.view<Array>().at(0);
+
+  msg = Channel::transferable(std::move(msg));
+  ASSERT_TRUE(channel.trySend(msg));
+  Value out{};
+  ASSERT_TRUE(channel.tryRecv(out));
+  const auto &arr = out.view<Array>();
+  EXPECT_EQ(&arr.at(0), storage);
+  EXPECT_FALSE(arr.at(0).view<String>().isRope());
+  EXPECT_FALSE(arr.at(1).view<Array>().at(0).view<String>().isRope());
+  EXPECT_EQ(arr.at(0).view<String>(), rope);
+
+  Array objects{1, Channel::arrays()};
+  objects.at(0) = Value{Object{nullptr}};
+  Value bad{std::move(objects)};
+  EXPECT_FALSE(Channel::canTransfer(bad));
+  EXPECT_THROW((void)Channel::transferable(std::move(bad)), std::runtime_error);
+}
+
+TEST(Channel, ReceiverParksUntilSenderRuns) {
+  constexpr Int kCount = 100;
+  auto channel = std::make_shared<Channel>(Channel::eSPSC, 4);
+
+  std::stringstream ist{};
+  std::stringstream ost{};
+  Interpreter producer{makeProducer(kCount)};
+  Interpreter consumer{makeConsumer(kCount), ost, ist};
+  producer.attachChannel(0, channel);
+  consumer.attachChannel(0, channel);
+
+  ASSERT_EQ(consumer.run(), Interpreter::eBLOCKED);
+  EXPECT_EQ(consumer.getState().blockedOn, channel.get());
+  EXPECT_EQ(consumer.getState().blockedOp, Channel::eRECV);
+
+  std::size_t rounds = 0;
+  auto producerStatus = Interpreter::eRUNNING;
+  auto consumerStatus = Interpreter::eBLOCKED;
+  while (consumerStatus != Interpreter::eHALTED) {
+    ASSERT_LT(++rounds, 1000U);
+    if (producerStatus != Interpreter::eHALTED) {
+      producerStatus = producer.run();
+      EXPECT_NE(producerStatus, Interpreter::eRUNNING);
+    }
+    consumerStatus = consumer.run();
+  }
+
+  EXPECT_GT(rounds, kCount / channel->capacity() - 1);
+  EXPECT_EQ(ost.str(), std::to_string(kCount * (kCount + 1) / 2) + "\n");
+}
+
+TEST(Channel, SendMovesArraysOutOfTheRegister) {
+  auto channel = std::make_shared<Channel>(Channel::eSPSC, 1);
+  Interpreter producer{makeCode({array(8), mov(1), chan(eCHAN_SEND, 0, 1), halt()})};
+  Interpreter consumer{makeCode({chan(eCHAN_RECV, 0), mov(2), halt()})};
+  producer.attachChannel(0, channel);
+  consumer.attachChannel(0, channel);
+
+  ASSERT_EQ(producer.run(), Interpreter::eHALTED);
+  ASSERT_EQ(consumer.run(), Interpreter::eHALTED);
+
+  EXPECT_TRUE(producer.getState().rf.readReg(1).holds<Null>());
+  auto received = consumer.getState().rf.readReg(2).get<Array>();
+  EXPECT_EQ(received.size(), 8);
+  EXPECT_EQ(received.resource(), consumer.getState().arrays);
+}
+
+// the storage of a sent array is charged to the sender until the receiver
+// moves it into its own account
+TEST(Channel, ReceiverTakesOverTheCharge) {
+  constexpr std::size_t kBytes = 64 * sizeof(Value);
+  auto channel = std::make_shared<Channel>(Channel::eSPSC, 1);
+  Interpreter producer{makeCode({array(64), mov(1), chan(eCHAN_SEND, 0, 1), halt()})};
+  Interpreter consumer{makeCode({chan(eCHAN_RECV, 0), mov(2), halt()})};
+  producer.attachChannel(0, channel);
+  consumer.attachChannel(0, channel);
+
+  ASSERT_EQ(producer.run(), Interpreter::eHALTED);
+  auto charged = producer.allocationStats().sharedBytes;
+  EXPECT_GE(charged, kBytes);
+  ASSERT_EQ(consumer.run(), Interpreter::eHALTED);
+  EXPECT_LE(producer.allocationStats().sharedBytes + kBytes, charged);
+  EXPECT_GE(consumer.allocationStats().sharedBytes, kBytes);
+  EXPECT_GE(consumer.allocationStats().peakBytes, kBytes);
+}
+
+TEST(Channel, MemoryLimitCoversThePool) {
+  auto channel = std::make_shared<Channel>(Channel::eSPSC, 1);
+  Interpreter sender{makeCode({array(1024), halt()})};
+  sender.attachChannel(0, channel);
+  sender.setMemoryLimit(4096);
+  ASSERT_EQ(sender.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(sender.getState().trap.kind, Interpreter::eTRAP_OUT_OF_MEMORY);
+  EXPECT_EQ(sender.getState().trap.pc, 0);
+  EXPECT_EQ(sender.allocationStats().refused, 1);
+  EXPECT_EQ(sender.allocationStats().sharedBytes, 0);
+
+  // the producer is gone by the time the array is received
+  {
+    Interpreter producer{makeCode({array(256), mov(1), chan(eCHAN_SEND, 0, 1), halt()})};
+    producer.attachChannel(0, channel);
+    ASSERT_EQ(producer.run(), Interpreter::eHALTED);
+  }
+  Interpreter consumer{makeCode({chan(eCHAN_RECV, 0), halt()})};
+  consumer.attachChannel(0, channel);
+  consumer.setMemoryLimit(4096);
+  ASSERT_EQ(consumer.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(consumer.getState().trap.kind, Interpreter::eTRAP_OUT_OF_MEMORY);
+  EXPECT_EQ(consumer.getState().trap.pc, 0);
+}
+
+TEST(Channel, UnattachedChannelTraps) {
+  Interpreter interp{makeCode({chan(eCHAN_RECV, 3), halt()})};
+  EXPECT_EQ(interp.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(interp.getState().trap.kind, Interpreter::eTRAP_UNATTACHED_CHANNEL);
+  EXPECT_EQ(interp.getState().trap.operand, 3);
+}
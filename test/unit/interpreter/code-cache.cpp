@@ -0,0 +1,195 @@
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "decoder/image.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/code-cache.hpp"
+#include "interpreter/interpreter.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+// clang-format off
+// prints its input plus `k`
+std::vector<Instr> addK(Int k) {
+  return {unary(eUNARY_READ), mov(1), imm(k), mov(2), binary(eBINARY_ADD, 1, 2), mov(3),
+          unary(eUNARY_WRITE, 3), halt()};
+}
+// clang-format on
+
+class CodeCacheTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    m_dir = std::filesystem::temp_directory_path() /
+            ("pvm-code-cache-" + std::to_string(::getpid()));
+    std::filesystem::remove_all(m_dir);
+  }
+
+  void TearDown() override {
+    std::filesystem::remove_all(m_dir);
+  }
+
+  std::string image(const std::vector<Instr> &instrs, const std::string &name) {
+    std::filesystem::create_directories(m_dir / "images");
+    auto path = (m_dir / "images" / name).string();
+    saveImage(path, instrs);
+    return path;
+  }
+
+  std::vector<std::filesystem::path> entries() const {
+    std::vector<std::filesystem::path> found{};
+    for (const auto &file : std::filesystem::directory_iterator{m_dir / "cache"}) {
+      found.push_back(file.path());
+    }
+    return found;
+  }
+
+  std::filesystem::path m_dir{};
+};
+
+std::string run(CodePtr code, const std::string &input) {
+  std::istringstream ist{input};
+  std::ostringstream ost{};
+  Interpreter interp{std::move(code), ost, ist};
+  EXPECT_EQ(interp.run(), Interpreter::eHALTED);
+  return ost.str();
+}
+
+} // namespace
+
+TEST_F(CodeCacheTest, SecondLoadHitsTheEntry) {
+  auto path = image(addK(3), "add3.pvm");
+
+  CodeCache cache{m_dir / "cache"};
+  auto first = cache.load(path);
+  EXPECT_EQ(cache.stats().misses, 1);
+  ASSERT_EQ(entries().size(), 1);
+
+  // a fresh cache, as in the next process
+  CodeCache next{m_dir / "cache"};
+  auto second = next.load(path);
+  EXPECT_EQ(next.stats().hits, 1);
+  EXPECT_EQ(next.stats().misses, 0);
+
+  ASSERT_EQ(second->size(), first->size());
+  EXPECT_EQ(encodeProgram({second->data().begin(), second->data().end()}),
+            encodeProgram(addK(3)));
+  EXPECT_EQ(second->verified(), std::optional{true});
+  EXPECT_EQ(run(second, "4"), "7\n");
+  EXPECT_TRUE(Interpreter{second}.getState().verified);
+}
+
+TEST_F(CodeCacheTest, KeyedByContents) {
+  CodeCache cache{m_dir / "cache"};
+  (void)cache.load(image(addK(1), "a.pvm"));
+  (void)cache.load(image(addK(2), "b.pvm"));
+  // the same bytecode under another name
+  (void)cache.load(image(addK(1), "c.pvm"));
+
+  EXPECT_EQ(cache.stats().misses, 2);
+  EXPECT_EQ(cache.stats().hits, 1);
+  EXPECT_EQ(entries().size(), 2);
+}
+
+TEST_F(CodeCacheTest, DamagedEntryIsReplaced) {
+  auto path = image(addK(5), "add5.pvm");
+  CodeCache cache{m_dir / "cache"};
+  (void)cache.load(path);
+
+  auto entry = entries().front();
+  auto size = std::filesystem::file_size(entry);
+  {
+    std::fstream fs{entry, std::ios::in | std::ios::out | std::ios::binary};
+    fs.seekp(static_cast<std::streamoff>(sizeof(CodeCacheHeader)));
+    fs.put('\xff');
+  }
+  EXPECT_EQ(run(cache.load(path), "1"), "6\n");
+  EXPECT_EQ(cache.stats().misses, 2);
+
+  std::filesystem::resize_file(entry, size / 2);
+  EXPECT_EQ(run(cache.load(path), "1"), "6\n");
+  EXPECT_EQ(cache.stats().misses, 3);
+
+  EXPECT_EQ(run(cache.load(path), "1"), "6\n");
+  EXPECT_EQ(cache.stats().hits, 1);
+}
+
+TEST_F(CodeCacheTest, DamagedInstructionsAreDecodedAgain) {
+  auto path = image(addK(5), "add5.pvm");
+  CodeCache cache{m_dir / "cache"};
+  (void)cache.load(path);
+
+  // the words still match, the opID of the last instruction does not fit
+  auto entry = entries().front();
+  auto size = std::filesystem::file_size(entry);
+  {
+    std::fstream fs{entry, std::ios::in | std::ios::out | std::ios::binary};
+    fs.seekp(static_cast<std::streamoff>(size - sizeof(Instr) + 1));
+    fs.put('\x7f');
+  }
+  auto code = cache.load(path);
+  EXPECT_EQ(cache.stats().misses, 2);
+  EXPECT_EQ(code->loadInstr(7).opID, eHALT_HALT);
+  EXPECT_EQ(run(code, "1"), "6\n");
+}
+
+TEST_F(CodeCacheTest, FlippedFlagsAreDecodedAgain) {
+  auto path = image(addK(5), "add5.pvm");
+  CodeCache cache{m_dir / "cache"};
+  auto verified = cache.load(path)->verified();
+  ASSERT_TRUE(verified.has_value());
+
+  auto entry = entries().front();
+  {
+    std::fstream fs{entry, std::ios::in | std::ios::out | std::ios::binary};
+    fs.seekp(static_cast<std::streamoff>(offsetof(CodeCacheHeader, flags)));
+    fs.put(*verified ? '\x00' : '\x01');
+  }
+  auto code = cache.load(path);
+  EXPECT_EQ(cache.stats().misses, 2);
+  EXPECT_EQ(code->verified(), verified);
+}
+
+TEST_F(CodeCacheTest, EvictsLeastRecentlyUsed) {
+  auto a = image(addK(1), "a.pvm");
+  auto b = image(addK(2), "b.pvm");
+  auto c = image(addK(3), "c.pvm");
+
+  CodeCache unbounded{m_dir / "cache"};
+  (void)unbounded.load(a);
+  (void)unbounded.load(b);
+  auto entrySize = std::filesystem::file_size(entries().front());
+
+  // a was stored first but used last
+  auto now = std::filesystem::file_time_type::clock::now();
+  for (const auto &entry : entries()) {
+    std::filesystem::last_write_time(entry, now - std::chrono::hours{1});
+  }
+  (void)unbounded.load(a);
+  EXPECT_EQ(unbounded.stats().hits, 1);
+
+  CodeCache bounded{m_dir / "cache", 2 * entrySize};
+  (void)bounded.load(c);
+  EXPECT_EQ(bounded.stats().evictions, 1);
+  ASSERT_EQ(entries().size(), 2);
+
+  CodeCache check{m_dir / "cache"};
+  (void)check.load(a);
+  (void)check.load(c);
+  EXPECT_EQ(check.stats().hits, 2);
+  (void)check.load(b);
+  EXPECT_EQ(check.stats().misses, 1);
+}
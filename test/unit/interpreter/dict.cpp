@@ -0,0 +1,153 @@
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "generated/handlers.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/verifier.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+// clang-format off
+InstrDICT dict(std::uint32_t regid1, std::uint32_t regid2 = 0) {
+  return InstrDICT::Builder().regid1(regid1).regid2(regid2).build();
+}
+
+Instr op(DictOpID opID, InstrDICT instr) {
+  return Instr{.opType = eDICT, .opID = opID, .instrVar = instr};
+}
+
+// reads n and n numbers, counts each of them in r2 and prints the number of
+// distinct ones and the count of 7
+std::vector<Instr> histogram() {
+  return {
+    /* 00 */ unary(eUNARY_READ),    mov(1),
+    /* 02 */ op(eDICT_NEW, dict(1)), mov(2),
+    /* 04 */ imm(0),                mov(3),
+    /* 06 */ imm(1),                mov(4),
+    /* 08 */ unary(eUNARY_READ),    mov(5),
+    /* 10 */ op(eDICT_HAS, dict(2, 5)), mov(6),
+    /* 12 */ branch(eBRANCH_BRANCH, 6, 3),
+    /* 13 */ imm(0),                op(eDICT_SET, dict(2, 5)),
+    /* 15 */ op(eDICT_GET, dict(2, 5)), mov(7),
+    /* 17 */ binary(eBINARY_ADD, 7, 4), op(eDICT_SET, dict(2, 5)),
+    /* 19 */ binary(eBINARY_ADD, 3, 4), mov(3),
+    /* 21 */ binary(eBINARY_LESS, 3, 1), mov(6),
+    /* 23 */ branch(eBRANCH_BRANCH, 6, -15),
+    /* 24 */ op(eDICT_SIZE, dict(2)), mov(8), unary(eUNARY_WRITE, 8),
+    /* 27 */ imm(7),                mov(9),
+    /* 29 */ op(eDICT_GET, dict(2, 9)), mov(10), unary(eUNARY_WRITE, 10),
+    /* 32 */ halt(),
+  };
+}
+// clang-format on
+
+} // namespace
+
+TEST(DictOps, CountsOccurrences) {
+  std::istringstream ist{"8  7 3 7 1 7 3 9 2"};
+  std::ostringstream ost{};
+  Interpreter interp{std::make_shared<const Code>(histogram()), ost, ist};
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(ost.str(), "5\n3\n");
+}
+
+TEST(DictOps, Verifies) {
+  // the counts come out of dict.get untyped, the rest is typed
+  EXPECT_FALSE(verify(Code{histogram()}).ok);
+
+  std::vector<Instr> instrs{imm(4),
+                            mov(1),
+                            op(eDICT_NEW, dict(1)),
+                            mov(2),
+                            op(eDICT_SET, dict(2, 1)),
+                            op(eDICT_HAS, dict(2, 1)),
+                            mov(3),
+                            op(eDICT_KEYS, dict(2)),
+                            mov(4),
+                            op(eDICT_SIZE, dict(2)),
+                            mov(5),
+                            unary(eUNARY_WRITE, 5),
+                            halt()};
+  ASSERT_TRUE(verify(Code{instrs}).ok);
+  instrs[4] = op(eDICT_SET, dict(1, 1));
+  EXPECT_FALSE(verify(Code{instrs}).ok);
+}
+
+TEST(DictOps, Keys) {
+  auto state = createState();
+  state.rf.writeReg(1, Value{Int{0}});
+  exec_dict_new(state, dict(1));
+  state.rf.writeReg(2, state.rf.readAcc());
+  for (Int key : {5, 6, 7}) {
+    state.rf.writeReg(3, Value{key});
+    exec_dict_set(state, dict(2, 3));
+  }
+  state.rf.writeReg(3, Value{Int{6}});
+  exec_dict_remove(state, dict(2, 3));
+  EXPECT_TRUE(state.rf.readAcc().get<Bool>());
+
+  exec_dict_keys(state, dict(2));
+  auto keys = state.rf.readAcc().get<Array>();
+  ASSERT_EQ(keys.size(), 2);
+  EXPECT_EQ(keys.at(0).get<Int>() + keys.at(1).get<Int>(), 12);
+  EXPECT_EQ(state.status, Interpreter::eRUNNING);
+}
+
+TEST(DictOps, MissingKeyTraps) {
+  auto state = createState();
+  state.rf.writeReg(1, Value{Dict{}});
+  state.rf.writeReg(2, Value{Int{3}});
+
+  exec_dict_get(state, dict(1, 2));
+
+  EXPECT_EQ(state.status, Interpreter::eTRAPPED);
+  EXPECT_EQ(state.trap.kind, Interpreter::eTRAP_MISSING_KEY);
+  EXPECT_EQ(state.trap.operand, 2);
+}
+
+TEST(DictOps, InvalidKeyTraps) {
+  auto state = createState();
+  state.rf.writeReg(1, Value{Dict{}});
+  state.rf.writeReg(2, Value{Array{1}});
+
+  exec_dict_set(state, dict(1, 2));
+
+  EXPECT_EQ(state.status, Interpreter::eTRAPPED);
+  EXPECT_EQ(state.trap.kind, Interpreter::eTRAP_TYPE_MISMATCH);
+  EXPECT_EQ(state.trap.operand, 2);
+}
+
+TEST(DictOps, SurvivesSnapshot) {
+  auto path = (std::filesystem::temp_directory_path() /
+               ("pvm-dict-" + std::to_string(::getpid()) + ".snap"))
+                  .string();
+  std::istringstream ist1{"8  7 3 7 1 "};
+  std::ostringstream ost1{};
+  Interpreter origin{std::make_shared<const Code>(histogram()), ost1, ist1};
+  origin.setNonBlockingInput(true);
+  ASSERT_EQ(origin.run(), Interpreter::eWAITING_INPUT);
+  origin.snapshot(path);
+
+  std::istringstream ist2{"7 3 9 2"};
+  std::ostringstream ost2{};
+  Interpreter restored{std::make_shared<const Code>(std::vector<Instr>{}), ost2, ist2};
+  restored.restore(path);
+  std::filesystem::remove(path);
+  EXPECT_EQ(restored.getState().rf.readReg(2).get<Dict>().size(), 3);
+  ASSERT_EQ(restored.run(), Interpreter::eHALTED);
+  EXPECT_EQ(ost2.str(), "5\n3\n");
+}
@@ -0,0 +1,156 @@
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "common/instruction.hpp"
+#include "generated/bytecode.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/embedded.hpp"
+#include "interpreter/interpreter.hpp"
+
+using namespace pvm;
+
+namespace {
+
+// clang-format off
+constexpr std::size_t kInt = 1;
+
+constexpr Instr imm(std::uint32_t data) {
+  return Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(data).build()};
+}
+
+constexpr Instr mov(std::uint32_t regid) {
+  return Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(regid).build()};
+}
+
+constexpr Instr binary(BinaryOpID opID, std::uint32_t regid1, std::uint32_t regid2) {
+  return Instr{.opType = eBINARY,
+               .opID = opID,
+               .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(regid1).regid2(regid2).build()};
+}
+
+constexpr Instr unary(UnaryOpID opID, std::uint32_t regid = 0) {
+  return Instr{.opType = eUNARY,
+               .opID = opID,
+               .instrVar = InstrUNARY::Builder().ttypeid(kInt).regid(regid).build()};
+}
+
+constexpr Instr func(FuncOpID opID, std::uint32_t regid, std::uint32_t offset) {
+  return Instr{.opType = eFUNC,
+               .opID = opID,
+               .instrVar = InstrFUNC::Builder().regid(regid).offset(offset).build()};
+}
+
+constexpr Instr branch(BranchOpID opID, std::uint32_t regid, std::uint32_t offset = 0) {
+  return Instr{.opType = eBRANCH,
+               .opID = opID,
+               .instrVar = InstrBRANCH::Builder().regid(regid).offset(offset).build()};
+}
+
+constexpr Instr halt() {
+  return Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()};
+}
+
+// prints 1 + 2 + ... + n for n read from input
+constexpr auto kLoopSum = encodeWords(std::array{
+    /* 0 */ unary(eUNARY_READ), mov(1), imm(0), mov(2), imm(1), mov(3), imm(1), mov(4),
+    /* 8 */ binary(eBINARY_EQUAL, 4, 4), mov(6),
+    /* 10 */ binary(eBINARY_LESS, 1, 3), mov(5), branch(eBRANCH_BRANCH, 5, 6),
+    /* 13 */ binary(eBINARY_ADD, 2, 3), mov(2), binary(eBINARY_ADD, 3, 4), mov(3),
+    /* 17 */ branch(eBRANCH_BRANCH, 6, -7),
+    /* 18 */ unary(eUNARY_WRITE, 2), halt(),
+});
+
+// the same sum, recursively
+constexpr auto kRecursiveSum = encodeWords(std::array{
+    /* 0 */ unary(eUNARY_READ), mov(1), binary(eBINARY_EQUAL, 1, 1), mov(2),
+    /* 4 */ branch(eBRANCH_CALL, 2, 4), mov(1), unary(eUNARY_WRITE, 1), halt(),
+    // sum(r1)
+    /* 8 */ imm(0), mov(3), binary(eBINARY_EQUAL, 1, 3), mov(4),
+    /* 12 */ branch(eBRANCH_BRANCH, 4, 12),
+    /* 13 */ binary(eBINARY_ADD, 1, 3), mov(7), imm(-1), mov(5),
+    /* 17 */ binary(eBINARY_ADD, 1, 5), mov(1), branch(eBRANCH_CALL, 2, -11),
+    /* 20 */ mov(8), binary(eBINARY_ADD, 7, 8), mov(9), branch(eBRANCH_RET, 9),
+    /* 24 */ imm(0), mov(9), branch(eBRANCH_RET, 9),
+});
+
+// a closure adding its captured 10 to the input, called twice
+constexpr auto kClosure = encodeWords(std::array{
+    /* 0 */ imm(10), mov(5),
+    /* 2 */ func(eFUNC_NEW, 0, 13), func(eFUNC_BIND, 5, 0), mov(4),
+    /* 5 */ unary(eUNARY_READ), mov(1), branch(eBRANCH_ICALL, 4), mov(6),
+    /* 9 */ mov(1), branch(eBRANCH_ICALL, 4), mov(7),
+    /* 12 */ unary(eUNARY_WRITE, 6), unary(eUNARY_WRITE, 7), halt(),
+    // adder: r1 + env[0]
+    /* 15 */ mov(10), func(eFUNC_ENV, 10, 0), mov(11),
+    /* 18 */ binary(eBINARY_ADD, 1, 11), mov(12), branch(eBRANCH_RET, 12),
+});
+// clang-format on
+
+static_assert(static_cast<std::int32_t>(
+                  std::get<InstrBRANCH>(decodeWord(kLoopSum[17]).instrVar).offset) == -7);
+static_assert(encodeWord(decodeWord(kRecursiveSum[15])) == kRecursiveSum[15]);
+
+template <const auto &Words>
+std::string runEmbedded(const std::string &input,
+                        std::uint64_t budget = Interpreter::kUnlimitedFuel) {
+  std::istringstream ist{input};
+  std::ostringstream ost{};
+  Interpreter interp{aotCode(kEmbedded<Words>), ost, ist};
+  while (interp.run(kEmbedded<Words>, budget) == Interpreter::eOUT_OF_FUEL) {
+  }
+  EXPECT_EQ(interp.getState().status, Interpreter::eHALTED);
+  return ost.str();
+}
+
+template <const auto &Words>
+std::string interpret(const std::string &input) {
+  std::istringstream ist{input};
+  std::ostringstream ost{};
+  Interpreter interp{aotCode(kEmbedded<Words>), ost, ist};
+  EXPECT_EQ(interp.run(), Interpreter::eHALTED);
+  return ost.str();
+}
+
+} // namespace
+
+TEST(Embedded, DecodesAtCompileTime) {
+  constexpr auto kInstr = decodeWord(kClosure[2]);
+  static_assert(kInstr.opType == eFUNC && kInstr.opID == eFUNC_NEW);
+  static_assert(std::get<InstrFUNC>(kInstr.instrVar).offset == 13);
+
+  auto code = aotCode(kEmbedded<kClosure>);
+  ASSERT_EQ(code->size(), kClosure.size());
+  EXPECT_EQ(code->loadInstr(2).opType, eFUNC);
+}
+
+TEST(Embedded, MatchesInterpreter) {
+  for (const auto *input : {"0", "1", "7", "100"}) {
+    EXPECT_EQ(runEmbedded<kLoopSum>(input), interpret<kLoopSum>(input));
+    EXPECT_EQ(runEmbedded<kRecursiveSum>(input), interpret<kRecursiveSum>(input));
+    EXPECT_EQ(runEmbedded<kClosure>(input), interpret<kClosure>(input));
+  }
+  EXPECT_EQ(runEmbedded<kLoopSum>("10"), "55\n");
+}
+
+TEST(Embedded, ResumesAfterRunningOutOfFuel) {
+  EXPECT_EQ(runEmbedded<kLoopSum>("50", 3), interpret<kLoopSum>("50"));
+  EXPECT_EQ(runEmbedded<kRecursiveSum>("50", 3), interpret<kRecursiveSum>("50"));
+}
+
+TEST(Embedded, WaitsForInput) {
+  std::istringstream ist{};
+  std::ostringstream ost{};
+  Interpreter interp{aotCode(kEmbedded<kLoopSum>), ost, ist};
+  interp.setNonBlockingInput(true);
+  ASSERT_EQ(interp.run(kEmbedded<kLoopSum>), Interpreter::eWAITING_INPUT);
+
+  ist.str("4");
+  ist.clear();
+  ASSERT_EQ(interp.run(kEmbedded<kLoopSum>), Interpreter::eHALTED);
+  EXPECT_EQ(ost.str(), "10\n");
+}
@@ -0,0 +1,129 @@
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/tracer.hpp"
+
+using namespace pvm;
+
+namespace {
+
+constexpr std::size_t kInt = 1;
+
+// r1 counts up to r3, the loop body is 5 instructions long
+Code makeCounter(Int limit) {
+  // clang-format off
+  std::vector<Instr> instrs{
+    /* 00 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    /* 01 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 02 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(1).build()},
+    /* 03 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 04 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(limit).build()},
+    /* 05 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 06 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(2).build()},
+    /* 07 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 08 */ Instr{.opType = eBINARY, .opID = eBINARY_LESS, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(3).build()},
+    /* 09 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(4).build()},
+    /* 10 */ Instr{.opType = eBRANCH, .opID = eBRANCH_BRANCH, .instrVar = InstrBRANCH::Builder().regid(4).offset(-4).build()},
+    /* 11 */ Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  };
+  // clang-format on
+  return Code{std::move(instrs)};
+}
+
+// r1 is forever true, the loop never exits
+Code makeSpin() {
+  // clang-format off
+  std::vector<Instr> instrs{
+    /* 00 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    /* 01 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 02 */ Instr{.opType = eBINARY, .opID = eBINARY_EQUAL, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(2).regid2(2).build()},
+    /* 03 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 04 */ Instr{.opType = eBRANCH, .opID = eBRANCH_BRANCH, .instrVar = InstrBRANCH::Builder().regid(1).offset(-2).build()},
+    /* 05 */ Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  };
+  // clang-format on
+  return Code{std::move(instrs)};
+}
+
+} // namespace
+
+TEST(Fuel, LongLoopRunsToCompletion) {
+  constexpr Int kLimit = 1'000'000;
+  auto code = makeCounter(kLimit);
+  Interpreter interp{code};
+
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(interp.getState().rf.readReg(1).get<Int>(), kLimit);
+}
+
+TEST(Fuel, SlicedRunMatchesUnbounded) {
+  constexpr Int kLimit = 1000;
+  constexpr std::uint64_t kBudget = 64;
+  auto code = makeCounter(kLimit);
+  Interpreter interp{code};
+
+  std::size_t slices = 0;
+  auto status = Interpreter::eRUNNING;
+  while ((status = interp.run(kBudget)) == Interpreter::eOUT_OF_FUEL) {
+    ++slices;
+  }
+
+  ASSERT_EQ(status, Interpreter::eHALTED);
+  EXPECT_EQ(interp.getState().rf.readReg(1).get<Int>(), kLimit);
+  // 5 instructions per iteration, a slice overshoots by at most one iteration
+  EXPECT_GE(slices, 5 * kLimit / (kBudget + 5));
+  EXPECT_LE(slices, 5 * kLimit / (kBudget - 5));
+  EXPECT_EQ(interp.run(kBudget), Interpreter::eHALTED);
+}
+
+TEST(Fuel, BudgetBoundsExecutedInstructions) {
+  constexpr std::uint64_t kBudget = 23;
+  constexpr std::uint64_t kSegment = 5;
+  auto code = makeCounter(100);
+  Interpreter interp{code};
+  Tracer tracer{1U << 12U};
+  interp.setTracer(&tracer);
+
+  std::uint64_t executed = 0;
+  while (interp.run(kBudget) == Interpreter::eOUT_OF_FUEL) {
+    auto slice = tracer.recorded() - executed;
+    EXPECT_LE(slice, kBudget + kSegment);
+    EXPECT_GE(slice, kBudget - kSegment);
+    executed = tracer.recorded();
+  }
+  EXPECT_EQ(interp.getState().rf.readReg(1).get<Int>(), 100);
+}
+
+TEST(Fuel, ZeroBudgetMakesNoProgressPastCheckpoint) {
+  auto code = makeSpin();
+  Interpreter interp{code};
+
+  ASSERT_EQ(interp.run(0), Interpreter::eOUT_OF_FUEL);
+  auto pc = interp.getState().rf.readPC();
+  EXPECT_EQ(pc, 4);
+
+  ASSERT_EQ(interp.run(0), Interpreter::eOUT_OF_FUEL);
+  EXPECT_EQ(interp.getState().rf.readPC(), pc);
+}
+
+TEST(Fuel, InterruptStopsEndlessLoop) {
+  auto code = makeSpin();
+  Interpreter interp{code};
+
+  std::thread stopper{[&interp] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    interp.interrupt();
+  }};
+  auto status = interp.run();
+  stopper.join();
+
+  ASSERT_EQ(status, Interpreter::eINTERRUPTED);
+  EXPECT_EQ(interp.run(1000), Interpreter::eOUT_OF_FUEL);
+}
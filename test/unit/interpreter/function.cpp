@@ -0,0 +1,107 @@
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+// r4 = closure adding its captured 10 to r1, called with 5 and 7
+CodePtr makeAdder() {
+  // clang-format off
+  return makeCode({
+      /* 0 */ imm(10), mov(5),
+      /* 2 */ func(eFUNC_NEW, 0, 12), func(eFUNC_BIND, 5, 0), mov(4),
+      /* 5 */ imm(5), mov(1), branch(eBRANCH_ICALL, 4), mov(6),
+      /* 9 */ imm(7), mov(1), branch(eBRANCH_ICALL, 4), mov(7),
+      /* 13 */ halt(),
+      // adder: r1 + env[0]
+      /* 14 */ mov(10), func(eFUNC_ENV, 10, 0), mov(11),
+      /* 17 */ binary(eBINARY_ADD, 1, 11), mov(12), branch(eBRANCH_RET, 12),
+  });
+  // clang-format on
+}
+
+} // namespace
+
+TEST(Function, ClosureSeesCapturedValues) {
+  Interpreter interp{makeAdder()};
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  const auto &state = interp.getState();
+  EXPECT_EQ(state.rf.readReg(6).get<Int>(), 15);
+  EXPECT_EQ(state.rf.readReg(7).get<Int>(), 17);
+
+  auto fn = state.rf.readReg(4).get<Function>();
+  EXPECT_EQ(fn.entry(), 14);
+  ASSERT_EQ(fn.captured(), 1);
+  EXPECT_EQ(fn.env(0).get<Int>(), 10);
+}
+
+TEST(Function, CallSiteFollowsChangingTargets) {
+  // apply(r4, r1) called with inc and then dbl
+  // clang-format off
+  auto code = makeCode({
+      /* 0 */ imm(0), mov(2),
+      /* 2 */ Instr{.opType = eBINARY, .opID = eBINARY_EQUAL, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(2).regid2(2).build()},
+      /* 3 */ mov(3),
+      /* 4 */ func(eFUNC_NEW, 0, 14), mov(4),
+      /* 6 */ imm(20), mov(1),
+      /* 8 */ branch(eBRANCH_CALL, 3, 7), mov(6),
+      /* 10 */ func(eFUNC_NEW, 0, 13), mov(4),
+      /* 12 */ branch(eBRANCH_CALL, 3, 3), mov(7),
+      /* 14 */ halt(),
+      // apply
+      /* 15 */ branch(eBRANCH_ICALL, 4), mov(9), branch(eBRANCH_RET, 9),
+      // inc
+      /* 18 */ imm(1), mov(8), binary(eBINARY_ADD, 1, 8), mov(9), branch(eBRANCH_RET, 9),
+      // dbl
+      /* 23 */ binary(eBINARY_ADD, 1, 1), mov(9), branch(eBRANCH_RET, 9),
+  });
+  // clang-format on
+
+  Interpreter interp{code};
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  const auto &state = interp.getState();
+  EXPECT_EQ(state.rf.readReg(6).get<Int>(), 21);
+  EXPECT_EQ(state.rf.readReg(7).get<Int>(), 40);
+  EXPECT_TRUE(state.stack.empty());
+}
+
+TEST(Function, RejectsTargetsOutsideTheCode) {
+  auto code =
+      makeCode({func(eFUNC_NEW, 0, 100), mov(1), branch(eBRANCH_ICALL, 1), halt()});
+  Interpreter interp{code};
+  EXPECT_EQ(interp.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(interp.getState().trap.kind, Interpreter::eTRAP_BAD_CALL_TARGET);
+  EXPECT_EQ(interp.getState().trap.operand, 100);
+}
+
+TEST(Function, SnapshotKeepsClosures) {
+  auto path = std::filesystem::temp_directory_path() / "pvm-function-snapshot.bin";
+
+  Interpreter origin{makeAdder()};
+  ASSERT_EQ(origin.run(), Interpreter::eHALTED);
+  origin.snapshot(path.string());
+
+  Interpreter restored{makeCode({})};
+  restored.restore(path.string());
+
+  auto fn = restored.getState().rf.readReg(4).get<Function>();
+  EXPECT_EQ(fn.entry(), 14);
+  ASSERT_EQ(fn.captured(), 1);
+  EXPECT_EQ(fn.env(0).get<Int>(), 10);
+
+  std::filesystem::remove(path);
+}
@@ -1,5 +1,6 @@
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <sstream>
 #include <vector>
 
@@ -20,8 +21,12 @@ using namespace pvm;
 constexpr std::uint32_t kInt = 1;
 
 auto createState() {
-  return Interpreter::State{Decoder{}, RegFile{}, Memory{}, Code{std::vector<Instr>{}},
-                            std::cout, std::cin};
+  return Interpreter::State{Decoder{},
+                            RegFile{},
+                            Memory{},
+                            std::make_shared<const Code>(std::vector<Instr>{}),
+                            std::cout,
+                            std::cin};
 }
 
 TEST(Handlers, Halt) {
@@ -113,3 +118,79 @@ TEST(Handlers, BinaryLess) {
 
   ASSERT_EQ(state.rf.readAcc().get<Bool>(), lhs < rhs);
 }
+
+TEST(Handlers, BinaryTypeMismatchTraps) {
+  RegId lrid = 6;
+  RegId rrid = 3;
+
+  auto state = createState();
+  state.rf.writeReg(lrid, Value{Int{1}});
+  state.rf.writeReg(rrid, Value{Float{2}});
+  auto add = InstrBINARY::Builder().regid1(lrid).regid2(rrid).ttypeid(kInt).build();
+
+  exec_binary_add(state, add);
+
+  ASSERT_EQ(state.status, Interpreter::eTRAPPED);
+  ASSERT_EQ(state.trap.kind, Interpreter::eTRAP_TYPE_MISMATCH);
+  ASSERT_EQ(state.trap.operand, rrid);
+  ASSERT_TRUE(state.rf.readAcc().holds<Null>());
+}
+
+TEST(Handlers, IntDivisionTraps) {
+  RegId lrid = 2;
+  RegId rrid = 4;
+
+  auto state = createState();
+  state.rf.writeReg(lrid, Value{Int{7}});
+  state.rf.writeReg(rrid, Value{Int{0}});
+  auto div = InstrBINARY::Builder().regid1(lrid).regid2(rrid).ttypeid(kInt).build();
+
+  exec_binary_div(state, div);
+
+  ASSERT_EQ(state.status, Interpreter::eTRAPPED);
+  ASSERT_EQ(state.trap.kind, Interpreter::eTRAP_DIVISION);
+  ASSERT_EQ(state.trap.operand, rrid);
+
+  auto overflow = createState();
+  overflow.rf.writeReg(lrid, Value{std::numeric_limits<Int>::min()});
+  overflow.rf.writeReg(rrid, Value{Int{-1}});
+
+  exec_binary_div(overflow, div);
+
+  ASSERT_EQ(overflow.status, Interpreter::eTRAPPED);
+  ASSERT_EQ(overflow.trap.kind, Interpreter::eTRAP_DIVISION);
+  ASSERT_TRUE(overflow.rf.readAcc().holds<Null>());
+}
+
+TEST(Handlers, UnknownTypeIdTraps) {
+  auto state = createState();
+  auto write = InstrUNARY::Builder().regid(1).ttypeid(7).build();
+
+  exec_unary_write(state, write);
+
+  ASSERT_EQ(state.status, Interpreter::eTRAPPED);
+  ASSERT_EQ(state.trap.kind, Interpreter::eTRAP_INVALID_TYPE_ID);
+  ASSERT_EQ(state.trap.operand, 7);
+}
+
+TEST(Handlers, TrapStopsTheRun) {
+  auto ret = Instr{.opType = eBRANCH,
+                   .opID = eBRANCH_RET,
+                   .instrVar = InstrBRANCH::Builder().regid(2).build()};
+  auto one = Instr{.opType = eIMM,
+                   .opID = eIMM_INTEGER,
+                   .instrVar = InstrIMM::Builder().data(1).build()};
+  Interpreter interp{std::make_shared<const Code>(std::vector<Instr>{one, ret, one})};
+
+  ASSERT_EQ(interp.run(), Interpreter::eTRAPPED);
+  const auto &state = interp.getState();
+  EXPECT_EQ(state.trap.kind, Interpreter::eTRAP_EMPTY_CALL_STACK);
+  EXPECT_EQ(state.trap.pc, 1);
+  EXPECT_EQ(state.rf.readPC(), 1);
+  EXPECT_EQ(Interpreter::describe(state.trap), "return with an empty call stack at pc 1");
+
+  // stays trapped until reset
+  EXPECT_EQ(interp.run(), Interpreter::eTRAPPED);
+  interp.reset();
+  EXPECT_EQ(interp.getState().trap.kind, Interpreter::eTRAP_NONE);
+}
@@ -0,0 +1,150 @@
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/hwprof.hpp"
+#include "interpreter/interpreter.hpp"
+
+using namespace pvm;
+
+namespace {
+
+constexpr std::size_t kInt = 1;
+
+// r1 <- readI, loop r1 times: r3 += 1, write r3
+Code makeProgram() {
+  // clang-format off
+  std::vector<Instr> instrs{
+    /* 00 */ Instr{.opType = eUNARY, .opID = eUNARY_READ, .instrVar = InstrUNARY::Builder().ttypeid(kInt).build()},
+    /* 01 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 02 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    /* 03 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 04 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(1).build()},
+    /* 05 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(4).build()},
+    /* 06 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(3).regid2(4).build()},
+    /* 07 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 08 */ Instr{.opType = eBINARY, .opID = eBINARY_LESS, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(3).regid2(1).build()},
+    /* 09 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(5).build()},
+    /* 10 */ Instr{.opType = eBRANCH, .opID = eBRANCH_BRANCH, .instrVar = InstrBRANCH::Builder().regid(5).offset(-4).build()},
+    /* 11 */ Instr{.opType = eUNARY, .opID = eUNARY_WRITE, .instrVar = InstrUNARY::Builder().ttypeid(kInt).regid(3).build()},
+    /* 12 */ Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  };
+  // clang-format on
+  return Code{std::move(instrs)};
+}
+
+std::uint64_t totalExecs(const std::vector<HwCounts> &counts) {
+  std::uint64_t execs = 0;
+  for (const auto &c : counts) {
+    execs += c.execs;
+  }
+  return execs;
+}
+
+} // namespace
+
+TEST(HwProf, ChargesEveryInstruction) {
+  if (!HwProfiler::available()) {
+    GTEST_SKIP() << "perf_event_open is not permitted here";
+  }
+  auto code = makeProgram();
+  std::stringstream ist{"3"};
+  std::stringstream ost{};
+  HwProfiler profiler{4};
+
+  Interpreter interp{code, ost, ist};
+  interp.setHwProfiler(&profiler);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(ost.str(), "3\n");
+
+  // 6 setup, 3 loop iterations of 5, write and halt
+  constexpr std::uint64_t kExecuted = 6 + 3 * 5 + 2;
+  std::vector<HwCounts> ops{};
+  for (std::uint8_t opType = 0; opType < eOPCODE_NUM; ++opType) {
+    for (std::uint8_t opID = 0; opID < HwProfiler::kOpsPerType; ++opID) {
+      ops.push_back(profiler.byOp(opType, opID));
+    }
+  }
+  EXPECT_EQ(totalExecs(ops), kExecuted);
+  EXPECT_EQ(profiler.byOp(eBINARY, eBINARY_ADD).execs, 3);
+  EXPECT_EQ(profiler.byOp(eBRANCH, eBRANCH_BRANCH).execs, 3);
+  EXPECT_EQ(profiler.byOp(eHALT, eHALT_HALT).execs, 1);
+
+  const auto &ranges = profiler.byRange();
+  ASSERT_EQ(ranges.size(), 4);
+  EXPECT_EQ(totalExecs(ranges), kExecuted);
+  // pcs 8-11: the loop tail, then the write after it
+  EXPECT_EQ(ranges[2].execs, 3 * 3 + 1);
+}
+
+TEST(HwProf, CountsTime) {
+  if (!HwProfiler::available()) {
+    GTEST_SKIP() << "perf_event_open is not permitted here";
+  }
+  auto code = makeProgram();
+  std::stringstream ist{"20000"};
+  std::stringstream ost{};
+  HwProfiler profiler{};
+
+  Interpreter interp{code, ost, ist};
+  interp.setHwProfiler(&profiler);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  auto clock = profiler.has(eHW_CYCLES) ? eHW_CYCLES : eHW_TASK_CLOCK;
+  ASSERT_TRUE(profiler.has(clock));
+  std::uint64_t total = 0;
+  for (const auto &range : profiler.byRange()) {
+    total += range.values[clock];
+  }
+  EXPECT_GT(total, 0);
+  EXPECT_EQ(profiler.byOp(eBINARY, eBINARY_ADD).execs, 20000);
+}
+
+TEST(HwProf, DetachedRunIsNotCharged) {
+  if (!HwProfiler::available()) {
+    GTEST_SKIP() << "perf_event_open is not permitted here";
+  }
+  auto code = makeProgram();
+  std::stringstream ist{"2 2"};
+  std::stringstream ost{};
+  HwProfiler profiler{};
+
+  Interpreter interp{code, ost, ist};
+  interp.setHwProfiler(&profiler);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  auto execs = totalExecs(profiler.byRange());
+
+  interp.reset();
+  interp.setHwProfiler(&profiler);
+  interp.setHwProfiler(nullptr);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(totalExecs(profiler.byRange()), execs);
+  EXPECT_EQ(ost.str(), "2\n2\n");
+}
+
+TEST(HwProf, ReportsOpcodesAndRanges) {
+  if (!HwProfiler::available()) {
+    GTEST_SKIP() << "perf_event_open is not permitted here";
+  }
+  auto code = makeProgram();
+  std::stringstream ist{"5"};
+  std::stringstream ost{};
+  HwProfiler profiler{};
+
+  Interpreter interp{code, ost, ist};
+  interp.setHwProfiler(&profiler);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  std::ostringstream report{};
+  profiler.report(report);
+  auto text = report.str();
+  EXPECT_NE(text.find("binary.add"), std::string::npos);
+  EXPECT_NE(text.find("halt.halt"), std::string::npos);
+  EXPECT_NE(text.find("0-15"), std::string::npos);
+  EXPECT_EQ(text.find("vec.add"), std::string::npos);
+}
@@ -0,0 +1,138 @@
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/memo.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+// clang-format off
+constexpr Addr kFibEntry = 13;
+
+// r2 = fib(n) computed by plain double recursion, r26 is true, r27 = 1, r28 = 2
+CodePtr makeFib(Int n) {
+  return makeCode({
+      /* 0 */ imm(0), mov(25), imm(1), mov(27), imm(2), mov(28),
+      /* 6 */ imm(n), mov(1), binary(eBINARY_EQUAL, 25, 25), mov(26),
+      /* 10 */ branch(eBRANCH_CALL, 26, 3), mov(2), halt(),
+      // fib: n < 2 ? n : fib(n - 1) + fib(n - 2)
+      /* 13 */ binary(eBINARY_LESS, 1, 28), mov(20), branch(eBRANCH_BRANCH, 20, 12),
+      /* 16 */ binary(eBINARY_SUB, 1, 27), mov(1), branch(eBRANCH_CALL, 26, -5), mov(22),
+      /* 20 */ binary(eBINARY_SUB, 1, 27), mov(1), branch(eBRANCH_CALL, 26, -9), mov(23),
+      /* 24 */ binary(eBINARY_ADD, 22, 23), mov(24), branch(eBRANCH_RET, 24),
+      /* 27 */ branch(eBRANCH_RET, 1),
+  });
+}
+
+// calls a function printing its argument twice
+CodePtr makeImpure() {
+  return makeCode({
+      /* 0 */ imm(7), mov(1), binary(eBINARY_EQUAL, 1, 1), mov(26),
+      /* 4 */ branch(eBRANCH_CALL, 26, 4), branch(eBRANCH_CALL, 26, 3), halt(),
+      /* 7 */ halt(),
+      /* 8 */ write(1), branch(eBRANCH_RET, 1),
+  });
+}
+
+// calls a function returning a fresh array twice, r2 and r3 hold the results
+CodePtr makeArrays() {
+  return makeCode({
+      /* 0 */ imm(0), mov(1), binary(eBINARY_EQUAL, 1, 1), mov(26),
+      /* 4 */ branch(eBRANCH_CALL, 26, 5), mov(2), branch(eBRANCH_CALL, 26, 3), mov(3),
+      /* 8 */ halt(),
+      /* 9 */ array(4), mov(4), branch(eBRANCH_RET, 4),
+  });
+}
+// clang-format on
+
+} // namespace
+
+TEST(Memo, FibLiveIns) {
+  auto code = makeFib(5);
+  auto info = analyzePurity(*code, kFibEntry);
+
+  EXPECT_TRUE(info.pure);
+  EXPECT_EQ(info.liveIns, (std::vector<RegId>{1, 26, 27, 28}));
+}
+
+TEST(Memo, WriteIsImpure) {
+  auto code = makeImpure();
+  EXPECT_FALSE(analyzePurity(*code, 8).pure);
+  EXPECT_TRUE(analyzePurity(*code, 8, true).pure);
+}
+
+TEST(Memo, RecursiveFib) {
+  Interpreter plain{makeFib(20)};
+  ASSERT_EQ(plain.run(), Interpreter::eHALTED);
+  EXPECT_EQ(plain.getState().rf.readReg(2).get<Int>(), 6765);
+  EXPECT_EQ(plain.memoStats().hits, 0);
+
+  Interpreter interp{makeFib(20)};
+  interp.enableMemoization(64);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(interp.getState().rf.readReg(2).get<Int>(), 6765);
+
+  const auto &stats = interp.memoStats();
+  EXPECT_EQ(stats.misses, 21);
+  EXPECT_GT(stats.hits, 0);
+  EXPECT_EQ(stats.entries, 21);
+  EXPECT_EQ(stats.evictions, 0);
+  EXPECT_TRUE(interp.getState().stack.empty());
+}
+
+TEST(Memo, EvictsLeastRecentlyUsed) {
+  Interpreter interp{makeFib(15)};
+  interp.enableMemoization(2);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(interp.getState().rf.readReg(2).get<Int>(), 610);
+
+  const auto &stats = interp.memoStats();
+  EXPECT_EQ(stats.entries, 2);
+  EXPECT_GT(stats.evictions, 0);
+}
+
+TEST(Memo, SkipsImpureCalls) {
+  std::stringstream ost{};
+  std::stringstream ist{};
+  Interpreter interp{makeImpure(), ost, ist};
+  interp.enableMemoization(16);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  EXPECT_EQ(ost.str(), "7\n7\n");
+  EXPECT_EQ(interp.memoStats().skipped, 2);
+  EXPECT_EQ(interp.memoStats().entries, 0);
+}
+
+TEST(Memo, ResetDisables) {
+  Interpreter interp{makeFib(10)};
+  interp.enableMemoization(16);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  interp.reset(makeFib(10));
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(interp.getState().rf.readReg(2).get<Int>(), 55);
+  EXPECT_EQ(interp.memoStats().misses, 0);
+}
+
+// memoized results live in the arena, they have to go before it is released
+TEST(Memo, ResetDropsArenaResultsFirst) {
+  Interpreter interp{makeArrays()};
+  interp.enableMemoization(16);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  ASSERT_EQ(interp.memoStats().hits, 1);
+  EXPECT_EQ(interp.getState().rf.readReg(3).get<Array>().size(), 4);
+
+  interp.reset(makeCode({halt()}));
+  EXPECT_EQ(interp.allocationStats().deallocations, 0);
+  EXPECT_EQ(interp.allocationStats().bytesInUse, 0);
+}
@@ -0,0 +1,90 @@
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+TEST(Memory, GrowCommitsZeroedPages) {
+  Memory mem{};
+  EXPECT_EQ(mem.pages(), 0);
+  EXPECT_EQ(mem.grow(2), 0);
+  EXPECT_EQ(mem.grow(1), 2);
+  EXPECT_EQ(mem.size(), 3 * Memory::kPageSize);
+  EXPECT_EQ(mem.load<Int>(mem.size() - sizeof(Int)), 0);
+
+  mem.store<Int>(12, 42);
+  EXPECT_EQ(mem.load<Int>(12), 42);
+  EXPECT_EQ(mem.grow(Memory::kMaxPages), -1);
+  EXPECT_EQ(mem.pages(), 3);
+
+  mem.reset();
+  EXPECT_EQ(mem.pages(), 0);
+  mem.grow(1);
+  EXPECT_EQ(mem.load<Int>(12), 0);
+}
+
+TEST(Memory, LoadStoreInstructions) {
+  // r1 <- 1, grow by r1, r2 <- 100, [r2 + 8] <- -7, [r2 + 12] <- 2.5, load both back
+  // clang-format off
+  auto code = makeCode({
+      imm(1), mov(1),
+      mem(eMEM_GROW, 0, 1, 0), mov(3),
+      imm(100), mov(2),
+      imm(static_cast<std::uint32_t>(-7)), mem(eMEM_STORE, kInt, 2, 8),
+      mem(eMEM_LOAD, kInt, 2, 8), mov(4),
+      Instr{.opType = eIMM, .opID = eIMM_FLOATING, .instrVar = InstrIMM::Builder().data(0x4100).build()},
+      mem(eMEM_STORE, kFloat, 2, 12),
+      mem(eMEM_LOAD, kFloat, 2, 12), mov(5),
+      mem(eMEM_SIZE, 0, 0, 0), mov(6),
+      halt(),
+  });
+  // clang-format on
+
+  Interpreter interp{code};
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  const auto &state = interp.getState();
+  EXPECT_EQ(state.rf.readReg(3).get<Int>(), 0);
+  EXPECT_EQ(state.rf.readReg(4).get<Int>(), -7);
+  EXPECT_FLOAT_EQ(state.rf.readReg(5).get<Float>(), 2.5F);
+  EXPECT_EQ(state.rf.readReg(6).get<Int>(), 1);
+  EXPECT_EQ(state.mem.load<Int>(108), -7);
+}
+
+TEST(Memory, OutOfBoundsAccessTraps) {
+  // load from an empty memory, then from just past one committed page
+  auto empty = makeCode({imm(0), mov(1), mem(eMEM_LOAD, kInt, 1, 0), halt()});
+  Interpreter interp{empty};
+  EXPECT_EQ(interp.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(interp.getState().trap.kind, Interpreter::eTRAP_MEMORY_FAULT);
+  EXPECT_EQ(interp.getState().trap.pc, 2);
+  EXPECT_EQ(interp.getState().rf.readPC(), 2);
+
+  auto pastEnd = makeCode({
+      imm(1), mov(1), mem(eMEM_GROW, 0, 1, 0),
+      imm(Memory::kPageSize - 2048), mov(2),
+      imm(1), mem(eMEM_STORE, kInt, 2, 2044),
+      mem(eMEM_STORE, kInt, 2, 2045),
+      halt(),
+  });
+  interp.reset(pastEnd);
+  EXPECT_EQ(interp.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(interp.getState().trap.pc, 7);
+  EXPECT_EQ(interp.getState().rf.readPC(), 7);
+  EXPECT_EQ(interp.getState().mem.load<Int>(Memory::kPageSize - 4), 1);
+
+  // the interpreter stays usable after a fault
+  interp.reset(makeCode(
+      {imm(1), mov(1), mem(eMEM_GROW, 0, 1, 0), mem(eMEM_LOAD, kInt, 1, 0), halt()}));
+  EXPECT_EQ(interp.run(), Interpreter::eHALTED);
+}
@@ -0,0 +1,98 @@
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "common/value.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/native.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+Int gSeen = 0;
+
+Float scale(Int n, Float x) {
+  return static_cast<Float>(n) * x;
+}
+
+void remember(Int val) noexcept {
+  gSeen = val;
+}
+
+Int increment(Int val) {
+  return val + 1;
+}
+
+Float identity(Float val) {
+  return val;
+}
+
+// clang-format off
+// r1 = 3, r2 = 2.5, r3 = scale(r1, r2), remember(r1), r4 = r1 + 1
+CodePtr makeProgram() {
+  return std::make_shared<const Code>(std::vector<Instr>{
+      imm(3), mov(1),
+      Instr{.opType = eIMM, .opID = eIMM_FLOATING, .instrVar = InstrIMM::Builder().data(0x4100).build()},
+      mov(2),
+      native(1, 7), mov(3),
+      native(1, 0),
+      native(1, 2), mov(4),
+      halt(),
+  });
+}
+// clang-format on
+
+// functions may be passed to natives but not made by them
+static_assert(NativeType<Function> && !NativeResult<Function>);
+static_assert(NativeResult<Array>);
+
+} // namespace
+
+TEST(Native, PassesRegistersUnboxed) {
+  Interpreter interp{makeProgram()};
+  interp.registerNative<&scale>(7);
+  interp.registerNative<&remember>(0);
+  interp.registerNative<&increment>(2);
+
+  gSeen = 0;
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  const auto &rf = interp.getState().rf;
+  EXPECT_FLOAT_EQ(rf.readReg(3).get<Float>(), 7.5F);
+  EXPECT_EQ(rf.readReg(4).get<Int>(), 4);
+  EXPECT_EQ(gSeen, 3);
+}
+
+TEST(Native, UnregisteredIdTraps) {
+  Interpreter interp{makeProgram()};
+  interp.registerNative<&scale>(7);
+  EXPECT_EQ(interp.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(interp.getState().trap.kind, Interpreter::eTRAP_UNREGISTERED_NATIVE);
+}
+
+TEST(Native, ArgumentTypesAreChecked) {
+  auto code = std::make_shared<const Code>(
+      std::vector<Instr>{imm(1), mov(1), native(1, 0), halt()});
+  Interpreter interp{code};
+  interp.registerNative<&identity>(0);
+  EXPECT_EQ(interp.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(interp.getState().trap.kind, Interpreter::eTRAP_NATIVE_ARGUMENT);
+  EXPECT_EQ(interp.getState().trap.pc, 2);
+}
+
+TEST(Native, ResetDropsRegistrations) {
+  Interpreter interp{makeProgram()};
+  interp.registerNative<&scale>(7);
+  EXPECT_EQ(interp.getState().natives.size(), 8);
+
+  interp.reset();
+  EXPECT_TRUE(interp.getState().natives.empty());
+}
@@ -0,0 +1,124 @@
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "common/shape.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+TEST(Object, ShapesFollowFieldOrder) {
+  ShapeTree tree{};
+  const auto *xy = tree.transition(tree.transition(tree.root(), 1), 2);
+  const auto *yx = tree.transition(tree.transition(tree.root(), 2), 1);
+
+  EXPECT_EQ(tree.transition(tree.transition(tree.root(), 1), 2), xy);
+  EXPECT_NE(xy, yx);
+  EXPECT_EQ(tree.size(), 5);
+
+  EXPECT_EQ(xy->find(1), 0);
+  EXPECT_EQ(xy->find(2), 1);
+  EXPECT_EQ(yx->find(1), 1);
+  EXPECT_EQ(xy->find(3), Shape::kNoSlot);
+  EXPECT_EQ(xy->fields(), (std::vector<FieldId>{1, 2}));
+}
+
+TEST(Object, GetAndSetFields) {
+  auto code = makeCode({
+      object(eOBJECT_NEW), mov(1),
+      imm(10), object(eOBJECT_SET, 1, 5),
+      imm(20), object(eOBJECT_SET, 1, 7),
+      imm(30), object(eOBJECT_SET, 1, 5),
+      object(eOBJECT_GET, 1, 5), mov(2),
+      object(eOBJECT_GET, 1, 7), mov(3),
+      halt(),
+  });
+
+  Interpreter interp{code};
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  const auto &state = interp.getState();
+  EXPECT_EQ(state.rf.readReg(2).get<Int>(), 30);
+  EXPECT_EQ(state.rf.readReg(3).get<Int>(), 20);
+  EXPECT_EQ(state.rf.readReg(1).get<Object>().shape()->size(), 2);
+}
+
+TEST(Object, MissingFieldTraps) {
+  auto code = makeCode({object(eOBJECT_NEW), mov(1), object(eOBJECT_GET, 1, 3), halt()});
+  Interpreter interp{code};
+  EXPECT_EQ(interp.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(interp.getState().trap.kind, Interpreter::eTRAP_MISSING_FIELD);
+  EXPECT_EQ(interp.getState().trap.operand, 3);
+}
+
+TEST(Object, CallSiteCachesEveryShapeItSees) {
+  constexpr std::uint32_t kGetter = 19;
+
+  // clang-format off
+  auto code = makeCode({
+      /* 0 */ imm(0), mov(2),
+      /* 2 */ Instr{.opType = eBINARY, .opID = eBINARY_EQUAL, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(2).regid2(2).build()},
+      /* 3 */ mov(3),
+      // {f1: 11}
+      /* 4 */ object(eOBJECT_NEW), mov(1), imm(11), object(eOBJECT_SET, 1, 1),
+      /* 8 */ branch(eBRANCH_CALL, 3, kGetter - 8), mov(6),
+      // {f2: 1, f1: 22}
+      /* 10 */ object(eOBJECT_NEW), mov(1), imm(1), object(eOBJECT_SET, 1, 2),
+      /* 14 */ imm(22), object(eOBJECT_SET, 1, 1),
+      /* 16 */ branch(eBRANCH_CALL, 3, kGetter - 16), mov(7),
+      /* 18 */ halt(),
+      // r1.f1
+      /* 19 */ object(eOBJECT_GET, 1, 1), mov(9), branch(eBRANCH_RET, 9, 0),
+  });
+  // clang-format on
+
+  Interpreter interp{code};
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  const auto &state = interp.getState();
+  EXPECT_EQ(state.rf.readReg(6).get<Int>(), 11);
+  EXPECT_EQ(state.rf.readReg(7).get<Int>(), 22);
+  EXPECT_EQ(state.shapes.size(), 4);
+  ASSERT_EQ(state.inlineCaches.size(), code->size());
+  EXPECT_EQ(state.inlineCaches[kGetter].used, 2);
+  EXPECT_EQ(state.inlineCaches[7].used, 1);
+
+  interp.reset();
+  EXPECT_TRUE(interp.getState().inlineCaches.empty());
+  EXPECT_EQ(interp.getState().shapes.size(), 1);
+}
+
+TEST(Object, SnapshotKeepsAliasesAndCycles) {
+  auto path = std::filesystem::temp_directory_path() / "pvm-object-snapshot.bin";
+
+  // r1 = r2 = {f3: itself, f4: 8}
+  auto code = makeCode({
+      object(eOBJECT_NEW), mov(1), mov(2),
+      object(eOBJECT_SET, 1, 3),
+      imm(8), object(eOBJECT_SET, 2, 4),
+      halt(),
+  });
+
+  Interpreter origin{code};
+  ASSERT_EQ(origin.run(), Interpreter::eHALTED);
+  origin.snapshot(path.string());
+
+  Interpreter restored{makeCode({})};
+  restored.restore(path.string());
+
+  const auto &rf = restored.getState().rf;
+  auto obj = rf.readReg(1).get<Object>();
+  EXPECT_EQ(obj.identity(), rf.readReg(2).get<Object>().identity());
+  EXPECT_EQ(obj.slot(obj.shape()->find(3)).get<Object>().identity(), obj.identity());
+  EXPECT_EQ(obj.slot(obj.shape()->find(4)).get<Int>(), 8);
+
+  std::filesystem::remove(path);
+}
@@ -0,0 +1,107 @@
+#include <cstddef>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/pool.hpp"
+
+using namespace pvm;
+
+namespace {
+
+constexpr std::size_t kInt = 1;
+
+// r7 <- read, r8 <- r7 * r7, write r8
+CodePtr makeSquare() {
+  // clang-format off
+  std::vector<Instr> instrs{
+    Instr{.opType = eUNARY, .opID = eUNARY_READ, .instrVar = InstrUNARY::Builder().ttypeid(kInt).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(7).build()},
+    Instr{.opType = eBINARY, .opID = eBINARY_MUL, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(7).regid2(7).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(8).build()},
+    Instr{.opType = eUNARY, .opID = eUNARY_WRITE, .instrVar = InstrUNARY::Builder().ttypeid(kInt).regid(8).build()},
+    Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  };
+  // clang-format on
+  return std::make_shared<const Code>(std::move(instrs));
+}
+
+} // namespace
+
+TEST(Pool, ResetClearsTouchedState) {
+  auto code = makeSquare();
+  std::stringstream ist{"6"};
+  std::stringstream ost{};
+  Interpreter interp{code, ost, ist};
+
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  ASSERT_EQ(interp.getState().rf.readReg(8).get<Int>(), 36);
+
+  interp.reset();
+  const auto &state = interp.getState();
+  EXPECT_EQ(state.status, Interpreter::eRUNNING);
+  EXPECT_EQ(state.rf.readPC(), 0);
+  EXPECT_TRUE(state.rf.readAcc().holds<Null>());
+  EXPECT_TRUE(state.rf.readReg(7).holds<Null>());
+  EXPECT_TRUE(state.rf.readReg(8).holds<Null>());
+  EXPECT_TRUE(state.stack.empty());
+}
+
+TEST(Pool, ResetRebindsStreams) {
+  auto code = makeSquare();
+  std::stringstream ist1{"3"};
+  std::stringstream ost1{};
+  Interpreter interp{code, ost1, ist1};
+  interp.run();
+
+  std::stringstream ist2{"-5"};
+  std::stringstream ost2{};
+  interp.reset(code, ost2, ist2);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  EXPECT_EQ(ost1.str(), "9\n");
+  EXPECT_EQ(ost2.str(), "25\n");
+}
+
+TEST(Pool, ReusesReleasedInstances) {
+  auto code = makeSquare();
+  InterpreterPool pool{2, 1};
+  ASSERT_EQ(pool.idle(), 1);
+
+  Interpreter *first = nullptr;
+  for (Int i = 0; i < 10; ++i) {
+    std::stringstream ist{std::to_string(i)};
+    std::stringstream ost{};
+    auto interp = pool.acquire(code, ost, ist);
+    if (first == nullptr) {
+      first = interp.get();
+    }
+    EXPECT_EQ(interp.get(), first);
+    EXPECT_EQ(pool.idle(), 0);
+
+    ASSERT_EQ(interp->run(), Interpreter::eHALTED);
+    EXPECT_EQ(ost.str(), std::to_string(i * i) + "\n");
+  }
+  EXPECT_EQ(pool.idle(), 1);
+  // released instances do not pin the program
+  EXPECT_EQ(code.use_count(), 1);
+}
+
+TEST(Pool, KeepsAtMostMaxIdle) {
+  auto code = makeSquare();
+  InterpreterPool pool{2};
+
+  {
+    auto a = pool.acquire(code);
+    auto b = pool.acquire(code);
+    auto c = pool.acquire(code);
+    EXPECT_NE(a.get(), b.get());
+    EXPECT_NE(b.get(), c.get());
+  }
+  EXPECT_EQ(pool.idle(), 2);
+}
@@ -0,0 +1,224 @@
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+
+using namespace pvm;
+
+namespace {
+
+constexpr std::size_t kInt = 1;
+
+// r1 <- 7, r2 <- array[4], r8 <- read * r1, write r8
+CodePtr makeScale() {
+  // clang-format off
+  std::vector<Instr> instrs{
+    Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(7).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    Instr{.opType = eIMM, .opID = eIMM_ARRAY, .instrVar = InstrIMM::Builder().data(4).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    Instr{.opType = eUNARY, .opID = eUNARY_READ, .instrVar = InstrUNARY::Builder().ttypeid(kInt).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(7).build()},
+    Instr{.opType = eBINARY, .opID = eBINARY_MUL, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(7).regid2(1).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(8).build()},
+    Instr{.opType = eUNARY, .opID = eUNARY_WRITE, .instrVar = InstrUNARY::Builder().ttypeid(kInt).regid(8).build()},
+    Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  };
+  // clang-format on
+  return std::make_shared<const Code>(std::move(instrs));
+}
+
+// r0 <- sum(1..5) computed by recursive calls
+CodePtr makeRecursiveSum() {
+  // clang-format off
+  std::vector<Instr> instrs{
+    /* 0 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(5).build()},
+    /* 1 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 2 */ Instr{.opType = eBINARY, .opID = eBINARY_EQUAL, .instrVar = InstrBINARY::Builder().regid1(1).regid2(1).ttypeid(kInt).build()},
+    /* 3 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 4 */ Instr{.opType = eBRANCH, .opID = eBRANCH_CALL, .instrVar = InstrBRANCH::Builder().regid(2).offset(3).build()},
+    /* 5 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 6 */ Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+    /* 7 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    /* 8 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 9 */ Instr{.opType = eBINARY, .opID = eBINARY_EQUAL, .instrVar = InstrBINARY::Builder().regid1(1).regid2(2).ttypeid(kInt).build()},
+    /* 10 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 11 */ Instr{.opType = eBRANCH, .opID = eBRANCH_BRANCH, .instrVar = InstrBRANCH::Builder().regid(3).offset(14).build()},
+    /* 12 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(2).build()},
+    /* 13 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 14 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(-1).build()},
+    /* 15 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 16 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(2).build()},
+    /* 17 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 18 */ Instr{.opType = eBINARY, .opID = eBINARY_EQUAL, .instrVar = InstrBINARY::Builder().regid1(1).regid2(1).ttypeid(kInt).build()},
+    /* 19 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(4).build()},
+    /* 20 */ Instr{.opType = eBRANCH, .opID = eBRANCH_CALL, .instrVar = InstrBRANCH::Builder().regid(4).offset(-13).build()},
+    /* 21 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 22 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(3).build()},
+    /* 23 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 24 */ Instr{.opType = eBRANCH, .opID = eBRANCH_RET, .instrVar = InstrBRANCH::Builder().regid(1).offset(0).build()},
+    /* 25 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    /* 26 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 27 */ Instr{.opType = eBRANCH, .opID = eBRANCH_RET, .instrVar = InstrBRANCH::Builder().regid(1).offset(0).build()},
+  };
+  // clang-format on
+  return std::make_shared<const Code>(std::move(instrs));
+}
+
+std::filesystem::path snapshotPath(const char *name) {
+  return std::filesystem::temp_directory_path() / name;
+}
+
+} // namespace
+
+TEST(Snapshot, ResumesWaitingForInput) {
+  auto path = snapshotPath("pvm-snapshot-input.bin");
+
+  std::stringstream ist1{};
+  std::stringstream ost1{};
+  Interpreter origin{makeScale(), ost1, ist1};
+  origin.setNonBlockingInput(true);
+  ASSERT_EQ(origin.run(), Interpreter::eWAITING_INPUT);
+  origin.snapshot(path.string());
+
+  std::stringstream ist2{"6"};
+  std::stringstream ost2{};
+  Interpreter restored{std::make_shared<const Code>(std::vector<Instr>{}), ost2, ist2};
+  restored.restore(path.string());
+
+  const auto &state = restored.getState();
+  EXPECT_EQ(state.rf.readPC(), 4);
+  EXPECT_EQ(state.rf.readReg(1).get<Int>(), 7);
+  EXPECT_EQ(state.rf.readReg(2).get<Array>().size(), 4);
+  EXPECT_EQ(state.code->size(), 10);
+
+  ASSERT_EQ(restored.run(), Interpreter::eHALTED);
+  EXPECT_EQ(ost2.str(), "42\n");
+
+  std::filesystem::remove(path);
+}
+
+TEST(Snapshot, RestoresCallStack) {
+  auto path = snapshotPath("pvm-snapshot-stack.bin");
+
+  Interpreter origin{makeRecursiveSum()};
+  ASSERT_EQ(origin.run(20), Interpreter::eOUT_OF_FUEL);
+  auto depth = origin.getState().stack.size();
+  ASSERT_GT(depth, 0);
+  origin.snapshot(path.string());
+
+  Interpreter restored{std::make_shared<const Code>(std::vector<Instr>{})};
+  restored.restore(path.string());
+  EXPECT_EQ(restored.getState().stack.size(), depth);
+  EXPECT_EQ(restored.getState().rf.readPC(), origin.getState().rf.readPC());
+
+  ASSERT_EQ(restored.run(), Interpreter::eHALTED);
+  ASSERT_EQ(origin.run(), Interpreter::eHALTED);
+  EXPECT_EQ(restored.getState().rf.readReg(0).get<Int>(), 15);
+  EXPECT_EQ(origin.getState().rf.readReg(0).get<Int>(), 15);
+
+  std::filesystem::remove(path);
+}
+
+TEST(Snapshot, RestoresLinearMemory) {
+  auto path = snapshotPath("pvm-snapshot-memory.bin");
+
+  // grow by 3 pages, [r2 + 4] <- 99 with r2 on the last page
+  // clang-format off
+  auto code = std::make_shared<const Code>(std::vector<Instr>{
+    Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(3).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    Instr{.opType = eMEM, .opID = eMEM_GROW, .instrVar = InstrMEM::Builder().regid(1).build()},
+    Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(2 * Memory::kPageSize).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(99).build()},
+    Instr{.opType = eMEM, .opID = eMEM_STORE, .instrVar = InstrMEM::Builder().ttypeid(kInt).regid(2).offset(4).build()},
+    Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  });
+  // clang-format on
+
+  Interpreter origin{code};
+  ASSERT_EQ(origin.run(), Interpreter::eHALTED);
+  origin.snapshot(path.string());
+  // only the written page is stored
+  EXPECT_LT(std::filesystem::file_size(path), 2 * Memory::kPageSize);
+
+  Interpreter restored{std::make_shared<const Code>(std::vector<Instr>{})};
+  restored.restore(path.string());
+  const auto &mem = restored.getState().mem;
+  EXPECT_EQ(restored.getState().status, Interpreter::eHALTED);
+  EXPECT_EQ(mem.pages(), 3);
+  EXPECT_EQ(mem.load<Int>(2 * Memory::kPageSize + 4), 99);
+  EXPECT_EQ(mem.load<Int>(4), 0);
+
+  std::filesystem::remove(path);
+}
+
+TEST(Snapshot, RestoreOverwritesPreviousState) {
+  auto path = snapshotPath("pvm-snapshot-overwrite.bin");
+
+  Interpreter origin{makeScale()};
+  origin.snapshot(path.string());
+
+  std::stringstream ist{"2"};
+  std::stringstream ost{};
+  Interpreter interp{makeRecursiveSum(), ost, ist};
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  interp.restore(path.string());
+
+  const auto &state = interp.getState();
+  EXPECT_EQ(state.status, Interpreter::eRUNNING);
+  EXPECT_EQ(state.rf.readPC(), 0);
+  EXPECT_TRUE(state.rf.readReg(0).holds<Null>());
+  EXPECT_TRUE(state.stack.empty());
+
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(ost.str(), "14\n");
+
+  std::filesystem::remove(path);
+}
+
+TEST(Snapshot, RejectsDamagedFiles) {
+  auto path = snapshotPath("pvm-snapshot-damaged.bin");
+  Interpreter interp{makeScale()};
+
+  {
+    std::ofstream ofs{path, std::ios::binary};
+    ofs << "definitely not a snapshot";
+  }
+  EXPECT_THROW(interp.restore(path.string()), std::runtime_error);
+
+  interp.snapshot(path.string());
+  auto size = std::filesystem::file_size(path);
+  std::filesystem::resize_file(path, size - 1);
+  EXPECT_THROW(interp.restore(path.string()), std::runtime_error);
+
+  std::filesystem::remove(path);
+  EXPECT_THROW(interp.restore(path.string()), std::runtime_error);
+}
+
+TEST(Snapshot, RejectsMalformedInstructions) {
+  auto path = snapshotPath("pvm-snapshot-malformed.bin");
+  Interpreter interp{makeScale()};
+  interp.snapshot(path.string());
+
+  {
+    // the code section follows the 32 byte header; give its first Instr an
+    // opID no operation type has
+    std::fstream fs{path, std::ios::binary | std::ios::in | std::ios::out};
+    fs.seekp(static_cast<std::streamoff>(32 + offsetof(Instr, opID)));
+    fs.put(static_cast<char>(0x7f));
+  }
+  EXPECT_THROW(interp.restore(path.string()), std::runtime_error);
+
+  std::filesystem::remove(path);
+}
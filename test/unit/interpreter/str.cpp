@@ -0,0 +1,157 @@
+#include <bit>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "common/string.hpp"
+#include "generated/handlers.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/verifier.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+// clang-format off
+InstrSTR str(std::uint32_t regid1, std::uint32_t regid2 = 0, std::uint32_t regid3 = 0) {
+  return InstrSTR::Builder().regid1(regid1).regid2(regid2).regid3(regid3).build();
+}
+
+Instr op(StrOpID opID, InstrSTR instr) {
+  return Instr{.opType = eSTR, .opID = opID, .instrVar = instr};
+}
+// clang-format on
+
+// reads two words, prints them joined, the length of the result, the slice
+// [2, 5) of it and whether the interned words are equal
+std::vector<Instr> joinWords() {
+  // clang-format off
+  return {
+      unary(eUNARY_READ, 0, kString),  mov(1),
+      unary(eUNARY_READ, 0, kString),  mov(2),
+      op(eSTR_CONCAT, str(1, 2)),      mov(3),
+      unary(eUNARY_WRITE, 3, kString),
+      op(eSTR_LEN, str(3)),            mov(4),
+      unary(eUNARY_WRITE, 4),
+      imm(2),                          mov(5),
+      imm(5),                          mov(6),
+      op(eSTR_SLICE, str(3, 5, 6)),    mov(7),
+      unary(eUNARY_WRITE, 7, kString),
+      op(eSTR_INTERN, str(1)),         mov(8),
+      op(eSTR_INTERN, str(2)),         mov(9),
+      op(eSTR_EQUAL, str(8, 9)),       mov(10),
+      op(eSTR_INTERN, str(3)),         mov(11),
+      halt(),
+  };
+  // clang-format on
+}
+
+} // namespace
+
+TEST(Str, JoinsWords) {
+  auto code = std::make_shared<const Code>(joinWords());
+  ASSERT_TRUE(verify(*code).ok);
+
+  std::istringstream ist{"an_identifier_of_some_length  an_identifier_of_some_length"};
+  std::ostringstream ost{};
+  Interpreter interp{code, ost, ist};
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(ost.str(),
+            "an_identifier_of_some_lengthan_identifier_of_some_length\n56\n_id\n");
+
+  const auto &state = interp.getState();
+  EXPECT_TRUE(state.rf.readReg(10).get<Bool>());
+  EXPECT_TRUE(state.rf.readReg(8).get<String>().interned());
+  EXPECT_EQ(state.strings.size(), 2);
+}
+
+TEST(Str, Bytes) {
+  auto state = createState();
+  state.rf.writeReg(1, Value{String{"abc"}});
+  state.rf.writeReg(2, Value{Int{1}});
+  exec_str_at(state, str(1, 2));
+  EXPECT_EQ(state.rf.readAcc().get<Int>(), 'b');
+
+  state.rf.writeReg(2, Value{Int{'z'}});
+  exec_str_chr(state, str(2));
+  EXPECT_EQ(state.rf.readAcc().get<String>().view(), "z");
+
+  state.rf.writeReg(3, Value{String{"abd"}});
+  exec_str_compare(state, str(1, 3));
+  EXPECT_EQ(state.rf.readAcc().get<Int>(), -1);
+  exec_str_hash(state, str(1));
+  EXPECT_EQ(state.rf.readAcc().get<Int>(), std::bit_cast<Int>(String{"abc"}.hash()));
+  EXPECT_EQ(state.status, Interpreter::eRUNNING);
+}
+
+TEST(Str, OutOfRangeTraps) {
+  auto atEnd = createState();
+  atEnd.rf.writeReg(1, Value{String{"abc"}});
+  atEnd.rf.writeReg(2, Value{Int{3}});
+  exec_str_at(atEnd, str(1, 2));
+  EXPECT_EQ(atEnd.status, Interpreter::eTRAPPED);
+  EXPECT_EQ(atEnd.trap.kind, Interpreter::eTRAP_INDEX_OUT_OF_RANGE);
+
+  auto reversed = createState();
+  reversed.rf.writeReg(1, Value{String{"abc"}});
+  reversed.rf.writeReg(2, Value{Int{2}});
+  reversed.rf.writeReg(3, Value{Int{1}});
+  exec_str_slice(reversed, str(1, 2, 3));
+  EXPECT_EQ(reversed.status, Interpreter::eTRAPPED);
+  EXPECT_EQ(reversed.trap.kind, Interpreter::eTRAP_INDEX_OUT_OF_RANGE);
+
+  auto notByte = createState();
+  notByte.rf.writeReg(1, Value{Int{256}});
+  exec_str_chr(notByte, str(1));
+  EXPECT_EQ(notByte.trap.kind, Interpreter::eTRAP_INDEX_OUT_OF_RANGE);
+}
+
+TEST(Str, TypeMismatchTraps) {
+  auto state = createState();
+  state.rf.writeReg(1, Value{String{"abc"}});
+  state.rf.writeReg(2, Value{Int{1}});
+
+  exec_str_concat(state, str(1, 2));
+
+  EXPECT_EQ(state.status, Interpreter::eTRAPPED);
+  EXPECT_EQ(state.trap.kind, Interpreter::eTRAP_TYPE_MISMATCH);
+  EXPECT_EQ(state.trap.operand, 2);
+
+  auto instrs = joinWords();
+  instrs[4] = op(eSTR_CONCAT, str(1, 5));
+  instrs.insert(instrs.begin(), {imm(1), mov(5)});
+  EXPECT_FALSE(verify(Code{instrs}).ok);
+}
+
+TEST(Str, SurvivesSnapshot) {
+  auto path = (std::filesystem::temp_directory_path() /
+               ("pvm-str-" + std::to_string(::getpid()) + ".snap"))
+                  .string();
+  std::istringstream ist1{"an_identifier_of_some_length "};
+  std::ostringstream ost1{};
+  Interpreter origin{std::make_shared<const Code>(joinWords()), ost1, ist1};
+  origin.setNonBlockingInput(true);
+  ASSERT_EQ(origin.run(), Interpreter::eWAITING_INPUT);
+  origin.snapshot(path);
+
+  std::istringstream ist2{"an_identifier_of_some_length"};
+  std::ostringstream ost2{};
+  Interpreter restored{std::make_shared<const Code>(std::vector<Instr>{}), ost2, ist2};
+  restored.restore(path);
+  std::filesystem::remove(path);
+  EXPECT_EQ(restored.getState().rf.readReg(1).get<String>().view(),
+            "an_identifier_of_some_length");
+  ASSERT_EQ(restored.run(), Interpreter::eHALTED);
+  EXPECT_TRUE(restored.getState().rf.readReg(10).get<Bool>());
+}
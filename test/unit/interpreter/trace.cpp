@@ -0,0 +1,157 @@
+#include <cstddef>
+#include <filesystem>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/tracer.hpp"
+
+using namespace pvm;
+
+namespace {
+
+constexpr std::size_t kInt = 1;
+constexpr std::size_t kFloat = 2;
+
+// r1 <- readI, r2 <- readF, loop r1 times: r3 += 1, write r3, r2
+Code makeProgram() {
+  // clang-format off
+  std::vector<Instr> instrs{
+    /* 00 */ Instr{.opType = eUNARY, .opID = eUNARY_READ, .instrVar = InstrUNARY::Builder().ttypeid(kInt).build()},
+    /* 01 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 02 */ Instr{.opType = eUNARY, .opID = eUNARY_READ, .instrVar = InstrUNARY::Builder().ttypeid(kFloat).build()},
+    /* 03 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 04 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    /* 05 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 06 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(1).build()},
+    /* 07 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(4).build()},
+    /* 08 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(3).regid2(4).build()},
+    /* 09 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 10 */ Instr{.opType = eBINARY, .opID = eBINARY_LESS, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(3).regid2(1).build()},
+    /* 11 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(5).build()},
+    /* 12 */ Instr{.opType = eBRANCH, .opID = eBRANCH_BRANCH, .instrVar = InstrBRANCH::Builder().regid(5).offset(-4).build()},
+    /* 13 */ Instr{.opType = eUNARY, .opID = eUNARY_WRITE, .instrVar = InstrUNARY::Builder().ttypeid(kInt).regid(3).build()},
+    /* 14 */ Instr{.opType = eUNARY, .opID = eUNARY_WRITE, .instrVar = InstrUNARY::Builder().ttypeid(kFloat).regid(2).build()},
+    /* 15 */ Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  };
+  // clang-format on
+  return Code{std::move(instrs)};
+}
+
+} // namespace
+
+TEST(Trace, RecordsEveryInstruction) {
+  auto code = makeProgram();
+  std::stringstream ist{"3 0.1"};
+  std::stringstream ost{};
+  Tracer tracer{1024};
+
+  Interpreter interp{code, ost, ist};
+  interp.setTracer(&tracer);
+  interp.run();
+
+  // 8 setup, 3 loop iterations of 5, 2 writes and halt
+  constexpr std::size_t kExecuted = 8 + 3 * 5 + 3;
+  auto events = tracer.events();
+  ASSERT_EQ(tracer.recorded(), kExecuted);
+  ASSERT_EQ(events.size(), kExecuted);
+
+  auto stats = collectTraceStats(events, tracer.recorded());
+  EXPECT_EQ(stats.byKind[eTRACE_READ], 2);
+  EXPECT_EQ(stats.byKind[eTRACE_WRITE], 2);
+  EXPECT_EQ(stats.byKind[eTRACE_BRANCH_TAKEN], 2);
+  EXPECT_EQ(stats.byKind[eTRACE_BRANCH_NOT_TAKEN], 1);
+  EXPECT_EQ(stats.byOp[eBINARY][eBINARY_ADD], 3);
+
+  EXPECT_EQ(events.front().pc, 0);
+  EXPECT_EQ(events.front().payload, 3);
+  EXPECT_EQ(events.back().opType, eHALT);
+}
+
+TEST(Trace, ReplayReproducesOutput) {
+  auto code = makeProgram();
+  std::stringstream ist{"4 0.3"};
+  std::stringstream ost{};
+  Tracer tracer{64};
+
+  Interpreter interp{code, ost, ist};
+  interp.setTracer(&tracer);
+  interp.run();
+
+  std::stringstream replayIst{traceReplayInput(tracer.events(), tracer.recorded())};
+  std::stringstream replayOst{};
+  Interpreter replay{code, replayOst, replayIst};
+  replay.run();
+
+  EXPECT_EQ(replayOst.str(), ost.str());
+}
+
+TEST(Trace, RingKeepsLatestEvents) {
+  auto code = makeProgram();
+  std::stringstream ist{"10 1.5"};
+  std::stringstream ost{};
+  Tracer tracer{16};
+
+  Interpreter interp{code, ost, ist};
+  interp.setTracer(&tracer);
+  interp.run();
+
+  auto events = tracer.events();
+  ASSERT_EQ(events.size(), tracer.capacity());
+  EXPECT_GT(tracer.recorded(), tracer.capacity());
+  EXPECT_EQ(events.back().opType, eHALT);
+  EXPECT_THROW(auto input = traceReplayInput(events, tracer.recorded()), std::runtime_error);
+}
+
+TEST(Trace, FileBackedRoundTrip) {
+  auto path = std::filesystem::temp_directory_path() / "pvm-trace-test.bin";
+  auto code = makeProgram();
+  std::stringstream ost{};
+  std::vector<TraceEvent> recorded{};
+
+  {
+    std::stringstream ist{"2 2.5"};
+    Tracer tracer{path.string(), 100};
+    Interpreter interp{code, ost, ist};
+    interp.setTracer(&tracer);
+    interp.run();
+    recorded = tracer.events();
+  }
+
+  TraceReader reader{path.string()};
+  ASSERT_FALSE(reader.wrapped());
+  ASSERT_EQ(reader.events().size(), recorded.size());
+  for (std::size_t i = 0; i < recorded.size(); ++i) {
+    EXPECT_EQ(reader.events()[i].pc, recorded[i].pc);
+    EXPECT_EQ(reader.events()[i].kind, recorded[i].kind);
+    EXPECT_EQ(reader.events()[i].payload, recorded[i].payload);
+  }
+  EXPECT_EQ(traceReplayInput(reader.events(), reader.recorded()), "2\n2.5\n");
+
+  std::filesystem::remove(path);
+}
+
+TEST(Trace, TakenBranchToTheNextInstruction) {
+  // clang-format off
+  Code code{std::vector<Instr>{
+    Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    Instr{.opType = eBINARY, .opID = eBINARY_EQUAL, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(1).build()},
+    Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    Instr{.opType = eBRANCH, .opID = eBRANCH_BRANCH, .instrVar = InstrBRANCH::Builder().regid(2).offset(1).build()},
+    Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  }};
+  // clang-format on
+  Tracer tracer{16};
+  Interpreter interp{code};
+  interp.setTracer(&tracer);
+  ASSERT_EQ(interp.run(), Interpreter::eHALTED);
+
+  auto stats = collectTraceStats(tracer.events(), tracer.recorded());
+  EXPECT_EQ(stats.byKind[eTRACE_BRANCH_TAKEN], 1);
+  EXPECT_EQ(stats.byKind[eTRACE_BRANCH_NOT_TAKEN], 0);
+}
@@ -0,0 +1,137 @@
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "common/vec4.hpp"
+#include "generated/handlers.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/verifier.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+// clang-format off
+InstrVEC vec(std::uint32_t ttypeid, std::uint32_t regid1, std::uint32_t regid2 = 0, std::uint32_t lane = 0) {
+  return InstrVEC::Builder().ttypeid(ttypeid).regid1(regid1).regid2(regid2).lane(lane).build();
+}
+
+Instr op(VecOpID opID, InstrVEC instr) {
+  return Instr{.opType = eVEC, .opID = opID, .instrVar = instr};
+}
+// clang-format on
+
+// reads four lanes into `regid`
+void readVec(std::vector<Instr> &instrs, std::uint32_t regid) {
+  instrs.insert(instrs.end(), {unary(eUNARY_READ, 0, kFloat), mov(1),
+                               op(eVEC_SPLAT, vec(kFloat, 1)), mov(regid)});
+  for (std::uint32_t lane = 1; lane < 4; ++lane) {
+    instrs.insert(instrs.end(), {unary(eUNARY_READ, 0, kFloat), mov(1),
+                                 op(eVEC_SET, vec(kFloat, regid, 1, lane)), mov(regid)});
+  }
+}
+
+// prints the dot product of two vectors read from input
+std::vector<Instr> dot() {
+  std::vector<Instr> instrs{};
+  readVec(instrs, 2);
+  readVec(instrs, 3);
+  // acc <- r2 - r2, then r2 * r3 + acc
+  instrs.insert(instrs.end(),
+                {op(eVEC_SUB, vec(kFloat, 2, 2)), op(eVEC_FMA, vec(kFloat, 2, 3)), mov(4),
+                 op(eVEC_HSUM, vec(kFloat, 4)), mov(5), write(5, kFloat), halt()});
+  return instrs;
+}
+
+} // namespace
+
+TEST(Vec, DotProduct) {
+  auto code = std::make_shared<const Code>(dot());
+  ASSERT_TRUE(verify(*code).ok);
+
+  std::istringstream ist{"1 2 3 4 5 6 7 8"};
+  std::ostringstream ost{};
+  Interpreter interp{code, ost, ist};
+  ASSERT_TRUE(interp.getState().verified);
+  EXPECT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(ost.str(), "70\n");
+}
+
+TEST(Vec, LanesAndMasks) {
+  auto state = createState();
+  state.rf.writeReg(1, Value{Int{3}});
+  exec_vec_splat(state, vec(kInt, 1));
+  state.rf.writeReg(2, state.rf.readAcc());
+  state.rf.writeReg(1, Value{Int{-4}});
+  exec_vec_set(state, vec(kInt, 2, 1, 2));
+  state.rf.writeReg(3, state.rf.readAcc());
+  ASSERT_EQ(state.rf.readReg(3).get<Vec4i>(), (Vec4i{{3, 3, -4, 3}}));
+
+  exec_vec_get(state, vec(kInt, 3, 0, 2));
+  EXPECT_EQ(state.rf.readAcc().get<Int>(), -4);
+  exec_vec_less(state, vec(kInt, 3, 2));
+  EXPECT_EQ(state.rf.readAcc().get<Vec4i>(), (Vec4i{{0, 0, -1, 0}}));
+  exec_vec_max(state, vec(kInt, 3, 2));
+  EXPECT_EQ(state.rf.readAcc().get<Vec4i>(), vec4::splat(Int{3}));
+  exec_vec_hsum(state, vec(kInt, 3));
+  EXPECT_EQ(state.rf.readAcc().get<Int>(), 5);
+  EXPECT_EQ(state.status, Interpreter::eRUNNING);
+}
+
+TEST(Vec, LaneTypeMismatchTraps) {
+  auto state = createState();
+  state.rf.writeReg(1, Value{vec4::splat(Int{1})});
+  state.rf.writeReg(2, Value{vec4::splat(Float{1})});
+
+  exec_vec_add(state, vec(kInt, 1, 2));
+
+  EXPECT_EQ(state.status, Interpreter::eTRAPPED);
+  EXPECT_EQ(state.trap.kind, Interpreter::eTRAP_TYPE_MISMATCH);
+  EXPECT_EQ(state.trap.operand, 2);
+}
+
+TEST(Vec, IntDivisionIsInvalid) {
+  auto state = createState();
+  state.rf.writeReg(1, Value{vec4::splat(Int{1})});
+
+  exec_vec_div(state, vec(kInt, 1, 1));
+
+  EXPECT_EQ(state.status, Interpreter::eTRAPPED);
+  EXPECT_EQ(state.trap.kind, Interpreter::eTRAP_INVALID_TYPE_ID);
+
+  auto instrs = dot();
+  instrs[instrs.size() - 6] = op(eVEC_DIV, vec(kInt, 2, 3));
+  EXPECT_FALSE(verify(Code{instrs}).ok);
+}
+
+TEST(Vec, SurvivesSnapshot) {
+  auto path = (std::filesystem::temp_directory_path() /
+               ("pvm-vec-" + std::to_string(::getpid()) + ".snap"))
+                  .string();
+  std::istringstream ist1{"1 2 3 4"};
+  std::ostringstream ost1{};
+  Interpreter origin{std::make_shared<const Code>(dot()), ost1, ist1};
+  origin.setNonBlockingInput(true);
+  ASSERT_EQ(origin.run(), Interpreter::eWAITING_INPUT);
+  origin.snapshot(path);
+
+  std::istringstream ist2{"5 6 7 8"};
+  std::ostringstream ost2{};
+  Interpreter restored{std::make_shared<const Code>(std::vector<Instr>{}), ost2, ist2};
+  restored.restore(path);
+  std::filesystem::remove(path);
+  EXPECT_EQ(restored.getState().rf.readReg(2).get<Vec4f>(), (Vec4f{{1, 2, 3, 4}}));
+  EXPECT_EQ(restored.run(), Interpreter::eHALTED);
+  EXPECT_EQ(ost2.str(), "70\n");
+}
@@ -0,0 +1,198 @@
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "common/builders.hpp"
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/verifier.hpp"
+
+using namespace pvm;
+using namespace pvm::test;
+
+namespace {
+
+// clang-format off
+// prints 1 + 2 + ... + n for n read from input
+std::vector<Instr> loopSum() {
+  return {
+      /* 0 */ unary(eUNARY_READ), mov(1), imm(0), mov(2), imm(1), mov(3), imm(1), mov(4),
+      /* 8 */ binary(eBINARY_EQUAL, 4, 4), mov(6),
+      /* 10 */ binary(eBINARY_LESS, 1, 3), mov(5), branch(eBRANCH_BRANCH, 5, 6),
+      /* 13 */ binary(eBINARY_ADD, 2, 3), mov(2), binary(eBINARY_ADD, 3, 4), mov(3),
+      /* 17 */ branch(eBRANCH_BRANCH, 6, -7),
+      /* 18 */ unary(eUNARY_WRITE, 2), halt(),
+  };
+}
+
+// the same sum, recursively
+std::vector<Instr> recursiveSum() {
+  return {
+      /* 0 */ unary(eUNARY_READ), mov(1), binary(eBINARY_EQUAL, 1, 1), mov(2),
+      /* 4 */ branch(eBRANCH_CALL, 2, 4), mov(1), unary(eUNARY_WRITE, 1), halt(),
+      // sum(r1)
+      /* 8 */ imm(0), mov(3), binary(eBINARY_EQUAL, 1, 3), mov(4),
+      /* 12 */ branch(eBRANCH_BRANCH, 4, 12),
+      /* 13 */ binary(eBINARY_ADD, 1, 3), mov(7), imm(-1), mov(5),
+      /* 17 */ binary(eBINARY_ADD, 1, 5), mov(1), branch(eBRANCH_CALL, 2, -11),
+      /* 20 */ mov(8), binary(eBINARY_ADD, 7, 8), mov(9), branch(eBRANCH_RET, 9),
+      /* 24 */ imm(0), mov(9), branch(eBRANCH_RET, 9),
+  };
+}
+
+// a closure doubling its argument, called twice
+std::vector<Instr> closure() {
+  return {
+      /* 0 */ imm(10), mov(5),
+      /* 2 */ func(eFUNC_NEW, 0, 14), func(eFUNC_BIND, 5, 0), mov(4),
+      /* 5 */ unary(eUNARY_READ), mov(1), branch(eBRANCH_ICALL, 4), mov(6),
+      /* 9 */ mov(1), branch(eBRANCH_ICALL, 4), mov(7),
+      /* 12 */ unary(eUNARY_WRITE, 6), unary(eUNARY_WRITE, 7), halt(),
+      /* 15 */ halt(),
+      /* 16 */ binary(eBINARY_ADD, 1, 1), mov(12), branch(eBRANCH_RET, 12),
+  };
+}
+
+// the same through the captured environment, whose types are not tracked
+std::vector<Instr> envClosure() {
+  return {
+      /* 0 */ imm(10), mov(5),
+      /* 2 */ func(eFUNC_NEW, 0, 9), func(eFUNC_BIND, 5, 0), mov(4),
+      /* 5 */ unary(eUNARY_READ), mov(1), branch(eBRANCH_ICALL, 4),
+      /* 8 */ unary(eUNARY_WRITE), halt(),
+      /* 10 */ halt(),
+      /* 11 */ mov(10), func(eFUNC_ENV, 10, 0), mov(11),
+      /* 14 */ binary(eBINARY_ADD, 1, 11), mov(12), branch(eBRANCH_RET, 12),
+  };
+}
+// clang-format on
+
+std::string run(const std::vector<Instr> &instrs, const std::string &input,
+                bool expectVerified) {
+  std::istringstream ist{input};
+  std::ostringstream ost{};
+  Interpreter interp{std::make_shared<const Code>(instrs), ost, ist};
+  EXPECT_EQ(interp.getState().verified, expectVerified);
+  EXPECT_EQ(interp.run(), Interpreter::eHALTED);
+  return ost.str();
+}
+
+void expectRejected(const std::vector<Instr> &instrs, Addr pc,
+                    const std::string &reason) {
+  auto result = verify(Code{instrs});
+  EXPECT_FALSE(result.ok);
+  EXPECT_EQ(result.pc, pc);
+  EXPECT_NE(result.reason.find(reason), std::string::npos) << result.reason;
+  EXPECT_FALSE(Interpreter{Code{instrs}}.getState().verified);
+}
+
+} // namespace
+
+TEST(Verifier, AcceptsWellTypedPrograms) {
+  for (const auto &instrs : {loopSum(), recursiveSum(), closure()}) {
+    auto result = verify(Code{instrs});
+    EXPECT_TRUE(result.ok) << result.pc << ": " << result.reason;
+  }
+}
+
+TEST(Verifier, VerifiedProgramsRunUnchecked) {
+  EXPECT_EQ(run(loopSum(), "100", true), "5050\n");
+  EXPECT_EQ(run(recursiveSum(), "100", true), "5050\n");
+  EXPECT_EQ(run(closure(), "5", true), "10\n20\n");
+  EXPECT_EQ(run(envClosure(), "5", false), "15\n");
+}
+
+TEST(Verifier, VerifiedDivisionStillTraps) {
+  std::istringstream ist{"0"};
+  std::ostringstream ost{};
+  Interpreter interp{makeCode({unary(eUNARY_READ), mov(1), imm(7), mov(2),
+                               binary(eBINARY_DIV, 2, 1), halt()}),
+                     ost, ist};
+  ASSERT_TRUE(interp.getState().verified);
+  ASSERT_EQ(interp.run(), Interpreter::eTRAPPED);
+  EXPECT_EQ(interp.getState().trap.kind, Interpreter::eTRAP_DIVISION);
+  EXPECT_EQ(interp.getState().trap.pc, 4);
+  EXPECT_EQ(Interpreter::describe(interp.getState().trap),
+            "integer division by zero or overflow, divisor in r1 at pc 4");
+}
+
+// interpreters and resets onto the same code read the verdict of the first
+TEST(Verifier, VerdictIsKeptOnTheCode) {
+  auto code = makeCode(loopSum());
+  EXPECT_FALSE(code->verified().has_value());
+  Interpreter interp{code};
+  EXPECT_EQ(code->verified(), true);
+  interp.reset(nullptr);
+  interp.reset(code);
+  EXPECT_TRUE(interp.getState().verified);
+
+  auto rejected = makeCode({imm(1), mov(1), branch(eBRANCH_BRANCH, 1, 2), halt(), halt()});
+  interp.reset(rejected);
+  EXPECT_EQ(rejected->verified(), false);
+  EXPECT_FALSE(interp.getState().verified);
+}
+
+TEST(Verifier, RejectsBranchOnNonBool) {
+  expectRejected({imm(1), mov(1), branch(eBRANCH_BRANCH, 1, 2), halt(), halt()}, 2, "r1");
+}
+
+TEST(Verifier, RejectsUnwrittenOperand) {
+  expectRejected({imm(1), mov(1), binary(eBINARY_ADD, 1, 2), halt()}, 2, "r2");
+}
+
+TEST(Verifier, RejectsOperandOfEitherType) {
+  // r1 is an Int on one path and a Float on the other
+  expectRejected({unary(eUNARY_READ), mov(2), binary(eBINARY_EQUAL, 2, 2), mov(3),
+                  branch(eBRANCH_BRANCH, 3, 3), unary(eUNARY_READ, 0, 2), mov(1),
+                  unary(eUNARY_WRITE, 1), halt()},
+                 7, "r1");
+}
+
+TEST(Verifier, RejectsInvalidTypeId) {
+  expectRejected({unary(eUNARY_READ, 0, 4), halt()}, 0, "type id");
+  expectRejected({unary(eUNARY_READ), unary(eUNARY_SQRT), halt()}, 1, "type id");
+}
+
+TEST(Verifier, RejectsBadControlFlow) {
+  expectRejected({imm(1), mov(1), binary(eBINARY_EQUAL, 1, 1), mov(2),
+                  branch(eBRANCH_BRANCH, 2, 10), halt()},
+                 4, "outside");
+  expectRejected({imm(1), branch(eBRANCH_RET, 0)}, 1, "empty call stack");
+  expectRejected({imm(1), mov(1)}, 1, "falls off");
+}
+
+TEST(Verifier, RejectsConditionalCall) {
+  // r3 = r1 < r2 may be false, the call then leaves its frame behind
+  auto instrs = recursiveSum();
+  instrs[2] = binary(eBINARY_LESS, 1, 1);
+  expectRejected(instrs, 4, "r2");
+}
+
+TEST(Verifier, RestoredStateRunsChecked) {
+  auto path = (std::filesystem::temp_directory_path() /
+               ("pvm-verifier-" + std::to_string(::getpid()) + ".snap"))
+                  .string();
+  std::istringstream ist{"100"};
+  std::ostringstream ost{};
+  Interpreter interp{std::make_shared<const Code>(loopSum()), ost, ist};
+  ASSERT_TRUE(interp.getState().verified);
+  ASSERT_EQ(interp.run(20), Interpreter::eOUT_OF_FUEL);
+  interp.snapshot(path);
+
+  interp.restore(path);
+  std::filesystem::remove(path);
+  EXPECT_FALSE(interp.getState().verified);
+  EXPECT_EQ(interp.run(), Interpreter::eHALTED);
+  EXPECT_EQ(ost.str(), "5050\n");
+
+  interp.reset();
+  EXPECT_TRUE(interp.getState().verified);
+}
@@ -0,0 +1,228 @@
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/instruction.hpp"
+#include "generated/instruction.hpp"
+#include "scheduler/scheduler.hpp"
+
+using namespace pvm;
+
+namespace {
+
+constexpr std::size_t kInt = 1;
+
+// writes the sum 1 + ... + n for n read from the input
+CodePtr makeSum() {
+  // clang-format off
+  std::vector<Instr> instrs{
+    /* 00 */ Instr{.opType = eUNARY, .opID = eUNARY_READ, .instrVar = InstrUNARY::Builder().ttypeid(kInt).build()},
+    /* 01 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 02 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    /* 03 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 04 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 05 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(1).build()},
+    /* 06 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(4).build()},
+    /* 07 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(2).regid2(4).build()},
+    /* 08 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 09 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(3).regid2(2).build()},
+    /* 10 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 11 */ Instr{.opType = eBINARY, .opID = eBINARY_LESS, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(2).regid2(1).build()},
+    /* 12 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(5).build()},
+    /* 13 */ Instr{.opType = eBRANCH, .opID = eBRANCH_BRANCH, .instrVar = InstrBRANCH::Builder().regid(5).offset(-6).build()},
+    /* 14 */ Instr{.opType = eUNARY, .opID = eUNARY_WRITE, .instrVar = InstrUNARY::Builder().ttypeid(kInt).regid(3).build()},
+    /* 15 */ Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  };
+  // clang-format on
+  return std::make_shared<const Code>(std::move(instrs));
+}
+
+CodePtr makeSpin() {
+  // clang-format off
+  std::vector<Instr> instrs{
+    /* 00 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    /* 01 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 02 */ Instr{.opType = eBINARY, .opID = eBINARY_EQUAL, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(2).regid2(2).build()},
+    /* 03 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 04 */ Instr{.opType = eBRANCH, .opID = eBRANCH_BRANCH, .instrVar = InstrBRANCH::Builder().regid(1).offset(-2).build()},
+  };
+  // clang-format on
+  return std::make_shared<const Code>(std::move(instrs));
+}
+
+// sends 1, ..., n over channel 0
+CodePtr makeProducer(Int n) {
+  // clang-format off
+  std::vector<Instr> instrs{
+    /* 00 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(1).build()},
+    /* 01 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 02 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 03 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(n + 1).build()},
+    /* 04 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 05 */ Instr{.opType = eCHAN, .opID = eCHAN_SEND, .instrVar = InstrCHAN::Builder().regid(1).id(0).build()},
+    /* 06 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(2).build()},
+    /* 07 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 08 */ Instr{.opType = eBINARY, .opID = eBINARY_LESS, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(3).build()},
+    /* 09 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(4).build()},
+    /* 10 */ Instr{.opType = eBRANCH, .opID = eBRANCH_BRANCH, .instrVar = InstrBRANCH::Builder().regid(4).offset(-5).build()},
+    /* 11 */ Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  };
+  // clang-format on
+  return std::make_shared<const Code>(std::move(instrs));
+}
+
+// n times: receives from channel 0 and sends the doubled value over channel 1
+CodePtr makeDoubler(Int n) {
+  // clang-format off
+  std::vector<Instr> instrs{
+    /* 00 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    /* 01 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 02 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(1).build()},
+    /* 03 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 04 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(n).build()},
+    /* 05 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 06 */ Instr{.opType = eCHAN, .opID = eCHAN_RECV, .instrVar = InstrCHAN::Builder().id(0).build()},
+    /* 07 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(6).build()},
+    /* 08 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(6).regid2(6).build()},
+    /* 09 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(6).build()},
+    /* 10 */ Instr{.opType = eCHAN, .opID = eCHAN_SEND, .instrVar = InstrCHAN::Builder().regid(6).id(1).build()},
+    /* 11 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(2).build()},
+    /* 12 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 13 */ Instr{.opType = eBINARY, .opID = eBINARY_LESS, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(3).build()},
+    /* 14 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(4).build()},
+    /* 15 */ Instr{.opType = eBRANCH, .opID = eBRANCH_BRANCH, .instrVar = InstrBRANCH::Builder().regid(4).offset(-9).build()},
+    /* 16 */ Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  };
+  // clang-format on
+  return std::make_shared<const Code>(std::move(instrs));
+}
+
+// receives n values from channel 1 and writes their sum
+CodePtr makeSink(Int n) {
+  // clang-format off
+  std::vector<Instr> instrs{
+    /* 00 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(0).build()},
+    /* 01 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 02 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(5).build()},
+    /* 03 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(1).build()},
+    /* 04 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(2).build()},
+    /* 05 */ Instr{.opType = eIMM, .opID = eIMM_INTEGER, .instrVar = InstrIMM::Builder().data(n).build()},
+    /* 06 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(3).build()},
+    /* 07 */ Instr{.opType = eCHAN, .opID = eCHAN_RECV, .instrVar = InstrCHAN::Builder().id(1).build()},
+    /* 08 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(6).build()},
+    /* 09 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(5).regid2(6).build()},
+    /* 10 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(5).build()},
+    /* 11 */ Instr{.opType = eBINARY, .opID = eBINARY_ADD, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(2).build()},
+    /* 12 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(1).build()},
+    /* 13 */ Instr{.opType = eBINARY, .opID = eBINARY_LESS, .instrVar = InstrBINARY::Builder().ttypeid(kInt).regid1(1).regid2(3).build()},
+    /* 14 */ Instr{.opType = eREG, .opID = eREG_MOV, .instrVar = InstrREG::Builder().regid(4).build()},
+    /* 15 */ Instr{.opType = eBRANCH, .opID = eBRANCH_BRANCH, .instrVar = InstrBRANCH::Builder().regid(4).offset(-8).build()},
+    /* 16 */ Instr{.opType = eUNARY, .opID = eUNARY_WRITE, .instrVar = InstrUNARY::Builder().ttypeid(kInt).regid(5).build()},
+    /* 17 */ Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrHALT::Builder().build()},
+  };
+  // clang-format on
+  return std::make_shared<const Code>(std::move(instrs));
+}
+
+std::string sum(Int n) {
+  return std::to_string(n * (n + 1) / 2) + "\n";
+}
+
+} // namespace
+
+TEST(Scheduler, RunsManyTasksOnSharedCode) {
+  constexpr Int kTasks = 300;
+  auto code = makeSum();
+  Scheduler sched{4, 256};
+
+  std::vector<Scheduler::TaskId> ids{};
+  for (Int i = 0; i < kTasks; ++i) {
+    ids.push_back(sched.spawn(code, std::to_string(i + 1)));
+  }
+  sched.wait();
+
+  for (Int i = 0; i < kTasks; ++i) {
+    ASSERT_EQ(sched.status(ids[i]), Interpreter::eHALTED);
+    ASSERT_EQ(sched.output(ids[i]), sum(i + 1));
+  }
+  // one copy held here, one by each interpreter
+  EXPECT_EQ(code.use_count(), kTasks + 1);
+}
+
+TEST(Scheduler, ParksOnInputAndResumesOnFeed) {
+  Scheduler sched{2};
+  auto id = sched.spawn(makeSum(), {}, false);
+
+  sched.wait(id);
+  ASSERT_EQ(sched.status(id), Interpreter::eWAITING_INPUT);
+  EXPECT_TRUE(sched.output(id).empty());
+
+  sched.feed(id, "100 ");
+  sched.wait(id);
+  ASSERT_EQ(sched.status(id), Interpreter::eHALTED);
+  EXPECT_EQ(sched.output(id), sum(100));
+}
+
+TEST(Scheduler, ClosedInputReadsDefault) {
+  Scheduler sched{1};
+  auto id = sched.spawn(makeSum(), {}, false);
+
+  sched.wait(id);
+  ASSERT_EQ(sched.status(id), Interpreter::eWAITING_INPUT);
+
+  sched.closeInput(id);
+  sched.wait(id);
+  ASSERT_EQ(sched.status(id), Interpreter::eHALTED);
+  EXPECT_EQ(sched.output(id), "1\n");
+}
+
+TEST(Scheduler, EndlessTaskDoesNotStarveOthers) {
+  Scheduler sched{1, 128};
+  auto spin = sched.spawn(makeSpin());
+
+  auto code = makeSum();
+  std::vector<Scheduler::TaskId> ids{};
+  for (Int i = 0; i < 20; ++i) {
+    ids.push_back(sched.spawn(code, "1000"));
+  }
+  for (auto id : ids) {
+    sched.wait(id);
+    EXPECT_EQ(sched.output(id), sum(1000));
+  }
+  EXPECT_EQ(sched.status(spin), Interpreter::eOUT_OF_FUEL);
+}
+
+TEST(Scheduler, PipelineOverChannels) {
+  constexpr Int kCount = 3000;
+  Scheduler sched{4, 64};
+  auto first = std::make_shared<Channel>(Channel::eSPSC, 8);
+  auto second = std::make_shared<Channel>(Channel::eMPSC, 8);
+
+  auto sink = sched.spawn(makeSink(2 * kCount), {}, true, {nullptr, second});
+  sched.spawn(makeDoubler(kCount), {}, true, {first, second});
+  sched.spawn(makeProducer(kCount), {}, true, {first});
+  // a second source sharing the multi-producer channel
+  sched.spawn(makeProducer(kCount), {}, true, {second});
+
+  sched.wait();
+  ASSERT_EQ(sched.status(sink), Interpreter::eHALTED);
+  auto expected = static_cast<long long>(kCount) * (kCount + 1) / 2 * 3;
+  EXPECT_EQ(sched.output(sink), std::to_string(expected) + "\n");
+}
+
+TEST(Scheduler, ThrowingTaskFailsAlone) {
+  Scheduler sched{2};
+  // a halt whose operands are not a halt's, dispatching it throws
+  auto broken = sched.spawn(std::make_shared<const Code>(std::vector<Instr>{
+      Instr{.opType = eHALT, .opID = eHALT_HALT, .instrVar = InstrREG{}}}));
+  auto sum = sched.spawn(makeSum(), "100");
+
+  sched.wait();
+  EXPECT_EQ(sched.status(broken), Interpreter::eTRAPPED);
+  EXPECT_NE(sched.error(broken), nullptr);
+  EXPECT_EQ(sched.status(sum), Interpreter::eHALTED);
+  EXPECT_EQ(sched.error(sum), nullptr);
+}
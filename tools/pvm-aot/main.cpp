@@ -0,0 +1,61 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <CLI/CLI.hpp>
+
+#include "compiler/aot.hpp"
+#include "decoder/image.hpp"
+
+namespace {
+
+void writeSource(const std::string &path, const std::string &source) {
+  std::ofstream ofs{path, std::ios::trunc};
+  ofs << source;
+  if (!ofs) {
+    throw std::runtime_error{"cannot write " + path};
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  CLI::App app{"PlumbusVM ahead-of-time compiler"};
+  app.require_subcommand(1);
+
+  std::string image{};
+  std::string output{};
+  pvm::AotOptions options{};
+
+  auto *emit = app.add_subcommand("emit", "Translate a bytecode image to C++");
+  emit->add_option("image", image, "Bytecode image")
+      ->required()
+      ->check(CLI::ExistingFile);
+  emit->add_option("-o,--output", output, "C++ file")->required();
+  emit->add_flag("--shared", options.shared, "Leave out main() for a shared object");
+
+  auto *build = app.add_subcommand(
+      "build", "Compile a bytecode image, the C++ is kept next to the output as .cpp");
+  build->add_option("image", image, "Bytecode image")
+      ->required()
+      ->check(CLI::ExistingFile);
+  build->add_option("-o,--output", output, "Executable or shared object")->required();
+  build->add_flag("--shared", options.shared, "Build a shared object for `pvm run`");
+
+  CLI11_PARSE(app, argc, argv);
+
+  try {
+    auto source = pvm::emitAot(pvm::loadImage(image), options);
+    if (emit->parsed()) {
+      writeSource(output, source);
+    } else if (build->parsed()) {
+      writeSource(output + ".cpp", source);
+      pvm::buildAot(output + ".cpp", output, options);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,88 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <CLI/CLI.hpp>
+
+#include "compiler/layout.hpp"
+#include "decoder/image.hpp"
+
+namespace {
+
+void printRow(const char *name, double before, double after) {
+  std::cout << "  " << std::setw(22) << std::left << name << std::setw(14) << before
+            << std::setw(14) << after;
+  if (before > 0) {
+    std::cout << std::showpos << 100.0 * (after - before) / before << '%'
+              << std::noshowpos;
+  }
+  std::cout << '\n';
+}
+
+void printReport(const pvm::LayoutMetrics &before, const pvm::LayoutMetrics &after) {
+  std::cout << std::fixed << std::setprecision(2) << "  " << std::setw(22) << std::left
+            << "" << std::setw(14) << "before" << std::setw(14) << "after" << "change\n";
+  printRow("hot cache lines", static_cast<double>(before.hotLines),
+           static_cast<double>(after.hotLines));
+  printRow("hot pages", static_cast<double>(before.hotPages),
+           static_cast<double>(after.hotPages));
+  printRow("line switches", static_cast<double>(before.lineSwitches),
+           static_cast<double>(after.lineSwitches));
+  printRow("mean jump distance", before.jumpDistance, after.jumpDistance);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  CLI::App app{"PlumbusVM profile-guided code layout"};
+  app.require_subcommand(1);
+
+  std::string image{};
+  std::string profilePath{};
+  std::string input{};
+  std::string output{};
+
+  auto *profile = app.add_subcommand(
+      "profile", "Run a bytecode image to halt and record how often each pc executes");
+  profile->add_option("image", image, "Bytecode image")
+      ->required()
+      ->check(CLI::ExistingFile);
+  profile->add_option("-i,--input", input, "Program input, stdin by default")
+      ->check(CLI::ExistingFile);
+  profile->add_option("-o,--output", output, "Profile file")->required();
+
+  auto *optimize = app.add_subcommand(
+      "optimize", "Move hot code together and cold code to the end, report the gain");
+  optimize->add_option("image", image, "Bytecode image")
+      ->required()
+      ->check(CLI::ExistingFile);
+  optimize->add_option("profile", profilePath, "Profile of the image")
+      ->required()
+      ->check(CLI::ExistingFile);
+  optimize->add_option("-o,--output", output, "Reordered bytecode image")->required();
+
+  CLI11_PARSE(app, argc, argv);
+
+  try {
+    auto instrs = pvm::loadImage(image);
+    if (profile->parsed()) {
+      std::ifstream ifs{};
+      if (!input.empty()) {
+        ifs.open(input);
+      }
+      pvm::saveProfile(output, pvm::profileRun(instrs, input.empty() ? std::cin : ifs));
+    } else if (optimize->parsed()) {
+      auto counts = pvm::loadProfile(profilePath);
+      auto layout = pvm::layoutHotCold(instrs, counts);
+      pvm::saveImage(output, layout.instrs);
+      printReport(pvm::measureLayout(instrs, counts),
+                  pvm::measureLayout(layout.instrs, layout.profile));
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,104 @@
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <CLI/CLI.hpp>
+
+#include "generated/instruction.hpp"
+#include "interpreter/tracer.hpp"
+
+namespace {
+
+constexpr const char *kKindNames[pvm::eTRACE_KIND_NUM] = {
+    "exec", "branch-taken", "branch-not-taken", "call", "ret", "read", "write",
+};
+
+void printStats(const pvm::TraceReader &reader) {
+  auto stats = pvm::collectTraceStats(reader.events(), reader.recorded());
+
+  std::cout << "recorded: " << stats.total << '\n';
+  std::cout << "kept:     " << stats.kept << (reader.wrapped() ? " (ring wrapped)" : "")
+            << '\n';
+
+  std::cout << "\nevents:\n";
+  for (std::size_t kind = 0; kind < pvm::eTRACE_KIND_NUM; ++kind) {
+    std::cout << "  " << std::setw(18) << std::left << kKindNames[kind]
+              << stats.byKind[kind] << '\n';
+  }
+
+  std::cout << "\nopcodes:\n";
+  for (std::size_t opType = 0; opType < stats.byOp.size(); ++opType) {
+    const auto &ops = stats.byOp[opType];
+    for (std::size_t opID = 0; opID < ops.size(); ++opID) {
+      if (ops[opID] == 0) {
+        continue;
+      }
+      auto share = 100.0 * static_cast<double>(ops[opID]) / static_cast<double>(stats.kept);
+      std::cout << "  " << std::setw(18) << std::left
+                << pvm::opName(static_cast<std::uint8_t>(opType),
+                               static_cast<std::uint8_t>(opID))
+                << std::setw(12) << ops[opID] << std::fixed << std::setprecision(2) << share
+                << "%\n";
+    }
+  }
+
+  auto branches = stats.byKind[pvm::eTRACE_BRANCH_TAKEN] +
+                  stats.byKind[pvm::eTRACE_BRANCH_NOT_TAKEN];
+  if (branches != 0) {
+    std::cout << "\nbranches taken: " << std::fixed << std::setprecision(2)
+              << 100.0 * static_cast<double>(stats.byKind[pvm::eTRACE_BRANCH_TAKEN]) /
+                     static_cast<double>(branches)
+              << "%\n";
+  }
+}
+
+void printEvents(const pvm::TraceReader &reader) {
+  auto first = reader.recorded() - reader.events().size();
+  for (const auto &event : reader.events()) {
+    std::cout << std::setw(10) << std::left << first++ << std::setw(8) << event.pc
+              << std::setw(18) << pvm::opName(event.opType, event.opID)
+              << kKindNames[event.kind < pvm::eTRACE_KIND_NUM ? event.kind : 0];
+    if (event.kind != pvm::eTRACE_EXEC) {
+      std::cout << " 0x" << std::hex << event.payload << std::dec;
+    }
+    std::cout << '\n';
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  CLI::App app{"PlumbusVM trace decoder"};
+  app.require_subcommand(1);
+
+  std::string path{};
+
+  auto *stats = app.add_subcommand("stats", "Print event and opcode statistics");
+  stats->add_option("trace", path, "Trace file")->required()->check(CLI::ExistingFile);
+
+  auto *dump = app.add_subcommand("dump", "Print kept events in execution order");
+  dump->add_option("trace", path, "Trace file")->required()->check(CLI::ExistingFile);
+
+  auto *replay = app.add_subcommand(
+      "replay-input", "Print recorded unary.read values to feed back as program input");
+  replay->add_option("trace", path, "Trace file")->required()->check(CLI::ExistingFile);
+
+  CLI11_PARSE(app, argc, argv);
+
+  try {
+    pvm::TraceReader reader{path};
+    if (stats->parsed()) {
+      printStats(reader);
+    } else if (dump->parsed()) {
+      printEvents(reader);
+    } else if (replay->parsed()) {
+      std::cout << pvm::traceReplayInput(reader.events(), reader.recorded());
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
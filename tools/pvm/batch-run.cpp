@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "batch-run.hpp"
+#include "common/io.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/verifier.hpp"
+
+namespace pvm::tools {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Written by a worker after every input, followed by `size` bytes of output
+struct ResultHeader final {
+  std::uint64_t index;
+  std::uint64_t latencyNs;
+  std::uint64_t size;
+  bool ok;
+};
+
+struct Outcome final {
+  std::uint64_t latencyNs;
+  bool ok;
+};
+
+struct Worker final {
+  pid_t pid;
+  int fd;
+  std::string pending{};
+};
+
+using WorkQueue = std::atomic<std::uint64_t>;
+static_assert(WorkQueue::is_always_lock_free, "the work queue is shared by processes");
+
+std::filesystem::path outputPath(const BatchOptions &options, const std::string &input) {
+  auto name = std::filesystem::path{input}.filename();
+  name += ".out";
+  return std::filesystem::path{options.outputDir} / name;
+}
+
+// One input through the worker's interpreter, output either into the file
+// or returned for the parent to merge
+bool runOne(Interpreter &interp, const CodePtr &code, const AotProgram *aot,
+            const std::string &input, const BatchOptions &options, std::string &output) {
+  std::ifstream ist{input, std::ios::binary};
+  if (!ist) {
+    throw std::runtime_error{"cannot open"};
+  }
+  std::ofstream file{};
+  std::ostringstream merged{};
+  std::ostream *ost = &merged;
+  if (!options.outputDir.empty()) {
+    auto path = outputPath(options, input);
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      throw std::runtime_error{"cannot open " + path.string()};
+    }
+    ost = &file;
+  }
+
+  interp.reset(code, *ost, ist);
+  auto status = aot != nullptr ? interp.run(*aot) : interp.run();
+  if (status == Interpreter::eTRAPPED) {
+    std::cerr << input << ": " << Interpreter::describe(interp.getState().trap)
+              << std::endl;
+  }
+  output = merged.str();
+  return status == Interpreter::eHALTED && ost->flush();
+}
+
+[[noreturn]] void work(const CodePtr &code, const AotProgram *aot,
+                       const std::vector<std::string> &inputs,
+                       const BatchOptions &options, WorkQueue &queue, int fd) {
+  Interpreter interp{code};
+  interp.setMemoryLimit(options.memoryLimit);
+  for (;;) {
+    auto index = queue.fetch_add(1, std::memory_order_relaxed);
+    if (index >= inputs.size()) {
+      break;
+    }
+
+    std::string output{};
+    auto start = Clock::now();
+    bool ok = false;
+    try {
+      ok = runOne(interp, code, aot, inputs[index], options, output);
+    } catch (const std::exception &e) {
+      std::cerr << inputs[index] << ": " << e.what() << std::endl;
+    }
+    auto latency =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+
+    ResultHeader header{.index = index,
+                        .latencyNs = static_cast<std::uint64_t>(latency.count()),
+                        .size = output.size(),
+                        .ok = ok};
+    if (!writeAll(fd, &header, sizeof(header)) ||
+        !writeAll(fd, output.data(), output.size())) {
+      ::_exit(1);
+    }
+  }
+  ::close(fd);
+  ::_exit(0);
+}
+
+// Takes every complete result off the worker's stream
+template <typename OnResult>
+void drain(Worker &worker, OnResult onResult) {
+  for (;;) {
+    ResultHeader header{};
+    if (worker.pending.size() < sizeof(header)) {
+      return;
+    }
+    std::memcpy(&header, worker.pending.data(), sizeof(header));
+    if (worker.pending.size() < sizeof(header) + header.size) {
+      return;
+    }
+    onResult(header, worker.pending.substr(sizeof(header), header.size));
+    worker.pending.erase(0, sizeof(header) + header.size);
+  }
+}
+
+double percentileMs(const std::vector<std::uint64_t> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  auto rank = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+  return static_cast<double>(sorted[rank]) / 1e6;
+}
+
+void report(const std::vector<std::optional<Outcome>> &outcomes, std::size_t jobs,
+            Clock::duration wall) {
+  std::vector<std::uint64_t> latencies{};
+  std::size_t failed = 0;
+  for (const auto &outcome : outcomes) {
+    if (outcome) {
+      latencies.push_back(outcome->latencyNs);
+    }
+    failed += !outcome || !outcome->ok ? 1U : 0U;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  auto seconds = std::chrono::duration<double>(wall).count();
+  std::cerr << std::fixed << std::setprecision(3) << outcomes.size() << " inputs, "
+            << failed << " failed, " << jobs << " jobs, " << seconds << " s, "
+            << (seconds > 0 ? static_cast<double>(outcomes.size()) / seconds : 0)
+            << " inputs/s\n"
+            << "latency ms: p50 " << percentileMs(latencies, 0.5) << ", p90 "
+            << percentileMs(latencies, 0.9) << ", p99 " << percentileMs(latencies, 0.99)
+            << ", max " << percentileMs(latencies, 1) << std::endl;
+}
+
+} // namespace
+
+int runBatch(CodePtr code, const AotProgram *aot, const std::vector<std::string> &inputs,
+             const BatchOptions &options) {
+  if (!options.outputDir.empty()) {
+    std::filesystem::create_directories(options.outputDir);
+    std::set<std::filesystem::path> names{};
+    for (const auto &input : inputs) {
+      if (!names.insert(outputPath(options, input)).second) {
+        throw std::invalid_argument{"two inputs would write " +
+                                    outputPath(options, input).string()};
+      }
+    }
+  }
+
+  // verified once here rather than in every worker
+  if (!code->verified()) {
+    code->setVerified(verify(*code).ok);
+  }
+
+  auto *shared = ::mmap(nullptr, sizeof(WorkQueue), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    throw std::system_error{errno, std::generic_category(), "cannot map the work queue"};
+  }
+  auto *queue = new (shared) WorkQueue{0};
+
+  auto start = Clock::now();
+  auto jobs = std::max<std::size_t>(1, std::min(options.jobs, inputs.size()));
+  std::vector<Worker> workers{};
+  std::cout.flush();
+  for (std::size_t i = 0; i < jobs; ++i) {
+    int fds[2];
+    if (::pipe(fds) != 0) {
+      throw std::system_error{errno, std::generic_category(), "pipe failed"};
+    }
+    auto pid = ::fork();
+    if (pid < 0) {
+      throw std::system_error{errno, std::generic_category(), "fork failed"};
+    }
+    if (pid == 0) {
+      ::close(fds[0]);
+      for (const auto &worker : workers) {
+        ::close(worker.fd);
+      }
+      work(code, aot, inputs, options, *queue, fds[1]);
+    }
+    ::close(fds[1]);
+    workers.push_back(Worker{.pid = pid, .fd = fds[0]});
+  }
+
+  std::vector<std::optional<Outcome>> outcomes(inputs.size());
+  std::map<std::uint64_t, std::string> unordered{};
+  std::uint64_t nextOut = 0;
+  auto emit = [&] {
+    for (auto it = unordered.begin(); it != unordered.end() && it->first == nextOut;
+         it = unordered.erase(it), ++nextOut) {
+      std::cout << it->second;
+    }
+    std::cout.flush();
+  };
+  auto onResult = [&](const ResultHeader &header, std::string output) {
+    outcomes.at(header.index) = Outcome{.latencyNs = header.latencyNs, .ok = header.ok};
+    if (options.outputDir.empty()) {
+      unordered.emplace(header.index, std::move(output));
+      emit();
+    }
+  };
+
+  std::vector<char> buf(1U << 16U);
+  for (;;) {
+    std::vector<pollfd> fds{};
+    for (const auto &worker : workers) {
+      if (worker.fd >= 0) {
+        fds.push_back(pollfd{.fd = worker.fd, .events = POLLIN, .revents = 0});
+      }
+    }
+    if (fds.empty()) {
+      break;
+    }
+    if (::poll(fds.data(), fds.size(), -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw std::system_error{errno, std::generic_category(), "poll failed"};
+    }
+
+    for (auto &worker : workers) {
+      auto it = std::find_if(fds.begin(), fds.end(),
+                             [&](const pollfd &p) { return p.fd == worker.fd; });
+      if (it == fds.end() || it->revents == 0) {
+        continue;
+      }
+      auto n = ::read(worker.fd, buf.data(), buf.size());
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        ::close(worker.fd);
+        worker.fd = -1;
+        continue;
+      }
+      worker.pending.append(buf.data(), static_cast<std::size_t>(n));
+      drain(worker, onResult);
+    }
+  }
+
+  // inputs of a worker that died leave gaps, the outputs after them follow
+  // in order
+  for (auto &[index, output] : unordered) {
+    std::cout << output;
+  }
+  std::cout.flush();
+
+  bool ok = true;
+  for (const auto &worker : workers) {
+    int status = 0;
+    while (::waitpid(worker.pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    ok &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+  ::munmap(shared, sizeof(WorkQueue));
+
+  for (std::size_t i = 0; i < inputs.size(); ++i) {
+    if (!outcomes[i]) {
+      std::cerr << inputs[i] << ": worker died" << std::endl;
+    }
+    ok &= outcomes[i] && outcomes[i]->ok;
+  }
+  report(outcomes, jobs, Clock::now() - start);
+  return ok ? 0 : 1;
+}
+
+} // namespace pvm::tools
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "interpreter/aot.hpp"
+#include "memory/arena.hpp"
+#include "memory/memory.hpp"
+
+namespace pvm::tools {
+
+struct BatchOptions final {
+  std::size_t jobs{1};
+  // `<outputDir>/<input file name>.out` per input; stdout in input order when
+  // empty
+  std::string outputDir{};
+  // Interpreter::setMemoryLimit() of every run
+  std::size_t memoryLimit{Arena::kNoLimit};
+};
+
+// Runs the program once per input file, with the file as its stdin. `code`
+// is decoded and verified once and shared copy-on-write with `jobs` forked
+// workers, which take inputs off a shared counter. Throughput and latency
+// percentiles go to stderr. `aot` runs the compiled program instead.
+int runBatch(CodePtr code, const AotProgram *aot, const std::vector<std::string> &inputs,
+             const BatchOptions &options);
+
+} // namespace pvm::tools
@@ -0,0 +1,111 @@
+#include <cerrno>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "common/io.hpp"
+#include "fork-server.hpp"
+#include "interpreter/interpreter.hpp"
+
+namespace pvm::tools {
+
+namespace {
+
+struct Request final {
+  pid_t pid;
+  int fd;
+};
+
+[[noreturn]] void serve(Interpreter &warm, std::stringstream &ist, std::stringstream &ost,
+                        const std::string &input, int fd) {
+  int code = 0;
+  try {
+    ist.str(input);
+    ost.str({});
+    auto trapped = warm.run() == Interpreter::eTRAPPED;
+    if (trapped) {
+      std::cerr << "request failed: " << Interpreter::describe(warm.getState().trap)
+                << std::endl;
+    }
+    auto output = ost.str();
+    code = writeAll(fd, output.data(), output.size()) && !trapped ? 0 : 1;
+  } catch (const std::exception &e) {
+    std::cerr << "request failed: " << e.what() << std::endl;
+    code = 1;
+  }
+  ::close(fd);
+  ::_exit(code);
+}
+
+bool collect(const Request &req) {
+  std::vector<char> buf(1U << 16U);
+  for (;;) {
+    auto n = ::read(req.fd, buf.data(), buf.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    std::cout.write(buf.data(), n);
+  }
+  ::close(req.fd);
+  std::cout.flush();
+
+  int status = 0;
+  while (::waitpid(req.pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+} // namespace
+
+int runForkServer(const std::string &snapshot, std::size_t jobs) {
+  std::stringstream ist{};
+  std::stringstream ost{};
+  Interpreter warm{std::make_shared<const Code>(std::vector<Instr>{}), ost, ist};
+  warm.restore(snapshot);
+
+  std::deque<Request> inflight{};
+  bool ok = true;
+  std::string line{};
+  while (std::getline(std::cin, line)) {
+    if (inflight.size() >= jobs) {
+      ok &= collect(inflight.front());
+      inflight.pop_front();
+    }
+
+    int fds[2];
+    if (::pipe(fds) != 0) {
+      std::cerr << "pipe failed" << std::endl;
+      return 1;
+    }
+
+    std::cout.flush();
+    auto pid = ::fork();
+    if (pid < 0) {
+      std::cerr << "fork failed" << std::endl;
+      return 1;
+    }
+    if (pid == 0) {
+      ::close(fds[0]);
+      serve(warm, ist, ost, line, fds[1]);
+    }
+
+    ::close(fds[1]);
+    inflight.push_back(Request{.pid = pid, .fd = fds[0]});
+  }
+
+  for (const auto &req : inflight) {
+    ok &= collect(req);
+  }
+  return ok ? 0 : 1;
+}
+
+} // namespace pvm::tools
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace pvm::tools {
+
+// Restores `snapshot` once, then serves every line of stdin as the input of
+// a forked copy of the warm interpreter. Up to `jobs` copies run at a time,
+// their outputs are written to stdout in request order.
+int runForkServer(const std::string &snapshot, std::size_t jobs);
+
+} // namespace pvm::tools
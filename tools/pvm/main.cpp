@@ -1,9 +1,164 @@
+#include <cstddef>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <CLI/CLI.hpp>
 
+#include "batch-run.hpp"
+#include "decoder/image.hpp"
+#include "fork-server.hpp"
+#include "interpreter/aot.hpp"
+#include "interpreter/code-cache.hpp"
+#include "interpreter/hwprof.hpp"
+#include "interpreter/interpreter.hpp"
+#include "interpreter/tracer.hpp"
+
+namespace {
+
+int exitCode(const pvm::Interpreter &interp, pvm::Interpreter::Status status) {
+  if (status == pvm::Interpreter::eTRAPPED) {
+    std::cerr << pvm::Interpreter::describe(interp.getState().trap) << std::endl;
+  }
+  return status == pvm::Interpreter::eHALTED ? 0 : 1;
+}
+
+int resume(const std::string &snapshot) {
+  pvm::Interpreter interp{std::make_shared<const pvm::Code>(std::vector<pvm::Instr>{})};
+  interp.restore(snapshot);
+  return exitCode(interp, interp.run());
+}
+
+struct RunOptions final {
+  std::string codeCache{};
+  bool hwprof{false};
+  std::string trace{};
+  std::size_t traceEvents{std::size_t{1} << 20U};
+  std::vector<std::string> inputs{};
+  // also applied to the runs of batch
+  std::size_t memoryLimit{pvm::Arena::kNoLimit};
+  pvm::tools::BatchOptions batch{};
+};
+
+// `program` is a bytecode image or a shared object built by pvm-aot, images
+// are decoded through `codeCache` unless it is empty. `hwprof` prints the
+// hardware counters of every opcode and pc range to stderr, `trace` keeps the
+// last `traceEvents` instructions in that file for pvm-trace. With `inputs`
+// the program runs once per input file instead of on stdin. Every run is held
+// to `memoryLimit`.
+int run(const std::string &program, const RunOptions &options) {
+  if (options.hwprof && (program.ends_with(".so") || !options.inputs.empty())) {
+    throw std::invalid_argument{"--hwprof needs a bytecode image and stdin"};
+  }
+  if (!options.trace.empty() && (program.ends_with(".so") || !options.inputs.empty())) {
+    throw std::invalid_argument{"--trace needs a bytecode image and stdin"};
+  }
+  auto batch = options.batch;
+  batch.memoryLimit = options.memoryLimit;
+  if (program.ends_with(".so")) {
+    pvm::AotLibrary lib{program};
+    if (!options.inputs.empty()) {
+      return pvm::tools::runBatch(pvm::aotCode(lib.program()), &lib.program(),
+                                  options.inputs, batch);
+    }
+    pvm::Interpreter interp{pvm::aotCode(lib.program())};
+    interp.setMemoryLimit(options.memoryLimit);
+    return exitCode(interp, interp.run(lib.program()));
+  }
+
+  auto code = options.codeCache.empty()
+                  ? std::make_shared<const pvm::Code>(pvm::loadImage(program))
+                  : pvm::CodeCache{options.codeCache}.load(program);
+  if (!options.inputs.empty()) {
+    return pvm::tools::runBatch(std::move(code), nullptr, options.inputs, batch);
+  }
+  pvm::Interpreter interp{std::move(code)};
+  interp.setMemoryLimit(options.memoryLimit);
+  std::unique_ptr<pvm::Tracer> tracer{};
+  if (!options.trace.empty()) {
+    tracer = std::make_unique<pvm::Tracer>(options.trace, options.traceEvents);
+    interp.setTracer(tracer.get());
+  }
+  if (!options.hwprof) {
+    return exitCode(interp, interp.run());
+  }
+
+  pvm::HwProfiler profiler{};
+  interp.setHwProfiler(&profiler);
+  auto status = interp.run();
+  profiler.report(std::cerr);
+  return exitCode(interp, status);
+}
+
+} // namespace
+
 int main(int argc, char **argv) {
   CLI::App app{"PlumbusVM"};
+
+  std::string snapshot{};
+  std::string program{};
+  std::size_t jobs = 1;
+  RunOptions runOptions{};
+
+  auto *runCmd = app.add_subcommand(
+      "run", "Run a bytecode image, or a shared object built by pvm-aot, to halt");
+  runCmd->add_option("program", program, "Image or .so")
+      ->required()
+      ->check(CLI::ExistingFile);
+  runCmd->add_option("inputs", runOptions.inputs,
+                     "Files to run the program on, one run each with the file as stdin")
+      ->check(CLI::ExistingFile);
+  runCmd->add_option("--code-cache", runOptions.codeCache,
+                     "Directory caching decoded images across runs");
+  runCmd->add_flag("--hwprof", runOptions.hwprof,
+                   "Report hardware performance counters per opcode and pc range");
+  runCmd->add_option("--trace", runOptions.trace,
+                     "Record the executed instructions into FILE for pvm-trace");
+  runCmd->add_option("--trace-events", runOptions.traceEvents,
+                     "Events the trace ring keeps, the last ones win")
+      ->check(CLI::PositiveNumber);
+  runCmd->add_option("--memory-limit", runOptions.memoryLimit,
+                     "Bytes of arena and linear memory a run may hold, it traps past "
+                     "them");
+  runCmd->add_option("-j,--jobs", runOptions.batch.jobs, "Concurrent workers for inputs")
+      ->check(CLI::PositiveNumber);
+  runCmd->add_option("-o,--output-dir", runOptions.batch.outputDir,
+                     "Write the output of every input to DIR/<input name>.out instead "
+                     "of stdout");
+
+  auto *resumeCmd = app.add_subcommand("resume", "Restore a snapshot and run it to halt");
+  resumeCmd->add_option("snapshot", snapshot, "Snapshot file")
+      ->required()
+      ->check(CLI::ExistingFile);
+
+  auto *forkServerCmd = app.add_subcommand(
+      "fork-server", "Restore a snapshot once and run every stdin line as the input of "
+                     "a forked copy of it");
+  forkServerCmd->add_option("snapshot", snapshot, "Snapshot file")
+      ->required()
+      ->check(CLI::ExistingFile);
+  forkServerCmd->add_option("-j,--jobs", jobs, "Concurrent workers")
+      ->check(CLI::PositiveNumber);
+
   CLI11_PARSE(app, argc, argv);
+
+  try {
+    if (runCmd->parsed()) {
+      return run(program, runOptions);
+    }
+    if (resumeCmd->parsed()) {
+      return resume(snapshot);
+    }
+    if (forkServerCmd->parsed()) {
+      return pvm::tools::runForkServer(snapshot, jobs);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+
   return 0;
 }